@@ -0,0 +1,167 @@
+// Records the descriptor work of N draws per frame with per-draw descriptor
+// sets and with the bindless table, and reports the cost per draw.
+//
+//   descriptor_bench [--draws N] [--frames F]
+//
+// Only the command buffers are recorded, nothing is submitted, so the
+// numbers are the CPU cost of descriptor handling alone.
+
+#include "engine/renderer.hpp"
+#include "engine/descriptors.hpp"
+#include "engine/vk_util.hpp"
+#include "engine/logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace engine;
+
+namespace {
+
+    using bench_clock = std::chrono::steady_clock;
+
+    // every draw reads its own 64 bytes, aligned for any storage buffer offset
+    constexpr VkDeviceSize draw_stride = 256;
+    constexpr VkDeviceSize draw_range = 64;
+
+    double ns_per_draw(bench_clock::duration time, uint32_t frames, uint32_t draws) {
+        return std::chrono::duration<double, std::nano>(time).count() / (double(frames) * draws);
+    }
+
+    void begin(VkDevice device, VkCommandPool pool, VkCommandBuffer cmd) {
+        check_vk(vkResetCommandPool(device, pool, 0));
+
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.pNext = nullptr;
+        begin_info.pInheritanceInfo = nullptr;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        check_vk(vkBeginCommandBuffer(cmd, &begin_info));
+    }
+}
+
+int main(int argc, char** argv) {
+    auto logger = get_default_logger();
+
+    uint32_t draws = 10000;
+    uint32_t frames = 100;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+            draws = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        }
+    }
+
+    RendererParams params;
+    params.headless = true;
+    Renderer renderer(window_t(nullptr, destroySdlWindow), params);
+    if (!renderer.init()) {
+        return 1;
+    }
+    const VkDevice device = renderer.device();
+
+    Buffer buffer = renderer.allocator().create_buffer(
+        draws * draw_stride,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        MemoryUsage::dynamic_per_frame
+    );
+
+    VkCommandPoolCreateInfo pool_info = {};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.pNext = nullptr;
+    pool_info.queueFamilyIndex = renderer.graphics_queue_family();
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    VkCommandPool command_pool = VK_NULL_HANDLE;
+    check_vk(vkCreateCommandPool(device, &pool_info, nullptr, &command_pool));
+
+    VkCommandBufferAllocateInfo buffer_info = {};
+    buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    buffer_info.pNext = nullptr;
+    buffer_info.commandPool = command_pool;
+    buffer_info.commandBufferCount = 1;
+    buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    check_vk(vkAllocateCommandBuffers(device, &buffer_info, &cmd));
+
+    logger->info("{} draw(s) per frame, {} frame(s) per mode", draws, frames);
+    logger->info("mode          ns/draw   setup ms   pools");
+
+    // per draw: allocate a set, write its buffer, bind it
+    {
+        VkDescriptorSetLayoutBinding binding = {};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_ALL;
+        binding.pImmutableSamplers = nullptr;
+        const VkDescriptorSetLayout set_layout = renderer.descriptor_layouts().get(std::span(&binding, 1));
+        const VkPipelineLayout layout = renderer.descriptor_layouts().pipeline_layout(std::span(&set_layout, 1));
+
+        // never submitted, so one slot can be reset every frame
+        DescriptorAllocator descriptors(device, 1);
+        DescriptorWriter writer;
+        bench_clock::duration time = {};
+        // the first frame grows the pools
+        for (uint32_t frame = 0; frame < frames + 1; ++frame) {
+            begin(device, command_pool, cmd);
+            const auto start = bench_clock::now();
+            descriptors.begin_frame(0);
+            for (uint32_t draw = 0; draw < draws; ++draw) {
+                const VkDescriptorSet set = descriptors.allocate(set_layout);
+                writer.write_buffer(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, buffer.handle(), draw * draw_stride, draw_range);
+                writer.update(device, set);
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &set, 0, nullptr);
+            }
+            if (frame > 0) {
+                time += bench_clock::now() - start;
+            }
+            check_vk(vkEndCommandBuffer(cmd));
+        }
+        logger->info(
+            "per-draw sets {:9.1f} {:10} {:7}",
+            ns_per_draw(time, frames, draws),
+            "-",
+            descriptors.stats().pools
+        );
+    }
+
+    // once: register every draw's range; per draw: push its index
+    if (BindlessTable* bindless = renderer.bindless()) {
+        const VkPipelineLayout layout = bindless->pipeline_layout(sizeof(uint32_t));
+
+        const auto setup_start = bench_clock::now();
+        std::vector<uint32_t> indices(draws);
+        for (uint32_t draw = 0; draw < draws; ++draw) {
+            indices[draw] = bindless->add_buffer(buffer.handle(), draw * draw_stride, draw_range);
+        }
+        const double setup_ms = std::chrono::duration<double, std::milli>(bench_clock::now() - setup_start).count();
+
+        bench_clock::duration time = {};
+        for (uint32_t frame = 0; frame < frames + 1; ++frame) {
+            begin(device, command_pool, cmd);
+            const auto start = bench_clock::now();
+            bindless->bind(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout);
+            for (uint32_t draw = 0; draw < draws; ++draw) {
+                vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_ALL, 0, sizeof(uint32_t), &indices[draw]);
+            }
+            if (frame > 0) {
+                time += bench_clock::now() - start;
+            }
+            check_vk(vkEndCommandBuffer(cmd));
+        }
+        logger->info("bindless      {:9.1f} {:10.3f} {:7}", ns_per_draw(time, frames, draws), setup_ms, 1);
+
+        for (const uint32_t index : indices) {
+            bindless->remove_buffer(index, 0);
+        }
+    } else {
+        logger->info("bindless      not supported by the device");
+    }
+
+    vkDestroyCommandPool(device, command_pool, nullptr);
+    return 0;
+}
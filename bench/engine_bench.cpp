@@ -0,0 +1,554 @@
+// Google Benchmark suite of the engine's fixed costs, headless, so it runs on
+// lavapipe in CI: Renderer::init, shader loading, the CPU cost of a frame with
+// N empty or populated passes or with subpasses that preserve attachments,
+// command recording, and culling plus sorting the CPU draw list. Results are
+// written as JSON; --compare checks them against a stored baseline.
+//
+//   engine_bench [--compare baseline.json] [--threshold 0.1] [benchmark flags]
+//
+// Without --benchmark_out the results go to engine_bench.json. The exit code
+// is 1 when a benchmark got slower than the baseline by more than the
+// threshold, or when one of the baseline's benchmarks did not run.
+
+#include "engine/renderer.hpp"
+#include "engine/logger.hpp"
+
+#include <benchmark/benchmark.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace engine;
+
+namespace {
+
+    RendererParams bench_params() {
+        RendererParams params;
+        params.headless = true;
+        // the layer's checks would be most of what is measured
+        params.validation = false;
+        params.stats_window = 32;
+        params.draw_count = 1;
+        params.recording_threads = 1;
+        params.shaders.hot_reload = false;
+        return params;
+    }
+
+    // One renderer per draw count; initialising is measured separately and
+    // too slow to repeat for every run of a benchmark.
+    struct RendererCache {
+        std::unique_ptr<Renderer> renderer;
+        uint32_t draw_count = 0;
+    };
+
+    RendererCache& renderer_cache() {
+        static RendererCache cache;
+        return cache;
+    }
+
+    Renderer& cached_renderer(uint32_t draw_count) {
+        RendererCache& cache = renderer_cache();
+        if (!cache.renderer || cache.draw_count != draw_count) {
+            cache.renderer.reset();
+            RendererParams params = bench_params();
+            params.draw_count = draw_count;
+            cache.renderer = std::make_unique<Renderer>(window_t(nullptr, destroySdlWindow), params);
+            if (!cache.renderer->init()) {
+                std::fprintf(stderr, "failed to initialise a headless renderer\n");
+                std::exit(1);
+            }
+            cache.draw_count = draw_count;
+            // the triangle pipeline compiles in the background
+            cache.renderer->render();
+            cache.renderer->pipelines().wait_idle();
+        }
+        return *cache.renderer;
+    }
+
+    // per-frame CPU times of the last completed stats window
+    void report_frame_stats(benchmark::State& state, const Renderer& renderer) {
+        const FrameStats& stats = renderer.frame_stats();
+        state.counters["cpu_ms"] = stats.cpu_ms;
+        state.counters["record_ms"] = stats.record_ms;
+        state.counters["draw_list_ms"] = stats.draw_list_ms;
+        state.counters["binds_saved"] = stats.binds_saved;
+    }
+
+    void BM_renderer_init(benchmark::State& state) {
+        for (auto _ : state) {
+            auto renderer = std::make_unique<Renderer>(window_t(nullptr, destroySdlWindow), bench_params());
+            if (!renderer->init()) {
+                state.SkipWithError("Renderer::init failed");
+                break;
+            }
+            state.PauseTiming();
+            renderer.reset();
+            state.ResumeTiming();
+        }
+    }
+    BENCHMARK(BM_renderer_init)->Unit(benchmark::kMillisecond)->Iterations(5);
+
+    void BM_shader_load(benchmark::State& state) {
+        Renderer& renderer = cached_renderer(1);
+        ShaderLibraryParams params;
+        params.hot_reload = false;
+        size_t shaders = 0;
+        for (auto _ : state) {
+            auto library = std::make_unique<ShaderLibrary>(renderer.device(), renderer.vfs(), params);
+            shaders = library->load_all();
+            state.PauseTiming();
+            library.reset();
+            state.ResumeTiming();
+        }
+        state.counters["shaders"] = static_cast<double>(shaders);
+    }
+    BENCHMARK(BM_shader_load)->Unit(benchmark::kMillisecond);
+
+    // args: extra graphics passes, draws per pass (0 leaves them empty)
+    void BM_render_frame(benchmark::State& state) {
+        Renderer& renderer = cached_renderer(1);
+        const uint32_t passes = static_cast<uint32_t>(state.range(0));
+        const uint32_t draws = static_cast<uint32_t>(state.range(1));
+
+        GraphicsPipelineDesc desc;
+        desc.vertex_shader = renderer.shaders().find("triangle.vert");
+        desc.fragment_shader = renderer.shaders().find("triangle.frag");
+
+        renderer.set_graph_callback([&](RenderGraph& graph, RenderGraphImage target) {
+            for (uint32_t i = 0; i < passes; ++i) {
+                graph.add_pass(
+                    "bench",
+                    PassType::graphics,
+                    [&](PassBuilder& pass) {
+                        pass.write_color(target);
+                    },
+                    [&](const PassContext& context) {
+                        if (draws == 0) {
+                            return;
+                        }
+                        GraphicsPipelineDesc pass_desc = desc;
+                        pass_desc.render_pass = context.render_pass;
+                        pass_desc.subpass = context.subpass;
+                        const VkPipeline pipeline = renderer.pipelines().get(renderer.pipelines().request(pass_desc));
+                        if (pipeline == VK_NULL_HANDLE) {
+                            return;
+                        }
+                        VkViewport viewport = {};
+                        viewport.width = static_cast<float>(context.extent.width);
+                        viewport.height = static_cast<float>(context.extent.height);
+                        viewport.maxDepth = 1.0f;
+                        VkRect2D scissor = {};
+                        scissor.extent = context.extent;
+                        vkCmdBindPipeline(context.cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                        vkCmdSetViewport(context.cmd, 0, 1, &viewport);
+                        vkCmdSetScissor(context.cmd, 0, 1, &scissor);
+                        for (uint32_t draw = 0; draw < draws; ++draw) {
+                            vkCmdDraw(context.cmd, 3, 1, 0, draw);
+                        }
+                    }
+                );
+            }
+        });
+
+        // every subpass index needs its own pipeline, compiled in the background
+        renderer.render();
+        renderer.pipelines().wait_idle();
+        renderer.reset_frame_stats();
+
+        for (auto _ : state) {
+            renderer.render();
+        }
+        report_frame_stats(state, renderer);
+        renderer.set_graph_callback(nullptr);
+        renderer.flush();
+    }
+    BENCHMARK(BM_render_frame)
+        ->ArgNames({ "passes", "draws" })
+        ->Args({ 0, 0 })
+        ->Args({ 8, 0 })
+        ->Args({ 32, 0 })
+        ->Args({ 8, 64 })
+        ->Args({ 32, 64 })
+        ->Unit(benchmark::kMicrosecond);
+
+    // One render pass whose subpasses alternate between two attachments:
+    // target, scratch, target, then both. The second subpass has to preserve
+    // the target and the third the scratch image, which the run checks.
+    void BM_render_frame_interleaved(benchmark::State& state) {
+        Renderer& renderer = cached_renderer(1);
+
+        renderer.set_graph_callback([&](RenderGraph& graph, RenderGraphImage target) {
+            TransientImageDesc desc;
+            desc.format = VK_FORMAT_R8G8B8A8_UNORM;
+            desc.extent = renderer.extent();
+            const RenderGraphImage scratch = graph.create_image("scratch", desc);
+
+            const auto empty = [](const PassContext&) {};
+            graph.add_pass("a", PassType::graphics, [&](PassBuilder& pass) { pass.write_color(target); }, empty);
+            graph.add_pass("b", PassType::graphics, [&](PassBuilder& pass) { pass.write_color(scratch, VkClearColorValue{}); }, empty);
+            graph.add_pass("a again", PassType::graphics, [&](PassBuilder& pass) { pass.write_color(target); }, empty);
+            graph.add_pass(
+                "resolve",
+                PassType::graphics,
+                [&](PassBuilder& pass) {
+                    pass.read_input(scratch);
+                    pass.write_color(target);
+                },
+                empty
+            );
+        });
+
+        renderer.render();
+        if (renderer.graph().stats().preserved_attachments < 2) {
+            state.SkipWithError("the interleaved subpasses do not preserve their attachments");
+        }
+        renderer.reset_frame_stats();
+
+        for (auto _ : state) {
+            renderer.render();
+        }
+        report_frame_stats(state, renderer);
+        state.counters["preserved"] = renderer.graph().stats().preserved_attachments;
+        renderer.set_graph_callback(nullptr);
+        renderer.flush();
+    }
+    BENCHMARK(BM_render_frame_interleaved)->Unit(benchmark::kMicrosecond);
+
+    // args: triangles drawn by the main pass, recording threads
+    void BM_record(benchmark::State& state) {
+        Renderer& renderer = cached_renderer(static_cast<uint32_t>(state.range(0)));
+        renderer.set_recording_threads(static_cast<uint32_t>(state.range(1)));
+        // lets the command pools grow to their steady state
+        for (uint32_t i = 0; i < 10; ++i) {
+            renderer.render();
+        }
+        renderer.reset_frame_stats();
+
+        for (auto _ : state) {
+            renderer.render();
+        }
+        report_frame_stats(state, renderer);
+        state.counters["draws_per_second"] = benchmark::Counter(
+            static_cast<double>(state.range(0)) * state.iterations(),
+            benchmark::Counter::kIsRate
+        );
+        renderer.flush();
+    }
+    BENCHMARK(BM_record)
+        ->ArgNames({ "draws", "threads" })
+        ->ArgsProduct({ { 1000, 10000, 50000 }, { 1, std::max(1u, std::thread::hardware_concurrency()) } })
+        ->Unit(benchmark::kMicrosecond);
+
+    // args: objects, threads. Spheres scattered in a cube around the camera,
+    // about one in seven survives culling; 16 pipelines and 256 materials.
+    void BM_draw_list(benchmark::State& state) {
+        const uint32_t objects = static_cast<uint32_t>(state.range(0));
+        JobSystem jobs(static_cast<uint32_t>(state.range(1)));
+
+        DrawList list;
+        list.reserve(objects);
+        std::mt19937 random(objects);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> radius(0.5f, 2.0f);
+        for (uint32_t i = 0; i < objects; ++i) {
+            const glm::vec4 sphere(position(random), position(random), position(random), radius(random));
+            const DrawPass pass = i % 10 == 0 ? DrawPass::blended : DrawPass::opaque;
+            list.add(sphere, pass, i % 16, i % 256);
+        }
+
+        const glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        const glm::mat4 projection = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+        const glm::mat4 view_projection = projection * view;
+
+        double cull_ms = 0.0;
+        double sort_ms = 0.0;
+        for (auto _ : state) {
+            list.build(view_projection, &jobs);
+            cull_ms += list.stats().cull_ms;
+            sort_ms += list.stats().sort_ms;
+        }
+        const double iterations = static_cast<double>(std::max<benchmark::IterationCount>(state.iterations(), 1));
+        state.counters["visible"] = static_cast<double>(list.stats().visible);
+        state.counters["cull_ms"] = cull_ms / iterations;
+        state.counters["sort_ms"] = sort_ms / iterations;
+        state.counters["objects_per_second"] = benchmark::Counter(
+            static_cast<double>(objects) * state.iterations(),
+            benchmark::Counter::kIsRate
+        );
+    }
+    BENCHMARK(BM_draw_list)
+        ->ArgNames({ "objects", "threads" })
+        ->ArgsProduct({ { 100000 }, { 1, std::max(1u, std::thread::hardware_concurrency()) } })
+        ->Unit(benchmark::kMicrosecond);
+
+    // Records every run's real time next to the console output.
+    class CollectingReporter : public benchmark::ConsoleReporter {
+    public:
+        void ReportRuns(const std::vector<Run>& runs) override {
+            ConsoleReporter::ReportRuns(runs);
+            for (const Run& run : runs) {
+                if (!run.error_occurred) {
+                    m_real_ns[run.benchmark_name()] = run.GetAdjustedRealTime()
+                        / benchmark::GetTimeUnitMultiplier(run.time_unit) * 1e9;
+                }
+            }
+        }
+
+        const std::map<std::string, double>& real_ns() const { return m_real_ns; }
+
+    private:
+        std::map<std::string, double> m_real_ns;
+    };
+
+    // Just enough JSON for the flat objects in Google Benchmark's
+    // "benchmarks" array: strings, numbers and literals; nested values are
+    // skipped.
+    class BaselineParser {
+    public:
+        explicit BaselineParser(std::string text)
+            : m_text(std::move(text)) {}
+
+        // benchmark name -> real time in nanoseconds
+        std::optional<std::map<std::string, double>> parse() {
+            const size_t key = m_text.find("\"benchmarks\"");
+            if (key == std::string::npos) {
+                return std::nullopt;
+            }
+            m_position = m_text.find('[', key);
+            if (m_position == std::string::npos) {
+                return std::nullopt;
+            }
+            ++m_position;
+
+            std::map<std::string, double> times;
+            while (true) {
+                skip_space();
+                if (peek() == ']') {
+                    return times;
+                }
+                if (peek() == ',') {
+                    ++m_position;
+                    continue;
+                }
+                auto entry = parse_entry();
+                if (!entry) {
+                    return std::nullopt;
+                }
+                if (entry->count("name") && entry->count("real_time") && entry->count("time_unit")) {
+                    times[(*entry)["name"]] = std::strtod((*entry)["real_time"].c_str(), nullptr) * unit_to_ns((*entry)["time_unit"]);
+                }
+            }
+        }
+
+    private:
+        static double unit_to_ns(const std::string& unit) {
+            if (unit == "us") {
+                return 1e3;
+            }
+            if (unit == "ms") {
+                return 1e6;
+            }
+            if (unit == "s") {
+                return 1e9;
+            }
+            return 1.0;
+        }
+
+        char peek() const { return m_position < m_text.size() ? m_text[m_position] : '\0'; }
+
+        void skip_space() {
+            while (m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position]))) {
+                ++m_position;
+            }
+        }
+
+        std::optional<std::string> parse_string() {
+            if (peek() != '"') {
+                return std::nullopt;
+            }
+            ++m_position;
+            std::string value;
+            while (m_position < m_text.size() && m_text[m_position] != '"') {
+                if (m_text[m_position] == '\\' && m_position + 1 < m_text.size()) {
+                    ++m_position;
+                }
+                value.push_back(m_text[m_position++]);
+            }
+            ++m_position;
+            return value;
+        }
+
+        // a number or literal as text, or a nested value skipped as ""
+        std::optional<std::string> parse_value() {
+            skip_space();
+            const char c = peek();
+            if (c == '"') {
+                return parse_string();
+            }
+            if (c == '{' || c == '[') {
+                int depth = 0;
+                bool in_string = false;
+                for (; m_position < m_text.size(); ++m_position) {
+                    const char d = m_text[m_position];
+                    if (in_string) {
+                        if (d == '\\') {
+                            ++m_position;
+                        } else if (d == '"') {
+                            in_string = false;
+                        }
+                    } else if (d == '"') {
+                        in_string = true;
+                    } else if (d == '{' || d == '[') {
+                        ++depth;
+                    } else if ((d == '}' || d == ']') && --depth == 0) {
+                        ++m_position;
+                        return std::string();
+                    }
+                }
+                return std::nullopt;
+            }
+            const size_t begin = m_position;
+            while (m_position < m_text.size() && m_text[m_position] != ',' && m_text[m_position] != '}'
+                && !std::isspace(static_cast<unsigned char>(m_text[m_position]))) {
+                ++m_position;
+            }
+            if (begin == m_position) {
+                return std::nullopt;
+            }
+            return m_text.substr(begin, m_position - begin);
+        }
+
+        std::optional<std::map<std::string, std::string>> parse_entry() {
+            if (peek() != '{') {
+                return std::nullopt;
+            }
+            ++m_position;
+            std::map<std::string, std::string> fields;
+            while (true) {
+                skip_space();
+                if (peek() == '}') {
+                    ++m_position;
+                    return fields;
+                }
+                if (peek() == ',') {
+                    ++m_position;
+                    continue;
+                }
+                auto key = parse_string();
+                skip_space();
+                if (!key || peek() != ':') {
+                    return std::nullopt;
+                }
+                ++m_position;
+                auto value = parse_value();
+                if (!value) {
+                    return std::nullopt;
+                }
+                fields[*key] = *value;
+            }
+        }
+
+    private:
+        std::string m_text;
+        size_t m_position = 0;
+    };
+
+    // true if nothing regressed
+    bool compare(const std::map<std::string, double>& baseline, const std::map<std::string, double>& current, double threshold) {
+        std::printf("%-48s %14s %14s %9s\n", "benchmark", "baseline ns", "current ns", "change");
+
+        bool passed = true;
+        for (const auto& [name, baseline_ns] : baseline) {
+            const auto it = current.find(name);
+            if (it == current.end()) {
+                // filtered out on purpose, or it failed
+                std::printf("%-48s %14.0f %14s %9s\n", name.c_str(), baseline_ns, "-", "missing");
+                passed = false;
+                continue;
+            }
+            const double change = baseline_ns > 0.0 ? it->second / baseline_ns - 1.0 : 0.0;
+            const bool regressed = change > threshold;
+            std::printf(
+                "%-48s %14.0f %14.0f %+8.1f%%%s\n",
+                name.c_str(),
+                baseline_ns,
+                it->second,
+                change * 100.0,
+                regressed ? "  REGRESSION" : ""
+            );
+            passed = passed && !regressed;
+        }
+        return passed;
+    }
+}
+
+int main(int argc, char** argv) {
+    LoggingParams logging;
+    // the renderers' own statistics would drown the results
+    logging.level = spdlog::level::warn;
+    init_logging(logging);
+
+    const char* baseline_path = nullptr;
+    double threshold = 0.1;
+    bool has_output = false;
+    std::vector<char*> args = { argv[0] };
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = std::max(0.0, std::atof(argv[++i]));
+        } else {
+            has_output = has_output || std::strncmp(argv[i], "--benchmark_out=", 16) == 0;
+            args.push_back(argv[i]);
+        }
+    }
+    std::string out_flag = "--benchmark_out=engine_bench.json";
+    std::string format_flag = "--benchmark_out_format=json";
+    if (!has_output) {
+        args.push_back(out_flag.data());
+        args.push_back(format_flag.data());
+    }
+
+    int arg_count = static_cast<int>(args.size());
+    benchmark::Initialize(&arg_count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(arg_count, args.data())) {
+        return 1;
+    }
+
+    // read before running, so a broken baseline fails early
+    std::optional<std::map<std::string, double>> baseline;
+    if (baseline_path != nullptr) {
+        std::ifstream file(baseline_path);
+        std::stringstream text;
+        text << file.rdbuf();
+        baseline = BaselineParser(text.str()).parse();
+        if (!file || !baseline) {
+            std::fprintf(stderr, "could not read the baseline %s\n", baseline_path);
+            return 1;
+        }
+    }
+
+    CollectingReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    renderer_cache().renderer.reset();
+    flush_logs();
+
+    if (baseline && !compare(*baseline, reporter.real_ns(), threshold)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Renders a grid of instances headless through the GPU-driven scene and
+// reports how the CPU and GPU frame times grow with the instance count.
+//
+//   gpu_driven_bench [--max-instances N] [--frames F] [--occlusion]
+
+#include "engine/renderer.hpp"
+#include "engine/logger.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace engine;
+
+namespace {
+
+    Vertex make_vertex(const glm::vec3& position, const glm::vec3& normal) {
+        Vertex vertex = {};
+        vertex.position[0] = position.x;
+        vertex.position[1] = position.y;
+        vertex.position[2] = position.z;
+        const glm::vec3 n = glm::normalize(normal);
+        vertex.normal[0] = static_cast<int16_t>(std::lround(n.x * 32767.0f));
+        vertex.normal[1] = static_cast<int16_t>(std::lround(n.y * 32767.0f));
+        vertex.normal[2] = static_cast<int16_t>(std::lround(n.z * 32767.0f));
+        return vertex;
+    }
+
+    void add_triangle(MeshData& mesh, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        const glm::vec3 normal = glm::cross(b - a, c - a);
+        for (const glm::vec3& corner : { a, b, c }) {
+            mesh.indices.push_back(static_cast<uint32_t>(mesh.vertices.size()));
+            mesh.vertices.push_back(make_vertex(corner, normal));
+        }
+    }
+
+    MeshData make_octahedron() {
+        MeshData mesh;
+        mesh.name = "octahedron";
+        const glm::vec3 axes[6] = {
+            { 0.6f, 0.0f, 0.0f }, { 0.0f, 0.6f, 0.0f }, { 0.0f, 0.0f, 0.6f },
+            { -0.6f, 0.0f, 0.0f }, { 0.0f, -0.6f, 0.0f }, { 0.0f, 0.0f, -0.6f },
+        };
+        for (int x : { 0, 3 }) {
+            for (int y : { 1, 4 }) {
+                for (int z : { 2, 5 }) {
+                    // the three axes of an octant, wound so the face points away from the origin
+                    const bool flip = (x == 3) != (y == 4) != (z == 5);
+                    if (flip) {
+                        add_triangle(mesh, axes[x], axes[z], axes[y]);
+                    } else {
+                        add_triangle(mesh, axes[x], axes[y], axes[z]);
+                    }
+                }
+            }
+        }
+        return mesh;
+    }
+
+    std::vector<GpuInstance> make_grid(uint32_t count, uint32_t mesh_count) {
+        const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+        std::vector<GpuInstance> instances(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            const float x = (static_cast<float>(i % side) - side * 0.5f) * 2.0f;
+            const float z = (static_cast<float>(i / side) - side * 0.5f) * 2.0f;
+            GpuInstance& instance = instances[i];
+            std::fill(std::begin(instance.transform), std::end(instance.transform), 0.0f);
+            instance.transform[0] = 1.0f;
+            instance.transform[5] = 1.0f;
+            instance.transform[10] = 1.0f;
+            instance.transform[3] = x;
+            instance.transform[7] = 0.0f;
+            instance.transform[11] = z;
+            instance.mesh = i % mesh_count;
+        }
+        return instances;
+    }
+
+    glm::mat4 orbit_camera(uint32_t frame, uint32_t instances, VkExtent2D extent) {
+        const float extent_world = std::sqrt(static_cast<float>(instances)) * 2.0f;
+        const float angle = frame * 0.01f;
+        const glm::vec3 eye(std::cos(angle) * extent_world * 0.3f, extent_world * 0.1f + 4.0f, std::sin(angle) * extent_world * 0.3f);
+        const glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(
+            glm::radians(70.0f),
+            static_cast<float>(extent.width) / extent.height,
+            0.1f,
+            extent_world * 2.0f
+        );
+        // Vulkan's clip space y points down
+        projection[1][1] *= -1.0f;
+        return projection * view;
+    }
+}
+
+int main(int argc, char** argv) {
+    auto logger = get_default_logger();
+
+    uint32_t max_instances = 1000000;
+    uint32_t frames = 120;
+    RendererParams params;
+    params.headless = true;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--max-instances") == 0 && i + 1 < argc) {
+            max_instances = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--occlusion") == 0) {
+            params.scene.occlusion = true;
+        }
+    }
+    params.stats_window = frames;
+    params.scene.max_instances = max_instances;
+
+    Renderer renderer(window_t(nullptr, destroySdlWindow), params);
+    if (!renderer.init()) {
+        return 1;
+    }
+    GpuScene* scene = renderer.scene();
+    if (scene == nullptr) {
+        logger->error("the gpu driven scene is not available on this device");
+        return 1;
+    }
+
+    const uint32_t mesh_count = 2;
+    scene->add_mesh(make_cube());
+    scene->add_mesh(make_octahedron());
+
+    // the first frames request the pipelines and draw nothing until they
+    // are compiled
+    renderer.render();
+    renderer.pipelines().wait_idle();
+
+    const VkExtent2D extent = { params.headless_width, params.headless_height };
+    logger->info(
+        "{} frame(s) per run, draw count {}, occlusion {}",
+        frames,
+        scene->stats().draw_count ? "on" : "off",
+        scene->stats().occlusion ? "on" : "off"
+    );
+    logger->info("instances     cpu ms   record ms     gpu ms");
+
+    uint32_t frame = 0;
+    for (uint32_t count = 1000; count <= max_instances; count *= 10) {
+        scene->set_instances(make_grid(count, mesh_count));
+
+        // the upload and the new draw buffers happen in the first frames
+        for (uint32_t i = 0; i < 10; ++i) {
+            scene->set_view_projection(orbit_camera(frame++, count, extent));
+            renderer.render();
+        }
+        renderer.reset_frame_stats();
+        // the first frame of a window only starts the clock
+        for (uint32_t i = 0; i < frames + 1; ++i) {
+            scene->set_view_projection(orbit_camera(frame++, count, extent));
+            renderer.render();
+        }
+
+        const FrameStats& stats = renderer.frame_stats();
+        logger->info(
+            "{:9} {:10.3f} {:11.3f} {:10.3f}",
+            count,
+            stats.cpu_ms,
+            stats.record_ms,
+            stats.gpu_ms
+        );
+    }
+
+    renderer.flush();
+    return 0;
+}
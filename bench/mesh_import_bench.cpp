@@ -0,0 +1,123 @@
+// Imports a set of OBJ files with 1..N threads and reports throughput.
+//
+//   mesh_import_bench [--threads N] [--repeat R] <file.obj | directory>...
+
+#include "engine/mesh.hpp"
+#include "engine/logger.hpp"
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace engine;
+
+namespace {
+
+    // Starts a new peak RSS measurement (linux 4.0+), after handing the
+    // previous run's freed heap back so it is not counted again. False if
+    // the kernel does not support it.
+    bool reset_peak_rss() {
+        malloc_trim(0);
+        std::ofstream clear_refs("/proc/self/clear_refs");
+        clear_refs << "5";
+        return static_cast<bool>(clear_refs.flush());
+    }
+
+    // VmHWM, the peak since the last reset_peak_rss()
+    uint64_t peak_rss_bytes() {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.starts_with("VmHWM:")) {
+                // kilobytes
+                return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+            }
+        }
+        return 0;
+    }
+
+    void collect(const std::filesystem::path& path, std::vector<std::filesystem::path>& files) {
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".obj") {
+                    files.push_back(entry.path());
+                }
+            }
+        } else {
+            files.push_back(path);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    auto logger = get_default_logger();
+
+    uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t repeat = 1;
+    std::vector<std::filesystem::path> files;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            max_threads = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else {
+            collect(argv[i], files);
+        }
+    }
+
+    if (files.empty()) {
+        logger->error("usage: mesh_import_bench [--threads N] [--repeat R] <file.obj | directory>...");
+        return 1;
+    }
+
+    // repeating the list gives the workers enough files to balance
+    std::vector<std::filesystem::path> batch;
+    for (uint32_t r = 0; r < repeat; ++r) {
+        batch.insert(batch.end(), files.begin(), files.end());
+    }
+
+    logger->info("importing {} file(s)", batch.size());
+    logger->info("threads      MB/s   Mvert/s   out verts    indices   peak RSS MiB");
+
+    std::vector<uint32_t> thread_counts;
+    for (uint32_t threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    bool per_run_rss = true;
+    for (uint32_t threads : thread_counts) {
+        if (per_run_rss && !reset_peak_rss()) {
+            logger->warn("cannot reset the peak RSS, it is the maximum over all runs so far");
+            per_run_rss = false;
+        }
+
+        MeshImportStats stats;
+        {
+            auto meshes = import_obj_batch(batch, threads, &stats);
+        }
+
+        logger->info(
+            "{:7} {:9.1f} {:9.2f} {:11} {:10} {:14.1f}",
+            threads,
+            stats.megabytes_per_second(),
+            stats.vertices_per_second() / 1e6,
+            stats.vertices,
+            stats.indices,
+            peak_rss_bytes() / (1024.0 * 1024.0)
+        );
+
+        if (stats.failed_files > 0) {
+            logger->warn("{} file(s) failed to import", stats.failed_files);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+// Records the same headless frame with 1..N threads and reports how command
+// recording scales.
+//
+//   record_bench [--draws N] [--threads T] [--frames F]
+
+#include "engine/renderer.hpp"
+#include "engine/logger.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace engine;
+
+int main(int argc, char** argv) {
+    auto logger = get_default_logger();
+
+    uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t frames = 120;
+    RendererParams params;
+    params.headless = true;
+    params.draw_count = 50000;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+            params.draw_count = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            max_threads = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = std::max(1, std::atoi(argv[++i]));
+        }
+    }
+    params.stats_window = frames;
+    params.recording_threads = 1;
+
+    // one renderer for all runs, only the job system is recreated
+    Renderer renderer(window_t(nullptr, destroySdlWindow), params);
+    if (!renderer.init()) {
+        return 1;
+    }
+
+    // the first frame requests the triangle pipeline and draws nothing
+    // until it is compiled
+    renderer.render();
+    renderer.pipelines().wait_idle();
+
+    std::vector<uint32_t> thread_counts;
+    for (uint32_t threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    logger->info("recording {} draw(s) per frame, {} frame(s) per run", params.draw_count, frames);
+    logger->info("threads   record ms    cpu ms   speedup   efficiency");
+
+    double single_thread_ms = 0.0;
+    for (uint32_t threads : thread_counts) {
+        renderer.set_recording_threads(threads);
+
+        // let the new pools grow to their steady state
+        for (uint32_t i = 0; i < 10; ++i) {
+            renderer.render();
+        }
+        renderer.reset_frame_stats();
+        // the first frame of a window only starts the clock
+        for (uint32_t i = 0; i < frames + 1; ++i) {
+            renderer.render();
+        }
+
+        const FrameStats& stats = renderer.frame_stats();
+        if (single_thread_ms == 0.0) {
+            single_thread_ms = stats.record_ms;
+        }
+        const double speedup = stats.record_ms > 0.0 ? single_thread_ms / stats.record_ms : 0.0;
+        logger->info(
+            "{:7} {:11.3f} {:9.3f} {:9.2f} {:11.1f}%",
+            threads,
+            stats.record_ms,
+            stats.cpu_ms,
+            speedup,
+            speedup / threads * 100.0
+        );
+    }
+
+    renderer.flush();
+    return 0;
+}
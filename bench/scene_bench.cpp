@@ -0,0 +1,130 @@
+// Measures the scene's world transform propagation on the CPU for growing
+// node counts and 1..N threads, once with the whole hierarchy moving and once
+// with 1% of the nodes changed.
+//
+//   scene_bench [--max-nodes N] [--threads T] [--iterations I]
+
+#include "engine/scene.hpp"
+#include "engine/logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace engine;
+
+namespace {
+
+    using bench_clock = std::chrono::steady_clock;
+
+    // a four-way tree under a single root, about log4(count) levels deep
+    std::vector<NodeId> build_tree(Scene& scene, uint32_t count) {
+        std::vector<NodeId> nodes;
+        nodes.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            const NodeId parent = i == 0 ? invalid_node : nodes[(i - 1) / 4];
+            Transform local;
+            local.position = glm::vec3(static_cast<float>(i % 4) - 1.5f, 1.0f, 0.0f);
+            local.scale = glm::vec3(0.9f);
+            const NodeId node = scene.create_node(parent, local);
+            scene.set_mesh(node, i % 8, glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
+            nodes.push_back(node);
+        }
+        scene.update();
+        return nodes;
+    }
+
+    struct Measurement {
+        double ms = 0.0;
+        // million updated nodes per second
+        double rate = 0.0;
+    };
+
+    // averages over updates after `change` marked what moved
+    template <typename Change>
+    Measurement measure(Scene& scene, JobSystem& jobs, uint32_t iterations, Change change) {
+        double total_ms = 0.0;
+        uint64_t updated = 0;
+        for (uint32_t i = 0; i < iterations; ++i) {
+            change(i);
+            const auto start = bench_clock::now();
+            scene.update(&jobs);
+            total_ms += std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+            updated += scene.stats().updated_nodes;
+        }
+        Measurement result;
+        result.ms = total_ms / iterations;
+        result.rate = total_ms > 0.0 ? updated / total_ms / 1000.0 : 0.0;
+        return result;
+    }
+}
+
+int main(int argc, char** argv) {
+    auto logger = get_default_logger();
+
+    uint32_t max_nodes = 1000000;
+    uint32_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t iterations = 50;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--max-nodes") == 0 && i + 1 < argc) {
+            max_nodes = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            max_threads = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+        }
+    }
+
+    std::vector<uint32_t> thread_counts;
+    for (uint32_t threads = 1; threads < max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(max_threads);
+
+    logger->info("{} update(s) per measurement", iterations);
+    logger->info("    nodes levels threads   all ms  all Mnodes/s    1% ms  1% Mnodes/s");
+
+    for (uint32_t count = 10000; count <= max_nodes; count *= 10) {
+        Scene scene;
+        const std::vector<NodeId> nodes = build_tree(scene, count);
+
+        std::mt19937 random(count);
+        std::uniform_int_distribution<size_t> pick(0, nodes.size() - 1);
+        const uint32_t partial_count = std::max(1u, count / 100);
+
+        for (uint32_t threads : thread_counts) {
+            JobSystem jobs(threads);
+
+            // moving the root recomputes every node
+            const Measurement all = measure(scene, jobs, iterations, [&](uint32_t i) {
+                Transform root;
+                root.position = glm::vec3(static_cast<float>(i), 0.0f, 0.0f);
+                scene.set_local_transform(nodes[0], root);
+            });
+
+            // scattered leaves and small subtrees
+            const Measurement partial = measure(scene, jobs, iterations, [&](uint32_t) {
+                for (uint32_t n = 0; n < partial_count; ++n) {
+                    const NodeId node = nodes[pick(random)];
+                    scene.set_local_transform(node, scene.local_transform(node));
+                }
+            });
+
+            logger->info(
+                "{:9} {:6} {:7} {:8.3f} {:13.1f} {:8.3f} {:12.1f}",
+                count,
+                scene.stats().levels,
+                threads,
+                all.ms,
+                all.rate,
+                partial.ms,
+                partial.rate
+            );
+        }
+    }
+    return 0;
+}
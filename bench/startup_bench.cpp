@@ -0,0 +1,126 @@
+// Measures headless Renderer::init with the asset pack and with loose files,
+// cold and warm. Cold runs first drop the engine's asset files from the page
+// cache; the driver and its own caches are left alone, so the difference
+// between the modes is what the files cost.
+//
+//   startup_bench [--runs N] [--pack assets.pack]
+
+#include "engine/renderer.hpp"
+#include "engine/logger.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+using namespace engine;
+
+namespace {
+
+    using bench_clock = std::chrono::steady_clock;
+
+    // Clean pages only, which is why the data is synced first; needs no
+    // privileges, unlike dropping the whole cache.
+    void evict(const std::filesystem::path& path) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    void evict_assets(const RendererParams& params) {
+        evict(params.asset_pack);
+        std::error_code error;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(params.shaders.spirv_dir, error)) {
+            if (entry.is_regular_file()) {
+                evict(entry.path());
+            }
+        }
+    }
+
+    struct Startup {
+        double init_ms = 0.0;
+        double shader_ms = 0.0;
+        VfsStats vfs;
+    };
+
+    std::optional<Startup> start(const RendererParams& params) {
+        Startup result;
+        const auto begin = bench_clock::now();
+        auto renderer = std::make_unique<Renderer>(window_t(nullptr, destroySdlWindow), params);
+        if (!renderer->init()) {
+            return std::nullopt;
+        }
+        result.init_ms = std::chrono::duration<double, std::milli>(bench_clock::now() - begin).count();
+        result.shader_ms = renderer->shaders().stats().load_ms;
+        result.vfs = renderer->vfs().stats();
+        return result;
+    }
+}
+
+int main(int argc, char** argv) {
+    auto logger = get_default_logger();
+
+    RendererParams params;
+    params.headless = true;
+    // the layer's checks would be most of what is measured
+    params.validation = false;
+    params.recording_threads = 1;
+    params.shaders.hot_reload = false;
+
+    uint32_t runs = 5;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--pack") == 0 && i + 1 < argc) {
+            params.asset_pack = argv[++i];
+        }
+    }
+
+    if (!std::filesystem::exists(params.asset_pack)) {
+        logger->warn("no asset pack at {}, both modes load loose files", params.asset_pack.string());
+    }
+
+    logger->info("mode    cache   init ms   shaders ms   pack opens   loose opens");
+    for (const bool packed : { true, false }) {
+        RendererParams mode = params;
+        if (!packed) {
+            mode.asset_pack.clear();
+        }
+        for (const bool cold : { true, false }) {
+            Startup total;
+            for (uint32_t run = 0; run < runs; ++run) {
+                if (cold) {
+                    evict_assets(params);
+                }
+                const auto startup = start(mode);
+                if (!startup) {
+                    logger->error("renderer failed to initialise");
+                    return 1;
+                }
+                total.init_ms += startup->init_ms;
+                total.shader_ms += startup->shader_ms;
+                total.vfs = startup->vfs;
+            }
+            logger->info(
+                "{:6} {:6} {:9.2f} {:12.2f} {:12} {:13}",
+                packed ? "pack" : "loose",
+                cold ? "cold" : "warm",
+                total.init_ms / runs,
+                total.shader_ms / runs,
+                total.vfs.pack_opens + total.vfs.decompressed_opens,
+                total.vfs.loose_opens
+            );
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,656 @@
+#include "allocator.hpp"
+#include "deletion_queue.hpp"
+#include "vk_util.hpp"
+
+#include <utility>
+
+
+namespace engine {
+
+    const char* to_string(MemoryUsage usage) {
+        switch (usage) {
+        case MemoryUsage::static_geometry:   return "static_geometry";
+        case MemoryUsage::dynamic_per_frame: return "dynamic_per_frame";
+        case MemoryUsage::staging:           return "staging";
+        case MemoryUsage::readback:          return "readback";
+        case MemoryUsage::render_target:     return "render_target";
+        case MemoryUsage::texture:           return "texture";
+        default:                             return "unknown";
+        }
+    }
+
+    namespace {
+
+        VmaAllocationCreateInfo allocation_info_for(MemoryUsage usage) {
+            VmaAllocationCreateInfo info = {};
+            info.usage = VMA_MEMORY_USAGE_AUTO;
+
+            switch (usage) {
+            case MemoryUsage::static_geometry:
+            case MemoryUsage::render_target:
+            case MemoryUsage::texture:
+                info.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+                break;
+            case MemoryUsage::dynamic_per_frame:
+            case MemoryUsage::staging:
+                info.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+                    | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+                break;
+            case MemoryUsage::readback:
+                info.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+                    | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+                break;
+            default:
+                break;
+            }
+
+            return info;
+        }
+
+        // The same as allocation_info_for with the memory properties spelled
+        // out. VMA only resolves the AUTO usages when it creates the buffer or
+        // image itself, so plain memory allocations outside a pool need these.
+        VmaAllocationCreateInfo explicit_allocation_info_for(MemoryUsage usage) {
+            VmaAllocationCreateInfo info = {};
+            info.usage = VMA_MEMORY_USAGE_UNKNOWN;
+
+            switch (usage) {
+            case MemoryUsage::render_target:
+                info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                break;
+            case MemoryUsage::static_geometry:
+            case MemoryUsage::texture:
+                info.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                break;
+            case MemoryUsage::dynamic_per_frame:
+                info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+                info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+                info.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                break;
+            case MemoryUsage::staging:
+                info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+                info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+                break;
+            case MemoryUsage::readback:
+                info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+                info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+                info.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+                break;
+            default:
+                break;
+            }
+
+            return info;
+        }
+
+        // buffer usage the pool's memory type is chosen for
+        VkBufferUsageFlags representative_buffer_usage(MemoryUsage usage) {
+            switch (usage) {
+            case MemoryUsage::static_geometry:
+                return VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+                    | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
+                    | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            case MemoryUsage::dynamic_per_frame:
+                return VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                    | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+            case MemoryUsage::staging:
+                return VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            case MemoryUsage::readback:
+                return VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+            default:
+                return 0;
+            }
+        }
+
+        PoolStats to_pool_stats(const VmaDetailedStatistics& detailed) {
+            PoolStats stats;
+            stats.block_count = detailed.statistics.blockCount;
+            stats.allocation_count = detailed.statistics.allocationCount;
+            stats.block_bytes = detailed.statistics.blockBytes;
+            stats.allocation_bytes = detailed.statistics.allocationBytes;
+            stats.free_range_count = detailed.unusedRangeCount;
+            stats.largest_free_range = detailed.unusedRangeCount > 0 ? detailed.unusedRangeSizeMax : 0;
+            return stats;
+        }
+    }
+
+    // Buffer
+
+    Buffer::Buffer(Buffer&& other) noexcept
+        : m_allocator(std::exchange(other.m_allocator, nullptr))
+        , m_record(std::move(other.m_record)) {}
+
+    Buffer& Buffer::operator=(Buffer&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_allocator = std::exchange(other.m_allocator, nullptr);
+            m_record = std::move(other.m_record);
+        }
+        return *this;
+    }
+
+    Buffer::~Buffer() {
+        reset();
+    }
+
+    void Buffer::flush(VkDeviceSize offset, VkDeviceSize size) {
+        check_vk(vmaFlushAllocation(m_allocator->handle(), m_record->allocation, offset, size));
+    }
+
+    void Buffer::invalidate(VkDeviceSize offset, VkDeviceSize size) {
+        check_vk(vmaInvalidateAllocation(m_allocator->handle(), m_record->allocation, offset, size));
+    }
+
+    void Buffer::reset() {
+        if (m_record) {
+            m_allocator->release(std::move(m_record));
+        }
+        m_allocator = nullptr;
+    }
+
+    // Image
+
+    Image::Image(Image&& other) noexcept
+        : m_allocator(std::exchange(other.m_allocator, nullptr))
+        , m_record(std::move(other.m_record)) {}
+
+    Image& Image::operator=(Image&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_allocator = std::exchange(other.m_allocator, nullptr);
+            m_record = std::move(other.m_record);
+        }
+        return *this;
+    }
+
+    Image::~Image() {
+        reset();
+    }
+
+    void Image::reset() {
+        if (m_record) {
+            m_allocator->release(std::move(m_record));
+        }
+        m_allocator = nullptr;
+    }
+
+    // DeviceMemory
+
+    DeviceMemory::DeviceMemory(DeviceMemory&& other) noexcept
+        : m_allocator(std::exchange(other.m_allocator, nullptr))
+        , m_allocation(std::exchange(other.m_allocation, VK_NULL_HANDLE))
+        , m_size(std::exchange(other.m_size, 0)) {}
+
+    DeviceMemory& DeviceMemory::operator=(DeviceMemory&& other) noexcept {
+        if (this != &other) {
+            reset();
+            m_allocator = std::exchange(other.m_allocator, nullptr);
+            m_allocation = std::exchange(other.m_allocation, VK_NULL_HANDLE);
+            m_size = std::exchange(other.m_size, 0);
+        }
+        return *this;
+    }
+
+    DeviceMemory::~DeviceMemory() {
+        reset();
+    }
+
+    bool DeviceMemory::bind_image(VkImage image, VkDeviceSize offset) {
+        return check_vk(vmaBindImageMemory2(m_allocator->handle(), m_allocation, offset, image, nullptr));
+    }
+
+    void DeviceMemory::reset() {
+        if (m_allocation != VK_NULL_HANDLE) {
+            m_allocator->release(m_allocation);
+            m_allocation = VK_NULL_HANDLE;
+        }
+        m_allocator = nullptr;
+        m_size = 0;
+    }
+
+    // Allocator
+
+    Allocator::Allocator(
+        VkInstance instance,
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        bool memory_budget_supported,
+        bool buffer_device_address
+    )
+        : m_device(device)
+        , m_logger(create_logger("allocator")) {
+        VmaAllocatorCreateInfo info = {};
+        info.instance = instance;
+        info.physicalDevice = physical_device;
+        info.device = device;
+        info.vulkanApiVersion = VK_API_VERSION_1_1;
+        if (memory_budget_supported) {
+            info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+        }
+        if (buffer_device_address) {
+            info.flags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+        }
+        check_vk(vmaCreateAllocator(&info, &m_allocator));
+
+        m_logger->info(
+            "memory budget queries {}",
+            memory_budget_supported ? "use VK_EXT_memory_budget" : "are estimated"
+        );
+
+        create_pools();
+    }
+
+    Allocator::~Allocator() {
+        if (m_defrag_context != VK_NULL_HANDLE) {
+            // the caller waited for the device, so the pending copies are done
+            if (m_defrag_pass_open) {
+                finish_defragmentation_pass();
+            }
+            vmaEndDefragmentation(m_allocator, m_defrag_context, nullptr);
+        }
+
+        if (m_live_allocations > 0) {
+            m_logger->warn("{} allocation(s) still alive on shutdown", m_live_allocations.load());
+        }
+
+        for (auto pool : m_pools) {
+            if (pool != VK_NULL_HANDLE) {
+                vmaDestroyPool(m_allocator, pool);
+            }
+        }
+        vmaDestroyAllocator(m_allocator);
+    }
+
+    void Allocator::create_pools() {
+        for (uint32_t i = 0; i < uint32_t(MemoryUsage::count); ++i) {
+            const auto usage = MemoryUsage(i);
+            const auto alloc_info = allocation_info_for(usage);
+
+            uint32_t memory_type = 0;
+            VkResult result;
+            if (usage == MemoryUsage::render_target || usage == MemoryUsage::texture) {
+                VkImageCreateInfo image_info = {};
+                image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+                image_info.imageType = VK_IMAGE_TYPE_2D;
+                image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+                image_info.extent = { 1024, 1024, 1 };
+                image_info.mipLevels = 1;
+                image_info.arrayLayers = 1;
+                image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+                image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+                image_info.usage = usage == MemoryUsage::texture
+                    ? VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                    : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+                result = vmaFindMemoryTypeIndexForImageInfo(m_allocator, &image_info, &alloc_info, &memory_type);
+            } else {
+                VkBufferCreateInfo buffer_info = {};
+                buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+                buffer_info.size = 65536;
+                buffer_info.usage = representative_buffer_usage(usage);
+                result = vmaFindMemoryTypeIndexForBufferInfo(m_allocator, &buffer_info, &alloc_info, &memory_type);
+            }
+
+            if (result != VK_SUCCESS) {
+                m_logger->warn("no memory type for the {} pool, using default allocations", to_string(usage));
+                continue;
+            }
+
+            VmaPoolCreateInfo pool_info = {};
+            pool_info.memoryTypeIndex = memory_type;
+            // 0 lets VMA pick the preferred block size for the heap
+            pool_info.blockSize = 0;
+            check_vk(vmaCreatePool(m_allocator, &pool_info, &m_pools[i]));
+            vmaSetPoolName(m_allocator, m_pools[i], to_string(usage));
+        }
+    }
+
+    Buffer Allocator::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage) {
+        auto record = std::make_unique<detail::BufferRecord>();
+        record->usage = memory_usage;
+        record->create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        record->create_info.pNext = nullptr;
+        record->create_info.size = size;
+        record->create_info.usage = usage;
+        record->create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        if (memory_usage == MemoryUsage::static_geometry) {
+            // defragmentation copies the contents to the new location
+            record->create_info.usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        }
+
+        auto alloc_info = allocation_info_for(memory_usage);
+        alloc_info.pUserData = record.get();
+        alloc_info.pool = m_pools[size_t(memory_usage)];
+
+        VmaAllocationInfo result_info = {};
+        VkResult result = vmaCreateBuffer(
+            m_allocator, &record->create_info, &alloc_info,
+            &record->buffer, &record->allocation, &result_info
+        );
+        if (result != VK_SUCCESS && alloc_info.pool != VK_NULL_HANDLE) {
+            // the buffer's memory type bits exclude the pool, fall back to the general heaps
+            alloc_info.pool = VK_NULL_HANDLE;
+            result = vmaCreateBuffer(
+                m_allocator, &record->create_info, &alloc_info,
+                &record->buffer, &record->allocation, &result_info
+            );
+        }
+        if (!check_vk(result)) {
+            return {};
+        }
+
+        record->mapped = result_info.pMappedData;
+        ++m_live_allocations;
+
+        Buffer buffer;
+        buffer.m_allocator = this;
+        buffer.m_record = std::move(record);
+        return buffer;
+    }
+
+    Image Allocator::create_image(const VkImageCreateInfo& info, MemoryUsage memory_usage) {
+        auto record = std::make_unique<detail::ImageRecord>();
+        record->usage = memory_usage;
+        record->create_info = info;
+
+        auto alloc_info = allocation_info_for(memory_usage);
+        alloc_info.pUserData = record.get();
+        alloc_info.pool = m_pools[size_t(memory_usage)];
+
+        VkResult result = vmaCreateImage(
+            m_allocator, &record->create_info, &alloc_info,
+            &record->image, &record->allocation, nullptr
+        );
+        if (result != VK_SUCCESS && alloc_info.pool != VK_NULL_HANDLE) {
+            alloc_info.pool = VK_NULL_HANDLE;
+            result = vmaCreateImage(
+                m_allocator, &record->create_info, &alloc_info,
+                &record->image, &record->allocation, nullptr
+            );
+        }
+        if (!check_vk(result)) {
+            return {};
+        }
+
+        ++m_live_allocations;
+
+        Image image;
+        image.m_allocator = this;
+        image.m_record = std::move(record);
+        return image;
+    }
+
+    DeviceMemory Allocator::allocate_memory(const VkMemoryRequirements& requirements, MemoryUsage memory_usage) {
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+        if (m_pools[size_t(memory_usage)] != VK_NULL_HANDLE) {
+            // pools ignore the usage, so the AUTO ones are fine here
+            auto alloc_info = allocation_info_for(memory_usage);
+            alloc_info.pool = m_pools[size_t(memory_usage)];
+            result = vmaAllocateMemory(m_allocator, &requirements, &alloc_info, &allocation, nullptr);
+        }
+        if (result != VK_SUCCESS) {
+            // the pool's memory type may not be allowed for this resource,
+            // e.g. a depth format next to the pool's RGBA8 pick
+            VmaAllocationCreateInfo fallback_info = explicit_allocation_info_for(memory_usage);
+            fallback_info.memoryTypeBits = requirements.memoryTypeBits;
+            result = vmaAllocateMemory(m_allocator, &requirements, &fallback_info, &allocation, nullptr);
+        }
+        if (!check_vk(result)) {
+            return {};
+        }
+
+        ++m_live_allocations;
+
+        DeviceMemory memory;
+        memory.m_allocator = this;
+        memory.m_allocation = allocation;
+        memory.m_size = requirements.size;
+        return memory;
+    }
+
+    void Allocator::release(std::unique_ptr<detail::BufferRecord> record) {
+        if (m_deletions == nullptr) {
+            destroy(*record);
+            return;
+        }
+        // VMA keeps pointing at the record until it is destroyed
+        std::shared_ptr<detail::BufferRecord> retired(std::move(record));
+        m_deletions->defer([this, retired] { destroy(*retired); });
+    }
+
+    void Allocator::release(std::unique_ptr<detail::ImageRecord> record) {
+        if (m_deletions == nullptr) {
+            destroy(*record);
+            return;
+        }
+        std::shared_ptr<detail::ImageRecord> retired(std::move(record));
+        m_deletions->defer([this, retired] { destroy(*retired); });
+    }
+
+    void Allocator::release(VmaAllocation allocation) {
+        if (m_deletions == nullptr) {
+            free(allocation);
+            return;
+        }
+        m_deletions->defer([this, allocation] { free(allocation); });
+    }
+
+    void Allocator::destroy(detail::BufferRecord& record) {
+        vmaDestroyBuffer(m_allocator, record.buffer, record.allocation);
+        --m_live_allocations;
+    }
+
+    void Allocator::destroy(detail::ImageRecord& record) {
+        vmaDestroyImage(m_allocator, record.image, record.allocation);
+        --m_live_allocations;
+    }
+
+    void Allocator::free(VmaAllocation allocation) {
+        vmaFreeMemory(m_allocator, allocation);
+        --m_live_allocations;
+    }
+
+    std::vector<HeapBudget> Allocator::heap_budgets() const {
+        const VkPhysicalDeviceMemoryProperties* memory_properties;
+        vmaGetMemoryProperties(m_allocator, &memory_properties);
+
+        std::vector<VmaBudget> budgets(memory_properties->memoryHeapCount);
+        vmaGetHeapBudgets(m_allocator, budgets.data());
+
+        std::vector<HeapBudget> result(budgets.size());
+        for (size_t i = 0; i < budgets.size(); ++i) {
+            result[i].flags = memory_properties->memoryHeaps[i].flags;
+            result[i].usage = budgets[i].usage;
+            result[i].budget = budgets[i].budget;
+        }
+        return result;
+    }
+
+    AllocatorStats Allocator::stats() const {
+        AllocatorStats stats;
+
+        VmaTotalStatistics total;
+        vmaCalculateStatistics(m_allocator, &total);
+        PoolStats pooled;
+
+        for (size_t i = 0; i < m_pools.size(); ++i) {
+            if (m_pools[i] == VK_NULL_HANDLE) {
+                continue;
+            }
+            VmaDetailedStatistics detailed;
+            vmaCalculatePoolStatistics(m_allocator, m_pools[i], &detailed);
+            stats.pools[i] = to_pool_stats(detailed);
+
+            pooled.block_count += stats.pools[i].block_count;
+            pooled.allocation_count += stats.pools[i].allocation_count;
+            pooled.block_bytes += stats.pools[i].block_bytes;
+            pooled.allocation_bytes += stats.pools[i].allocation_bytes;
+        }
+
+        // whatever is not in a pool went to the default heaps
+        const PoolStats all = to_pool_stats(total.total);
+        stats.unpooled.block_count = all.block_count - pooled.block_count;
+        stats.unpooled.allocation_count = all.allocation_count - pooled.allocation_count;
+        stats.unpooled.block_bytes = all.block_bytes - pooled.block_bytes;
+        stats.unpooled.allocation_bytes = all.allocation_bytes - pooled.allocation_bytes;
+
+        stats.total_allocations = m_live_allocations;
+        stats.defragmentation_moves = m_defrag_moves;
+        stats.defragmentation_bytes_moved = m_defrag_bytes_moved;
+        return stats;
+    }
+
+    void Allocator::set_frame(uint64_t frame_number) {
+        vmaSetCurrentFrameIndex(m_allocator, static_cast<uint32_t>(frame_number));
+    }
+
+    void Allocator::begin_defragmentation(VkDeviceSize max_bytes_per_frame, uint32_t max_moves_per_frame) {
+        const VmaPool pool = m_pools[size_t(MemoryUsage::static_geometry)];
+        if (m_defrag_context != VK_NULL_HANDLE || pool == VK_NULL_HANDLE) {
+            return;
+        }
+
+        VmaDefragmentationInfo info = {};
+        info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+        info.pool = pool;
+        info.maxBytesPerPass = max_bytes_per_frame;
+        info.maxAllocationsPerPass = max_moves_per_frame;
+        if (check_vk(vmaBeginDefragmentation(m_allocator, &info, &m_defrag_context))) {
+            m_logger->info("defragmentation of the {} pool started", to_string(MemoryUsage::static_geometry));
+        }
+    }
+
+    void Allocator::defragment_step(VkCommandBuffer cmd, uint64_t frame_number, uint64_t completed_frames) {
+        if (m_defrag_context == VK_NULL_HANDLE) {
+            return;
+        }
+
+        if (m_defrag_pass_open) {
+            if (completed_frames <= m_defrag_pass_frame) {
+                // the copies of the open pass are still in flight
+                return;
+            }
+            finish_defragmentation_pass();
+            if (m_defrag_context == VK_NULL_HANDLE) {
+                return;
+            }
+        }
+
+        m_defrag_pass = {};
+        VkResult result = vmaBeginDefragmentationPass(m_allocator, m_defrag_context, &m_defrag_pass);
+        if (result == VK_SUCCESS) {
+            // nothing left to move
+            VmaDefragmentationStats defrag_stats;
+            vmaEndDefragmentation(m_allocator, m_defrag_context, &defrag_stats);
+            m_defrag_context = VK_NULL_HANDLE;
+            m_logger->info(
+                "defragmentation finished: {} bytes moved, {} bytes freed, {} blocks released",
+                defrag_stats.bytesMoved,
+                defrag_stats.bytesFreed,
+                defrag_stats.deviceMemoryBlocksFreed
+            );
+            return;
+        }
+        if (result != VK_INCOMPLETE) {
+            check_vk(result);
+            return;
+        }
+
+        bool copied = false;
+        for (uint32_t i = 0; i < m_defrag_pass.moveCount; ++i) {
+            VmaDefragmentationMove& move = m_defrag_pass.pMoves[i];
+
+            VmaAllocationInfo src_info;
+            vmaGetAllocationInfo(m_allocator, move.srcAllocation, &src_info);
+            auto* record = static_cast<detail::BufferRecord*>(src_info.pUserData);
+
+            // only buffers are created in the defragmented pool, but be safe
+            if (record == nullptr || record->allocation != move.srcAllocation) {
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                continue;
+            }
+
+            VkBuffer new_buffer;
+            if (vkCreateBuffer(m_device, &record->create_info, nullptr, &new_buffer) != VK_SUCCESS) {
+                move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+                continue;
+            }
+            check_vk(vmaBindBufferMemory(m_allocator, move.dstTmpAllocation, new_buffer));
+
+            if (!copied) {
+                // earlier submissions wrote these buffers, e.g. the culling
+                // shader's draws and the scene's upload copies
+                VkMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+                barrier.pNext = nullptr;
+                barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+                vkCmdPipelineBarrier(
+                    cmd,
+                    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    0,
+                    1, &barrier,
+                    0, nullptr,
+                    0, nullptr
+                );
+            }
+
+            VkBufferCopy region = {};
+            region.srcOffset = 0;
+            region.dstOffset = 0;
+            region.size = record->create_info.size;
+            vkCmdCopyBuffer(cmd, record->buffer, new_buffer, 1, &region);
+
+            // frames recorded from now on use the new buffer, frames already
+            // submitted finish before this frame's copy completes
+            m_defrag_retired.push_back(record->buffer);
+            record->buffer = new_buffer;
+
+            ++m_defrag_moves;
+            m_defrag_bytes_moved += region.size;
+            copied = true;
+        }
+
+        if (copied) {
+            VkMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.pNext = nullptr;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            vkCmdPipelineBarrier(
+                cmd,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                0,
+                1, &barrier,
+                0, nullptr,
+                0, nullptr
+            );
+        }
+
+        m_defrag_pass_open = true;
+        m_defrag_pass_frame = frame_number;
+    }
+
+    void Allocator::finish_defragmentation_pass() {
+        for (VkBuffer buffer : m_defrag_retired) {
+            vkDestroyBuffer(m_device, buffer, nullptr);
+        }
+        m_defrag_retired.clear();
+        m_defrag_pass_open = false;
+
+        // VMA now points the moved allocations at their new memory
+        VkResult result = vmaEndDefragmentationPass(m_allocator, m_defrag_context, &m_defrag_pass);
+        if (result == VK_SUCCESS) {
+            VmaDefragmentationStats defrag_stats;
+            vmaEndDefragmentation(m_allocator, m_defrag_context, &defrag_stats);
+            m_defrag_context = VK_NULL_HANDLE;
+            m_logger->info(
+                "defragmentation finished: {} bytes moved, {} blocks released",
+                defrag_stats.bytesMoved,
+                defrag_stats.deviceMemoryBlocksFreed
+            );
+        }
+    }
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "logger.hpp"
+
+#include <vulkan/vulkan.h>
+#include <vk_mem_alloc.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+
+namespace engine {
+
+    // Every allocation goes to the pool of its usage, so long lived geometry,
+    // per-frame data and render targets do not fragment each other.
+    enum class MemoryUsage : uint32_t {
+        static_geometry,   // device local, filled once through staging, may be moved by defragmentation
+        dynamic_per_frame, // host visible, persistently mapped, rewritten every frame
+        staging,           // host visible, persistently mapped, written sequentially by the CPU
+        readback,          // host visible and cached, persistently mapped, read by the CPU
+        render_target,     // device local images
+        texture,           // device local sampled images, filled through staging
+        count
+    };
+
+    const char* to_string(MemoryUsage usage);
+
+    class Allocator;
+    class DeletionQueue;
+
+    namespace detail {
+        // Heap allocated so the address stays stable while handles are moved
+        // around; VMA keeps a pointer to it as allocation user data, which is
+        // how defragmentation finds the owner of a moved allocation.
+        struct BufferRecord {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VmaAllocation allocation = VK_NULL_HANDLE;
+            VkBufferCreateInfo create_info = {};
+            MemoryUsage usage = MemoryUsage::static_geometry;
+            void* mapped = nullptr;
+        };
+
+        struct ImageRecord {
+            VkImage image = VK_NULL_HANDLE;
+            VmaAllocation allocation = VK_NULL_HANDLE;
+            VkImageCreateInfo create_info = {};
+            MemoryUsage usage = MemoryUsage::render_target;
+        };
+    }
+
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+        ~Buffer();
+
+        explicit operator bool() const { return m_record != nullptr; }
+
+        // A defragmentation pass replaces the buffer and destroys the old
+        // one once the frame that copied it has finished, so fetch this
+        // every frame; a VkBuffer kept across frames goes stale.
+        VkBuffer handle() const { return m_record ? m_record->buffer : VK_NULL_HANDLE; }
+        VkDeviceSize size() const { return m_record ? m_record->create_info.size : 0; }
+        MemoryUsage usage() const { return m_record->usage; }
+
+        // nullptr unless the buffer lives in host visible memory
+        void* mapped() const { return m_record ? m_record->mapped : nullptr; }
+
+        // no-ops on coherent memory
+        void flush(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+        void invalidate(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+        void reset();
+
+    private:
+        friend class Allocator;
+
+        Allocator* m_allocator = nullptr;
+        std::unique_ptr<detail::BufferRecord> m_record;
+    };
+
+    // Buffer holding `count` elements of T.
+    template<typename T>
+    class TypedBuffer {
+    public:
+        TypedBuffer() = default;
+        TypedBuffer(Buffer buffer, size_t count)
+            : m_buffer(std::move(buffer))
+            , m_count(count) {}
+
+        explicit operator bool() const { return static_cast<bool>(m_buffer); }
+
+        VkBuffer handle() const { return m_buffer.handle(); }
+        size_t count() const { return m_count; }
+        VkDeviceSize size_bytes() const { return m_count * sizeof(T); }
+
+        // empty unless the buffer lives in host visible memory
+        std::span<T> mapped() const {
+            return { static_cast<T*>(m_buffer.mapped()), m_buffer.mapped() ? m_count : 0 };
+        }
+
+        Buffer& buffer() { return m_buffer; }
+        const Buffer& buffer() const { return m_buffer; }
+
+    private:
+        Buffer m_buffer;
+        size_t m_count = 0;
+    };
+
+    class Image {
+    public:
+        Image() = default;
+        Image(Image&& other) noexcept;
+        Image& operator=(Image&& other) noexcept;
+        Image(const Image&) = delete;
+        Image& operator=(const Image&) = delete;
+        ~Image();
+
+        explicit operator bool() const { return m_record != nullptr; }
+
+        VkImage handle() const { return m_record ? m_record->image : VK_NULL_HANDLE; }
+        VkFormat format() const { return m_record->create_info.format; }
+        VkExtent3D extent() const { return m_record->create_info.extent; }
+        uint32_t mip_levels() const { return m_record->create_info.mipLevels; }
+
+        void reset();
+
+    private:
+        friend class Allocator;
+
+        Allocator* m_allocator = nullptr;
+        std::unique_ptr<detail::ImageRecord> m_record;
+    };
+
+    // Memory without a resource, for images that are bound to it by hand.
+    // Transient render graph images whose lifetimes do not overlap share one.
+    class DeviceMemory {
+    public:
+        DeviceMemory() = default;
+        DeviceMemory(DeviceMemory&& other) noexcept;
+        DeviceMemory& operator=(DeviceMemory&& other) noexcept;
+        DeviceMemory(const DeviceMemory&) = delete;
+        DeviceMemory& operator=(const DeviceMemory&) = delete;
+        ~DeviceMemory();
+
+        explicit operator bool() const { return m_allocation != VK_NULL_HANDLE; }
+
+        VkDeviceSize size() const { return m_size; }
+
+        bool bind_image(VkImage image, VkDeviceSize offset = 0);
+
+        void reset();
+
+    private:
+        friend class Allocator;
+
+        Allocator* m_allocator = nullptr;
+        VmaAllocation m_allocation = VK_NULL_HANDLE;
+        VkDeviceSize m_size = 0;
+    };
+
+    struct HeapBudget {
+        VkMemoryHeapFlags flags;
+        // bytes the process has allocated from the heap / may allocate before
+        // the driver starts evicting or failing. Exact with VK_EXT_memory_budget,
+        // estimated by VMA otherwise.
+        VkDeviceSize usage;
+        VkDeviceSize budget;
+    };
+
+    struct PoolStats {
+        uint32_t block_count = 0;
+        uint32_t allocation_count = 0;
+        VkDeviceSize block_bytes = 0;
+        VkDeviceSize allocation_bytes = 0;
+        uint32_t free_range_count = 0;
+        VkDeviceSize largest_free_range = 0;
+
+        // 0 when all free space is one range, close to 1 when it is scattered
+        double fragmentation() const {
+            const VkDeviceSize free_bytes = block_bytes - allocation_bytes;
+            return free_bytes > 0 ? 1.0 - double(largest_free_range) / double(free_bytes) : 0.0;
+        }
+    };
+
+    struct AllocatorStats {
+        std::array<PoolStats, size_t(MemoryUsage::count)> pools;
+        // allocations that did not fit their pool's memory type
+        PoolStats unpooled;
+
+        uint64_t total_allocations = 0;
+        uint64_t defragmentation_moves = 0;
+        uint64_t defragmentation_bytes_moved = 0;
+    };
+
+    class Allocator {
+    public:
+        Allocator(
+            VkInstance instance,
+            VkPhysicalDevice physical_device,
+            VkDevice device,
+            bool memory_budget_supported,
+            // for buffers created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+            bool buffer_device_address = false
+        );
+        ~Allocator();
+
+        Allocator(const Allocator&) = delete;
+        Allocator& operator=(const Allocator&) = delete;
+
+        Buffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memory_usage);
+
+        template<typename T>
+        TypedBuffer<T> create_typed_buffer(size_t count, VkBufferUsageFlags usage, MemoryUsage memory_usage) {
+            return TypedBuffer<T>(create_buffer(count * sizeof(T), usage, memory_usage), count);
+        }
+
+        Image create_image(const VkImageCreateInfo& info, MemoryUsage memory_usage);
+
+        // `requirements` may be the combination of several resources' needs
+        DeviceMemory allocate_memory(const VkMemoryRequirements& requirements, MemoryUsage memory_usage);
+
+        // cheap, reads the budget VMA tracks per frame
+        std::vector<HeapBudget> heap_budgets() const;
+        // walks all blocks, meant for periodic monitoring rather than every frame
+        AllocatorStats stats() const;
+
+        // tells VMA a new frame started, which refreshes the budget numbers
+        void set_frame(uint64_t frame_number);
+
+        // Starts an incremental defragmentation of the static geometry pool,
+        // which is then carried out by defragment_step over the next frames.
+        void begin_defragmentation(VkDeviceSize max_bytes_per_frame = 16 * 1024 * 1024, uint32_t max_moves_per_frame = 64);
+        bool is_defragmenting() const { return m_defrag_context != VK_NULL_HANDLE; }
+
+        // Records the copies of at most one defragmentation pass into cmd,
+        // which must be submitted as frame `frame_number`. A pass is finished
+        // (old buffers freed, VMA notified) once `completed_frames` shows that
+        // frame has finished on the GPU. Has to be called outside a render pass.
+        // Moved buffers get a new Buffer::handle(), see there.
+        void defragment_step(VkCommandBuffer cmd, uint64_t frame_number, uint64_t completed_frames);
+
+        VmaAllocator handle() const { return m_allocator; }
+
+        // With a queue, buffers, images and memory that go out of scope are
+        // freed once the frames that may use them have finished instead of
+        // right away. nullptr frees right away again, e.g. at teardown.
+        void set_deletion_queue(DeletionQueue* queue) { m_deletions = queue; }
+
+    private:
+        friend class Buffer;
+        friend class Image;
+        friend class DeviceMemory;
+
+        // now or through the deletion queue
+        void release(std::unique_ptr<detail::BufferRecord> record);
+        void release(std::unique_ptr<detail::ImageRecord> record);
+        void release(VmaAllocation allocation);
+
+        void destroy(detail::BufferRecord& record);
+        void destroy(detail::ImageRecord& record);
+        void free(VmaAllocation allocation);
+
+        void create_pools();
+        void finish_defragmentation_pass();
+
+    private:
+        VkDevice m_device;
+        VmaAllocator m_allocator = VK_NULL_HANDLE;
+        std::array<VmaPool, size_t(MemoryUsage::count)> m_pools = {};
+
+        DeletionQueue* m_deletions = nullptr;
+
+        VmaDefragmentationContext m_defrag_context = VK_NULL_HANDLE;
+        VmaDefragmentationPassMoveInfo m_defrag_pass = {};
+        bool m_defrag_pass_open = false;
+        uint64_t m_defrag_pass_frame = 0;
+        std::vector<VkBuffer> m_defrag_retired;
+
+        std::atomic<uint64_t> m_live_allocations = 0;
+        uint64_t m_defrag_moves = 0;
+        uint64_t m_defrag_bytes_moved = 0;
+
+        logger_t m_logger;
+    };
+}
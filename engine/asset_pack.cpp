@@ -0,0 +1,234 @@
+#include "asset_pack.hpp"
+#include "hash.hpp"
+
+#include <lz4.h>
+#include <lz4hc.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+
+namespace engine {
+
+    namespace {
+        uint64_t align_up(uint64_t value, uint64_t alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+        bool entry_less(const PackEntry& entry, uint64_t name_hash, std::string_view entry_name, std::string_view name) {
+            return entry.name_hash != name_hash ? entry.name_hash < name_hash : entry_name < name;
+        }
+    }
+
+    // AssetPack
+
+    AssetPack::AssetPack(const std::filesystem::path& path)
+        : m_file(path) {
+        if (!m_file.is_open() || m_file.size() < sizeof(PackHeader)) {
+            return;
+        }
+
+        PackHeader header;
+        std::memcpy(&header, m_file.data(), sizeof(header));
+        const uint64_t toc_size = uint64_t(header.entry_count) * sizeof(PackEntry) + header.name_bytes;
+        if (header.magic != pack_magic
+            || header.version != pack_version
+            || header.file_size != m_file.size()
+            || sizeof(PackHeader) + toc_size > m_file.size()) {
+            return;
+        }
+        const auto toc = m_file.bytes().subspan(sizeof(PackHeader), toc_size);
+        if (hash_bytes(toc) != header.toc_hash) {
+            return;
+        }
+
+        // the mapping is page aligned and the header a multiple of 8 bytes
+        m_entries = { reinterpret_cast<const PackEntry*>(toc.data()), header.entry_count };
+        m_names = { reinterpret_cast<const char*>(toc.data()) + m_entries.size_bytes(), header.name_bytes };
+        for (const PackEntry& entry : m_entries) {
+            if (uint64_t(entry.name_offset) + entry.name_length > m_names.size()
+                || entry.offset + entry.stored_size > m_file.size()) {
+                m_entries = {};
+                m_names = {};
+                return;
+            }
+        }
+        m_path = path;
+    }
+
+    const PackEntry* AssetPack::find(std::string_view name) const {
+        const uint64_t name_hash = hash_string(name);
+        const auto it = std::lower_bound(m_entries.begin(), m_entries.end(), name, [&](const PackEntry& entry, std::string_view value) {
+            return entry_less(entry, name_hash, this->name(entry), value);
+        });
+        if (it == m_entries.end() || it->name_hash != name_hash || this->name(*it) != name) {
+            return nullptr;
+        }
+        return &*it;
+    }
+
+    std::string_view AssetPack::name(const PackEntry& entry) const {
+        return m_names.substr(entry.name_offset, entry.name_length);
+    }
+
+    std::span<const std::byte> AssetPack::stored(const PackEntry& entry) const {
+        return m_file.bytes().subspan(entry.offset, entry.stored_size);
+    }
+
+    // AssetPackWriter
+
+    void AssetPackWriter::add(std::string name, std::span<const std::byte> data, PackCompression compression) {
+        ++m_stats.entries;
+        m_stats.input_bytes += data.size();
+
+        const uint64_t content_hash = hash_bytes(data);
+        if (const auto same = m_by_hash.find(content_hash); same != m_by_hash.end() && m_blobs[same->second].size == data.size()) {
+            ++m_stats.deduplicated;
+            m_entries.push_back({ std::move(name), same->second });
+            return;
+        }
+
+        Blob blob;
+        blob.size = data.size();
+        blob.content_hash = content_hash;
+        blob.compression = PackCompression::none;
+        if (compression == PackCompression::lz4 && !data.empty() && data.size() <= LZ4_MAX_INPUT_SIZE) {
+            // offline, so the slow high compression mode; decoding is as fast
+            blob.stored.resize(LZ4_compressBound(static_cast<int>(data.size())));
+            const int stored = LZ4_compress_HC(
+                reinterpret_cast<const char*>(data.data()),
+                reinterpret_cast<char*>(blob.stored.data()),
+                static_cast<int>(data.size()),
+                static_cast<int>(blob.stored.size()),
+                LZ4HC_CLEVEL_DEFAULT
+            );
+            if (stored > 0 && uint64_t(stored) < data.size() - data.size() / 8) {
+                blob.stored.resize(stored);
+                blob.compression = PackCompression::lz4;
+                ++m_stats.compressed;
+            }
+        }
+        if (blob.compression == PackCompression::none) {
+            blob.stored.assign(data.begin(), data.end());
+        }
+        m_stats.stored_bytes += blob.stored.size();
+
+        m_by_hash.emplace(content_hash, m_blobs.size());
+        m_entries.push_back({ std::move(name), m_blobs.size() });
+        m_blobs.push_back(std::move(blob));
+    }
+
+    bool AssetPackWriter::add_file(std::string name, const std::filesystem::path& path, PackCompression compression) {
+        const MappedFile file(path);
+        if (!file.is_open()) {
+            return false;
+        }
+        add(std::move(name), file.bytes(), compression);
+        return true;
+    }
+
+    bool AssetPackWriter::write(const std::filesystem::path& path) {
+        std::vector<PackEntry> entries(m_entries.size());
+        std::string names;
+        for (size_t i = 0; i < m_entries.size(); ++i) {
+            const Blob& blob = m_blobs[m_entries[i].blob];
+            PackEntry& entry = entries[i];
+            entry = {};
+            entry.name_hash = hash_string(m_entries[i].name);
+            entry.stored_size = blob.stored.size();
+            entry.size = blob.size;
+            entry.content_hash = blob.content_hash;
+            entry.name_offset = static_cast<uint32_t>(names.size());
+            entry.name_length = static_cast<uint32_t>(m_entries[i].name.size());
+            entry.compression = blob.compression;
+            names += m_entries[i].name;
+        }
+
+        // blobs in the order they were added, each on its own pages
+        const uint64_t toc_size = entries.size() * sizeof(PackEntry) + names.size();
+        std::vector<uint64_t> blob_offsets(m_blobs.size());
+        uint64_t offset = align_up(sizeof(PackHeader) + toc_size, pack_alignment);
+        for (size_t i = 0; i < m_blobs.size(); ++i) {
+            blob_offsets[i] = offset;
+            offset = align_up(offset + m_blobs[i].stored.size(), pack_alignment);
+        }
+        for (size_t i = 0; i < entries.size(); ++i) {
+            entries[i].offset = blob_offsets[m_entries[i].blob];
+        }
+
+        // the table is searched by name hash
+        std::vector<size_t> order(entries.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return entry_less(entries[a], entries[b].name_hash, m_entries[a].name, m_entries[b].name);
+        });
+        std::vector<PackEntry> sorted(entries.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            sorted[i] = entries[order[i]];
+        }
+
+        std::vector<std::byte> toc(toc_size);
+        std::memcpy(toc.data(), sorted.data(), sorted.size() * sizeof(PackEntry));
+        std::memcpy(toc.data() + sorted.size() * sizeof(PackEntry), names.data(), names.size());
+
+        PackHeader header = {};
+        header.magic = pack_magic;
+        header.version = pack_version;
+        header.entry_count = static_cast<uint32_t>(sorted.size());
+        header.name_bytes = static_cast<uint32_t>(names.size());
+        header.toc_hash = hash_bytes(std::span<const std::byte>(toc));
+        header.file_size = m_blobs.empty() ? sizeof(PackHeader) + toc_size : blob_offsets.back() + m_blobs.back().stored.size();
+
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(toc.data()), toc.size());
+            uint64_t written = sizeof(header) + toc.size();
+            const std::vector<char> zeros(pack_alignment, 0);
+            for (size_t i = 0; i < m_blobs.size(); ++i) {
+                file.write(zeros.data(), blob_offsets[i] - written);
+                file.write(reinterpret_cast<const char*>(m_blobs[i].stored.data()), m_blobs[i].stored.size());
+                written = blob_offsets[i] + m_blobs[i].stored.size();
+            }
+            if (!file) {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if (error) {
+            return false;
+        }
+        m_stats.file_bytes = header.file_size;
+        return true;
+    }
+
+    bool decompress(PackCompression compression, std::span<const std::byte> input, std::span<std::byte> output) {
+        switch (compression) {
+        case PackCompression::none:
+            if (input.size() != output.size()) {
+                return false;
+            }
+            std::memcpy(output.data(), input.data(), input.size());
+            return true;
+        case PackCompression::lz4:
+            if (input.size() > size_t(std::numeric_limits<int>::max()) || output.size() > size_t(std::numeric_limits<int>::max())) {
+                return false;
+            }
+            return LZ4_decompress_safe(
+                reinterpret_cast<const char*>(input.data()),
+                reinterpret_cast<char*>(output.data()),
+                static_cast<int>(input.size()),
+                static_cast<int>(output.size())
+            ) == static_cast<int>(output.size());
+        default:
+            return false;
+        }
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace engine {
+
+    enum class PackCompression : uint32_t {
+        none,
+        lz4,
+    };
+
+    // On disk: the header, the table of contents sorted by name hash, the
+    // names, and then every blob at a multiple of pack_alignment, so a blob
+    // starts on its own page of the mapping and SPIR-V or vertex data can be
+    // used in place.
+    struct PackHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entry_count;
+        uint32_t name_bytes;
+        // of the entries and names
+        uint64_t toc_hash;
+        uint64_t file_size;
+    };
+
+    struct PackEntry {
+        uint64_t name_hash;
+        uint64_t offset;
+        // in the file, and once decompressed
+        uint64_t stored_size;
+        uint64_t size;
+        // hash_bytes of the uncompressed contents
+        uint64_t content_hash;
+        uint32_t name_offset;
+        uint32_t name_length;
+        PackCompression compression;
+        uint32_t padding;
+    };
+    static_assert(sizeof(PackEntry) == 56);
+
+    constexpr uint32_t pack_magic = 0x4B415045; // "EPAK"
+    constexpr uint32_t pack_version = 1;
+    constexpr uint64_t pack_alignment = 4096;
+
+    // A mapped pack. Lookups are a binary search over the name hashes; the
+    // pack is only read where it is touched.
+    class AssetPack {
+    public:
+        AssetPack() = default;
+        explicit AssetPack(const std::filesystem::path& path);
+
+        // false if the file is missing or not a valid pack
+        bool is_open() const { return !m_path.empty(); }
+        const std::filesystem::path& path() const { return m_path; }
+
+        // nullptr if the pack has no such name
+        const PackEntry* find(std::string_view name) const;
+
+        std::span<const PackEntry> entries() const { return m_entries; }
+        std::string_view name(const PackEntry& entry) const;
+        // the blob as stored, still compressed unless entry.compression is none
+        std::span<const std::byte> stored(const PackEntry& entry) const;
+
+    private:
+        MappedFile m_file;
+        std::filesystem::path m_path;
+        std::span<const PackEntry> m_entries;
+        std::string_view m_names;
+    };
+
+    struct AssetPackWriterStats {
+        uint32_t entries = 0;
+        // entries whose contents another entry already stored
+        uint32_t deduplicated = 0;
+        uint32_t compressed = 0;
+        uint64_t input_bytes = 0;
+        uint64_t stored_bytes = 0;
+        uint64_t file_bytes = 0;
+    };
+
+    // Collects named blobs and writes them as a pack. Identical contents are
+    // stored once; a blob asked to be compressed is kept uncompressed when
+    // that saves less than an eighth.
+    class AssetPackWriter {
+    public:
+        void add(std::string name, std::span<const std::byte> data, PackCompression compression = PackCompression::none);
+        // false if the file cannot be read
+        bool add_file(std::string name, const std::filesystem::path& path, PackCompression compression = PackCompression::none);
+
+        bool write(const std::filesystem::path& path);
+
+        const AssetPackWriterStats& stats() const { return m_stats; }
+
+    private:
+        struct Blob {
+            std::vector<std::byte> stored;
+            uint64_t size;
+            uint64_t content_hash;
+            PackCompression compression;
+        };
+        struct Entry {
+            std::string name;
+            size_t blob;
+        };
+
+        std::vector<Blob> m_blobs;
+        std::vector<Entry> m_entries;
+        // content hash -> blob
+        std::unordered_map<uint64_t, size_t> m_by_hash;
+        AssetPackWriterStats m_stats;
+    };
+
+    // Decompresses an lz4 blob into `output`, which has to be exactly the
+    // uncompressed size.
+    bool decompress(PackCompression compression, std::span<const std::byte> input, std::span<std::byte> output);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+
+namespace engine {
+
+    // Blocking multi-producer multi-consumer queue. push() waits while the
+    // queue is full, which is what keeps a multi stage pipeline from running
+    // ahead of its slowest stage and piling up memory.
+    template<typename T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity)
+            : m_capacity(capacity) {}
+
+        // false if the queue was closed
+        bool push(T value) {
+            std::unique_lock lock(m_mutex);
+            m_not_full.wait(lock, [&] { return m_closed || m_items.size() < m_capacity; });
+            if (m_closed) {
+                return false;
+            }
+            m_items.push_back(std::move(value));
+            lock.unlock();
+            m_not_empty.notify_one();
+            return true;
+        }
+
+        // waits for an item; empty once the queue is closed and drained
+        std::optional<T> pop() {
+            std::unique_lock lock(m_mutex);
+            m_not_empty.wait(lock, [&] { return m_closed || !m_items.empty(); });
+            return take(lock);
+        }
+
+        std::optional<T> try_pop() {
+            std::unique_lock lock(m_mutex);
+            return take(lock);
+        }
+
+        // wakes every waiting producer and consumer; pushes fail from now on
+        void close() {
+            {
+                std::lock_guard lock(m_mutex);
+                m_closed = true;
+            }
+            m_not_full.notify_all();
+            m_not_empty.notify_all();
+        }
+
+        size_t size() const {
+            std::lock_guard lock(m_mutex);
+            return m_items.size();
+        }
+
+        size_t capacity() const { return m_capacity; }
+
+    private:
+        std::optional<T> take(std::unique_lock<std::mutex>& lock) {
+            if (m_items.empty()) {
+                return {};
+            }
+            std::optional<T> value(std::move(m_items.front()));
+            m_items.pop_front();
+            lock.unlock();
+            m_not_full.notify_one();
+            return value;
+        }
+
+    private:
+        const size_t m_capacity;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_not_full;
+        std::condition_variable m_not_empty;
+        std::deque<T> m_items;
+        bool m_closed = false;
+    };
+}
@@ -0,0 +1,133 @@
+#include "command_recorder.hpp"
+#include "vk_util.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+
+namespace engine {
+
+    CommandRecorderParams::CommandRecorderParams()
+    : min_batch(256)
+    , batches_per_thread(4)
+    {}
+
+    CommandRecorder::CommandRecorder(
+        VkDevice device,
+        uint32_t queue_family,
+        JobSystem& jobs,
+        uint32_t frame_slots,
+        const CommandRecorderParams& params
+    )
+        : m_device(device)
+        , m_jobs(jobs)
+        , m_params(params) {
+        m_params.min_batch = std::max(m_params.min_batch, 1u);
+        m_params.batches_per_thread = std::max(m_params.batches_per_thread, 1u);
+
+        VkCommandPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.pNext = nullptr;
+        pool_info.queueFamilyIndex = queue_family;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        m_slots.resize(frame_slots);
+        for (auto& slot : m_slots) {
+            slot = std::vector<ThreadCommands>(m_jobs.thread_count());
+            for (auto& commands : slot) {
+                check_vk(vkCreateCommandPool(m_device, &pool_info, nullptr, &commands.pool));
+            }
+        }
+    }
+
+    CommandRecorder::~CommandRecorder() {
+        for (auto& slot : m_slots) {
+            for (auto& commands : slot) {
+                // frees the command buffers as well
+                vkDestroyCommandPool(m_device, commands.pool, nullptr);
+            }
+        }
+    }
+
+    void CommandRecorder::begin_frame(uint32_t frame_slot) {
+        m_slot = frame_slot;
+        m_secondaries = 0;
+        // one reset per pool instead of one per command buffer
+        for (auto& commands : m_slots[m_slot]) {
+            if (commands.used > 0) {
+                check_vk(vkResetCommandPool(m_device, commands.pool, 0));
+                commands.used = 0;
+            }
+        }
+    }
+
+    void CommandRecorder::record(
+        VkCommandBuffer primary,
+        const VkCommandBufferInheritanceInfo& inheritance,
+        uint32_t count,
+        const record_t& record
+    ) {
+        if (count == 0) {
+            return;
+        }
+
+        const uint32_t max_batches = m_jobs.thread_count() * m_params.batches_per_thread;
+        const uint32_t batch_count = std::clamp((count + m_params.min_batch - 1) / m_params.min_batch, 1u, max_batches);
+        const uint32_t batch_size = (count + batch_count - 1) / batch_count;
+
+        m_batches.assign(batch_count, VK_NULL_HANDLE);
+        auto& slot = m_slots[m_slot];
+
+        m_jobs.parallel_for(batch_count, 1, [&](uint32_t first_batch, uint32_t last_batch, uint32_t thread) {
+            for (uint32_t batch = first_batch; batch < last_batch; ++batch) {
+                ENGINE_PROFILE_ZONE("record batch");
+                VkCommandBuffer cmd = acquire(slot[thread]);
+
+                VkCommandBufferBeginInfo begin_info = {};
+                begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                begin_info.pNext = nullptr;
+                begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+                begin_info.pInheritanceInfo = &inheritance;
+                check_vk(vkBeginCommandBuffer(cmd, &begin_info));
+
+                const uint32_t begin = batch * batch_size;
+                record(cmd, begin, std::min(count, begin + batch_size));
+
+                check_vk(vkEndCommandBuffer(cmd));
+                m_batches[batch] = cmd;
+            }
+        });
+
+        // batch order, whatever thread recorded them
+        vkCmdExecuteCommands(primary, batch_count, m_batches.data());
+        m_secondaries += batch_count;
+    }
+
+    CommandRecorderStats CommandRecorder::stats() const {
+        CommandRecorderStats stats;
+        stats.threads = m_jobs.thread_count();
+        stats.secondaries = m_secondaries;
+        for (const auto& slot : m_slots) {
+            for (const auto& commands : slot) {
+                stats.allocated += static_cast<uint32_t>(commands.buffers.size());
+            }
+        }
+        return stats;
+    }
+
+    VkCommandBuffer CommandRecorder::acquire(ThreadCommands& commands) {
+        if (commands.used == commands.buffers.size()) {
+            VkCommandBufferAllocateInfo buffer_info = {};
+            buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            buffer_info.pNext = nullptr;
+            buffer_info.commandPool = commands.pool;
+            buffer_info.commandBufferCount = 1;
+            buffer_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+            VkCommandBuffer cmd = VK_NULL_HANDLE;
+            check_vk(vkAllocateCommandBuffers(m_device, &buffer_info, &cmd));
+            commands.buffers.push_back(cmd);
+        }
+        return commands.buffers[commands.used++];
+    }
+}
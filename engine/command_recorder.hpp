@@ -0,0 +1,95 @@
+#pragma once
+
+#include "job_system.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+
+namespace engine {
+
+    struct CommandRecorderParams {
+        CommandRecorderParams();
+
+        // fewer items than this are not worth a secondary command buffer
+        uint32_t min_batch;
+        // upper bound of secondaries per thread and call, a few per thread
+        // keep the threads busy when batches take uneven time
+        uint32_t batches_per_thread;
+    };
+
+    struct CommandRecorderStats {
+        uint32_t threads = 0;
+        // secondary command buffers recorded during the last frame
+        uint32_t secondaries = 0;
+        // allocated over all threads and frame slots
+        uint32_t allocated = 0;
+    };
+
+    // Splits draw recording across the job system. Every thread has its own
+    // command pool per frame slot (pools are externally synchronised, so
+    // sharing one would serialise the threads), and the secondaries are
+    // executed by the primary in batch order, independent of which thread
+    // recorded what.
+    class CommandRecorder {
+    public:
+        // records items [begin, end) into a secondary command buffer that
+        // inherits nothing but the render pass: bind pipelines and set
+        // dynamic state in every batch
+        using record_t = std::function<void(VkCommandBuffer cmd, uint32_t begin, uint32_t end)>;
+
+        CommandRecorder(
+            VkDevice device,
+            uint32_t queue_family,
+            JobSystem& jobs,
+            uint32_t frame_slots,
+            const CommandRecorderParams& params = CommandRecorderParams()
+        );
+        ~CommandRecorder();
+
+        CommandRecorder(const CommandRecorder&) = delete;
+        CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+        // The slot's previous frame has finished on the GPU; recycles its
+        // command buffers.
+        void begin_frame(uint32_t frame_slot);
+
+        // Records `count` items in parallel and executes the secondaries in
+        // `primary`, which has to be inside a subpass begun with
+        // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+        void record(
+            VkCommandBuffer primary,
+            const VkCommandBufferInheritanceInfo& inheritance,
+            uint32_t count,
+            const record_t& record
+        );
+
+        CommandRecorderStats stats() const;
+
+    private:
+        // one cache line each, only touched by its own thread
+        struct alignas(64) ThreadCommands {
+            VkCommandPool pool = VK_NULL_HANDLE;
+            std::vector<VkCommandBuffer> buffers;
+            uint32_t used = 0;
+        };
+
+        VkCommandBuffer acquire(ThreadCommands& commands);
+
+    private:
+        VkDevice m_device;
+        JobSystem& m_jobs;
+        CommandRecorderParams m_params;
+
+        // [frame slot][thread]
+        std::vector<std::vector<ThreadCommands>> m_slots;
+        uint32_t m_slot = 0;
+
+        // by batch index, filled by whichever thread records the batch
+        std::vector<VkCommandBuffer> m_batches;
+        uint32_t m_secondaries = 0;
+    };
+}
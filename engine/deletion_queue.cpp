@@ -0,0 +1,119 @@
+#include "deletion_queue.hpp"
+
+
+namespace engine {
+
+    namespace {
+        template<typename T>
+        T handle_as(uint64_t handle) {
+            return reinterpret_cast<T>(handle);
+        }
+    }
+
+    DeletionQueue::DeletionQueue(VkDevice device)
+        : m_device(device)
+        , m_logger(create_logger("deletion")) {}
+
+    DeletionQueue::~DeletionQueue() {
+        flush();
+    }
+
+    void DeletionQueue::begin_frame(uint64_t frame_number, uint64_t completed_frames) {
+        // destroyed outside the lock, so retiring from a destroy callback is fine
+        std::deque<Entry> finished;
+        {
+            std::lock_guard lock(m_mutex);
+            m_frame_number = frame_number;
+            while (!m_entries.empty() && m_entries.front().frame < completed_frames) {
+                finished.push_back(std::move(m_entries.front()));
+                m_entries.pop_front();
+            }
+            m_stats.destroyed += finished.size();
+            m_stats.last_batch = static_cast<uint32_t>(finished.size());
+        }
+        for (auto& entry : finished) {
+            destroy(entry);
+        }
+    }
+
+    void DeletionQueue::flush() {
+        std::deque<Entry> entries;
+        {
+            std::lock_guard lock(m_mutex);
+            entries.swap(m_entries);
+            m_stats.destroyed += entries.size();
+        }
+        if (!entries.empty()) {
+            ENGINE_LOG_DEBUG(m_logger, "destroying {} retired object(s)", entries.size());
+        }
+        for (auto& entry : entries) {
+            destroy(entry);
+        }
+    }
+
+    DeletionQueueStats DeletionQueue::stats() const {
+        std::lock_guard lock(m_mutex);
+        DeletionQueueStats stats = m_stats;
+        stats.pending = m_entries.size();
+        return stats;
+    }
+
+    void DeletionQueue::retire(VkObjectType type, uint64_t handle, std::function<void()> destroy) {
+        std::lock_guard lock(m_mutex);
+        // the frame being recorded may still use it
+        m_entries.push_back({ m_frame_number, type, handle, std::move(destroy) });
+        ++m_stats.retired;
+    }
+
+    void DeletionQueue::destroy(Entry& entry) {
+        switch (entry.type) {
+        case VK_OBJECT_TYPE_BUFFER:
+            vkDestroyBuffer(m_device, handle_as<VkBuffer>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_IMAGE:
+            vkDestroyImage(m_device, handle_as<VkImage>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_IMAGE_VIEW:
+            vkDestroyImageView(m_device, handle_as<VkImageView>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_SAMPLER:
+            vkDestroySampler(m_device, handle_as<VkSampler>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_PIPELINE:
+            vkDestroyPipeline(m_device, handle_as<VkPipeline>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+            vkDestroyPipelineLayout(m_device, handle_as<VkPipelineLayout>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_SHADER_MODULE:
+            vkDestroyShaderModule(m_device, handle_as<VkShaderModule>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_FRAMEBUFFER:
+            vkDestroyFramebuffer(m_device, handle_as<VkFramebuffer>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_RENDER_PASS:
+            vkDestroyRenderPass(m_device, handle_as<VkRenderPass>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_DESCRIPTOR_POOL:
+            vkDestroyDescriptorPool(m_device, handle_as<VkDescriptorPool>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_QUERY_POOL:
+            vkDestroyQueryPool(m_device, handle_as<VkQueryPool>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_COMMAND_POOL:
+            vkDestroyCommandPool(m_device, handle_as<VkCommandPool>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_FENCE:
+            vkDestroyFence(m_device, handle_as<VkFence>(entry.handle), nullptr);
+            break;
+        case VK_OBJECT_TYPE_SEMAPHORE:
+            vkDestroySemaphore(m_device, handle_as<VkSemaphore>(entry.handle), nullptr);
+            break;
+        default:
+            if (entry.destroy) {
+                entry.destroy();
+            }
+            break;
+        }
+    }
+}
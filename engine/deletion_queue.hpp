@@ -0,0 +1,150 @@
+#pragma once
+
+#include "logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+
+namespace engine {
+
+    struct DeletionQueueStats {
+        size_t pending = 0;
+        uint64_t retired = 0;
+        uint64_t destroyed = 0;
+        // destroyed by the last begin_frame()
+        uint32_t last_batch = 0;
+    };
+
+    namespace detail {
+        template<typename T>
+        constexpr VkObjectType object_type() {
+            if constexpr (std::is_same_v<T, VkBuffer>) { return VK_OBJECT_TYPE_BUFFER; }
+            else if constexpr (std::is_same_v<T, VkImage>) { return VK_OBJECT_TYPE_IMAGE; }
+            else if constexpr (std::is_same_v<T, VkImageView>) { return VK_OBJECT_TYPE_IMAGE_VIEW; }
+            else if constexpr (std::is_same_v<T, VkSampler>) { return VK_OBJECT_TYPE_SAMPLER; }
+            else if constexpr (std::is_same_v<T, VkPipeline>) { return VK_OBJECT_TYPE_PIPELINE; }
+            else if constexpr (std::is_same_v<T, VkPipelineLayout>) { return VK_OBJECT_TYPE_PIPELINE_LAYOUT; }
+            else if constexpr (std::is_same_v<T, VkShaderModule>) { return VK_OBJECT_TYPE_SHADER_MODULE; }
+            else if constexpr (std::is_same_v<T, VkFramebuffer>) { return VK_OBJECT_TYPE_FRAMEBUFFER; }
+            else if constexpr (std::is_same_v<T, VkRenderPass>) { return VK_OBJECT_TYPE_RENDER_PASS; }
+            else if constexpr (std::is_same_v<T, VkDescriptorPool>) { return VK_OBJECT_TYPE_DESCRIPTOR_POOL; }
+            else if constexpr (std::is_same_v<T, VkQueryPool>) { return VK_OBJECT_TYPE_QUERY_POOL; }
+            else if constexpr (std::is_same_v<T, VkCommandPool>) { return VK_OBJECT_TYPE_COMMAND_POOL; }
+            else if constexpr (std::is_same_v<T, VkFence>) { return VK_OBJECT_TYPE_FENCE; }
+            else if constexpr (std::is_same_v<T, VkSemaphore>) { return VK_OBJECT_TYPE_SEMAPHORE; }
+            else { static_assert(sizeof(T) == 0, "no deferred destruction for this handle type"); }
+        }
+    }
+
+    // Destroys GPU objects once the last frame that may use them has
+    // finished, so resources can be dropped at any time without waiting
+    // for the device.
+    //
+    // Whatever is retired while frame N is being recorded is tagged N and
+    // destroyed by the begin_frame() that first sees `completed_frames` > N;
+    // entries go in frame order, so only the front is ever looked at.
+    // retire() may be called from any thread, begin_frame() from the render
+    // thread.
+    class DeletionQueue {
+    public:
+        explicit DeletionQueue(VkDevice device);
+        // destroys everything still queued; the device has to be idle
+        ~DeletionQueue();
+
+        DeletionQueue(const DeletionQueue&) = delete;
+        DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+        // The frame now being recorded; destroys what `completed_frames`
+        // shows is no longer in use.
+        void begin_frame(uint64_t frame_number, uint64_t completed_frames);
+
+        template<typename T>
+        void retire(T handle) {
+            if (handle != VK_NULL_HANDLE) {
+                retire(detail::object_type<T>(), reinterpret_cast<uint64_t>(handle), {});
+            }
+        }
+        // runs `destroy` instead, for objects that are not a single handle,
+        // e.g. allocations
+        void defer(std::function<void()> destroy) {
+            retire(VK_OBJECT_TYPE_UNKNOWN, 0, std::move(destroy));
+        }
+
+        // Destroys everything now. Only when nothing is in flight, e.g.
+        // after vkDeviceWaitIdle at teardown.
+        void flush();
+
+        DeletionQueueStats stats() const;
+
+    private:
+        struct Entry {
+            uint64_t frame;
+            VkObjectType type;
+            uint64_t handle;
+            std::function<void()> destroy;
+        };
+
+        void retire(VkObjectType type, uint64_t handle, std::function<void()> destroy);
+        void destroy(Entry& entry);
+
+    private:
+        VkDevice m_device;
+
+        mutable std::mutex m_mutex;
+        std::deque<Entry> m_entries;
+        uint64_t m_frame_number = 0;
+
+        DeletionQueueStats m_stats;
+
+        logger_t m_logger;
+    };
+
+    // Owns a Vulkan handle and hands it to a DeletionQueue when it goes
+    // away, so dropping it in the middle of a session is safe.
+    template<typename T>
+    class UniqueHandle {
+    public:
+        UniqueHandle() = default;
+        UniqueHandle(DeletionQueue& queue, T handle)
+            : m_queue(&queue)
+            , m_handle(handle) {}
+        UniqueHandle(UniqueHandle&& other) noexcept
+            : m_queue(std::exchange(other.m_queue, nullptr))
+            , m_handle(std::exchange(other.m_handle, VK_NULL_HANDLE)) {}
+        UniqueHandle& operator=(UniqueHandle&& other) noexcept {
+            if (this != &other) {
+                reset();
+                m_queue = std::exchange(other.m_queue, nullptr);
+                m_handle = std::exchange(other.m_handle, VK_NULL_HANDLE);
+            }
+            return *this;
+        }
+        UniqueHandle(const UniqueHandle&) = delete;
+        UniqueHandle& operator=(const UniqueHandle&) = delete;
+        ~UniqueHandle() {
+            reset();
+        }
+
+        explicit operator bool() const { return m_handle != VK_NULL_HANDLE; }
+        T get() const { return m_handle; }
+
+        void reset() {
+            if (m_handle != VK_NULL_HANDLE) {
+                m_queue->retire(m_handle);
+            }
+            m_queue = nullptr;
+            m_handle = VK_NULL_HANDLE;
+        }
+
+    private:
+        DeletionQueue* m_queue = nullptr;
+        T m_handle = VK_NULL_HANDLE;
+    };
+}
@@ -0,0 +1,590 @@
+#include "descriptors.hpp"
+#include "hash.hpp"
+#include "vk_util.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+namespace engine {
+
+    DescriptorLayoutCache::DescriptorLayoutCache(VkDevice device)
+        : m_device(device) {}
+
+    DescriptorLayoutCache::~DescriptorLayoutCache() {
+        for (const auto& [hash, layout] : m_pipeline_layouts) {
+            vkDestroyPipelineLayout(m_device, layout, nullptr);
+        }
+        for (const auto& [hash, layout] : m_set_layouts) {
+            vkDestroyDescriptorSetLayout(m_device, layout, nullptr);
+        }
+    }
+
+    VkDescriptorSetLayout DescriptorLayoutCache::get(
+        std::span<const VkDescriptorSetLayoutBinding> bindings,
+        VkDescriptorSetLayoutCreateFlags flags,
+        std::span<const VkDescriptorBindingFlags> binding_flags
+    ) {
+        // the same bindings in another order are the same layout
+        std::vector<uint32_t> order(bindings.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            return bindings[a].binding < bindings[b].binding;
+        });
+
+        std::vector<VkDescriptorSetLayoutBinding> sorted_bindings;
+        std::vector<VkDescriptorBindingFlags> sorted_flags;
+        sorted_bindings.reserve(bindings.size());
+        uint64_t hash = hash_combine(flags, bindings.size());
+        for (const uint32_t i : order) {
+            const VkDescriptorSetLayoutBinding& binding = bindings[i];
+            sorted_bindings.push_back(binding);
+            hash = hash_combine(hash, binding.binding);
+            hash = hash_combine(hash, binding.descriptorType);
+            hash = hash_combine(hash, binding.descriptorCount);
+            hash = hash_combine(hash, binding.stageFlags);
+            if (binding.pImmutableSamplers != nullptr) {
+                hash = hash_bytes(binding.pImmutableSamplers, binding.descriptorCount * sizeof(VkSampler), hash);
+            }
+            if (!binding_flags.empty()) {
+                sorted_flags.push_back(binding_flags[i]);
+                hash = hash_combine(hash, binding_flags[i]);
+            }
+        }
+
+        std::lock_guard lock(m_mutex);
+        if (auto it = m_set_layouts.find(hash); it != m_set_layouts.end()) {
+            return it->second;
+        }
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT flags_info = {};
+        flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        flags_info.pNext = nullptr;
+        flags_info.bindingCount = static_cast<uint32_t>(sorted_flags.size());
+        flags_info.pBindingFlags = sorted_flags.data();
+
+        VkDescriptorSetLayoutCreateInfo layout_info = {};
+        layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.pNext = sorted_flags.empty() ? nullptr : &flags_info;
+        layout_info.flags = flags;
+        layout_info.bindingCount = static_cast<uint32_t>(sorted_bindings.size());
+        layout_info.pBindings = sorted_bindings.data();
+
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+        check_vk(vkCreateDescriptorSetLayout(m_device, &layout_info, nullptr, &layout));
+        m_set_layouts.emplace(hash, layout);
+        return layout;
+    }
+
+    VkDescriptorSetLayout DescriptorLayoutCache::get(
+        std::span<const ShaderReflection* const> shaders,
+        uint32_t set,
+        std::span<const uint32_t> dynamic_bindings
+    ) {
+        // a binding several stages use appears once, with all of their stages
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        for (const ShaderReflection* shader : shaders) {
+            for (const DescriptorBindingInfo& info : shader->bindings) {
+                if (info.set != set) {
+                    continue;
+                }
+                auto it = std::find_if(bindings.begin(), bindings.end(), [&](const VkDescriptorSetLayoutBinding& other) {
+                    return other.binding == info.binding;
+                });
+                if (it != bindings.end()) {
+                    it->stageFlags |= info.stages;
+                    continue;
+                }
+
+                VkDescriptorSetLayoutBinding binding = {};
+                binding.binding = info.binding;
+                binding.descriptorType = info.type;
+                binding.descriptorCount = info.count;
+                binding.stageFlags = info.stages;
+                binding.pImmutableSamplers = nullptr;
+                if (std::find(dynamic_bindings.begin(), dynamic_bindings.end(), info.binding) != dynamic_bindings.end()) {
+                    if (binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+                        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+                    } else if (binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+                        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+                    }
+                }
+                bindings.push_back(binding);
+            }
+        }
+        return get(bindings);
+    }
+
+    VkPipelineLayout DescriptorLayoutCache::pipeline_layout(
+        std::span<const VkDescriptorSetLayout> set_layouts,
+        std::span<const VkPushConstantRange> push_constants
+    ) {
+        uint64_t hash = hash_bytes(set_layouts.data(), set_layouts.size_bytes());
+        hash = hash_bytes(push_constants.data(), push_constants.size_bytes(), hash);
+
+        std::lock_guard lock(m_mutex);
+        if (auto it = m_pipeline_layouts.find(hash); it != m_pipeline_layouts.end()) {
+            return it->second;
+        }
+
+        VkPipelineLayoutCreateInfo layout_info = {};
+        layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layout_info.pNext = nullptr;
+        layout_info.flags = 0;
+        layout_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+        layout_info.pSetLayouts = set_layouts.data();
+        layout_info.pushConstantRangeCount = static_cast<uint32_t>(push_constants.size());
+        layout_info.pPushConstantRanges = push_constants.data();
+
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        check_vk(vkCreatePipelineLayout(m_device, &layout_info, nullptr, &layout));
+        m_pipeline_layouts.emplace(hash, layout);
+        return layout;
+    }
+
+    DescriptorAllocatorParams::DescriptorAllocatorParams()
+    : initial_sets(64)
+    , growth(1.5f)
+    , max_sets_per_pool(4096)
+    , ratios({
+        { VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+        { VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f },
+    })
+    {}
+
+    DescriptorAllocator::DescriptorAllocator(
+        VkDevice device,
+        uint32_t frame_slots,
+        const DescriptorAllocatorParams& params
+    )
+        : m_device(device)
+        , m_params(params)
+        , m_slots(std::max(frame_slots, 1u)) {
+        m_params.initial_sets = std::max(m_params.initial_sets, 1u);
+        m_params.max_sets_per_pool = std::max(m_params.max_sets_per_pool, m_params.initial_sets);
+        m_params.growth = std::max(m_params.growth, 1.0f);
+        m_next_pool_sets = m_params.initial_sets;
+    }
+
+    DescriptorAllocator::~DescriptorAllocator() {
+        for (const auto& pools : m_slots) {
+            for (VkDescriptorPool pool : pools) {
+                vkDestroyDescriptorPool(m_device, pool, nullptr);
+            }
+        }
+        for (VkDescriptorPool pool : m_free) {
+            vkDestroyDescriptorPool(m_device, pool, nullptr);
+        }
+    }
+
+    void DescriptorAllocator::begin_frame(uint32_t frame_slot) {
+        m_slot = frame_slot;
+        m_sets = 0;
+        // one reset per pool instead of freeing sets one by one
+        for (VkDescriptorPool pool : m_slots[m_slot]) {
+            check_vk(vkResetDescriptorPool(m_device, pool, 0));
+            m_free.push_back(pool);
+        }
+        m_slots[m_slot].clear();
+    }
+
+    VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const void* next) {
+        auto& pools = m_slots[m_slot];
+        if (pools.empty()) {
+            pools.push_back(take_pool());
+        }
+
+        VkDescriptorSetAllocateInfo allocate_info = {};
+        allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.pNext = next;
+        allocate_info.descriptorPool = pools.back();
+        allocate_info.descriptorSetCount = 1;
+        allocate_info.pSetLayouts = &layout;
+
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        VkResult result = vkAllocateDescriptorSets(m_device, &allocate_info, &set);
+        if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+            // the full pool stays with the slot until the slot is reset
+            pools.push_back(take_pool());
+            allocate_info.descriptorPool = pools.back();
+            result = vkAllocateDescriptorSets(m_device, &allocate_info, &set);
+        }
+        if (!check_vk(result)) {
+            return VK_NULL_HANDLE;
+        }
+        ++m_sets;
+        return set;
+    }
+
+    DescriptorAllocatorStats DescriptorAllocator::stats() const {
+        DescriptorAllocatorStats stats;
+        stats.pools = m_pools;
+        stats.sets = m_sets;
+        stats.grown = m_grown;
+        return stats;
+    }
+
+    VkDescriptorPool DescriptorAllocator::take_pool() {
+        if (!m_free.empty()) {
+            VkDescriptorPool pool = m_free.back();
+            m_free.pop_back();
+            return pool;
+        }
+
+        VkDescriptorPool pool = create_pool(m_next_pool_sets);
+        m_next_pool_sets = std::min(
+            static_cast<uint32_t>(std::ceil(m_next_pool_sets * m_params.growth)),
+            m_params.max_sets_per_pool
+        );
+        if (m_pools > 0) {
+            ++m_grown;
+        }
+        ++m_pools;
+        return pool;
+    }
+
+    VkDescriptorPool DescriptorAllocator::create_pool(uint32_t sets) {
+        std::vector<VkDescriptorPoolSize> sizes;
+        sizes.reserve(m_params.ratios.size());
+        for (const DescriptorPoolRatio& ratio : m_params.ratios) {
+            VkDescriptorPoolSize size = {};
+            size.type = ratio.type;
+            size.descriptorCount = std::max(1u, static_cast<uint32_t>(ratio.ratio * sets));
+            sizes.push_back(size);
+        }
+
+        VkDescriptorPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.pNext = nullptr;
+        pool_info.flags = 0;
+        pool_info.maxSets = sets;
+        pool_info.poolSizeCount = static_cast<uint32_t>(sizes.size());
+        pool_info.pPoolSizes = sizes.data();
+
+        VkDescriptorPool pool = VK_NULL_HANDLE;
+        check_vk(vkCreateDescriptorPool(m_device, &pool_info, nullptr, &pool));
+        return pool;
+    }
+
+    DescriptorWriter& DescriptorWriter::write_buffer(
+        uint32_t binding,
+        VkDescriptorType type,
+        VkBuffer buffer,
+        VkDeviceSize offset,
+        VkDeviceSize range,
+        uint32_t array_element
+    ) {
+        VkDescriptorBufferInfo info = {};
+        info.buffer = buffer;
+        info.offset = offset;
+        info.range = range;
+        m_buffers.push_back(info);
+
+        // the info pointers are filled in by update(), the vectors may still grow
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.pNext = nullptr;
+        write.dstBinding = binding;
+        write.dstArrayElement = array_element;
+        write.descriptorCount = 1;
+        write.descriptorType = type;
+        m_writes.push_back(write);
+        return *this;
+    }
+
+    DescriptorWriter& DescriptorWriter::write_image(
+        uint32_t binding,
+        VkDescriptorType type,
+        VkImageView view,
+        VkSampler sampler,
+        VkImageLayout layout,
+        uint32_t array_element
+    ) {
+        VkDescriptorImageInfo info = {};
+        info.sampler = sampler;
+        info.imageView = view;
+        info.imageLayout = layout;
+        m_images.push_back(info);
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.pNext = nullptr;
+        write.dstBinding = binding;
+        write.dstArrayElement = array_element;
+        write.descriptorCount = 1;
+        write.descriptorType = type;
+        // marks the write as an image write for update()
+        write.pImageInfo = &m_images.back();
+        m_writes.push_back(write);
+        return *this;
+    }
+
+    void DescriptorWriter::update(VkDevice device, VkDescriptorSet set) {
+        size_t buffer = 0;
+        size_t image = 0;
+        for (VkWriteDescriptorSet& write : m_writes) {
+            write.dstSet = set;
+            if (write.pImageInfo != nullptr) {
+                write.pImageInfo = &m_images[image++];
+            } else {
+                write.pBufferInfo = &m_buffers[buffer++];
+            }
+        }
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(m_writes.size()), m_writes.data(), 0, nullptr);
+        clear();
+    }
+
+    void DescriptorWriter::clear() {
+        m_writes.clear();
+        m_buffers.clear();
+        m_images.clear();
+    }
+
+    std::optional<VkPhysicalDeviceDescriptorIndexingFeaturesEXT> bindless_features(VkPhysicalDevice physical_device) {
+        if (!has_device_extension(physical_device, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+            return std::nullopt;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported = {};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        supported.pNext = nullptr;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &supported;
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        if (!supported.runtimeDescriptorArray
+            || !supported.descriptorBindingPartiallyBound
+            || !supported.descriptorBindingSampledImageUpdateAfterBind
+            || !supported.descriptorBindingStorageBufferUpdateAfterBind
+            || !supported.descriptorBindingUpdateUnusedWhilePending) {
+            return std::nullopt;
+        }
+
+        // only what the table uses, plus non-uniform indexing where available
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT enabled = {};
+        enabled.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        enabled.pNext = nullptr;
+        enabled.runtimeDescriptorArray = VK_TRUE;
+        enabled.descriptorBindingPartiallyBound = VK_TRUE;
+        enabled.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        enabled.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        enabled.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        enabled.shaderSampledImageArrayNonUniformIndexing = supported.shaderSampledImageArrayNonUniformIndexing;
+        enabled.shaderStorageBufferArrayNonUniformIndexing = supported.shaderStorageBufferArrayNonUniformIndexing;
+        return enabled;
+    }
+
+    BindlessParams::BindlessParams()
+    : max_textures(16384)
+    , max_buffers(16384)
+    {}
+
+    uint32_t BindlessTable::Array::acquire() {
+        uint32_t index = invalid_index;
+        if (!free.empty()) {
+            index = free.back();
+            free.pop_back();
+        } else if (next < capacity) {
+            index = next++;
+        } else {
+            return invalid_index;
+        }
+        ++used;
+        return index;
+    }
+
+    BindlessTable::BindlessTable(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        DescriptorLayoutCache& layouts,
+        const BindlessParams& params
+    )
+        : m_device(device)
+        , m_layouts(layouts) {
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT limits = {};
+        limits.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+        limits.pNext = nullptr;
+
+        VkPhysicalDeviceProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &limits;
+        vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+        // both arrays count against the per-stage resource limit
+        m_textures.capacity = std::min({
+            params.max_textures,
+            limits.maxDescriptorSetUpdateAfterBindSampledImages,
+            limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            limits.maxPerStageUpdateAfterBindResources / 2
+        });
+        m_buffers.capacity = std::min({
+            params.max_buffers,
+            limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+            limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+            limits.maxPerStageUpdateAfterBindResources - m_textures.capacity
+        });
+        m_textures.capacity = std::max(m_textures.capacity, 1u);
+        m_buffers.capacity = std::max(m_buffers.capacity, 1u);
+
+        VkDescriptorSetLayoutBinding bindings[2] = {};
+        bindings[0].binding = texture_binding;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = m_textures.capacity;
+        bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+        bindings[0].pImmutableSamplers = nullptr;
+        bindings[1].binding = buffer_binding;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[1].descriptorCount = m_buffers.capacity;
+        bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+        bindings[1].pImmutableSamplers = nullptr;
+
+        // entries nobody added are never written, and entries frames in flight
+        // do not use may change while those frames execute
+        const VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+            | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+            | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+        const VkDescriptorBindingFlags binding_flags[2] = { flags, flags };
+
+        m_set_layout = m_layouts.get(bindings, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT, binding_flags);
+
+        VkDescriptorPoolSize sizes[2] = {};
+        sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        sizes[0].descriptorCount = m_textures.capacity;
+        sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        sizes[1].descriptorCount = m_buffers.capacity;
+
+        VkDescriptorPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.pNext = nullptr;
+        pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        pool_info.maxSets = 1;
+        pool_info.poolSizeCount = 2;
+        pool_info.pPoolSizes = sizes;
+        check_vk(vkCreateDescriptorPool(m_device, &pool_info, nullptr, &m_pool));
+
+        VkDescriptorSetAllocateInfo allocate_info = {};
+        allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.pNext = nullptr;
+        allocate_info.descriptorPool = m_pool;
+        allocate_info.descriptorSetCount = 1;
+        allocate_info.pSetLayouts = &m_set_layout;
+        check_vk(vkAllocateDescriptorSets(m_device, &allocate_info, &m_set));
+
+        create_logger("render")->info(
+            "bindless descriptors: {} texture(s), {} storage buffer(s)",
+            m_textures.capacity,
+            m_buffers.capacity
+        );
+    }
+
+    BindlessTable::~BindlessTable() {
+        // frees the set as well; the layout belongs to the cache
+        vkDestroyDescriptorPool(m_device, m_pool, nullptr);
+    }
+
+    uint32_t BindlessTable::add_texture(VkImageView view, VkSampler sampler, VkImageLayout layout) {
+        const uint32_t index = m_textures.acquire();
+        if (index == invalid_index) {
+            ENGINE_LOG_LIMITED(create_logger("render"), ERROR, "bindless texture array is full ({})", m_textures.capacity);
+            return invalid_index;
+        }
+
+        VkDescriptorImageInfo info = {};
+        info.sampler = sampler;
+        info.imageView = view;
+        info.imageLayout = layout;
+        write(texture_binding, index, &info, nullptr);
+        return index;
+    }
+
+    uint32_t BindlessTable::add_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+        const uint32_t index = m_buffers.acquire();
+        if (index == invalid_index) {
+            ENGINE_LOG_LIMITED(create_logger("render"), ERROR, "bindless buffer array is full ({})", m_buffers.capacity);
+            return invalid_index;
+        }
+
+        VkDescriptorBufferInfo info = {};
+        info.buffer = buffer;
+        info.offset = offset;
+        info.range = range;
+        write(buffer_binding, index, nullptr, &info);
+        return index;
+    }
+
+    void BindlessTable::remove_texture(uint32_t index, uint64_t frame_number) {
+        release(m_textures, index, frame_number);
+    }
+
+    void BindlessTable::remove_buffer(uint32_t index, uint64_t frame_number) {
+        release(m_buffers, index, frame_number);
+    }
+
+    void BindlessTable::begin_frame(uint64_t completed_frames) {
+        // removals come in frame order
+        while (!m_releases.empty() && m_releases.front().frame < completed_frames) {
+            const Release& release = m_releases.front();
+            release.array->free.push_back(release.index);
+            m_releases.pop_front();
+        }
+    }
+
+    void BindlessTable::bind(
+        VkCommandBuffer cmd,
+        VkPipelineBindPoint bind_point,
+        VkPipelineLayout layout,
+        uint32_t set
+    ) const {
+        vkCmdBindDescriptorSets(cmd, bind_point, layout, set, 1, &m_set, 0, nullptr);
+    }
+
+    VkPipelineLayout BindlessTable::pipeline_layout(uint32_t push_constant_size, VkShaderStageFlags stages) {
+        VkPushConstantRange range = {};
+        range.stageFlags = stages;
+        range.offset = 0;
+        range.size = push_constant_size;
+
+        return m_layouts.pipeline_layout(
+            std::span(&m_set_layout, 1),
+            std::span(&range, push_constant_size > 0 ? 1 : 0)
+        );
+    }
+
+    void BindlessTable::write(
+        uint32_t binding,
+        uint32_t index,
+        const VkDescriptorImageInfo* image,
+        const VkDescriptorBufferInfo* buffer
+    ) {
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.pNext = nullptr;
+        write.dstSet = m_set;
+        write.dstBinding = binding;
+        write.dstArrayElement = index;
+        write.descriptorCount = 1;
+        write.descriptorType = image != nullptr ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pImageInfo = image;
+        write.pBufferInfo = buffer;
+        vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+    }
+
+    void BindlessTable::release(Array& array, uint32_t index, uint64_t frame_number) {
+        if (index == invalid_index) {
+            return;
+        }
+        --array.used;
+        m_releases.push_back({ frame_number, &array, index });
+    }
+}
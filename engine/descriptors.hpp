@@ -0,0 +1,261 @@
+#pragma once
+
+#include "shader_library.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+
+namespace engine {
+
+    // One VkDescriptorSetLayout per distinct set of bindings and one
+    // VkPipelineLayout per distinct combination of set layouts and push
+    // constants, both keyed by a hash of their contents. Everything lives as
+    // long as the cache. Thread safe.
+    class DescriptorLayoutCache {
+    public:
+        explicit DescriptorLayoutCache(VkDevice device);
+        ~DescriptorLayoutCache();
+
+        DescriptorLayoutCache(const DescriptorLayoutCache&) = delete;
+        DescriptorLayoutCache& operator=(const DescriptorLayoutCache&) = delete;
+
+        // Bindings may come in any order. binding_flags is empty or has one
+        // entry per binding and is chained as VkDescriptorSetLayoutBindingFlagsCreateInfo.
+        VkDescriptorSetLayout get(
+            std::span<const VkDescriptorSetLayoutBinding> bindings,
+            VkDescriptorSetLayoutCreateFlags flags = 0,
+            std::span<const VkDescriptorBindingFlags> binding_flags = {}
+        );
+        // the bindings the shaders reflect for `set`, with the stages of all of
+        // them; buffers at `dynamic_bindings` are bound with a dynamic offset
+        VkDescriptorSetLayout get(
+            std::span<const ShaderReflection* const> shaders,
+            uint32_t set,
+            std::span<const uint32_t> dynamic_bindings = {}
+        );
+
+        VkPipelineLayout pipeline_layout(
+            std::span<const VkDescriptorSetLayout> set_layouts,
+            std::span<const VkPushConstantRange> push_constants = {}
+        );
+
+    private:
+        VkDevice m_device;
+
+        std::mutex m_mutex;
+        std::unordered_map<uint64_t, VkDescriptorSetLayout> m_set_layouts;
+        std::unordered_map<uint64_t, VkPipelineLayout> m_pipeline_layouts;
+    };
+
+    struct DescriptorPoolRatio {
+        VkDescriptorType type;
+        // descriptors of this type per set
+        float ratio;
+    };
+
+    struct DescriptorAllocatorParams {
+        DescriptorAllocatorParams();
+
+        // sets in the first pool; each new pool holds `growth` times as many
+        // as the previous one, up to max_sets_per_pool
+        uint32_t initial_sets;
+        float growth;
+        uint32_t max_sets_per_pool;
+
+        std::vector<DescriptorPoolRatio> ratios;
+    };
+
+    struct DescriptorAllocatorStats {
+        uint32_t pools = 0;
+        // sets allocated since the current slot began
+        uint32_t sets = 0;
+        // pools created after the first one because the others were full
+        uint32_t grown = 0;
+    };
+
+    // Descriptor sets that live for one frame. Every frame slot keeps the pools
+    // it allocated from and resets them all at once when the slot comes around
+    // again; reset pools go back to a shared free list. A full pool is replaced
+    // by one from the free list or by a new, larger one, so the allocator
+    // grows to the busiest frame and then stops creating pools.
+    // Not thread safe: give every recording thread its own.
+    class DescriptorAllocator {
+    public:
+        DescriptorAllocator(
+            VkDevice device,
+            uint32_t frame_slots,
+            const DescriptorAllocatorParams& params = DescriptorAllocatorParams()
+        );
+        ~DescriptorAllocator();
+
+        DescriptorAllocator(const DescriptorAllocator&) = delete;
+        DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+        // call once the slot's fence has signalled
+        void begin_frame(uint32_t frame_slot);
+
+        // VK_NULL_HANDLE only if even a new pool cannot hold the layout
+        VkDescriptorSet allocate(VkDescriptorSetLayout layout, const void* next = nullptr);
+
+        DescriptorAllocatorStats stats() const;
+
+    private:
+        VkDescriptorPool take_pool();
+        VkDescriptorPool create_pool(uint32_t sets);
+
+    private:
+        VkDevice m_device;
+        DescriptorAllocatorParams m_params;
+
+        // pools used by each slot, the one allocated from last
+        std::vector<std::vector<VkDescriptorPool>> m_slots;
+        std::vector<VkDescriptorPool> m_free;
+        uint32_t m_slot = 0;
+        uint32_t m_next_pool_sets;
+
+        uint32_t m_pools = 0;
+        uint32_t m_sets = 0;
+        uint32_t m_grown = 0;
+    };
+
+    // Collects writes for one set and applies them in a single
+    // vkUpdateDescriptorSets call.
+    class DescriptorWriter {
+    public:
+        DescriptorWriter& write_buffer(
+            uint32_t binding,
+            VkDescriptorType type,
+            VkBuffer buffer,
+            VkDeviceSize offset = 0,
+            VkDeviceSize range = VK_WHOLE_SIZE,
+            uint32_t array_element = 0
+        );
+        DescriptorWriter& write_image(
+            uint32_t binding,
+            VkDescriptorType type,
+            VkImageView view,
+            VkSampler sampler,
+            VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            uint32_t array_element = 0
+        );
+
+        // applies and forgets the writes
+        void update(VkDevice device, VkDescriptorSet set);
+        void clear();
+
+    private:
+        std::vector<VkWriteDescriptorSet> m_writes;
+        std::vector<VkDescriptorBufferInfo> m_buffers;
+        std::vector<VkDescriptorImageInfo> m_images;
+    };
+
+    // The descriptor indexing features a BindlessTable needs, or nothing if the
+    // device lacks one of them. Chain the result into device creation.
+    std::optional<VkPhysicalDeviceDescriptorIndexingFeaturesEXT> bindless_features(VkPhysicalDevice physical_device);
+
+    struct BindlessParams {
+        BindlessParams();
+
+        // array sizes, clamped to the device's update-after-bind limits
+        uint32_t max_textures;
+        uint32_t max_buffers;
+    };
+
+    // One descriptor set for the whole frame with update-after-bind arrays of
+    // every texture and storage buffer. It is bound once per pass and draws
+    // select their resources by index through push constants, so there are
+    // no per-draw allocations, writes or binds. Shaders declare it as
+    //
+    //   layout(set = 0, binding = 0) uniform sampler2D textures[];
+    //   layout(set = 0, binding = 1) readonly buffer Buffers { uint data[]; } buffers[];
+    //
+    // Adding a resource writes its descriptor right away, which is allowed
+    // while the set is in use by earlier frames because unused slots may
+    // change; removed indices are reused once those frames have completed.
+    class BindlessTable {
+    public:
+        BindlessTable(
+            VkPhysicalDevice physical_device,
+            VkDevice device,
+            DescriptorLayoutCache& layouts,
+            const BindlessParams& params = BindlessParams()
+        );
+        ~BindlessTable();
+
+        BindlessTable(const BindlessTable&) = delete;
+        BindlessTable& operator=(const BindlessTable&) = delete;
+
+        // invalid_index when the array is full
+        uint32_t add_texture(
+            VkImageView view,
+            VkSampler sampler,
+            VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        );
+        uint32_t add_buffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+        // frames up to `frame_number` may still read the index
+        void remove_texture(uint32_t index, uint64_t frame_number);
+        void remove_buffer(uint32_t index, uint64_t frame_number);
+
+        // hands the removed indices of completed frames out again
+        void begin_frame(uint64_t completed_frames);
+
+        void bind(
+            VkCommandBuffer cmd,
+            VkPipelineBindPoint bind_point,
+            VkPipelineLayout layout,
+            uint32_t set = 0
+        ) const;
+
+        VkDescriptorSetLayout set_layout() const { return m_set_layout; }
+        // the table as set 0 and `push_constant_size` bytes for the indices
+        VkPipelineLayout pipeline_layout(uint32_t push_constant_size, VkShaderStageFlags stages = VK_SHADER_STAGE_ALL);
+
+        uint32_t texture_count() const { return m_textures.used; }
+        uint32_t buffer_count() const { return m_buffers.used; }
+
+        static constexpr uint32_t texture_binding = 0;
+        static constexpr uint32_t buffer_binding = 1;
+        static constexpr uint32_t invalid_index = ~0u;
+
+    private:
+        struct Array {
+            uint32_t capacity = 0;
+            // never handed out so far
+            uint32_t next = 0;
+            uint32_t used = 0;
+            std::vector<uint32_t> free;
+
+            uint32_t acquire();
+        };
+
+        struct Release {
+            uint64_t frame;
+            Array* array;
+            uint32_t index;
+        };
+
+        void write(uint32_t binding, uint32_t index, const VkDescriptorImageInfo* image, const VkDescriptorBufferInfo* buffer);
+        void release(Array& array, uint32_t index, uint64_t frame_number);
+
+    private:
+        VkDevice m_device;
+        DescriptorLayoutCache& m_layouts;
+
+        VkDescriptorSetLayout m_set_layout = VK_NULL_HANDLE;
+        VkDescriptorPool m_pool = VK_NULL_HANDLE;
+        VkDescriptorSet m_set = VK_NULL_HANDLE;
+
+        Array m_textures;
+        Array m_buffers;
+        std::deque<Release> m_releases;
+    };
+}
@@ -0,0 +1,370 @@
+#include "draw_list.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ENGINE_CULL_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ENGINE_CULL_SSE2 1
+#endif
+
+
+namespace engine {
+
+    namespace {
+
+        using clock = std::chrono::steady_clock;
+
+        constexpr uint32_t lanes = 8;
+
+        uint32_t padded(uint32_t count) {
+            return (count + lanes - 1) & ~(lanes - 1);
+        }
+
+        uint64_t field(uint32_t value, uint32_t bits) {
+            return value & ((uint64_t(1) << bits) - 1);
+        }
+
+        // positive floats order like their bit patterns, the top bits are a
+        // logarithmic depth for free
+        uint32_t quantise_depth(float depth) {
+            const float clamped = depth > 0.0f ? depth : 0.0f;
+            return std::bit_cast<uint32_t>(clamped) >> (32 - draw_key_depth_bits);
+        }
+
+        glm::vec4 row(const glm::mat4& matrix, int r) {
+            return glm::vec4(matrix[0][r], matrix[1][r], matrix[2][r], matrix[3][r]);
+        }
+
+        glm::vec4 normalise_plane(const glm::vec4& plane) {
+            const float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            return length > 0.0f ? plane / length : plane;
+        }
+    }
+
+    uint64_t make_draw_key(DrawPass pass, uint32_t pipeline, uint32_t material, float depth) {
+        const uint64_t pass_bits = field(static_cast<uint32_t>(pass), draw_key_pass_bits);
+        const uint64_t depth_bits = quantise_depth(depth);
+        const uint32_t state_bits = draw_key_pipeline_bits + draw_key_material_bits;
+        const uint64_t state = (field(pipeline, draw_key_pipeline_bits) << draw_key_material_bits)
+            | field(material, draw_key_material_bits);
+
+        if (pass == DrawPass::blended) {
+            const uint64_t far_first = field(~static_cast<uint32_t>(depth_bits), draw_key_depth_bits);
+            return (pass_bits << 60) | (far_first << state_bits) | state;
+        }
+        return (pass_bits << 60) | (state << draw_key_depth_bits) | depth_bits;
+    }
+
+    DrawListParams::DrawListParams()
+    : batch_size(4096)
+    {}
+
+    DrawList::DrawList(const DrawListParams& params)
+        : m_params(params) {
+        m_params.batch_size = padded(std::max(m_params.batch_size, lanes));
+    }
+
+    void DrawList::clear() {
+        m_x.clear();
+        m_y.clear();
+        m_z.clear();
+        m_radius.clear();
+        m_pass.clear();
+        m_pipeline.clear();
+        m_material.clear();
+        m_count = 0;
+        m_commands.clear();
+    }
+
+    void DrawList::reserve(uint32_t count) {
+        const uint32_t lanes_needed = padded(count);
+        m_x.reserve(lanes_needed);
+        m_y.reserve(lanes_needed);
+        m_z.reserve(lanes_needed);
+        m_radius.reserve(lanes_needed);
+        m_pass.reserve(count);
+        m_pipeline.reserve(count);
+        m_material.reserve(count);
+    }
+
+    uint32_t DrawList::add(const glm::vec4& sphere, DrawPass pass, uint32_t pipeline, uint32_t material) {
+        const uint32_t object = m_count++;
+        if (m_x.size() < padded(m_count)) {
+            // the padding lanes are never reported, whatever they hold
+            const size_t size = padded(m_count);
+            m_x.resize(size, 0.0f);
+            m_y.resize(size, 0.0f);
+            m_z.resize(size, 0.0f);
+            m_radius.resize(size, 0.0f);
+        }
+        m_pass.push_back(pass);
+        m_pipeline.push_back(pipeline);
+        m_material.push_back(material);
+        set_bounds(object, sphere);
+        return object;
+    }
+
+    void DrawList::set_bounds(uint32_t object, const glm::vec4& sphere) {
+        m_x[object] = sphere.x;
+        m_y[object] = sphere.y;
+        m_z[object] = sphere.z;
+        m_radius[object] = sphere.w;
+    }
+
+    void DrawList::build(const glm::mat4& view_projection, JobSystem* jobs) {
+        ENGINE_PROFILE_ZONE("draw list");
+        const auto cull_start = clock::now();
+
+        // Gribb-Hartmann; clip space depth is 0..w, so the near plane is the third row alone
+        const glm::vec4 x = row(view_projection, 0);
+        const glm::vec4 y = row(view_projection, 1);
+        const glm::vec4 z = row(view_projection, 2);
+        const glm::vec4 w = row(view_projection, 3);
+        m_planes = {
+            normalise_plane(w + x),
+            normalise_plane(w - x),
+            normalise_plane(w + y),
+            normalise_plane(w - y),
+            normalise_plane(z),
+            normalise_plane(w - z),
+        };
+        m_depth_row = w;
+
+        const uint32_t chunk_count = (m_count + m_params.batch_size - 1) / m_params.batch_size;
+        if (m_chunks.size() < chunk_count) {
+            m_chunks.resize(chunk_count);
+        }
+        if (jobs == nullptr || jobs->thread_count() == 1 || chunk_count < 2) {
+            for (uint32_t chunk = 0; chunk < chunk_count; ++chunk) {
+                const uint32_t begin = chunk * m_params.batch_size;
+                cull_range(begin, std::min(m_count, begin + m_params.batch_size), m_chunks[chunk]);
+            }
+        } else {
+            jobs->parallel_for(m_count, m_params.batch_size, [&](uint32_t begin, uint32_t end, uint32_t) {
+                cull_range(begin, end, m_chunks[begin / m_params.batch_size]);
+            });
+        }
+
+        size_t visible = 0;
+        for (uint32_t chunk = 0; chunk < chunk_count; ++chunk) {
+            visible += m_chunks[chunk].size();
+        }
+        m_commands.resize(visible);
+        size_t offset = 0;
+        for (uint32_t chunk = 0; chunk < chunk_count; ++chunk) {
+            std::copy(m_chunks[chunk].begin(), m_chunks[chunk].end(), m_commands.begin() + offset);
+            offset += m_chunks[chunk].size();
+        }
+
+        const auto sort_start = clock::now();
+        m_cull_ms = std::chrono::duration<double, std::milli>(sort_start - cull_start).count();
+        sort();
+        m_sort_ms = std::chrono::duration<double, std::milli>(clock::now() - sort_start).count();
+
+        m_binds.store(0, std::memory_order_relaxed);
+        m_binds_saved.store(0, std::memory_order_relaxed);
+    }
+
+    void DrawList::cull_range(uint32_t begin, uint32_t end, std::vector<DrawCommand>& out) const {
+        out.clear();
+
+        const auto emit = [&](uint32_t object) {
+            const float depth = m_depth_row.x * m_x[object]
+                + m_depth_row.y * m_y[object]
+                + m_depth_row.z * m_z[object]
+                + m_depth_row.w;
+            DrawCommand command = {};
+            command.key = make_draw_key(m_pass[object], m_pipeline[object], m_material[object], depth);
+            command.object = object;
+            out.push_back(command);
+        };
+
+        // begin is a multiple of 8, the arrays are padded past end
+#if defined(ENGINE_CULL_AVX2)
+        for (uint32_t base = begin; base < end; base += 8) {
+            const __m256 cx = _mm256_loadu_ps(&m_x[base]);
+            const __m256 cy = _mm256_loadu_ps(&m_y[base]);
+            const __m256 cz = _mm256_loadu_ps(&m_z[base]);
+            const __m256 radius = _mm256_loadu_ps(&m_radius[base]);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (const glm::vec4& plane : m_planes) {
+                __m256 distance = _mm256_add_ps(_mm256_set1_ps(plane.w), radius);
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.x), cx));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.y), cy));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.z), cz));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+            }
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+            while (mask != 0) {
+                const uint32_t object = base + std::countr_zero(mask);
+                mask &= mask - 1;
+                if (object >= end) {
+                    break;
+                }
+                emit(object);
+            }
+        }
+#elif defined(ENGINE_CULL_SSE2)
+        for (uint32_t base = begin; base < end; base += 4) {
+            const __m128 cx = _mm_loadu_ps(&m_x[base]);
+            const __m128 cy = _mm_loadu_ps(&m_y[base]);
+            const __m128 cz = _mm_loadu_ps(&m_z[base]);
+            const __m128 radius = _mm_loadu_ps(&m_radius[base]);
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (const glm::vec4& plane : m_planes) {
+                __m128 distance = _mm_add_ps(_mm_set1_ps(plane.w), radius);
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.x), cx));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), cy));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), cz));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+            }
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+            while (mask != 0) {
+                const uint32_t object = base + std::countr_zero(mask);
+                mask &= mask - 1;
+                if (object >= end) {
+                    break;
+                }
+                emit(object);
+            }
+        }
+#else
+        for (uint32_t object = begin; object < end; ++object) {
+            bool inside = true;
+            for (const glm::vec4& plane : m_planes) {
+                const float distance = plane.x * m_x[object]
+                    + plane.y * m_y[object]
+                    + plane.z * m_z[object]
+                    + plane.w
+                    + m_radius[object];
+                inside = inside && distance >= 0.0f;
+            }
+            if (inside) {
+                emit(object);
+            }
+        }
+#endif
+    }
+
+    // LSD radix sort, a byte per pass. All eight histograms come from one
+    // read of the keys, and bytes every key shares (the pass, the high
+    // pipeline bits) cost nothing. Stable, so equal keys keep object order.
+    void DrawList::sort() {
+        m_skipped_passes = 0;
+        const size_t count = m_commands.size();
+        if (count < 2) {
+            return;
+        }
+
+        std::array<std::array<uint32_t, 256>, 8> histograms = {};
+        for (const DrawCommand& command : m_commands) {
+            for (uint32_t byte = 0; byte < 8; ++byte) {
+                ++histograms[byte][(command.key >> (byte * 8)) & 0xff];
+            }
+        }
+
+        m_scratch.resize(count);
+        DrawCommand* source = m_commands.data();
+        DrawCommand* destination = m_scratch.data();
+        for (uint32_t byte = 0; byte < 8; ++byte) {
+            std::array<uint32_t, 256>& histogram = histograms[byte];
+            const uint32_t shift = byte * 8;
+            if (histogram[(source[0].key >> shift) & 0xff] == count) {
+                ++m_skipped_passes;
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for (uint32_t& bucket : histogram) {
+                const uint32_t size = bucket;
+                bucket = offset;
+                offset += size;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                destination[histogram[(source[i].key >> shift) & 0xff]++] = source[i];
+            }
+            std::swap(source, destination);
+        }
+
+        if (source != m_commands.data()) {
+            std::memcpy(m_commands.data(), source, count * sizeof(DrawCommand));
+        }
+    }
+
+    void DrawList::add_binds(uint64_t binds, uint64_t saved) {
+        m_binds.fetch_add(binds, std::memory_order_relaxed);
+        m_binds_saved.fetch_add(saved, std::memory_order_relaxed);
+    }
+
+    DrawListStats DrawList::stats() const {
+        DrawListStats stats;
+        stats.objects = m_count;
+        stats.visible = static_cast<uint32_t>(m_commands.size());
+        stats.cull_ms = m_cull_ms;
+        stats.sort_ms = m_sort_ms;
+        stats.skipped_passes = m_skipped_passes;
+        stats.binds = m_binds.load(std::memory_order_relaxed);
+        stats.binds_saved = m_binds_saved.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // BindFilter
+
+    void BindFilter::bind_pipeline(VkPipeline pipeline) {
+        if (pipeline == m_pipeline) {
+            ++m_saved;
+            return;
+        }
+        vkCmdBindPipeline(m_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        m_pipeline = pipeline;
+        ++m_binds;
+    }
+
+    void BindFilter::bind_descriptor_set(VkPipelineLayout layout, uint32_t set, VkDescriptorSet descriptor_set) {
+        if (layout != m_layout) {
+            // sets bound with another layout may not be compatible
+            m_sets = {};
+            m_layout = layout;
+        }
+        if (set < max_sets && m_sets[set] == descriptor_set) {
+            ++m_saved;
+            return;
+        }
+        vkCmdBindDescriptorSets(m_cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, set, 1, &descriptor_set, 0, nullptr);
+        if (set < max_sets) {
+            m_sets[set] = descriptor_set;
+        }
+        ++m_binds;
+    }
+
+    void BindFilter::bind_vertex_buffer(VkBuffer buffer, VkDeviceSize offset) {
+        if (buffer == m_vertex_buffer && offset == m_vertex_offset) {
+            ++m_saved;
+            return;
+        }
+        vkCmdBindVertexBuffers(m_cmd, 0, 1, &buffer, &offset);
+        m_vertex_buffer = buffer;
+        m_vertex_offset = offset;
+        ++m_binds;
+    }
+
+    void BindFilter::bind_index_buffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType type) {
+        if (buffer == m_index_buffer && offset == m_index_offset && type == m_index_type) {
+            ++m_saved;
+            return;
+        }
+        vkCmdBindIndexBuffer(m_cmd, buffer, offset, type);
+        m_index_buffer = buffer;
+        m_index_offset = offset;
+        m_index_type = type;
+        ++m_binds;
+    }
+}
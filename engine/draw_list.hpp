@@ -0,0 +1,167 @@
+#pragma once
+
+#include "job_system.hpp"
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+namespace engine {
+
+    // Order the passes are drawn in: opaque first and front to back so the
+    // depth test rejects as much as possible, blended last and back to front.
+    enum class DrawPass : uint8_t {
+        opaque,
+        masked,
+        blended,
+    };
+
+    // Bits of a sort key from the top. Opaque and masked draws sort by
+    // pass, pipeline, material, then depth; blended ones by pass, then
+    // depth from far to near, then pipeline and material.
+    constexpr uint32_t draw_key_pass_bits = 4;
+    constexpr uint32_t draw_key_pipeline_bits = 16;
+    constexpr uint32_t draw_key_material_bits = 20;
+    constexpr uint32_t draw_key_depth_bits = 24;
+
+    // `depth` is the distance along the view direction; negative values
+    // count as 0. Pipelines and materials are truncated to their bits.
+    uint64_t make_draw_key(DrawPass pass, uint32_t pipeline, uint32_t material, float depth);
+
+    struct DrawCommand {
+        uint64_t key;
+        uint32_t object;
+        uint32_t padding;
+    };
+
+    struct DrawListParams {
+        DrawListParams();
+
+        // objects culled per job, rounded up to a multiple of 8; smaller
+        // lists are culled inline
+        uint32_t batch_size;
+    };
+
+    struct DrawListStats {
+        uint32_t objects = 0;
+        // of the last build()
+        uint32_t visible = 0;
+        double cull_ms = 0.0;
+        double sort_ms = 0.0;
+        // byte positions the radix sort skipped because all keys agreed
+        uint32_t skipped_passes = 0;
+        // recorded against the last build(), summed over every BindFilter
+        // passed to add_binds()
+        uint64_t binds = 0;
+        uint64_t binds_saved = 0;
+    };
+
+    // CPU draw list: bounding spheres in structure of arrays layout, culled
+    // against the view frustum four or eight at a time (SSE2, or AVX2 with
+    // ENGINE_ENABLE_AVX2) across the job system, then the survivors radix
+    // sorted by a 64-bit key so draws sharing a pipeline and material end up
+    // next to each other and BindFilter can drop the repeated binds.
+    //
+    // Objects keep their index until clear(); only the bounds are expected
+    // to change from frame to frame.
+    class DrawList {
+    public:
+        explicit DrawList(const DrawListParams& params = DrawListParams());
+
+        void clear();
+        void reserve(uint32_t count);
+        // `sphere` is centre and radius in world space; returns the object's index
+        uint32_t add(const glm::vec4& sphere, DrawPass pass, uint32_t pipeline, uint32_t material);
+        void set_bounds(uint32_t object, const glm::vec4& sphere);
+        uint32_t object_count() const { return m_count; }
+
+        uint32_t pipeline(uint32_t object) const { return m_pipeline[object]; }
+        uint32_t material(uint32_t object) const { return m_material[object]; }
+
+        // Culls with the frustum of `view_projection` (Vulkan's 0..1 clip
+        // depth) and sorts what is left; the calling thread has to be the
+        // job system's submitting thread, `jobs` may be null to run inline.
+        void build(const glm::mat4& view_projection, JobSystem* jobs = nullptr);
+
+        // visible objects in draw order, until the next build()
+        std::span<const DrawCommand> commands() const { return m_commands; }
+
+        // thread safe, for the recording threads
+        void add_binds(uint64_t binds, uint64_t saved);
+
+        DrawListStats stats() const;
+
+    private:
+        // culls objects [begin, end) into `out`
+        void cull_range(uint32_t begin, uint32_t end, std::vector<DrawCommand>& out) const;
+        void sort();
+
+    private:
+        DrawListParams m_params;
+
+        // padded to a multiple of 8 objects so the SIMD loops need no tail
+        std::vector<float> m_x;
+        std::vector<float> m_y;
+        std::vector<float> m_z;
+        std::vector<float> m_radius;
+        std::vector<DrawPass> m_pass;
+        std::vector<uint32_t> m_pipeline;
+        std::vector<uint32_t> m_material;
+        uint32_t m_count = 0;
+
+        // of the last build(): normalised planes, then the row giving view depth
+        std::array<glm::vec4, 6> m_planes = {};
+        glm::vec4 m_depth_row = glm::vec4(0.0f);
+
+        // one per cull job, so the output order does not depend on the threads
+        std::vector<std::vector<DrawCommand>> m_chunks;
+        std::vector<DrawCommand> m_commands;
+        std::vector<DrawCommand> m_scratch;
+
+        double m_cull_ms = 0.0;
+        double m_sort_ms = 0.0;
+        uint32_t m_skipped_passes = 0;
+        std::atomic<uint64_t> m_binds = 0;
+        std::atomic<uint64_t> m_binds_saved = 0;
+    };
+
+    // Drops binds of state the command buffer already has bound. One per
+    // command buffer: a secondary starts with nothing bound, so every
+    // recording batch makes its own. Binding a pipeline keeps the
+    // descriptor sets, which stay valid for pipelines with compatible layouts.
+    class BindFilter {
+    public:
+        explicit BindFilter(VkCommandBuffer cmd)
+            : m_cmd(cmd) {}
+
+        void bind_pipeline(VkPipeline pipeline);
+        void bind_descriptor_set(VkPipelineLayout layout, uint32_t set, VkDescriptorSet descriptor_set);
+        void bind_vertex_buffer(VkBuffer buffer, VkDeviceSize offset = 0);
+        void bind_index_buffer(VkBuffer buffer, VkDeviceSize offset = 0, VkIndexType type = VK_INDEX_TYPE_UINT32);
+
+        uint64_t binds() const { return m_binds; }
+        uint64_t saved() const { return m_saved; }
+
+    private:
+        static constexpr uint32_t max_sets = 4;
+
+        VkCommandBuffer m_cmd;
+        VkPipeline m_pipeline = VK_NULL_HANDLE;
+        VkPipelineLayout m_layout = VK_NULL_HANDLE;
+        std::array<VkDescriptorSet, max_sets> m_sets = {};
+        VkBuffer m_vertex_buffer = VK_NULL_HANDLE;
+        VkDeviceSize m_vertex_offset = 0;
+        VkBuffer m_index_buffer = VK_NULL_HANDLE;
+        VkDeviceSize m_index_offset = 0;
+        VkIndexType m_index_type = VK_INDEX_TYPE_UINT32;
+
+        uint64_t m_binds = 0;
+        uint64_t m_saved = 0;
+    };
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "allocator.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+
+namespace engine {
+
+    // Engine-owned render target used instead of a swapchain image in headless
+    // mode, plus the host-visible buffer its contents are copied into.
+    struct OffscreenTarget {
+        Image image;
+        VkImageView image_view = VK_NULL_HANDLE;
+
+        // persistently mapped, from the readback pool
+        Buffer readback_buffer;
+
+        // set when a copy was submitted and the result was not handed out yet
+        bool readback_pending = false;
+    };
+
+    // Everything the CPU touches while recording one frame. The renderer keeps
+    // a ring of these, so frame N+1 can be recorded while the GPU still works
+    // on frame N. Transient per-frame resources belong here as well: they are
+    // only reused after the slot's fence has signalled.
+    struct FrameContext {
+        VkCommandPool command_pool = VK_NULL_HANDLE;
+        VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+
+        // signalled by the acquire; the render semaphores the present waits
+        // on belong to the swapchain images, see Renderer
+        VkSemaphore present_semaphore = VK_NULL_HANDLE;
+        VkFence render_fence = VK_NULL_HANDLE;
+
+        // only used in headless mode
+        OffscreenTarget offscreen;
+
+        // frame number that was last submitted from this slot
+        uint64_t submitted_frame = 0;
+        bool submitted = false;
+        // profiler::now_ns() time the submitted frame's input was sampled
+        uint64_t input_ns = 0;
+    };
+
+    // CPU side timings, averaged over the last reporting window.
+    struct FrameStats {
+        uint32_t frames_in_flight = 0;
+        uint64_t frame_count = 0;
+        VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        bool low_latency = false;
+
+        // time between two consecutive render() calls
+        double frame_ms = 0.0;
+        // time render() spent blocked on the slot fence
+        double fence_wait_ms = 0.0;
+        // time render() spent doing actual work (acquire, record, submit, present)
+        double cpu_ms = 0.0;
+        // parts of cpu_ms: waiting for the swapchain image, recording the
+        // render graph's passes, and submitting plus presenting
+        double acquire_ms = 0.0;
+        double record_ms = 0.0;
+        double submit_ms = 0.0;
+        // part of cpu_ms: culling and sorting the draw list, before recording
+        double draw_list_ms = 0.0;
+        // per frame: draws left after culling, and pipeline and descriptor
+        // binds the recording threads skipped because they were redundant
+        double draws = 0.0;
+        double binds_saved = 0.0;
+        // GPU time of the frame's command buffer, 0 without timestamp support
+        // or with profiling compiled out
+        double gpu_ms = 0.0;
+        // low latency mode: how long the frame start was delayed to sample
+        // input closer to the vblank
+        double pacing_ms = 0.0;
+        // from sampling input to the end of the frame's GPU work, 0 without
+        // GPU timestamps. Scan out adds the time the image waits for its
+        // vblank, which the swapchain does not report.
+        double latency_ms = 0.0;
+
+        // share of the frame the CPU was not waiting for the GPU, in [0, 1].
+        // With a single frame in flight this is roughly cpu / (cpu + gpu),
+        // with more frames it approaches 1 as long as the GPU keeps up.
+        double overlap() const {
+            return frame_ms > 0.0 ? 1.0 - fence_wait_ms / frame_ms : 0.0;
+        }
+    };
+}
@@ -0,0 +1,78 @@
+#include "frame_pacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace engine {
+
+    FramePacerParams::FramePacerParams()
+    : margin(2000)
+    , smoothing(0.1f)
+    , vblank_threshold(500)
+    {}
+
+    FramePacer::FramePacer(const FramePacerParams& params)
+        : m_params(params) {
+        m_params.smoothing = std::clamp(m_params.smoothing, 0.01f, 1.0f);
+    }
+
+    void FramePacer::set_refresh_interval(uint64_t interval_ns) {
+        m_interval_ns = interval_ns;
+        m_vblank_ns = 0;
+    }
+
+    void FramePacer::on_acquire(uint64_t begin_ns, uint64_t end_ns) {
+        const uint64_t threshold = std::chrono::nanoseconds(m_params.vblank_threshold).count();
+        if (end_ns - begin_ns < threshold) {
+            return;
+        }
+
+        // The display's nominal rate is rounded to whole hertz; whole
+        // intervals between two vblanks correct it, so the predicted phase
+        // drifts less while acquires do not block.
+        if (m_vblank_ns != 0 && m_interval_ns != 0) {
+            const double elapsed = static_cast<double>(end_ns - m_vblank_ns);
+            const double intervals = std::round(elapsed / m_interval_ns);
+            if (intervals >= 1.0 && intervals <= 120.0) {
+                const double measured = elapsed / intervals;
+                if (std::abs(measured - m_interval_ns) < m_interval_ns * 0.02) {
+                    m_interval_ns = static_cast<uint64_t>(m_interval_ns + (measured - m_interval_ns) * m_params.smoothing);
+                }
+            }
+        }
+        m_vblank_ns = end_ns;
+    }
+
+    void FramePacer::on_frame_work(uint64_t work_ns) {
+        if (m_work_ns == 0.0) {
+            m_work_ns = static_cast<double>(work_ns);
+            return;
+        }
+        // spikes count fully, so one slow frame does not make the next one late
+        m_work_ns = std::max(
+            static_cast<double>(work_ns),
+            m_work_ns + (work_ns - m_work_ns) * m_params.smoothing
+        );
+    }
+
+    uint64_t FramePacer::delay_ns(uint64_t now_ns) const {
+        if (m_interval_ns == 0 || m_vblank_ns == 0 || now_ns < m_vblank_ns) {
+            return 0;
+        }
+
+        const uint64_t budget = static_cast<uint64_t>(m_work_ns)
+            + std::chrono::nanoseconds(m_params.margin).count();
+        if (budget >= m_interval_ns) {
+            return 0;
+        }
+
+        // the first vblank ahead of now that the work still fits in front of
+        const uint64_t intervals = (now_ns - m_vblank_ns) / m_interval_ns + 1;
+        uint64_t start = m_vblank_ns + intervals * m_interval_ns - budget;
+        if (start < now_ns) {
+            start += m_interval_ns;
+        }
+        return start - now_ns;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+
+namespace engine {
+
+    struct FramePacerParams {
+        FramePacerParams();
+
+        // slack left between the predicted end of a frame's work and the
+        // vblank it aims for; mispredictions smaller than this do not miss it
+        std::chrono::microseconds margin;
+        // weight of the newest frame in the work time average, (0, 1]
+        float smoothing;
+        // acquires that blocked at least this long are taken as vblank times
+        std::chrono::microseconds vblank_threshold;
+    };
+
+    // Predicts how long a frame can wait before sampling input and still make
+    // the next vblank. In FIFO mode an acquire that had to block returns when
+    // the display releases an image, which gives the vblank phase; the refresh
+    // interval comes from the display. Starting the frame as late as the
+    // measured work time allows shortens the time between input and scan out
+    // without dropping frames. All times are profiler::now_ns() nanoseconds.
+    class FramePacer {
+    public:
+        explicit FramePacer(const FramePacerParams& params = FramePacerParams());
+
+        // 0 turns the delay off, e.g. for mailbox or immediate presentation
+        void set_refresh_interval(uint64_t interval_ns);
+        uint64_t refresh_interval() const { return m_interval_ns; }
+
+        void on_acquire(uint64_t begin_ns, uint64_t end_ns);
+        // time from input sampling until the frame's GPU work was done
+        void on_frame_work(uint64_t work_ns);
+
+        // how long to sleep at `now_ns` before sampling input, 0 without a
+        // vblank phase or refresh interval
+        uint64_t delay_ns(uint64_t now_ns) const;
+
+        uint64_t predicted_work_ns() const { return static_cast<uint64_t>(m_work_ns); }
+
+    private:
+        FramePacerParams m_params;
+        uint64_t m_interval_ns = 0;
+        // a recent vblank, 0 until an acquire has blocked
+        uint64_t m_vblank_ns = 0;
+        double m_work_ns = 0.0;
+    };
+}
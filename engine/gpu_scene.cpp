@@ -0,0 +1,733 @@
+#include "gpu_scene.hpp"
+#include "profiler.hpp"
+#include "vk_util.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+
+namespace engine {
+
+    namespace {
+
+        constexpr uint32_t flag_compact = 1;
+        constexpr uint32_t flag_occlusion = 2;
+
+        constexpr uint32_t cull_group_size = 64;
+        constexpr uint32_t reduce_group_size = 8;
+        // the draw buffers grow in powers of two from here
+        constexpr uint32_t min_capacity = 1024;
+
+        // earlier frames may still read what the upload overwrites
+        constexpr VkPipelineStageFlags scene_readers = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
+            | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+            | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+        // Gribb / Hartmann planes of a clip space with depth in [0, 1],
+        // normalised so the distance test works with the sphere radius
+        void frustum_planes(const glm::mat4& m, glm::vec4 (&planes)[6]) {
+            const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+            const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+            const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+            const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+            planes[0] = row3 + row0;
+            planes[1] = row3 - row0;
+            planes[2] = row3 + row1;
+            planes[3] = row3 - row1;
+            planes[4] = row2;
+            planes[5] = row3 - row2;
+            for (glm::vec4& plane : planes) {
+                plane /= glm::length(glm::vec3(plane));
+            }
+        }
+
+        uint32_t grown_capacity(uint32_t needed, uint32_t max) {
+            return std::min(std::bit_ceil(std::max(needed, min_capacity)), std::max(max, needed));
+        }
+    }
+
+    GpuSceneParams::GpuSceneParams()
+    : max_instances(1u << 20)
+    , occlusion(false)
+    {}
+
+    GpuScene::GpuScene(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        Allocator& allocator,
+        ShaderLibrary& shaders,
+        PipelineRegistry& pipelines,
+        DescriptorLayoutCache& layouts,
+        uint32_t frame_slots,
+        PFN_vkCmdDrawIndexedIndirectCountKHR draw_count,
+        const GpuSceneParams& params
+    )
+        : m_device(device)
+        , m_allocator(allocator)
+        , m_shaders(shaders)
+        , m_pipelines(pipelines)
+        , m_layouts(layouts)
+        , m_draw_count(draw_count)
+        , m_params(params)
+        , m_logger(create_logger("scene")) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        m_max_draw_count = properties.limits.maxDrawIndirectCount;
+        // one culling invocation per instance, in a single dispatch
+        const uint64_t max_dispatch = uint64_t(properties.limits.maxComputeWorkGroupCount[0]) * cull_group_size;
+        m_params.max_instances = static_cast<uint32_t>(std::min<uint64_t>({
+            m_params.max_instances,
+            max_dispatch,
+            m_max_draw_count
+        }));
+
+        m_frames.resize(frame_slots);
+        for (FrameResources& frame : m_frames) {
+            frame.count = m_allocator.create_buffer(
+                sizeof(uint32_t),
+                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                MemoryUsage::static_geometry
+            );
+        }
+
+        // the occlusion test picks pyramid levels by hand, texel centres only
+        VkSamplerCreateInfo sampler_info = {};
+        sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler_info.pNext = nullptr;
+        sampler_info.magFilter = VK_FILTER_NEAREST;
+        sampler_info.minFilter = VK_FILTER_NEAREST;
+        sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler_info.minLod = 0.0f;
+        sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+        check_vk(vkCreateSampler(m_device, &sampler_info, nullptr, &m_sampler));
+
+        create_pipelines();
+
+        m_logger->info(
+            "gpu driven drawing of up to {} instance(s), {}{}",
+            m_params.max_instances,
+            m_draw_count != nullptr ? "compacted with a draw count" : "without a draw count",
+            m_params.occlusion ? ", occlusion culling" : ""
+        );
+    }
+
+    GpuScene::~GpuScene() {
+        for (Retired& retired : m_retired) {
+            destroy(retired.pyramid);
+        }
+        destroy(m_pyramid);
+        vkDestroySampler(m_device, m_sampler, nullptr);
+    }
+
+    void GpuScene::create_pipelines() {
+        const ShaderId cull = m_shaders.find("cull.comp");
+        const ShaderId reduce = m_shaders.find("depth_reduce.comp");
+        const ShaderId vertex = m_shaders.find("scene.vert");
+        const ShaderId fragment = m_shaders.find("scene.frag");
+        if (cull == invalid_shader || reduce == invalid_shader || vertex == invalid_shader || fragment == invalid_shader) {
+            m_logger->error("failed to load the gpu scene shaders, gpu driven drawing is disabled");
+            return;
+        }
+
+        // the view block comes from the renderer's uniform ring every frame
+        const uint32_t view_binding = 0;
+        const ShaderReflection* cull_shaders[] = { &m_shaders.get(cull).reflection() };
+        m_cull_set_layout = m_layouts.get(cull_shaders, 0, std::span(&view_binding, 1));
+        ComputePipelineDesc cull_desc;
+        cull_desc.shader = cull;
+        cull_desc.layout = m_layouts.pipeline_layout(std::span(&m_cull_set_layout, 1));
+        m_cull_pipeline = m_pipelines.request(cull_desc);
+
+        const ShaderReflection* reduce_shaders[] = { &m_shaders.get(reduce).reflection() };
+        m_reduce_set_layout = m_layouts.get(reduce_shaders, 0);
+        ComputePipelineDesc reduce_desc;
+        reduce_desc.shader = reduce;
+        reduce_desc.layout = m_layouts.pipeline_layout(
+            std::span(&m_reduce_set_layout, 1),
+            m_shaders.get(reduce).reflection().push_constants
+        );
+        m_reduce_pipeline = m_pipelines.request(reduce_desc);
+
+        const ShaderReflection* draw_shaders[] = { &m_shaders.get(vertex).reflection(), &m_shaders.get(fragment).reflection() };
+        m_draw_set_layout = m_layouts.get(draw_shaders, 0, std::span(&view_binding, 1));
+        m_draw_desc.vertex_shader = vertex;
+        m_draw_desc.fragment_shader = fragment;
+        m_draw_desc.vertex_input = Vertex::input_description();
+        m_draw_desc.depth_test = true;
+        m_draw_desc.depth_write = true;
+        m_draw_desc.layout = m_layouts.pipeline_layout(std::span(&m_draw_set_layout, 1));
+
+        m_valid = true;
+    }
+
+    uint32_t GpuScene::add_mesh(const MeshData& mesh) {
+        MeshRecord record = {};
+        record.index_count = static_cast<uint32_t>(mesh.indices.size());
+        record.first_index = static_cast<uint32_t>(m_indices.size());
+        record.vertex_offset = static_cast<int32_t>(m_vertices.size());
+
+        glm::vec3 lo(std::numeric_limits<float>::max());
+        glm::vec3 hi(std::numeric_limits<float>::lowest());
+        for (const Vertex& vertex : mesh.vertices) {
+            const glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+            lo = glm::min(lo, position);
+            hi = glm::max(hi, position);
+        }
+        const glm::vec3 center = mesh.vertices.empty() ? glm::vec3(0.0f) : (lo + hi) * 0.5f;
+        float radius = 0.0f;
+        for (const Vertex& vertex : mesh.vertices) {
+            const glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+            radius = std::max(radius, glm::length(position - center));
+        }
+        record.bounds = glm::vec4(center, radius);
+
+        m_vertices.insert(m_vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+        m_indices.insert(m_indices.end(), mesh.indices.begin(), mesh.indices.end());
+        m_meshes.push_back(record);
+        m_geometry_dirty = true;
+        return static_cast<uint32_t>(m_meshes.size() - 1);
+    }
+
+    void GpuScene::set_instances(std::span<const GpuInstance> instances) {
+        if (instances.size() > m_params.max_instances) {
+            m_logger->warn("{} instance(s) given, only the first {} are drawn", instances.size(), m_params.max_instances);
+            instances = instances.first(m_params.max_instances);
+        }
+        m_instances.assign(instances.begin(), instances.end());
+        m_dirty_begin = 0;
+        m_dirty_end = static_cast<uint32_t>(m_instances.size());
+    }
+
+    void GpuScene::update_instances(uint32_t first, std::span<const GpuInstance> instances) {
+        if (first >= m_instances.size()) {
+            return;
+        }
+        const uint32_t count = std::min(static_cast<uint32_t>(instances.size()), static_cast<uint32_t>(m_instances.size()) - first);
+        if (count == 0) {
+            return;
+        }
+        std::copy_n(instances.begin(), count, m_instances.begin() + first);
+        if (m_dirty_begin == m_dirty_end) {
+            m_dirty_begin = first;
+            m_dirty_end = first + count;
+        } else {
+            m_dirty_begin = std::min(m_dirty_begin, first);
+            m_dirty_end = std::max(m_dirty_end, first + count);
+        }
+    }
+
+    void GpuScene::set_view_projection(const glm::mat4& view_projection) {
+        m_view_proj = view_projection;
+    }
+
+    void GpuScene::begin_frame(uint64_t frame_number, uint64_t completed_frames) {
+        m_frame_number = frame_number;
+        std::erase_if(m_retired, [&](Retired& retired) {
+            if (retired.frame >= completed_frames) {
+                return false;
+            }
+            destroy(retired.pyramid);
+            return true;
+        });
+    }
+
+    void GpuScene::add_cull_passes(
+        RenderGraph& graph,
+        uint32_t frame_slot,
+        VkExtent2D extent,
+        DescriptorAllocator& descriptors,
+        UniformRing& uniforms
+    ) {
+        ENGINE_PROFILE_ZONE("scene cull passes");
+        m_declared = Declared();
+        m_uploaded_bytes = 0;
+        if (!m_valid || m_instances.empty() || m_meshes.empty()) {
+            m_pyramid_valid = false;
+            return;
+        }
+        m_extent = extent;
+
+        FrameResources& frame = m_frames[frame_slot];
+        prepare_frame_resources(frame);
+        prepare_pyramid(extent);
+        // before staging, so nothing is staged for a frame that is not drawn
+        if (!write_view(uniforms)) {
+            ENGINE_LOG_LIMITED(m_logger, WARN, "the uniform ring is full, the scene is not drawn this frame");
+            return;
+        }
+        const std::vector<Copy> copies = stage_uploads();
+
+        Declared& declared = m_declared;
+        declared.active = true;
+        declared.vertices = graph.import_buffer("scene vertices", m_vertex_buffer.handle(), 0, 0, scene_readers);
+        declared.indices = graph.import_buffer("scene indices", m_index_buffer.handle(), 0, 0, scene_readers);
+        declared.meshes = graph.import_buffer("scene meshes", m_mesh_buffer.handle(), 0, 0, scene_readers);
+        declared.instances = graph.import_buffer("scene instances", m_instance_buffer.handle(), 0, 0, scene_readers);
+        // the slot's previous frame has completed, nothing reads these any more
+        declared.draws = graph.import_buffer("scene draws", frame.draws.handle(), 0, 0);
+        declared.count = graph.import_buffer("scene draw count", frame.count.handle(), 0, 0);
+        declared.pyramid = graph.import_image(
+            "depth pyramid",
+            m_pyramid.image.handle(),
+            m_pyramid.view,
+            VK_FORMAT_R32_SFLOAT,
+            m_pyramid.extent,
+            m_pyramid_initialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+        );
+        m_pyramid_initialized = true;
+
+        const VkDescriptorSet cull_set = descriptors.allocate(m_cull_set_layout);
+        declared.draw_set = descriptors.allocate(m_draw_set_layout);
+        if (cull_set == VK_NULL_HANDLE || declared.draw_set == VK_NULL_HANDLE) {
+            m_declared = Declared();
+            return;
+        }
+        DescriptorWriter writer;
+        writer.write_buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniforms.buffer(), 0, sizeof(ViewBlock))
+            .write_buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_instance_buffer.handle())
+            .write_buffer(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_mesh_buffer.handle())
+            .write_buffer(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame.draws.handle())
+            .write_buffer(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frame.count.handle())
+            .write_image(5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_pyramid.view, m_sampler, VK_IMAGE_LAYOUT_GENERAL)
+            .update(m_device, cull_set);
+        writer.write_buffer(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, uniforms.buffer(), 0, sizeof(ViewBlock))
+            .write_buffer(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_instance_buffer.handle())
+            .update(m_device, declared.draw_set);
+
+        if (!copies.empty()) {
+            const std::pair<RenderGraphBuffer, VkBuffer> targets[] = {
+                { declared.vertices, m_vertex_buffer.handle() },
+                { declared.indices, m_index_buffer.handle() },
+                { declared.meshes, m_mesh_buffer.handle() },
+                { declared.instances, m_instance_buffer.handle() },
+            };
+            graph.add_pass(
+                "scene upload",
+                PassType::transfer,
+                [&](PassBuilder& pass) {
+                    for (const auto& [buffer, handle] : targets) {
+                        const bool written = std::any_of(copies.begin(), copies.end(), [&](const Copy& copy) {
+                            return copy.destination == handle;
+                        });
+                        if (written) {
+                            pass.write_buffer(buffer, BufferUsage::transfer_dst);
+                        }
+                    }
+                },
+                [copies](const PassContext& context) {
+                    for (const Copy& copy : copies) {
+                        vkCmdCopyBuffer(context.cmd, copy.source, copy.destination, 1, &copy.region);
+                    }
+                }
+            );
+        }
+
+        graph.add_pass(
+            "scene cull reset",
+            PassType::transfer,
+            [&](PassBuilder& pass) {
+                pass.write_buffer(declared.count, BufferUsage::transfer_dst);
+            },
+            [count = declared.count](const PassContext& context) {
+                vkCmdFillBuffer(context.cmd, context.graph.buffer(count), 0, sizeof(uint32_t), 0);
+            }
+        );
+        graph.add_pass(
+            "scene cull",
+            PassType::compute,
+            [&](PassBuilder& pass) {
+                pass.read_buffer(declared.instances, BufferUsage::storage_read);
+                pass.read_buffer(declared.meshes, BufferUsage::storage_read);
+                pass.write_buffer(declared.draws, BufferUsage::storage_write);
+                pass.write_buffer(declared.count, BufferUsage::storage_write);
+                pass.read_storage(declared.pyramid);
+            },
+            [this, cull_set](const PassContext& context) {
+                record_cull(context.cmd, cull_set);
+            }
+        );
+    }
+
+    void GpuScene::add_draw_passes(RenderGraph& graph, RenderGraphImage target, DescriptorAllocator& descriptors) {
+        if (!m_declared.active) {
+            return;
+        }
+        const Declared& declared = m_declared;
+
+        TransientImageDesc depth_desc;
+        depth_desc.format = VK_FORMAT_D32_SFLOAT;
+        depth_desc.extent = m_extent;
+        const RenderGraphImage depth = graph.create_image("scene depth", depth_desc);
+
+        // only talks to earlier passes through attachments and buffer reads,
+        // so it becomes a subpass of the pass that cleared the target
+        graph.add_pass(
+            "scene",
+            PassType::graphics,
+            [&](PassBuilder& pass) {
+                pass.write_color(target);
+                pass.write_depth(depth, VkClearDepthStencilValue{ 1.0f, 0 });
+                pass.read_buffer(declared.draws, BufferUsage::indirect);
+                pass.read_buffer(declared.count, BufferUsage::indirect);
+                pass.read_buffer(declared.instances, BufferUsage::storage_read, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
+                pass.read_buffer(declared.vertices, BufferUsage::vertex);
+                pass.read_buffer(declared.indices, BufferUsage::index);
+            },
+            [this](const PassContext& context) {
+                record_draw(context);
+            }
+        );
+
+        if (!m_params.occlusion) {
+            return;
+        }
+        graph.add_pass(
+            "depth pyramid",
+            PassType::compute,
+            [&](PassBuilder& pass) {
+                pass.read_sampled(depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+                pass.write_storage(declared.pyramid);
+            },
+            [this, depth, &descriptors](const PassContext& context) {
+                record_pyramid(context, depth, descriptors);
+            }
+        );
+    }
+
+    GpuSceneStats GpuScene::stats() const {
+        GpuSceneStats stats;
+        stats.meshes = static_cast<uint32_t>(m_meshes.size());
+        stats.instances = static_cast<uint32_t>(m_instances.size());
+        stats.uploaded_bytes = m_uploaded_bytes;
+        stats.draw_count = m_draw_count != nullptr;
+        stats.occlusion = m_params.occlusion;
+        return stats;
+    }
+
+    std::vector<GpuScene::Copy> GpuScene::stage_uploads() {
+        const uint32_t instance_count = static_cast<uint32_t>(m_instances.size());
+        const VkDeviceSize instance_bytes = VkDeviceSize(instance_count) * sizeof(GpuInstance);
+        if (m_instance_buffer.size() < instance_bytes) {
+            // a new buffer has none of the old contents
+            const uint32_t capacity = grown_capacity(instance_count, m_params.max_instances);
+            grow(m_instance_buffer, VkDeviceSize(capacity) * sizeof(GpuInstance), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+            m_dirty_begin = 0;
+            m_dirty_end = instance_count;
+        }
+        if (m_geometry_dirty) {
+            grow(m_vertex_buffer, m_vertices.size() * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+            grow(m_index_buffer, m_indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+            grow(m_mesh_buffer, m_meshes.size() * sizeof(MeshRecord), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+        }
+
+        struct Source {
+            const void* data;
+            VkDeviceSize size;
+            VkBuffer destination;
+            VkDeviceSize offset;
+        };
+        std::vector<Source> sources;
+        if (m_geometry_dirty) {
+            sources.push_back({ m_vertices.data(), m_vertices.size() * sizeof(Vertex), m_vertex_buffer.handle(), 0 });
+            sources.push_back({ m_indices.data(), m_indices.size() * sizeof(uint32_t), m_index_buffer.handle(), 0 });
+            sources.push_back({ m_meshes.data(), m_meshes.size() * sizeof(MeshRecord), m_mesh_buffer.handle(), 0 });
+        }
+        if (m_dirty_begin < m_dirty_end) {
+            sources.push_back({
+                m_instances.data() + m_dirty_begin,
+                VkDeviceSize(m_dirty_end - m_dirty_begin) * sizeof(GpuInstance),
+                m_instance_buffer.handle(),
+                VkDeviceSize(m_dirty_begin) * sizeof(GpuInstance)
+            });
+        }
+        m_geometry_dirty = false;
+        m_dirty_begin = 0;
+        m_dirty_end = 0;
+
+        VkDeviceSize total = 0;
+        for (const Source& source : sources) {
+            total += source.size;
+        }
+        if (total == 0) {
+            return {};
+        }
+
+        Buffer staging = m_allocator.create_buffer(total, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::staging);
+        std::byte* mapped = static_cast<std::byte*>(staging.mapped());
+        std::vector<Copy> copies;
+        VkDeviceSize offset = 0;
+        for (const Source& source : sources) {
+            if (source.size == 0) {
+                continue;
+            }
+            std::memcpy(mapped + offset, source.data, source.size);
+            copies.push_back({ staging.handle(), source.destination, { offset, source.offset, source.size } });
+            offset += source.size;
+        }
+        staging.flush();
+        m_uploaded_bytes = total;
+
+        Retired& retired = m_retired.emplace_back();
+        retired.buffer = std::move(staging);
+        retired.frame = m_frame_number;
+        return copies;
+    }
+
+    void GpuScene::grow(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage) {
+        if (buffer.size() >= size) {
+            return;
+        }
+        if (buffer) {
+            Retired& retired = m_retired.emplace_back();
+            retired.buffer = std::move(buffer);
+            retired.frame = m_frame_number;
+        }
+        buffer = m_allocator.create_buffer(
+            std::bit_ceil(size),
+            usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            MemoryUsage::static_geometry
+        );
+    }
+
+    void GpuScene::prepare_frame_resources(FrameResources& frame) {
+        const uint32_t needed = static_cast<uint32_t>(m_instances.size());
+        if (frame.capacity >= needed) {
+            return;
+        }
+        // the slot's fence has signalled, so the old list can go right away
+        frame.capacity = grown_capacity(needed, m_params.max_instances);
+        frame.draws = m_allocator.create_buffer(
+            VkDeviceSize(frame.capacity) * sizeof(VkDrawIndexedIndirectCommand),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            MemoryUsage::static_geometry
+        );
+    }
+
+    void GpuScene::prepare_pyramid(VkExtent2D extent) {
+        // the largest power of two below the depth buffer, so every level
+        // is exactly half of the one before; one texel without occlusion,
+        // the culling shader still needs something bound
+        VkExtent2D size = { 1, 1 };
+        if (m_params.occlusion) {
+            size = { std::bit_floor(std::max(extent.width, 1u)), std::bit_floor(std::max(extent.height, 1u)) };
+        }
+        if (m_pyramid.image && m_pyramid.extent.width == size.width && m_pyramid.extent.height == size.height) {
+            return;
+        }
+        if (m_pyramid.image) {
+            // this frame's culling set still points at it
+            Retired& retired = m_retired.emplace_back();
+            retired.pyramid = std::move(m_pyramid);
+            retired.frame = m_frame_number;
+            m_pyramid = Pyramid();
+        }
+        m_pyramid_initialized = false;
+        m_pyramid_valid = false;
+
+        const uint32_t levels = std::bit_width(std::max(size.width, size.height));
+
+        VkImageCreateInfo image_info = {};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.pNext = nullptr;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = VK_FORMAT_R32_SFLOAT;
+        image_info.extent = { size.width, size.height, 1 };
+        image_info.mipLevels = levels;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        m_pyramid.image = m_allocator.create_image(image_info, MemoryUsage::render_target);
+        m_pyramid.extent = size;
+
+        VkImageViewCreateInfo view_info = {};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.pNext = nullptr;
+        view_info.image = m_pyramid.image.handle();
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = VK_FORMAT_R32_SFLOAT;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.levelCount = levels;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+        check_vk(vkCreateImageView(m_device, &view_info, nullptr, &m_pyramid.view));
+
+        m_pyramid.levels.resize(levels, VK_NULL_HANDLE);
+        view_info.subresourceRange.levelCount = 1;
+        for (uint32_t level = 0; level < levels; ++level) {
+            view_info.subresourceRange.baseMipLevel = level;
+            check_vk(vkCreateImageView(m_device, &view_info, nullptr, &m_pyramid.levels[level]));
+        }
+    }
+
+    void GpuScene::destroy(Pyramid& pyramid) {
+        for (VkImageView view : pyramid.levels) {
+            vkDestroyImageView(m_device, view, nullptr);
+        }
+        vkDestroyImageView(m_device, pyramid.view, nullptr);
+        pyramid = Pyramid();
+    }
+
+    bool GpuScene::write_view(UniformRing& uniforms) {
+        ViewBlock block = {};
+        block.view_proj = m_view_proj;
+        block.occlusion_view_proj = m_pyramid_view_proj;
+        frustum_planes(m_view_proj, block.planes);
+        block.pyramid_size = glm::vec2(m_pyramid.extent.width, m_pyramid.extent.height);
+        block.instance_count = static_cast<uint32_t>(m_instances.size());
+        block.flags = 0;
+        if (m_draw_count != nullptr) {
+            block.flags |= flag_compact;
+        }
+        if (m_params.occlusion && m_pyramid_valid) {
+            block.flags |= flag_occlusion;
+        }
+        // flushed by the ring before the submit
+        const UniformAllocation allocation = uniforms.push(block);
+        m_declared.view_offset = static_cast<uint32_t>(allocation.offset);
+        return static_cast<bool>(allocation);
+    }
+
+    void GpuScene::record_cull(VkCommandBuffer cmd, VkDescriptorSet set) {
+        // without this frame's list the draw would read a stale one
+        const VkPipeline pipeline = m_pipelines.get(m_cull_pipeline);
+        m_culled = pipeline != VK_NULL_HANDLE;
+        if (!m_culled) {
+            return;
+        }
+        const uint32_t instance_count = static_cast<uint32_t>(m_instances.size());
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelines.layout(m_cull_pipeline), 0, 1, &set, 1, &m_declared.view_offset);
+        vkCmdDispatch(cmd, (instance_count + cull_group_size - 1) / cull_group_size, 1, 1);
+    }
+
+    void GpuScene::record_draw(const PassContext& context) {
+        GraphicsPipelineDesc desc = m_draw_desc;
+        desc.render_pass = context.render_pass;
+        desc.subpass = context.subpass;
+        const PipelineId pipeline_id = m_pipelines.request(desc);
+        const VkPipeline pipeline = m_pipelines.get(pipeline_id);
+        if (!m_culled || pipeline == VK_NULL_HANDLE) {
+            return;
+        }
+
+        VkViewport viewport = {};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>(context.extent.width);
+        viewport.height = static_cast<float>(context.extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor = {};
+        scissor.offset = { 0, 0 };
+        scissor.extent = context.extent;
+
+        const VkCommandBuffer cmd = context.cmd;
+        const VkBuffer vertex_buffer = context.graph.buffer(m_declared.vertices);
+        const VkDeviceSize vertex_offset = 0;
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelines.layout(pipeline_id), 0, 1, &m_declared.draw_set, 1, &m_declared.view_offset);
+        vkCmdBindVertexBuffers(cmd, 0, 1, &vertex_buffer, &vertex_offset);
+        vkCmdBindIndexBuffer(cmd, context.graph.buffer(m_declared.indices), 0, VK_INDEX_TYPE_UINT32);
+
+        const VkBuffer draws = context.graph.buffer(m_declared.draws);
+        const uint32_t max_draws = static_cast<uint32_t>(m_instances.size());
+        if (m_draw_count != nullptr) {
+            m_draw_count(cmd, draws, 0, context.graph.buffer(m_declared.count), 0, max_draws, sizeof(VkDrawIndexedIndirectCommand));
+        } else {
+            vkCmdDrawIndexedIndirect(cmd, draws, 0, max_draws, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+
+    void GpuScene::record_pyramid(const PassContext& context, RenderGraphImage depth, DescriptorAllocator& descriptors) {
+        const VkPipeline pipeline = m_pipelines.get(m_reduce_pipeline);
+        m_pyramid_valid = pipeline != VK_NULL_HANDLE;
+        if (!m_pyramid_valid) {
+            return;
+        }
+        const VkPipelineLayout layout = m_pipelines.layout(m_reduce_pipeline);
+        const VkCommandBuffer cmd = context.cmd;
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+        struct Params {
+            int32_t source_size[2];
+            int32_t destination_size[2];
+        };
+
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.pNext = nullptr;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_pyramid.image.handle();
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+
+        DescriptorWriter writer;
+        VkImageView source = context.graph.view(depth);
+        VkImageLayout source_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        VkExtent2D source_size = m_extent;
+        for (uint32_t level = 0; level < m_pyramid.levels.size(); ++level) {
+            const VkExtent2D size = {
+                std::max(m_pyramid.extent.width >> level, 1u),
+                std::max(m_pyramid.extent.height >> level, 1u)
+            };
+            const VkDescriptorSet set = descriptors.allocate(m_reduce_set_layout);
+            writer.write_image(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, source, m_sampler, source_layout)
+                .write_image(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, m_pyramid.levels[level], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL)
+                .update(m_device, set);
+
+            const Params params = {
+                { int32_t(source_size.width), int32_t(source_size.height) },
+                { int32_t(size.width), int32_t(size.height) }
+            };
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+            vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+            vkCmdDispatch(
+                cmd,
+                (size.width + reduce_group_size - 1) / reduce_group_size,
+                (size.height + reduce_group_size - 1) / reduce_group_size,
+                1
+            );
+
+            // The next level reads this one. After the last level the same
+            // barrier makes the pyramid visible to the next frame's culling,
+            // which the graph does not know wrote it.
+            barrier.subresourceRange.baseMipLevel = level;
+            vkCmdPipelineBarrier(
+                cmd,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                0,
+                0, nullptr,
+                0, nullptr,
+                1, &barrier
+            );
+
+            source = m_pyramid.levels[level];
+            source_layout = VK_IMAGE_LAYOUT_GENERAL;
+            source_size = size;
+        }
+        m_pyramid_view_proj = m_view_proj;
+    }
+}
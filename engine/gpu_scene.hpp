@@ -0,0 +1,251 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "descriptors.hpp"
+#include "logger.hpp"
+#include "mesh.hpp"
+#include "pipeline.hpp"
+#include "render_graph.hpp"
+#include "shader_library.hpp"
+#include "uniform_ring.hpp"
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+namespace engine {
+
+    // One object in the scene, 64 bytes as the shaders read it.
+    struct GpuInstance {
+        // the first three rows of the object to world matrix
+        float transform[12];
+        // index returned by GpuScene::add_mesh
+        uint32_t mesh;
+        uint32_t padding[3];
+    };
+    static_assert(sizeof(GpuInstance) == 64);
+
+    struct GpuSceneParams {
+        GpuSceneParams();
+
+        // set_instances() drops whatever does not fit
+        uint32_t max_instances;
+        // also test against a depth pyramid of the previous frame
+        bool occlusion;
+    };
+
+    struct GpuSceneStats {
+        uint32_t meshes = 0;
+        uint32_t instances = 0;
+        // bytes copied to the GPU by the last frame's upload pass
+        VkDeviceSize uploaded_bytes = 0;
+        // vkCmdDrawIndexedIndirectCount, otherwise culled instances stay
+        // in the draw list with an instance count of 0
+        bool draw_count = false;
+        bool occlusion = false;
+    };
+
+    // GPU-driven drawing: meshes share one vertex and one index buffer,
+    // instances live in a storage buffer, and a compute pass culls them
+    // against the frustum (and, optionally, the previous frame's depth
+    // pyramid) and writes one VkDrawIndexedIndirectCommand per visible
+    // instance plus the draw count. The CPU records the same handful of
+    // commands for any number of instances:
+    //
+    //     scene.add_cull_passes(graph, slot, extent, descriptors, uniforms);
+    //     ... passes that clear `target` ...
+    //     scene.add_draw_passes(graph, target, descriptors);
+    //
+    // Uploads are graph passes as well and only happen after a change.
+    class GpuScene {
+    public:
+        // `draw_count` is vkCmdDrawIndexedIndirectCountKHR, or nullptr when
+        // VK_KHR_draw_indirect_count is not enabled
+        GpuScene(
+            VkPhysicalDevice physical_device,
+            VkDevice device,
+            Allocator& allocator,
+            ShaderLibrary& shaders,
+            PipelineRegistry& pipelines,
+            DescriptorLayoutCache& layouts,
+            uint32_t frame_slots,
+            PFN_vkCmdDrawIndexedIndirectCountKHR draw_count,
+            const GpuSceneParams& params = GpuSceneParams()
+        );
+        ~GpuScene();
+
+        GpuScene(const GpuScene&) = delete;
+        GpuScene& operator=(const GpuScene&) = delete;
+
+        // false if the shaders are missing; the passes are not added then
+        bool valid() const { return m_valid; }
+
+        // uploaded with the next frame; returns the index instances refer to
+        uint32_t add_mesh(const MeshData& mesh);
+
+        void set_instances(std::span<const GpuInstance> instances);
+        // only the changed range is uploaded
+        void update_instances(uint32_t first, std::span<const GpuInstance> instances);
+        uint32_t instance_count() const { return static_cast<uint32_t>(m_instances.size()); }
+
+        // Vulkan clip space, i.e. depth in [0, 1]
+        void set_view_projection(const glm::mat4& view_projection);
+
+        // frees the staging memory and replaced buffers of completed frames
+        void begin_frame(uint64_t frame_number, uint64_t completed_frames);
+
+        // The uploads and the culling pass. Declared before the passes that
+        // draw into the target, so they do not split its render pass. The
+        // frame's view constants go into `uniforms`.
+        void add_cull_passes(
+            RenderGraph& graph,
+            uint32_t frame_slot,
+            VkExtent2D extent,
+            DescriptorAllocator& descriptors,
+            UniformRing& uniforms
+        );
+        // draws into the `extent` sized target with a depth buffer of its
+        // own, then builds the depth pyramid the next frame culls against
+        void add_draw_passes(RenderGraph& graph, RenderGraphImage target, DescriptorAllocator& descriptors);
+
+        GpuSceneStats stats() const;
+
+    private:
+        // std140 block of cull.comp and scene.vert
+        struct ViewBlock {
+            glm::mat4 view_proj;
+            glm::mat4 occlusion_view_proj;
+            glm::vec4 planes[6];
+            glm::vec2 pyramid_size;
+            uint32_t instance_count;
+            uint32_t flags;
+        };
+        static_assert(sizeof(ViewBlock) == 240);
+
+        // std430 record of cull.comp
+        struct MeshRecord {
+            uint32_t index_count;
+            uint32_t first_index;
+            int32_t vertex_offset;
+            uint32_t padding;
+            glm::vec4 bounds;
+        };
+        static_assert(sizeof(MeshRecord) == 32);
+
+        struct FrameResources {
+            // written by the culling pass, read by the draw
+            Buffer draws;
+            Buffer count;
+            uint32_t capacity = 0;
+        };
+
+        struct Pyramid {
+            Image image;
+            VkImageView view = VK_NULL_HANDLE;
+            // one per level, for the reduction's reads and writes
+            std::vector<VkImageView> levels;
+            VkExtent2D extent = {};
+            // the depth buffer extent it was built from
+            VkExtent2D source = {};
+        };
+
+        struct Retired {
+            Buffer buffer;
+            Pyramid pyramid;
+            uint64_t frame;
+        };
+
+        struct Copy {
+            VkBuffer source;
+            VkBuffer destination;
+            VkBufferCopy region;
+        };
+
+        // what add_cull_passes() declared for add_draw_passes()
+        struct Declared {
+            bool active = false;
+            RenderGraphBuffer vertices;
+            RenderGraphBuffer indices;
+            RenderGraphBuffer meshes;
+            RenderGraphBuffer instances;
+            RenderGraphBuffer draws;
+            RenderGraphBuffer count;
+            RenderGraphImage pyramid;
+            VkDescriptorSet draw_set = VK_NULL_HANDLE;
+            // of the ViewBlock in the uniform ring, for both sets
+            uint32_t view_offset = 0;
+        };
+
+        void create_pipelines();
+        // moves the CPU side changes into staging memory and returns the copies
+        std::vector<Copy> stage_uploads();
+        void grow(Buffer& buffer, VkDeviceSize size, VkBufferUsageFlags usage);
+        void prepare_frame_resources(FrameResources& frame);
+        void prepare_pyramid(VkExtent2D extent);
+        void destroy(Pyramid& pyramid);
+
+        // false when the uniform ring is full
+        bool write_view(UniformRing& uniforms);
+        void record_cull(VkCommandBuffer cmd, VkDescriptorSet set);
+        void record_draw(const PassContext& context);
+        void record_pyramid(const PassContext& context, RenderGraphImage depth, DescriptorAllocator& descriptors);
+
+    private:
+        VkDevice m_device;
+        Allocator& m_allocator;
+        ShaderLibrary& m_shaders;
+        PipelineRegistry& m_pipelines;
+        DescriptorLayoutCache& m_layouts;
+        PFN_vkCmdDrawIndexedIndirectCountKHR m_draw_count;
+        GpuSceneParams m_params;
+        uint32_t m_max_draw_count = 0;
+        bool m_valid = false;
+
+        VkDescriptorSetLayout m_cull_set_layout = VK_NULL_HANDLE;
+        VkDescriptorSetLayout m_draw_set_layout = VK_NULL_HANDLE;
+        VkDescriptorSetLayout m_reduce_set_layout = VK_NULL_HANDLE;
+        // render pass and subpass are filled in by the graph
+        GraphicsPipelineDesc m_draw_desc;
+        PipelineId m_cull_pipeline = invalid_pipeline;
+        PipelineId m_reduce_pipeline = invalid_pipeline;
+        VkSampler m_sampler = VK_NULL_HANDLE;
+
+        // CPU copies, uploaded in full (geometry) or by dirty range (instances)
+        std::vector<Vertex> m_vertices;
+        std::vector<uint32_t> m_indices;
+        std::vector<MeshRecord> m_meshes;
+        std::vector<GpuInstance> m_instances;
+        bool m_geometry_dirty = false;
+        uint32_t m_dirty_begin = 0;
+        uint32_t m_dirty_end = 0;
+
+        Buffer m_vertex_buffer;
+        Buffer m_index_buffer;
+        Buffer m_mesh_buffer;
+        Buffer m_instance_buffer;
+
+        std::vector<FrameResources> m_frames;
+        Declared m_declared;
+        VkExtent2D m_extent = {};
+        // the culling pass of this frame ran, so the draw list is valid
+        bool m_culled = false;
+
+        Pyramid m_pyramid;
+        // left in GENERAL by an earlier frame
+        bool m_pyramid_initialized = false;
+        // the pyramid holds a depth buffer rendered with m_pyramid_view_proj
+        bool m_pyramid_valid = false;
+        glm::mat4 m_pyramid_view_proj = glm::mat4(1.0f);
+        glm::mat4 m_view_proj = glm::mat4(1.0f);
+
+        uint64_t m_frame_number = 0;
+        std::vector<Retired> m_retired;
+        VkDeviceSize m_uploaded_bytes = 0;
+
+        logger_t m_logger;
+    };
+}
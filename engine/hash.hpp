@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+
+
+namespace engine {
+
+    // 64 bit mixer from splitmix64, good enough to spread hash_combine inputs.
+    constexpr uint64_t hash_mix(uint64_t value) {
+        value ^= value >> 30;
+        value *= 0xBF58476D1CE4E5B9ull;
+        value ^= value >> 27;
+        value *= 0x94D049BB133111EBull;
+        value ^= value >> 31;
+        return value;
+    }
+
+    constexpr uint64_t hash_combine(uint64_t seed, uint64_t value) {
+        return hash_mix(seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2)));
+    }
+
+    // Fast non-cryptographic hash of a byte range, eight bytes per step.
+    // Used for content addressing (SPIR-V, pipeline state), not for security.
+    inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0) {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        uint64_t hash = hash_mix(seed ^ (size * 0x9E3779B97F4A7C15ull));
+
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ hash_mix(word)) * 0x9E3779B97F4A7C15ull;
+        }
+
+        uint64_t tail = 0;
+        if (i < size) {
+            std::memcpy(&tail, bytes + i, size - i);
+        }
+        return hash_mix(hash ^ tail);
+    }
+
+    inline uint64_t hash_bytes(std::span<const std::byte> bytes, uint64_t seed = 0) {
+        return hash_bytes(bytes.data(), bytes.size(), seed);
+    }
+
+    inline uint64_t hash_string(std::string_view text, uint64_t seed = 0) {
+        return hash_bytes(text.data(), text.size(), seed);
+    }
+
+    // Hash of a plain struct without padding holes.
+    template<typename T>
+    uint64_t hash_pod(const T& value, uint64_t seed = 0) {
+        return hash_bytes(&value, sizeof(T), seed);
+    }
+}
@@ -0,0 +1,170 @@
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+
+namespace engine {
+
+    namespace {
+
+        // which system a worker belongs to, so several systems can coexist
+        thread_local const JobSystem* t_system = nullptr;
+        thread_local uint32_t t_thread = 0;
+    }
+
+    JobSystem::JobSystem(uint32_t threads) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        m_queues.reserve(threads);
+        for (uint32_t i = 0; i < threads; ++i) {
+            m_queues.push_back(std::make_unique<WorkQueue>());
+        }
+
+        // the submitting thread is 0
+        m_workers.reserve(threads - 1);
+        for (uint32_t i = 1; i < threads; ++i) {
+            m_workers.emplace_back([this, i]() { worker(i); });
+        }
+    }
+
+    JobSystem::~JobSystem() {
+        {
+            std::lock_guard lock(m_sleep_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    uint32_t JobSystem::thread_index() const {
+        return t_system == this ? t_thread : 0;
+    }
+
+    void JobSystem::submit(JobCounter& counter, job_t job) {
+        counter.m_pending.fetch_add(1, std::memory_order_relaxed);
+        push(thread_index(), { std::move(job), &counter });
+        wake_workers(false);
+    }
+
+    void JobSystem::wait(JobCounter& counter) {
+        const uint32_t thread = thread_index();
+        while (!counter.done()) {
+            if (auto job = find_job(thread)) {
+                run(thread, *job);
+            } else {
+                // the remaining jobs are running on other threads
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void JobSystem::parallel_for(uint32_t count, uint32_t batch_size, const range_job_t& job) {
+        if (count == 0) {
+            return;
+        }
+        batch_size = std::max(batch_size, 1u);
+
+        JobCounter counter;
+        const uint32_t thread = thread_index();
+        for (uint32_t begin = 0; begin < count; begin += batch_size) {
+            const uint32_t end = std::min(count, begin + batch_size);
+            counter.m_pending.fetch_add(1, std::memory_order_relaxed);
+            push(thread, { [&job, begin, end](uint32_t thread) { job(begin, end, thread); }, &counter });
+        }
+        wake_workers(true);
+        wait(counter);
+    }
+
+    void JobSystem::push(uint32_t thread, Job job) {
+        WorkQueue& queue = *m_queues[thread];
+        {
+            std::lock_guard lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        m_queued.fetch_add(1, std::memory_order_release);
+    }
+
+    std::optional<JobSystem::Job> JobSystem::pop(uint32_t thread) {
+        WorkQueue& queue = *m_queues[thread];
+        std::lock_guard lock(queue.mutex);
+        if (queue.jobs.empty()) {
+            return std::nullopt;
+        }
+        Job job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    }
+
+    std::optional<JobSystem::Job> JobSystem::steal(uint32_t thief) {
+        const uint32_t count = thread_count();
+        for (uint32_t i = 1; i < count; ++i) {
+            WorkQueue& queue = *m_queues[(thief + i) % count];
+            // don't queue up behind the owner, try the next victim instead
+            std::unique_lock lock(queue.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || queue.jobs.empty()) {
+                continue;
+            }
+            Job job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return job;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<JobSystem::Job> JobSystem::find_job(uint32_t thread) {
+        if (auto job = pop(thread)) {
+            return job;
+        }
+        if (m_queued.load(std::memory_order_acquire) == 0) {
+            return std::nullopt;
+        }
+        return steal(thread);
+    }
+
+    void JobSystem::run(uint32_t thread, Job& job) {
+        job.function(thread);
+        job.counter->m_pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    void JobSystem::wake_workers(bool all) {
+        if (m_workers.empty()) {
+            return;
+        }
+        // taking the mutex orders this against a worker that just checked
+        // m_queued and is about to sleep
+        {
+            std::lock_guard lock(m_sleep_mutex);
+        }
+        if (all) {
+            m_wake.notify_all();
+        } else {
+            m_wake.notify_one();
+        }
+    }
+
+    void JobSystem::worker(uint32_t thread) {
+        t_system = this;
+        t_thread = thread;
+        ENGINE_PROFILE_THREAD("jobs " + std::to_string(thread));
+
+        while (true) {
+            if (auto job = find_job(thread)) {
+                run(thread, *job);
+                continue;
+            }
+
+            std::unique_lock lock(m_sleep_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_queued.load(std::memory_order_acquire) > 0; });
+            if (m_stop && m_queued.load(std::memory_order_acquire) == 0) {
+                return;
+            }
+        }
+    }
+}
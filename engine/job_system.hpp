@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+
+namespace engine {
+
+    // Number of jobs submitted against it that have not finished yet.
+    class JobCounter {
+    public:
+        bool done() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+
+        std::atomic<uint32_t> m_pending = 0;
+    };
+
+    // Fork-join job system with one deque per thread. A thread pushes and
+    // pops its own jobs at the back (newest first, still warm in cache) and
+    // steals from the front of the others' deques when it runs dry, so a big
+    // batch spreads over all cores without a shared queue everyone fights
+    // over. Waiting threads run jobs instead of blocking.
+    //
+    // Thread 0 is whichever thread is not a worker and submits jobs (the
+    // render thread); only one such thread may use a JobSystem at a time.
+    class JobSystem {
+    public:
+        // gets the index of the thread it runs on, 0 .. thread_count() - 1
+        using job_t = std::function<void(uint32_t thread)>;
+        using range_job_t = std::function<void(uint32_t begin, uint32_t end, uint32_t thread)>;
+
+        // threads including the submitting one, which makes 1 run every job
+        // inline; 0 picks the hardware concurrency
+        explicit JobSystem(uint32_t threads = 0);
+        ~JobSystem();
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        // workers plus the submitting thread
+        uint32_t thread_count() const { return static_cast<uint32_t>(m_queues.size()); }
+        // 0 outside of the workers
+        uint32_t thread_index() const;
+
+        void submit(JobCounter& counter, job_t job);
+
+        // runs jobs until every job of `counter` has finished
+        void wait(JobCounter& counter);
+
+        // Calls `job` for [0, count) in chunks of `batch_size` and waits.
+        // Chunk boundaries only depend on the arguments, not on the thread
+        // count, so results can be written to per-chunk slots deterministically.
+        void parallel_for(uint32_t count, uint32_t batch_size, const range_job_t& job);
+
+    private:
+        struct Job {
+            job_t function;
+            JobCounter* counter;
+        };
+
+        // one cache line each, the owner and thieves hit them constantly
+        struct alignas(64) WorkQueue {
+            std::mutex mutex;
+            std::deque<Job> jobs;
+        };
+
+        void push(uint32_t thread, Job job);
+        std::optional<Job> pop(uint32_t thread);
+        std::optional<Job> steal(uint32_t thief);
+        std::optional<Job> find_job(uint32_t thread);
+        void run(uint32_t thread, Job& job);
+        void wake_workers(bool all);
+        void worker(uint32_t thread);
+
+    private:
+        std::vector<std::unique_ptr<WorkQueue>> m_queues;
+        std::vector<std::thread> m_workers;
+
+        // jobs sitting in some deque, workers sleep while this is 0
+        std::atomic<uint32_t> m_queued = 0;
+        std::mutex m_sleep_mutex;
+        std::condition_variable m_wake;
+        bool m_stop = false;
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+
+namespace engine {
+
+    // Bounded multi-producer multi-consumer ring without locks. Every cell
+    // carries a sequence number that tells producers and consumers whose turn
+    // it is, so a push is one compare-exchange on the tail plus a store, and
+    // nobody ever sleeps inside the queue. Full and empty are reported to the
+    // caller instead of waited out; see BoundedQueue for the blocking flavour.
+    template<typename T>
+    class LockFreeQueue {
+    public:
+        // rounded up to a power of two
+        explicit LockFreeQueue(size_t capacity)
+            : m_mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+            , m_cells(std::make_unique<Cell[]>(m_mask + 1)) {
+            for (size_t i = 0; i <= m_mask; ++i) {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        LockFreeQueue(const LockFreeQueue&) = delete;
+        LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+        // false if the queue is full; `value` is left untouched then.
+        // `position` receives the number of pushes that came before this one.
+        bool try_push(T& value, size_t* position_out = nullptr) {
+            size_t position = m_tail.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = m_cells[position & m_mask];
+                const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+                if (difference == 0) {
+                    if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        cell.value = std::move(value);
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        if (position_out != nullptr) {
+                            *position_out = position;
+                        }
+                        return true;
+                    }
+                } else if (difference < 0) {
+                    // the consumer has not freed this cell from the last lap
+                    return false;
+                } else {
+                    position = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::optional<T> try_pop() {
+            size_t position = m_head.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = m_cells[position & m_mask];
+                const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto difference = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+                if (difference == 0) {
+                    if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        std::optional<T> value(std::move(cell.value));
+                        cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                        return value;
+                    }
+                } else if (difference < 0) {
+                    return std::nullopt;
+                } else {
+                    position = m_head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // a snapshot, only exact while nobody pushes or pops
+        size_t size() const {
+            const size_t tail = m_tail.load(std::memory_order_acquire);
+            const size_t head = m_head.load(std::memory_order_acquire);
+            return tail > head ? tail - head : 0;
+        }
+
+        // pushes started so far, including ones still being written
+        size_t push_count() const { return m_tail.load(std::memory_order_acquire); }
+
+        size_t capacity() const { return m_mask + 1; }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        const size_t m_mask;
+        std::unique_ptr<Cell[]> m_cells;
+
+        // producers and consumers on separate cache lines
+        alignas(64) std::atomic<size_t> m_tail = 0;
+        alignas(64) std::atomic<size_t> m_head = 0;
+    };
+}
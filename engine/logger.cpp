@@ -1,8 +1,241 @@
 #include "logger.hpp"
+#include "lock_free_queue.hpp"
 
-std::shared_ptr<spdlog::sinks::stdout_color_sink_mt> engine::get_default_sink() {
-    static auto default_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
-    return default_sink;
+#include <spdlog/details/log_msg_buffer.h>
+#include <spdlog/spdlog.h>
+
+#include <condition_variable>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+
+namespace {
+
+    // Hands messages to a background thread through a lock-free ring and
+    // writes them to `target` there. The caller only copies the formatted
+    // payload into the ring (no allocation for short messages), everything
+    // else, pattern formatting, colors and the console write, is off its thread.
+    class AsyncSink final : public spdlog::sinks::sink {
+    public:
+        AsyncSink(spdlog::sink_ptr target, size_t queue_size, std::chrono::milliseconds flush_interval)
+            : m_target(std::move(target))
+            , m_queue(queue_size)
+            , m_flush_interval(flush_interval)
+            , m_thread([this]() { write_loop(); }) {}
+
+        ~AsyncSink() override {
+            stop();
+        }
+
+        // writes out the queue and ends the thread; later messages are
+        // written synchronously
+        void stop() {
+            {
+                std::lock_guard lock(m_mutex);
+                m_stop = true;
+            }
+            m_wake.notify_one();
+            if (m_thread.joinable()) {
+                m_thread.join();
+            }
+            m_stopped.store(true, std::memory_order_release);
+
+            // whatever slipped in while the thread was finishing
+            while (auto message = m_queue.try_pop()) {
+                m_target->log(*message);
+            }
+            m_target->flush();
+            {
+                std::lock_guard lock(m_mutex);
+                m_written = std::numeric_limits<size_t>::max();
+            }
+            m_written_changed.notify_all();
+        }
+
+        void log(const spdlog::details::log_msg& message) override {
+            if (m_stopped.load(std::memory_order_acquire)) {
+                m_target->log(message);
+                return;
+            }
+
+            // errors are never dropped and are on the console before the call
+            // returns, in case the process goes down right after
+            const bool important = message.level >= spdlog::level::err;
+
+            spdlog::details::log_msg_buffer buffer(message);
+            size_t position = 0;
+            while (!m_queue.try_push(buffer, &position)) {
+                if (!important) {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                wake();
+                std::this_thread::yield();
+            }
+
+            if (important) {
+                wait_written(position + 1);
+            } else if (m_sleeping.load(std::memory_order_acquire)) {
+                // without the mutex a wake up can get lost, which only delays
+                // the message by one flush interval
+                m_wake.notify_one();
+            }
+        }
+
+        void flush() override {
+            if (m_stopped.load(std::memory_order_acquire)) {
+                m_target->flush();
+                return;
+            }
+            wait_written(m_queue.push_count());
+        }
+
+        void set_pattern(const std::string& pattern) override {
+            m_target->set_pattern(pattern);
+        }
+
+        void set_formatter(std::unique_ptr<spdlog::formatter> formatter) override {
+            m_target->set_formatter(std::move(formatter));
+        }
+
+    private:
+        void wake() {
+            // orders this against the writer checking the queue before it sleeps
+            {
+                std::lock_guard lock(m_mutex);
+            }
+            m_wake.notify_one();
+        }
+
+        void wait_written(size_t count) {
+            wake();
+            std::unique_lock lock(m_mutex);
+            m_written_changed.wait(lock, [&] { return m_written >= count; });
+        }
+
+        void write_loop() {
+            size_t written = 0;
+            while (true) {
+                const size_t before = written;
+                while (auto message = m_queue.try_pop()) {
+                    m_target->log(*message);
+                    ++written;
+                }
+
+                if (const uint32_t dropped = m_dropped.exchange(0, std::memory_order_relaxed)) {
+                    const std::string text = fmt::format("log queue full, dropped {} message(s)", dropped);
+                    m_target->log(spdlog::details::log_msg("log", spdlog::level::warn, text));
+                }
+
+                if (written != before) {
+                    m_target->flush();
+                    {
+                        std::lock_guard lock(m_mutex);
+                        m_written = written;
+                    }
+                    m_written_changed.notify_all();
+                }
+
+                std::unique_lock lock(m_mutex);
+                if (m_stop && m_queue.size() == 0) {
+                    return;
+                }
+                m_sleeping.store(true, std::memory_order_release);
+                m_wake.wait_for(lock, m_flush_interval, [&] { return m_stop || m_queue.size() > 0; });
+                m_sleeping.store(false, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        spdlog::sink_ptr m_target;
+        engine::LockFreeQueue<spdlog::details::log_msg_buffer> m_queue;
+        const std::chrono::milliseconds m_flush_interval;
+
+        std::atomic<uint32_t> m_dropped = 0;
+        std::atomic<bool> m_sleeping = false;
+        std::atomic<bool> m_stopped = false;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::condition_variable m_written_changed;
+        // messages the writer has handed to the target so far
+        size_t m_written = 0;
+        bool m_stop = false;
+
+        // last, so everything it uses exists when it starts
+        std::thread m_thread;
+    };
+
+    struct LoggingState {
+        std::mutex mutex;
+        spdlog::sink_ptr sink;
+        spdlog::level::level_enum level = spdlog::level::info;
+    };
+
+    LoggingState& logging_state() {
+        static LoggingState state;
+        return state;
+    }
+
+    // The loggers live in spdlog's registry, which may be destroyed after the
+    // console sink's statics; the writer thread has to be gone by then.
+    void stop_async_logging() {
+        LoggingState& state = logging_state();
+        std::lock_guard lock(state.mutex);
+        if (auto sink = std::dynamic_pointer_cast<AsyncSink>(state.sink)) {
+            sink->stop();
+        }
+    }
+}
+
+engine::LoggingParams::LoggingParams()
+: async(true)
+, queue_size(8192)
+, flush_interval(50)
+, level(spdlog::level::info)
+{}
+
+void engine::init_logging(const LoggingParams& params) {
+    spdlog::sink_ptr sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    if (params.async) {
+        sink = std::make_shared<AsyncSink>(std::move(sink), params.queue_size, params.flush_interval);
+    }
+
+    spdlog::sink_ptr previous;
+    {
+        LoggingState& state = logging_state();
+        std::lock_guard lock(state.mutex);
+        previous = std::exchange(state.sink, sink);
+        state.level = params.level;
+    }
+    if (previous) {
+        previous->flush();
+    }
+    // runs before the destructors of every static constructed so far
+    static const bool stop_at_exit = std::atexit(stop_async_logging) == 0;
+    (void)stop_at_exit;
+
+    const auto apply = [&](const logger_t& logger) {
+        logger->sinks() = { sink };
+        logger->set_level(params.level);
+    };
+    apply(get_default_logger());
+    spdlog::apply_all(apply);
+}
+
+void engine::flush_logs() {
+    get_default_sink()->flush();
+}
+
+spdlog::sink_ptr engine::get_default_sink() {
+    LoggingState& state = logging_state();
+    std::lock_guard lock(state.mutex);
+    if (!state.sink) {
+        state.sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    }
+    return state.sink;
 }
 
 engine::logger_t engine::get_default_logger() {
@@ -11,6 +244,19 @@ engine::logger_t engine::get_default_logger() {
 }
 
 engine::logger_t engine::create_logger(const std::string& name) {
-    return spdlog::stdout_color_st(name);
-}
+    // get and register have to happen as one step
+    static std::mutex mutex;
+    std::lock_guard lock(mutex);
 
+    if (logger_t logger = spdlog::get(name)) {
+        return logger;
+    }
+    auto logger = std::make_shared<spdlog::logger>(name, get_default_sink());
+    {
+        LoggingState& state = logging_state();
+        std::lock_guard state_lock(state.mutex);
+        logger->set_level(state.level);
+    }
+    spdlog::register_logger(logger);
+    return logger;
+}
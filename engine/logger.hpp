@@ -3,13 +3,101 @@
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/logger.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// Levels below SPDLOG_ACTIVE_LEVEL (set by the ENGINE_LOG_LEVEL cmake option)
+// are compiled out of the ENGINE_LOG_* macros: their arguments are not even
+// evaluated. Plain logger->info() calls are only filtered at run time.
+#define ENGINE_LOG(logger, severity, ...)                                                       \
+    do {                                                                                        \
+        if constexpr (SPDLOG_LEVEL_##severity >= SPDLOG_ACTIVE_LEVEL) {                         \
+            (logger)->log(                                                                      \
+                spdlog::source_loc{ __FILE__, __LINE__, SPDLOG_FUNCTION },                      \
+                static_cast<spdlog::level::level_enum>(SPDLOG_LEVEL_##severity),                \
+                __VA_ARGS__                                                                     \
+            );                                                                                  \
+        }                                                                                       \
+    } while (false)
+
+#define ENGINE_LOG_TRACE(logger, ...) ENGINE_LOG(logger, TRACE, __VA_ARGS__)
+#define ENGINE_LOG_DEBUG(logger, ...) ENGINE_LOG(logger, DEBUG, __VA_ARGS__)
+#define ENGINE_LOG_INFO(logger, ...) ENGINE_LOG(logger, INFO, __VA_ARGS__)
+#define ENGINE_LOG_WARN(logger, ...) ENGINE_LOG(logger, WARN, __VA_ARGS__)
+#define ENGINE_LOG_ERROR(logger, ...) ENGINE_LOG(logger, ERROR, __VA_ARGS__)
+#define ENGINE_LOG_CRITICAL(logger, ...) ENGINE_LOG(logger, CRITICAL, __VA_ARGS__)
+
+// For messages that may repeat every frame: each call site logs at most once
+// per second and reports how many messages it swallowed in between.
+#define ENGINE_LOG_LIMITED(logger, severity, ...)                                               \
+    do {                                                                                        \
+        if constexpr (SPDLOG_LEVEL_##severity >= SPDLOG_ACTIVE_LEVEL) {                         \
+            static ::engine::LogRateLimit engine_log_limit_;                                    \
+            if (const auto engine_log_suppressed_ = engine_log_limit_.allow()) {                \
+                ENGINE_LOG(logger, severity, __VA_ARGS__);                                      \
+                if (*engine_log_suppressed_ > 0) {                                              \
+                    ENGINE_LOG(logger, severity, "  ({} similar message(s) suppressed)", *engine_log_suppressed_); \
+                }                                                                               \
+            }                                                                                   \
+        }                                                                                       \
+    } while (false)
+
 namespace engine {
-    
+
     using logger_t = std::shared_ptr<spdlog::logger>;
 
-    std::shared_ptr<spdlog::sinks::stdout_color_sink_mt> get_default_sink();
+    struct LoggingParams {
+        LoggingParams();
+
+        // Messages are formatted on the calling thread and written to the
+        // console by a background thread, so logging never waits for I/O.
+        // Errors and above still wait until they are written.
+        bool async;
+        // messages that fit into the queue, rounded up to a power of two.
+        // When it is full, messages below error level are dropped and counted.
+        size_t queue_size;
+        // how long the background thread sleeps when it has nothing to do
+        std::chrono::milliseconds flush_interval;
+
+        spdlog::level::level_enum level;
+    };
+
+    // Switches every engine logger, existing and future, to the given backend.
+    // Call it early in main(), before other threads log.
+    void init_logging(const LoggingParams& params = LoggingParams());
+    // writes out everything queued so far
+    void flush_logs();
+
+    spdlog::sink_ptr get_default_sink();
 
     logger_t get_default_logger();
 
+    // Thread safe; asking for an existing name returns that logger.
     logger_t create_logger(const std::string& name);
+
+    // Lets a call every `interval` through and counts the rest.
+    class LogRateLimit {
+    public:
+        explicit LogRateLimit(std::chrono::steady_clock::duration interval = std::chrono::seconds(1))
+            : m_interval(interval.count()) {}
+
+        // the number of calls suppressed since the last one that went through,
+        // or nothing if this call is suppressed as well
+        std::optional<uint32_t> allow() {
+            const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+            int64_t next = m_next.load(std::memory_order_relaxed);
+            if (now < next || !m_next.compare_exchange_strong(next, now + m_interval, std::memory_order_relaxed)) {
+                m_suppressed.fetch_add(1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+            return m_suppressed.exchange(0, std::memory_order_relaxed);
+        }
+
+    private:
+        const int64_t m_interval;
+        std::atomic<int64_t> m_next = 0;
+        std::atomic<uint32_t> m_suppressed = 0;
+    };
 }
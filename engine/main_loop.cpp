@@ -0,0 +1,152 @@
+#include "main_loop.hpp"
+#include "profiler.hpp"
+
+#include <SDL.h>
+
+#include <algorithm>
+
+
+namespace engine {
+
+    MainLoopParams::MainLoopParams()
+    : step(std::chrono::microseconds(1000000 / 60))
+    , max_catch_up_steps(5)
+    , input_timeout(std::chrono::milliseconds(10))
+    {}
+
+    MainLoop::MainLoop(const MainLoopParams& params)
+        : m_params(params)
+        , m_logger(create_logger("loop")) {
+        m_params.step = std::max(m_params.step, std::chrono::microseconds(100));
+        m_params.max_catch_up_steps = std::max(m_params.max_catch_up_steps, 1u);
+    }
+
+    MainLoop::~MainLoop() = default;
+
+    void MainLoop::run(simulate_t simulate, render_t render, event_t on_event) {
+        m_running.store(true, std::memory_order_release);
+        m_logger->info(
+            "simulating at {:.1f} Hz on its own thread, rendering and input on two more",
+            1e6 / m_params.step.count()
+        );
+
+        std::thread simulation([this, &simulate]() { simulation_thread(simulate); });
+        std::thread renderer([this, &render]() { render_thread(render); });
+
+        SDL_Event event;
+        while (running()) {
+            // wakes up for events only, so it costs nothing while idle
+            if (SDL_WaitEventTimeout(&event, static_cast<int>(m_params.input_timeout.count())) == 0) {
+                continue;
+            }
+            std::vector<SDL_Event> received;
+            do {
+                if (on_event) {
+                    on_event(event);
+                }
+                received.push_back(event);
+            } while (SDL_PollEvent(&event) != 0);
+
+            std::lock_guard lock(m_events_mutex);
+            m_events.insert(m_events.end(), received.begin(), received.end());
+        }
+
+        simulation.join();
+        renderer.join();
+        // what was posted after the render thread's last frame
+        run_render_tasks();
+
+        m_logger->info(
+            "{} simulation step(s), {} dropped, {} frame(s)",
+            m_steps.load(std::memory_order_relaxed),
+            m_dropped_steps.load(std::memory_order_relaxed),
+            m_frames.load(std::memory_order_relaxed)
+        );
+    }
+
+    void MainLoop::stop() {
+        m_running.store(false, std::memory_order_release);
+    }
+
+    void MainLoop::post_render(std::function<void()> task) {
+        std::lock_guard lock(m_tasks_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+
+    MainLoopStats MainLoop::stats() const {
+        MainLoopStats stats;
+        stats.steps = m_steps.load(std::memory_order_relaxed);
+        stats.frames = m_frames.load(std::memory_order_relaxed);
+        stats.dropped_steps = m_dropped_steps.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    void MainLoop::simulation_thread(const simulate_t& simulate) {
+        ENGINE_PROFILE_THREAD("simulation");
+        using clock = std::chrono::steady_clock;
+
+        const double dt = std::chrono::duration<double>(m_params.step).count();
+        std::vector<SDL_Event> events;
+        uint64_t index = 0;
+        auto next = clock::now();
+
+        while (running()) {
+            const auto now = clock::now();
+            uint32_t steps = 0;
+            while (next <= now && steps < m_params.max_catch_up_steps) {
+                {
+                    std::lock_guard lock(m_events_mutex);
+                    events.swap(m_events);
+                }
+
+                ENGINE_PROFILE_ZONE("simulate");
+                SimulationStep step;
+                step.index = index;
+                step.dt = dt;
+                step.time = (index + 1) * dt;
+                step.events = events;
+                simulate(step);
+
+                // keeps its capacity for the next swap
+                events.clear();
+                ++index;
+                ++steps;
+                next += m_params.step;
+            }
+            m_steps.fetch_add(steps, std::memory_order_relaxed);
+
+            if (next <= now) {
+                // still behind after catching up: the simulation runs slower
+                // than real time for a moment rather than falling further back
+                const auto behind = now - next;
+                m_dropped_steps.fetch_add(behind / m_params.step + 1, std::memory_order_relaxed);
+                next = now + m_params.step;
+            }
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    void MainLoop::render_thread(const render_t& render) {
+        ENGINE_PROFILE_THREAD("render");
+        while (running()) {
+            run_render_tasks();
+            if (render()) {
+                m_frames.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                // nothing to render into; the window comes back through an event
+                std::this_thread::sleep_for(m_params.input_timeout);
+            }
+        }
+    }
+
+    void MainLoop::run_render_tasks() {
+        std::vector<std::function<void()>> tasks;
+        {
+            std::lock_guard lock(m_tasks_mutex);
+            tasks.swap(m_tasks);
+        }
+        for (auto& task : tasks) {
+            task();
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "logger.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+
+union SDL_Event;
+
+namespace engine {
+
+    struct MainLoopParams {
+        MainLoopParams();
+
+        // length of one simulation step, independent of the present rate
+        std::chrono::microseconds step;
+        // steps run back to back to catch up after a stall; simulated time
+        // beyond that is dropped instead of spiralling
+        uint32_t max_catch_up_steps;
+        // the input thread checks for stop() at least this often
+        std::chrono::milliseconds input_timeout;
+    };
+
+    struct SimulationStep {
+        uint64_t index;
+        // the fixed step length and the simulated time at its end, seconds
+        double dt;
+        double time;
+        // what the input thread received since the previous step
+        std::span<const SDL_Event> events;
+    };
+
+    struct MainLoopStats {
+        uint64_t steps = 0;
+        uint64_t frames = 0;
+        uint64_t dropped_steps = 0;
+    };
+
+    // Runs simulation, rendering and input on three threads:
+    //
+    // - the simulation thread calls `simulate` at a fixed rate and publishes
+    //   its results, usually into a SnapshotBuffer;
+    // - the render thread calls `render` as fast as the renderer lets it,
+    //   which renders the newest snapshot; its fence and acquire waits only
+    //   hold up that thread, so frame N is recorded while the simulation
+    //   computes N + 1 and the GPU still draws earlier frames;
+    // - the thread calling run() polls SDL events (SDL wants the thread that
+    //   created the window) and never waits for the GPU or the simulation.
+    //
+    // Renderer calls belong on the render thread; post_render() gets them there.
+    class MainLoop {
+    public:
+        using simulate_t = std::function<void(const SimulationStep& step)>;
+        // false when nothing was rendered, e.g. while the window is minimised
+        using render_t = std::function<bool()>;
+        // called on the input thread before the simulation sees the event
+        using event_t = std::function<void(const SDL_Event& event)>;
+
+        explicit MainLoop(const MainLoopParams& params = MainLoopParams());
+        ~MainLoop();
+
+        MainLoop(const MainLoop&) = delete;
+        MainLoop& operator=(const MainLoop&) = delete;
+
+        // returns after stop(), once the other two threads have finished
+        void run(simulate_t simulate, render_t render, event_t on_event);
+        // from any thread, including the callbacks
+        void stop();
+        bool running() const { return m_running.load(std::memory_order_acquire); }
+
+        // runs `task` on the render thread before its next frame
+        void post_render(std::function<void()> task);
+
+        MainLoopStats stats() const;
+
+    private:
+        void simulation_thread(const simulate_t& simulate);
+        void render_thread(const render_t& render);
+        void run_render_tasks();
+
+    private:
+        MainLoopParams m_params;
+        std::atomic<bool> m_running = false;
+
+        // input thread -> simulation thread
+        std::mutex m_events_mutex;
+        std::vector<SDL_Event> m_events;
+
+        // any thread -> render thread
+        std::mutex m_tasks_mutex;
+        std::vector<std::function<void()>> m_tasks;
+
+        std::atomic<uint64_t> m_steps = 0;
+        std::atomic<uint64_t> m_frames = 0;
+        std::atomic<uint64_t> m_dropped_steps = 0;
+
+        logger_t m_logger;
+    };
+}
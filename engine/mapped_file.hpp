@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+
+namespace engine {
+
+    // Read-only memory mapping of a whole file. The pages are only read in
+    // when they are touched, and nothing is copied into the process heap.
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::filesystem::path& path);
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile();
+
+        bool is_open() const { return m_open; }
+
+        std::span<const std::byte> bytes() const { return { m_data, m_size }; }
+        const std::byte* data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+        void close();
+
+    private:
+        const std::byte* m_data = nullptr;
+        size_t m_size = 0;
+        bool m_open = false;
+#if defined(_WIN32)
+        // no mmap here, the file is read into memory instead
+        std::vector<std::byte> m_fallback;
+#endif
+    };
+}
@@ -0,0 +1,349 @@
+#include "mesh.hpp"
+#include "logger.hpp"
+#include "vfs.hpp"
+
+#include <tiny_obj_loader.h>
+#include <meshoptimizer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include <unordered_map>
+
+
+namespace engine {
+
+    namespace {
+
+        struct VertexHash {
+            size_t operator()(const Vertex& vertex) const {
+                uint64_t words[3];
+                std::memcpy(words, &vertex, sizeof(words));
+
+                uint64_t hash = words[0] * 0x9E3779B97F4A7C15ull;
+                hash ^= (words[1] + 0x632BE59BD9B4E019ull + (hash << 6) + (hash >> 2));
+                hash ^= (words[2] + 0x85EBCA77C2B2AE63ull + (hash << 6) + (hash >> 2));
+                return static_cast<size_t>(hash ^ (hash >> 29));
+            }
+        };
+
+        // bitwise, to stay consistent with the hash (-0.f and 0.f differ)
+        struct VertexEqual {
+            bool operator()(const Vertex& a, const Vertex& b) const {
+                return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+            }
+        };
+
+        void quantise_normal(Vertex& vertex, float x, float y, float z) {
+            const float length = std::sqrt(x * x + y * y + z * z);
+            const float scale = length > 0.f ? 1.f / length : 0.f;
+            vertex.normal[0] = static_cast<int16_t>(meshopt_quantizeSnorm(x * scale, 16));
+            vertex.normal[1] = static_cast<int16_t>(meshopt_quantizeSnorm(y * scale, 16));
+            vertex.normal[2] = static_cast<int16_t>(meshopt_quantizeSnorm(z * scale, 16));
+            vertex.normal[3] = 0;
+        }
+
+        void add_stats(MeshImportStats& total, const MeshImportStats& file) {
+            total.files += file.files;
+            total.failed_files += file.failed_files;
+            total.source_bytes += file.source_bytes;
+            total.source_vertices += file.source_vertices;
+            total.vertices += file.vertices;
+            total.indices += file.indices;
+        }
+
+        // triangulated OBJ shapes to deduplicated, optimised vertices
+        MeshData build_mesh(
+            const tinyobj::attrib_t& attrib,
+            const std::vector<tinyobj::shape_t>& shapes,
+            std::string name,
+            MeshImportStats& file_stats
+        ) {
+            size_t corner_count = 0;
+            for (const auto& shape : shapes) {
+                corner_count += shape.mesh.indices.size();
+            }
+            file_stats.source_vertices = corner_count;
+
+            MeshData mesh;
+            mesh.name = std::move(name);
+            mesh.indices.reserve(corner_count);
+            // most OBJ files share every vertex between several triangles
+            mesh.vertices.reserve(corner_count / 3 + 1);
+
+            std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> unique_vertices;
+            unique_vertices.reserve(corner_count / 3 + 1);
+
+            for (const auto& shape : shapes) {
+                const auto& indices = shape.mesh.indices;
+
+                for (size_t triangle = 0; triangle + 2 < indices.size(); triangle += 3) {
+                    Vertex corners[3] = {};
+
+                    for (size_t corner = 0; corner < 3; ++corner) {
+                        const tinyobj::index_t index = indices[triangle + corner];
+                        Vertex& vertex = corners[corner];
+
+                        vertex.position[0] = attrib.vertices[3 * index.vertex_index + 0];
+                        vertex.position[1] = attrib.vertices[3 * index.vertex_index + 1];
+                        vertex.position[2] = attrib.vertices[3 * index.vertex_index + 2];
+
+                        if (index.normal_index >= 0) {
+                            quantise_normal(
+                                vertex,
+                                attrib.normals[3 * index.normal_index + 0],
+                                attrib.normals[3 * index.normal_index + 1],
+                                attrib.normals[3 * index.normal_index + 2]
+                            );
+                        }
+
+                        if (index.texcoord_index >= 0) {
+                            vertex.uv[0] = meshopt_quantizeHalf(attrib.texcoords[2 * index.texcoord_index + 0]);
+                            // OBJ has v pointing up, vulkan samples top down
+                            vertex.uv[1] = meshopt_quantizeHalf(1.f - attrib.texcoords[2 * index.texcoord_index + 1]);
+                        }
+                    }
+
+                    // files without normals get flat face normals
+                    if (indices[triangle].normal_index < 0) {
+                        const float* a = corners[0].position;
+                        const float* b = corners[1].position;
+                        const float* c = corners[2].position;
+                        const float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                        const float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                        for (auto& vertex : corners) {
+                            quantise_normal(
+                                vertex,
+                                e1[1] * e2[2] - e1[2] * e2[1],
+                                e1[2] * e2[0] - e1[0] * e2[2],
+                                e1[0] * e2[1] - e1[1] * e2[0]
+                            );
+                        }
+                    }
+
+                    for (const auto& vertex : corners) {
+                        auto [it, inserted] = unique_vertices.try_emplace(
+                            vertex,
+                            static_cast<uint32_t>(mesh.vertices.size())
+                        );
+                        if (inserted) {
+                            mesh.vertices.push_back(vertex);
+                        }
+                        mesh.indices.push_back(it->second);
+                    }
+                }
+            }
+
+            // the map is the biggest temporary, drop it before optimising
+            std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual>().swap(unique_vertices);
+
+            const size_t index_count = mesh.indices.size();
+            const size_t vertex_count = mesh.vertices.size();
+            if (index_count > 0) {
+                meshopt_optimizeVertexCache(mesh.indices.data(), mesh.indices.data(), index_count, vertex_count);
+                // allow 5% more cache misses in exchange for less overdraw
+                meshopt_optimizeOverdraw(
+                    mesh.indices.data(), mesh.indices.data(), index_count,
+                    mesh.vertices[0].position, vertex_count, sizeof(Vertex),
+                    1.05f
+                );
+                meshopt_optimizeVertexFetch(
+                    mesh.vertices.data(), mesh.indices.data(), index_count,
+                    mesh.vertices.data(), vertex_count, sizeof(Vertex)
+                );
+            }
+            mesh.vertices.shrink_to_fit();
+
+            file_stats.vertices = vertex_count;
+            file_stats.indices = index_count;
+            return mesh;
+        }
+
+        // lets tinyobjloader parse a mapping without copying it into a string
+        class MemoryBuffer : public std::streambuf {
+        public:
+            explicit MemoryBuffer(std::span<const std::byte> bytes) {
+                char* begin = const_cast<char*>(reinterpret_cast<const char*>(bytes.data()));
+                setg(begin, begin, begin + bytes.size());
+            }
+        };
+    }
+
+    VertexInputDescription Vertex::input_description() {
+        VertexInputDescription description;
+
+        VkVertexInputBindingDescription binding = {};
+        binding.binding = 0;
+        binding.stride = sizeof(Vertex);
+        binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        description.bindings.push_back(binding);
+
+        VkVertexInputAttributeDescription position = {};
+        position.binding = 0;
+        position.location = 0;
+        position.format = VK_FORMAT_R32G32B32_SFLOAT;
+        position.offset = offsetof(Vertex, position);
+
+        VkVertexInputAttributeDescription normal = {};
+        normal.binding = 0;
+        normal.location = 1;
+        normal.format = VK_FORMAT_R16G16B16A16_SNORM;
+        normal.offset = offsetof(Vertex, normal);
+
+        VkVertexInputAttributeDescription uv = {};
+        uv.binding = 0;
+        uv.location = 2;
+        uv.format = VK_FORMAT_R16G16_SFLOAT;
+        uv.offset = offsetof(Vertex, uv);
+
+        description.attributes = { position, normal, uv };
+        return description;
+    }
+
+    std::optional<MeshData> import_obj(const std::filesystem::path& path, MeshImportStats* stats) {
+        MeshImportStats file_stats;
+        file_stats.files = 1;
+
+        std::error_code error;
+        file_stats.source_bytes = std::filesystem::file_size(path, error);
+
+        tinyobj::ObjReaderConfig config;
+        config.triangulate = true;
+        config.vertex_color = false;
+
+        tinyobj::ObjReader reader;
+        if (!reader.ParseFromFile(path.string(), config)) {
+            get_default_logger()->error("failed to load {}: {}", path.string(), reader.Error());
+            file_stats.failed_files = 1;
+            if (stats != nullptr) {
+                *stats = file_stats;
+            }
+            return {};
+        }
+
+        MeshData mesh = build_mesh(reader.GetAttrib(), reader.GetShapes(), path.stem().string(), file_stats);
+        if (stats != nullptr) {
+            *stats = file_stats;
+        }
+        return mesh;
+    }
+
+    std::optional<MeshData> import_obj(const Vfs& vfs, std::string_view name, MeshImportStats* stats) {
+        MeshImportStats file_stats;
+        file_stats.files = 1;
+
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warning;
+        std::string error;
+        const auto file = vfs.open(name);
+        bool loaded = false;
+        if (file) {
+            file_stats.source_bytes = file->size();
+            MemoryBuffer buffer(file->bytes());
+            std::istream stream(&buffer);
+            // materials are not used, so no reader for .mtl files
+            loaded = tinyobj::LoadObj(&attrib, &shapes, &materials, &warning, &error, &stream, nullptr, true, false);
+        } else {
+            error = "not found";
+        }
+        if (!loaded) {
+            get_default_logger()->error("failed to load {}: {}", name, error);
+            file_stats.failed_files = 1;
+            if (stats != nullptr) {
+                *stats = file_stats;
+            }
+            return {};
+        }
+
+        MeshData mesh = build_mesh(attrib, shapes, std::filesystem::path(name).stem().string(), file_stats);
+        if (stats != nullptr) {
+            *stats = file_stats;
+        }
+        return mesh;
+    }
+
+    std::vector<std::optional<MeshData>> import_obj_batch(
+        std::span<const std::filesystem::path> paths,
+        uint32_t thread_count,
+        MeshImportStats* stats
+    ) {
+        const auto start = std::chrono::steady_clock::now();
+
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        thread_count = std::min<uint32_t>(thread_count, static_cast<uint32_t>(std::max<size_t>(paths.size(), 1)));
+
+        std::vector<std::optional<MeshData>> meshes(paths.size());
+        std::atomic<size_t> next_file = 0;
+
+        MeshImportStats total;
+        std::mutex stats_mutex;
+
+        // files differ a lot in size, so workers pull them one at a time
+        auto worker = [&]() {
+            MeshImportStats worker_stats;
+            for (size_t i = next_file++; i < paths.size(); i = next_file++) {
+                MeshImportStats file_stats;
+                meshes[i] = import_obj(paths[i], &file_stats);
+                add_stats(worker_stats, file_stats);
+            }
+
+            std::lock_guard lock(stats_mutex);
+            add_stats(total, worker_stats);
+        };
+
+        std::vector<std::thread> workers;
+        workers.reserve(thread_count - 1);
+        for (uint32_t i = 1; i < thread_count; ++i) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+
+        total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (stats != nullptr) {
+            *stats = total;
+        }
+
+        return meshes;
+    }
+
+    MeshData make_cube(float size) {
+        MeshData mesh;
+        mesh.name = "cube";
+        const float half = size * 0.5f;
+        for (int axis = 0; axis < 3; ++axis) {
+            for (const float side : { -1.0f, 1.0f }) {
+                const uint32_t first = static_cast<uint32_t>(mesh.vertices.size());
+                for (int corner = 0; corner < 4; ++corner) {
+                    Vertex vertex = {};
+                    vertex.position[axis] = side * half;
+                    vertex.position[(axis + 1) % 3] = (corner == 1 || corner == 2) ? half : -half;
+                    vertex.position[(axis + 2) % 3] = corner >= 2 ? half : -half;
+                    float normal[3] = { 0.f, 0.f, 0.f };
+                    normal[axis] = side;
+                    quantise_normal(vertex, normal[0], normal[1], normal[2]);
+                    mesh.vertices.push_back(vertex);
+                }
+                // counter-clockwise seen from outside
+                const uint32_t order[2][6] = { { 0, 2, 1, 0, 3, 2 }, { 0, 1, 2, 0, 2, 3 } };
+                for (const uint32_t index : order[side > 0.0f ? 1 : 0]) {
+                    mesh.indices.push_back(first + index);
+                }
+            }
+        }
+        return mesh;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace engine {
+
+    class Vfs;
+
+    struct VertexInputDescription {
+        std::vector<VkVertexInputBindingDescription> bindings;
+        std::vector<VkVertexInputAttributeDescription> attributes;
+    };
+
+    // Compact interleaved vertex, 24 bytes. Normals are snorm16, uvs are
+    // half floats so tiled coordinates outside [0, 1] survive quantisation.
+    struct Vertex {
+        float position[3];
+        int16_t normal[4];
+        uint16_t uv[2];
+
+        static VertexInputDescription input_description();
+    };
+    static_assert(sizeof(Vertex) == 24);
+
+    struct MeshData {
+        std::string name;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+    };
+
+    struct MeshImportStats {
+        uint32_t files = 0;
+        uint32_t failed_files = 0;
+        uint64_t source_bytes = 0;
+        // triangle corners read from the files, before deduplication
+        uint64_t source_vertices = 0;
+        uint64_t vertices = 0;
+        uint64_t indices = 0;
+        double seconds = 0.0;
+
+        double megabytes_per_second() const { return seconds > 0.0 ? source_bytes / seconds / (1024.0 * 1024.0) : 0.0; }
+        double vertices_per_second() const { return seconds > 0.0 ? source_vertices / seconds : 0.0; }
+    };
+
+    // Loads one OBJ file, triangulates it, deduplicates the quantised
+    // vertices and optimises the result for the post-transform vertex cache,
+    // overdraw and vertex fetch, in that order.
+    std::optional<MeshData> import_obj(const std::filesystem::path& path, MeshImportStats* stats = nullptr);
+    // the same from a Vfs asset, parsed in place; material files are ignored
+    std::optional<MeshData> import_obj(const Vfs& vfs, std::string_view name, MeshImportStats* stats = nullptr);
+
+    // Imports all files on `thread_count` threads (0 picks the hardware
+    // concurrency). The result keeps the order of `paths`; files that failed
+    // to load are empty optionals.
+    std::vector<std::optional<MeshData>> import_obj_batch(
+        std::span<const std::filesystem::path> paths,
+        uint32_t thread_count = 0,
+        MeshImportStats* stats = nullptr
+    );
+
+    // `size` wide around the origin, 24 vertices with flat normals
+    MeshData make_cube(float size = 1.0f);
+}
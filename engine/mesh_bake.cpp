@@ -0,0 +1,278 @@
+#include "mesh_bake.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+
+#include <meshoptimizer.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+
+namespace engine {
+
+    namespace {
+
+        struct BakedMeshHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t name_length;
+            uint32_t vertex_count;
+            uint32_t index_count;
+            uint32_t lod_count;
+            uint32_t meshlet_count;
+            uint32_t meshlet_vertex_count;
+            uint32_t meshlet_triangle_bytes;
+            uint32_t padding;
+            uint64_t data_hash;
+        };
+        constexpr uint32_t baked_mesh_magic = 0x48534D45; // "EMSH"
+        constexpr uint32_t baked_mesh_version = 1;
+
+        template<typename T>
+        std::span<const std::byte> as_bytes(const std::vector<T>& values) {
+            return std::as_bytes(std::span(values));
+        }
+
+        // the arrays behind the header, in file order
+        template<typename Function>
+        void for_each_array(const BakedMesh& mesh, Function&& function) {
+            function(std::as_bytes(std::span(mesh.name)));
+            function(as_bytes(mesh.vertices));
+            function(as_bytes(mesh.indices));
+            function(as_bytes(mesh.lods));
+            function(as_bytes(mesh.meshlets));
+            function(as_bytes(mesh.meshlet_vertices));
+            function(as_bytes(mesh.meshlet_triangles));
+        }
+
+        void build_meshlets(BakedMesh& mesh, MeshLod& lod, const MeshBakeParams& params) {
+            const uint32_t* indices = mesh.indices.data() + lod.index_offset;
+            const float* positions = mesh.vertices[0].position;
+
+            const size_t bound = meshopt_buildMeshletsBound(lod.index_count, params.meshlet_vertices, params.meshlet_triangles);
+            std::vector<meshopt_Meshlet> meshlets(bound);
+            std::vector<uint32_t> meshlet_vertices(bound * params.meshlet_vertices);
+            std::vector<uint8_t> meshlet_triangles(bound * params.meshlet_triangles * 3);
+            const size_t count = meshopt_buildMeshlets(
+                meshlets.data(),
+                meshlet_vertices.data(),
+                meshlet_triangles.data(),
+                indices,
+                lod.index_count,
+                positions,
+                mesh.vertices.size(),
+                sizeof(Vertex),
+                params.meshlet_vertices,
+                params.meshlet_triangles,
+                params.cone_weight
+            );
+
+            lod.meshlet_offset = static_cast<uint32_t>(mesh.meshlets.size());
+            lod.meshlet_count = static_cast<uint32_t>(count);
+            for (size_t i = 0; i < count; ++i) {
+                const meshopt_Meshlet& source = meshlets[i];
+                const meshopt_Bounds bounds = meshopt_computeMeshletBounds(
+                    &meshlet_vertices[source.vertex_offset],
+                    &meshlet_triangles[source.triangle_offset],
+                    source.triangle_count,
+                    positions,
+                    mesh.vertices.size(),
+                    sizeof(Vertex)
+                );
+
+                Meshlet meshlet = {};
+                std::copy(std::begin(bounds.center), std::end(bounds.center), meshlet.center);
+                meshlet.radius = bounds.radius;
+                std::copy(std::begin(bounds.cone_axis), std::end(bounds.cone_axis), meshlet.cone_axis);
+                meshlet.cone_cutoff = bounds.cone_cutoff;
+                meshlet.vertex_offset = static_cast<uint32_t>(mesh.meshlet_vertices.size());
+                meshlet.triangle_offset = static_cast<uint32_t>(mesh.meshlet_triangles.size());
+                meshlet.vertex_count = source.vertex_count;
+                meshlet.triangle_count = source.triangle_count;
+                mesh.meshlets.push_back(meshlet);
+
+                mesh.meshlet_vertices.insert(
+                    mesh.meshlet_vertices.end(),
+                    meshlet_vertices.begin() + source.vertex_offset,
+                    meshlet_vertices.begin() + source.vertex_offset + source.vertex_count
+                );
+                // padded to 4 bytes so a shader can read the triangles as uints
+                const size_t triangle_bytes = (source.triangle_count * 3 + 3) & ~size_t(3);
+                mesh.meshlet_triangles.insert(
+                    mesh.meshlet_triangles.end(),
+                    meshlet_triangles.begin() + source.triangle_offset,
+                    meshlet_triangles.begin() + source.triangle_offset + source.triangle_count * 3
+                );
+                mesh.meshlet_triangles.resize(meshlet.triangle_offset + triangle_bytes, 0);
+            }
+        }
+    }
+
+    MeshBakeParams::MeshBakeParams()
+    : max_lods(6)
+    , lod_ratio(0.5f)
+    , max_error(0.05f)
+    , min_triangles(64)
+    , meshlet_vertices(64)
+    , meshlet_triangles(124)
+    , cone_weight(0.25f)
+    {}
+
+    BakedMesh bake_mesh(MeshData mesh, const MeshBakeParams& params) {
+        BakedMesh baked;
+        baked.name = std::move(mesh.name);
+        baked.vertices = std::move(mesh.vertices);
+        baked.indices = std::move(mesh.indices);
+        if (baked.vertices.empty() || baked.indices.empty()) {
+            return baked;
+        }
+
+        const float* positions = baked.vertices[0].position;
+        const size_t vertex_count = baked.vertices.size();
+        // meshopt's errors are relative to the mesh extent
+        const float scale = meshopt_simplifyScale(positions, vertex_count, sizeof(Vertex));
+
+        MeshLod first = {};
+        first.index_count = static_cast<uint32_t>(baked.indices.size());
+        baked.lods.push_back(first);
+
+        // every LOD starts from the previous one, which is cheaper than going
+        // back to LOD 0 and keeps the chain nested; the errors add up
+        std::vector<uint32_t> source(baked.indices);
+        std::vector<uint32_t> simplified(source.size());
+        float error = 0.0f;
+        while (baked.lods.size() < std::max(params.max_lods, 1u)) {
+            const size_t target = static_cast<size_t>(source.size() / 3 * params.lod_ratio) * 3;
+            if (target / 3 < params.min_triangles) {
+                break;
+            }
+
+            float step_error = 0.0f;
+            const size_t count = meshopt_simplify(
+                simplified.data(),
+                source.data(),
+                source.size(),
+                positions,
+                vertex_count,
+                sizeof(Vertex),
+                target,
+                params.max_error,
+                &step_error
+            );
+            // stuck at the error bound or on the topology; further LODs would
+            // be the same
+            if (count == 0 || count > source.size() * 9 / 10) {
+                break;
+            }
+            simplified.resize(count);
+            meshopt_optimizeVertexCache(simplified.data(), simplified.data(), count, vertex_count);
+            error += step_error * scale;
+
+            MeshLod lod = {};
+            lod.index_offset = static_cast<uint32_t>(baked.indices.size());
+            lod.index_count = static_cast<uint32_t>(count);
+            lod.error = error;
+            baked.indices.insert(baked.indices.end(), simplified.begin(), simplified.end());
+            baked.lods.push_back(lod);
+
+            source.swap(simplified);
+            simplified.resize(source.size());
+        }
+
+        for (auto& lod : baked.lods) {
+            build_meshlets(baked, lod, params);
+        }
+        return baked;
+    }
+
+    bool save_baked_mesh(const std::filesystem::path& path, const BakedMesh& mesh) {
+        BakedMeshHeader header = {};
+        header.magic = baked_mesh_magic;
+        header.version = baked_mesh_version;
+        header.name_length = static_cast<uint32_t>(mesh.name.size());
+        header.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+        header.index_count = static_cast<uint32_t>(mesh.indices.size());
+        header.lod_count = static_cast<uint32_t>(mesh.lods.size());
+        header.meshlet_count = static_cast<uint32_t>(mesh.meshlets.size());
+        header.meshlet_vertex_count = static_cast<uint32_t>(mesh.meshlet_vertices.size());
+        header.meshlet_triangle_bytes = static_cast<uint32_t>(mesh.meshlet_triangles.size());
+        for_each_array(mesh, [&](std::span<const std::byte> bytes) {
+            header.data_hash = hash_bytes(bytes, header.data_hash);
+        });
+
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for_each_array(mesh, [&](std::span<const std::byte> bytes) {
+                file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            });
+            if (!file) {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        return !error;
+    }
+
+    std::optional<BakedMesh> load_baked_mesh(const std::filesystem::path& path) {
+        const MappedFile file(path);
+        if (!file.is_open()) {
+            return std::nullopt;
+        }
+        return load_baked_mesh(file.bytes());
+    }
+
+    std::optional<BakedMesh> load_baked_mesh(std::span<const std::byte> file) {
+        if (file.size() < sizeof(BakedMeshHeader)) {
+            return std::nullopt;
+        }
+        BakedMeshHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != baked_mesh_magic || header.version != baked_mesh_version) {
+            return std::nullopt;
+        }
+
+        BakedMesh mesh;
+        mesh.name.resize(header.name_length);
+        mesh.vertices.resize(header.vertex_count);
+        mesh.indices.resize(header.index_count);
+        mesh.lods.resize(header.lod_count);
+        mesh.meshlets.resize(header.meshlet_count);
+        mesh.meshlet_vertices.resize(header.meshlet_vertex_count);
+        mesh.meshlet_triangles.resize(header.meshlet_triangle_bytes);
+
+        size_t expected = sizeof(header);
+        for_each_array(mesh, [&](std::span<const std::byte> bytes) { expected += bytes.size(); });
+        if (expected != file.size()) {
+            return std::nullopt;
+        }
+
+        // the spans point into the vectors just sized above
+        size_t offset = sizeof(header);
+        uint64_t hash = 0;
+        for_each_array(mesh, [&](std::span<const std::byte> bytes) {
+            std::memcpy(const_cast<std::byte*>(bytes.data()), file.data() + offset, bytes.size());
+            hash = hash_bytes(bytes, hash);
+            offset += bytes.size();
+        });
+        if (hash != header.data_hash) {
+            return std::nullopt;
+        }
+        return mesh;
+    }
+
+    uint32_t select_lod(std::span<const MeshLod> lods, float distance, float max_error_per_unit) {
+        const float max_error = std::max(distance, 0.0f) * max_error_per_unit;
+        uint32_t selected = 0;
+        // errors only grow along the chain
+        for (uint32_t i = 1; i < lods.size() && lods[i].error <= max_error; ++i) {
+            selected = i;
+        }
+        return selected;
+    }
+}
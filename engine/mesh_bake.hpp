@@ -0,0 +1,85 @@
+#pragma once
+
+#include "mesh.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+
+namespace engine {
+
+    struct MeshBakeParams {
+        MeshBakeParams();
+
+        // LOD 0 included
+        uint32_t max_lods;
+        // each LOD aims for this fraction of the previous one's triangles
+        float lod_ratio;
+        // largest deviation a LOD may have, relative to the mesh extent
+        float max_error;
+        // no LOD gets simpler than this
+        uint32_t min_triangles;
+        // cluster limits; 64 / 124 fit mesh shader and compute culling groups
+        uint32_t meshlet_vertices;
+        uint32_t meshlet_triangles;
+        // how much meshlets favour tight normal cones over tight spheres
+        float cone_weight;
+    };
+
+    // One cluster of a LOD, laid out for a std430 storage buffer. Culled when
+    // its sphere is outside the frustum, or back-facing when
+    // dot(center - camera, cone_axis) >= cone_cutoff * |center - camera| + radius.
+    struct Meshlet {
+        float center[3];
+        float radius;
+        float cone_axis[3];
+        float cone_cutoff;
+        // into BakedMesh::meshlet_vertices / meshlet_triangles
+        uint32_t vertex_offset;
+        uint32_t triangle_offset;
+        uint32_t vertex_count;
+        uint32_t triangle_count;
+    };
+    static_assert(sizeof(Meshlet) == 48);
+
+    struct MeshLod {
+        uint32_t index_offset;
+        uint32_t index_count;
+        uint32_t meshlet_offset;
+        uint32_t meshlet_count;
+        // how far, in mesh units, the surface may be from LOD 0's
+        float error;
+    };
+
+    // The output of mesh_bake: every LOD indexes the same vertices, and is
+    // split into meshlets whose triangles are bytes indexing the meshlet's
+    // own vertex list.
+    struct BakedMesh {
+        std::string name;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<MeshLod> lods;
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> meshlet_vertices;
+        std::vector<uint8_t> meshlet_triangles;
+
+        uint32_t triangle_count(uint32_t lod) const { return lods[lod].index_count / 3; }
+    };
+
+    // Builds the LOD chain with quadric error simplification and splits
+    // every LOD into meshlets with bounding spheres and normal cones.
+    BakedMesh bake_mesh(MeshData mesh, const MeshBakeParams& params = MeshBakeParams());
+
+    bool save_baked_mesh(const std::filesystem::path& path, const BakedMesh& mesh);
+    std::optional<BakedMesh> load_baked_mesh(const std::filesystem::path& path);
+    // e.g. from Vfs::open()
+    std::optional<BakedMesh> load_baked_mesh(std::span<const std::byte> bytes);
+
+    // The coarsest LOD whose error, seen from `distance`, stays below
+    // `max_error_per_unit` (e.g. a pixel's size at distance 1).
+    uint32_t select_lod(std::span<const MeshLod> lods, float distance, float max_error_per_unit);
+}
@@ -0,0 +1,341 @@
+#include "mipmap.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ENGINE_MIP_AVX2 1
+#define ENGINE_MIP_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ENGINE_MIP_SSE2 1
+#endif
+
+
+namespace engine {
+
+    namespace {
+
+        constexpr size_t channels = 4;
+
+        uint32_t half_extent(uint32_t extent) {
+            return std::max(1u, extent / 2);
+        }
+
+        // Bessel function of the first kind, order 0, for the kaiser window.
+        double bessel_i0(double x) {
+            double sum = 1.0;
+            double term = 1.0;
+            for (int k = 1; k < 32; ++k) {
+                term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                sum += term;
+            }
+            return sum;
+        }
+
+        // Weights of the six source texels around an output texel, at
+        // distances -1.25 .. 1.25 measured in output texels.
+        std::array<float, 6> kaiser_weights() {
+            constexpr double alpha = 4.0;
+            constexpr double half_width = 1.5;
+            constexpr double pi = 3.14159265358979323846;
+
+            std::array<double, 6> weights;
+            double total = 0.0;
+            for (int k = 0; k < 6; ++k) {
+                const double d = (k - 2.5) / 2.0;
+                const double sinc = std::sin(pi * d) / (pi * d);
+                const double ratio = d / half_width;
+                const double window = bessel_i0(alpha * std::sqrt(1.0 - ratio * ratio)) / bessel_i0(alpha);
+                weights[k] = sinc * window;
+                total += weights[k];
+            }
+
+            std::array<float, 6> normalised;
+            for (int k = 0; k < 6; ++k) {
+                normalised[k] = static_cast<float>(weights[k] / total);
+            }
+            return normalised;
+        }
+
+        const std::array<float, 6>& kaiser_kernel() {
+            static const std::array<float, 6> weights = kaiser_weights();
+            return weights;
+        }
+
+        uint8_t to_unorm8(float value) {
+            return static_cast<uint8_t>(std::clamp(value + 0.5f, 0.f, 255.f));
+        }
+
+        void box_scalar(
+            const uint8_t* row0,
+            const uint8_t* row1,
+            uint32_t width,
+            uint32_t x_begin,
+            uint32_t x_end,
+            uint8_t* out
+        ) {
+            for (uint32_t x = x_begin; x < x_end; ++x) {
+                const uint32_t x0 = std::min(2 * x, width - 1);
+                const uint32_t x1 = std::min(2 * x + 1, width - 1);
+                for (size_t c = 0; c < channels; ++c) {
+                    const uint32_t sum = row0[x0 * channels + c] + row0[x1 * channels + c]
+                        + row1[x0 * channels + c] + row1[x1 * channels + c];
+                    out[x * channels + c] = static_cast<uint8_t>((sum + 2) >> 2);
+                }
+            }
+        }
+
+#if defined(ENGINE_MIP_SSE2)
+        // 4 output texels from 8 texels of two source rows
+        inline __m128i box4_sse2(const uint8_t* row0, const uint8_t* row1) {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0));
+            const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 16));
+            const __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1));
+            const __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 16));
+
+            // vertical sums, two texels per register in 16 bit lanes
+            const __m128i p01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+            const __m128i p23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+            const __m128i p45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+            const __m128i p67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+            // horizontal sums end up in the low 64 bits
+            const __m128i s0 = _mm_add_epi16(p01, _mm_srli_si128(p01, 8));
+            const __m128i s1 = _mm_add_epi16(p23, _mm_srli_si128(p23, 8));
+            const __m128i s2 = _mm_add_epi16(p45, _mm_srli_si128(p45, 8));
+            const __m128i s3 = _mm_add_epi16(p67, _mm_srli_si128(p67, 8));
+
+            const __m128i round = _mm_set1_epi16(2);
+            const __m128i out01 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s0, s1), round), 2);
+            const __m128i out23 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s2, s3), round), 2);
+            return _mm_packus_epi16(out01, out23);
+        }
+
+        inline __m128 load_texel(const uint8_t* texel) {
+            const __m128i zero = _mm_setzero_si128();
+            int32_t packed;
+            std::memcpy(&packed, texel, sizeof(packed));
+            const __m128i bytes = _mm_cvtsi32_si128(packed);
+            const __m128i words = _mm_unpacklo_epi8(bytes, zero);
+            return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+        }
+
+        inline void store_texel(__m128 value, uint8_t* texel) {
+            const __m128i ints = _mm_cvtps_epi32(value);
+            const __m128i words = _mm_packs_epi32(ints, ints);
+            const int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+            std::memcpy(texel, &packed, sizeof(packed));
+        }
+#endif
+
+#if defined(ENGINE_MIP_AVX2)
+        // 8 output texels from 16 texels of two source rows
+        inline __m256i box8_avx2(const uint8_t* row0, const uint8_t* row1) {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0));
+            const __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + 32));
+            const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1));
+            const __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + 32));
+
+            // same as the SSE2 version, but every step works on two 128 bit lanes
+            const __m256i lo0 = _mm256_add_epi16(_mm256_unpacklo_epi8(a0, zero), _mm256_unpacklo_epi8(b0, zero));
+            const __m256i hi0 = _mm256_add_epi16(_mm256_unpackhi_epi8(a0, zero), _mm256_unpackhi_epi8(b0, zero));
+            const __m256i lo1 = _mm256_add_epi16(_mm256_unpacklo_epi8(a1, zero), _mm256_unpacklo_epi8(b1, zero));
+            const __m256i hi1 = _mm256_add_epi16(_mm256_unpackhi_epi8(a1, zero), _mm256_unpackhi_epi8(b1, zero));
+
+            const __m256i slo0 = _mm256_add_epi16(lo0, _mm256_srli_si256(lo0, 8));
+            const __m256i shi0 = _mm256_add_epi16(hi0, _mm256_srli_si256(hi0, 8));
+            const __m256i slo1 = _mm256_add_epi16(lo1, _mm256_srli_si256(lo1, 8));
+            const __m256i shi1 = _mm256_add_epi16(hi1, _mm256_srli_si256(hi1, 8));
+
+            const __m256i round = _mm256_set1_epi16(2);
+            const __m256i out0 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(slo0, shi0), round), 2);
+            const __m256i out1 = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(slo1, shi1), round), 2);
+
+            // packing interleaves the lanes as texels 0 1 4 5 2 3 6 7
+            const __m256i packed = _mm256_packus_epi16(out0, out1);
+            return _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+        }
+#endif
+    }
+
+    uint32_t mip_level_count(uint32_t width, uint32_t height) {
+        uint32_t levels = 1;
+        while (width > 1 || height > 1) {
+            width = half_extent(width);
+            height = half_extent(height);
+            ++levels;
+        }
+        return levels;
+    }
+
+    size_t mip_chain_size(uint32_t width, uint32_t height) {
+        size_t size = size_t(width) * height * channels;
+        while (width > 1 || height > 1) {
+            width = half_extent(width);
+            height = half_extent(height);
+            size += size_t(width) * height * channels;
+        }
+        return size;
+    }
+
+    const char* mip_simd_name() {
+#if defined(ENGINE_MIP_AVX2)
+        return "avx2";
+#elif defined(ENGINE_MIP_SSE2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    void downsample_box(const std::byte* src_bytes, uint32_t width, uint32_t height, std::byte* dst_bytes) {
+        const auto* src = reinterpret_cast<const uint8_t*>(src_bytes);
+        auto* dst = reinterpret_cast<uint8_t*>(dst_bytes);
+        const uint32_t dst_width = half_extent(width);
+        const uint32_t dst_height = half_extent(height);
+        const size_t row_pitch = size_t(width) * channels;
+
+        for (uint32_t y = 0; y < dst_height; ++y) {
+            const uint8_t* row0 = src + std::min(2 * y, height - 1) * row_pitch;
+            const uint8_t* row1 = src + std::min(2 * y + 1, height - 1) * row_pitch;
+            uint8_t* out = dst + size_t(y) * dst_width * channels;
+
+            uint32_t x = 0;
+            // the vector paths need both source columns of every output texel
+            if (width >= 2) {
+#if defined(ENGINE_MIP_AVX2)
+                for (; x + 8 <= dst_width; x += 8) {
+                    const __m256i texels = box8_avx2(row0 + 2 * x * channels, row1 + 2 * x * channels);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x * channels), texels);
+                }
+#endif
+#if defined(ENGINE_MIP_SSE2)
+                for (; x + 4 <= dst_width; x += 4) {
+                    const __m128i texels = box4_sse2(row0 + 2 * x * channels, row1 + 2 * x * channels);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * channels), texels);
+                }
+#endif
+            }
+            box_scalar(row0, row1, width, x, dst_width, out);
+        }
+    }
+
+    void downsample_kaiser(const std::byte* src_bytes, uint32_t width, uint32_t height, std::byte* dst_bytes) {
+        const auto* src = reinterpret_cast<const uint8_t*>(src_bytes);
+        auto* dst = reinterpret_cast<uint8_t*>(dst_bytes);
+        const uint32_t dst_width = half_extent(width);
+        const uint32_t dst_height = half_extent(height);
+        const auto& weights = kaiser_kernel();
+
+        // horizontal pass into a float image of dst_width x height
+        std::vector<float> horizontal(size_t(dst_width) * height * channels);
+        for (uint32_t y = 0; y < height; ++y) {
+            const uint8_t* row = src + size_t(y) * width * channels;
+            float* out = horizontal.data() + size_t(y) * dst_width * channels;
+
+            for (uint32_t x = 0; x < dst_width; ++x) {
+#if defined(ENGINE_MIP_SSE2)
+                __m128 sum = _mm_setzero_ps();
+                for (int k = 0; k < 6; ++k) {
+                    const int sx = std::clamp(int(2 * x) - 2 + k, 0, int(width) - 1);
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), load_texel(row + sx * channels)));
+                }
+                _mm_storeu_ps(out + x * channels, sum);
+#else
+                for (size_t c = 0; c < channels; ++c) {
+                    float sum = 0.f;
+                    for (int k = 0; k < 6; ++k) {
+                        const int sx = std::clamp(int(2 * x) - 2 + k, 0, int(width) - 1);
+                        sum += weights[k] * row[sx * channels + c];
+                    }
+                    out[x * channels + c] = sum;
+                }
+#endif
+            }
+        }
+
+        // vertical pass, contiguous along the row so it vectorises over texels
+        const size_t row_floats = size_t(dst_width) * channels;
+        for (uint32_t y = 0; y < dst_height; ++y) {
+            const float* rows[6];
+            for (int k = 0; k < 6; ++k) {
+                const int sy = std::clamp(int(2 * y) - 2 + k, 0, int(height) - 1);
+                rows[k] = horizontal.data() + sy * row_floats;
+            }
+            uint8_t* out = dst + size_t(y) * row_floats;
+
+            size_t i = 0;
+#if defined(ENGINE_MIP_AVX2)
+            for (; i + 8 <= row_floats; i += 8) {
+                __m256 sum = _mm256_setzero_ps();
+                for (int k = 0; k < 6; ++k) {
+                    sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(rows[k] + i)));
+                }
+                const __m256i ints = _mm256_cvtps_epi32(sum);
+                const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(ints), _mm256_extracti128_si256(ints, 1));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(words, words));
+            }
+#endif
+#if defined(ENGINE_MIP_SSE2)
+            for (; i + 4 <= row_floats; i += 4) {
+                __m128 sum = _mm_setzero_ps();
+                for (int k = 0; k < 6; ++k) {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(rows[k] + i)));
+                }
+                store_texel(sum, out + i);
+            }
+#endif
+            for (; i < row_floats; ++i) {
+                float sum = 0.f;
+                for (int k = 0; k < 6; ++k) {
+                    sum += weights[k] * rows[k][i];
+                }
+                out[i] = to_unorm8(sum);
+            }
+        }
+    }
+
+    std::vector<MipLevel> generate_mips(
+        std::vector<std::byte>& pixels,
+        uint32_t width,
+        uint32_t height,
+        MipFilter filter
+    ) {
+        const uint32_t level_count = mip_level_count(width, height);
+
+        std::vector<MipLevel> levels;
+        levels.reserve(level_count);
+        levels.push_back({ 0, size_t(width) * height * channels, width, height });
+
+        size_t total = levels[0].size;
+        for (uint32_t i = 1; i < level_count; ++i) {
+            const MipLevel& previous = levels.back();
+            MipLevel level;
+            level.width = half_extent(previous.width);
+            level.height = half_extent(previous.height);
+            level.offset = total;
+            level.size = size_t(level.width) * level.height * channels;
+            levels.push_back(level);
+            total += level.size;
+        }
+
+        // one allocation for the whole chain, which is what gets uploaded
+        pixels.resize(total);
+        for (uint32_t i = 1; i < level_count; ++i) {
+            const MipLevel& source = levels[i - 1];
+            if (filter == MipFilter::kaiser) {
+                downsample_kaiser(pixels.data() + source.offset, source.width, source.height, pixels.data() + levels[i].offset);
+            } else {
+                downsample_box(pixels.data() + source.offset, source.width, source.height, pixels.data() + levels[i].offset);
+            }
+        }
+
+        return levels;
+    }
+}
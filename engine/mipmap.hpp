@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+namespace engine {
+
+    enum class MipFilter {
+        // 2x2 average, fastest
+        box,
+        // 6 tap kaiser windowed sinc, sharper and less aliasing
+        kaiser
+    };
+
+    struct MipLevel {
+        size_t offset;
+        size_t size;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // Number of levels down to 1x1.
+    uint32_t mip_level_count(uint32_t width, uint32_t height);
+
+    // Bytes of the full RGBA8 chain, level 0 included.
+    size_t mip_chain_size(uint32_t width, uint32_t height);
+
+    // Appends the full mip chain of an 8 bit RGBA image to `pixels`, which
+    // holds level 0 on entry, and returns the layout of every level (level 0
+    // included). Filters operate on the stored values, so sRGB data is
+    // filtered in gamma space.
+    std::vector<MipLevel> generate_mips(
+        std::vector<std::byte>& pixels,
+        uint32_t width,
+        uint32_t height,
+        MipFilter filter
+    );
+
+    // One 2:1 reduction step, exposed for benchmarking. dst must hold
+    // max(1, width / 2) * max(1, height / 2) pixels.
+    void downsample_box(const std::byte* src, uint32_t width, uint32_t height, std::byte* dst);
+    void downsample_kaiser(const std::byte* src, uint32_t width, uint32_t height, std::byte* dst);
+
+    // Which instruction set the downsamplers were compiled for.
+    const char* mip_simd_name();
+}
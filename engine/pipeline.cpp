@@ -0,0 +1,644 @@
+#include "pipeline.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "vk_util.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+
+namespace engine {
+
+    namespace {
+
+        using clock = std::chrono::steady_clock;
+
+        // Our own header in front of the driver's blob, so a truncated or
+        // corrupted file is caught before it reaches the driver.
+        struct CacheFileHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t data_size;
+            uint64_t data_hash;
+        };
+        constexpr uint32_t cache_file_magic = 0x43505645; // "EVPC"
+        constexpr uint32_t cache_file_version = 1;
+
+        std::filesystem::path default_cache_path() {
+            if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0') {
+                return std::filesystem::path(xdg) / "learning_volk" / "pipeline_cache.bin";
+            }
+            if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+                return std::filesystem::path(home) / ".cache" / "learning_volk" / "pipeline_cache.bin";
+            }
+            return "pipeline_cache.bin";
+        }
+
+        // The driver's blob starts with VkPipelineCacheHeaderVersionOne; a
+        // blob from another device or driver version is useless at best.
+        bool matches_device(std::span<const std::byte> data, const VkPhysicalDeviceProperties& properties) {
+            constexpr size_t header_size = 16 + VK_UUID_SIZE;
+            if (data.size() < header_size) {
+                return false;
+            }
+            uint32_t fields[4];
+            std::memcpy(fields, data.data(), sizeof(fields));
+            return fields[0] >= header_size
+                && fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+                && fields[2] == properties.vendorID
+                && fields[3] == properties.deviceID
+                && std::memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+
+        template<typename T>
+        bool equal_bytes(const std::vector<T>& a, const std::vector<T>& b) {
+            return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+        }
+    }
+
+    uint64_t GraphicsPipelineDesc::hash() const {
+        uint64_t hash = hash_combine(vertex_shader, fragment_shader);
+        hash = hash_bytes(vertex_input.bindings.data(), vertex_input.bindings.size() * sizeof(VkVertexInputBindingDescription), hash);
+        hash = hash_bytes(vertex_input.attributes.data(), vertex_input.attributes.size() * sizeof(VkVertexInputAttributeDescription), hash);
+        hash = hash_combine(hash, topology);
+        hash = hash_combine(hash, polygon_mode);
+        hash = hash_combine(hash, cull_mode);
+        hash = hash_combine(hash, front_face);
+        hash = hash_combine(hash, (uint64_t(depth_test) << 1) | uint64_t(depth_write));
+        hash = hash_combine(hash, depth_compare);
+        hash = hash_combine(hash, static_cast<uint64_t>(blend));
+        hash = hash_combine(hash, reinterpret_cast<uint64_t>(render_pass));
+        hash = hash_combine(hash, subpass);
+        hash = hash_combine(hash, reinterpret_cast<uint64_t>(layout));
+        return hash;
+    }
+
+    bool GraphicsPipelineDesc::operator==(const GraphicsPipelineDesc& other) const {
+        // the fallback is not part of the pipeline's state
+        return vertex_shader == other.vertex_shader
+            && fragment_shader == other.fragment_shader
+            && equal_bytes(vertex_input.bindings, other.vertex_input.bindings)
+            && equal_bytes(vertex_input.attributes, other.vertex_input.attributes)
+            && topology == other.topology
+            && polygon_mode == other.polygon_mode
+            && cull_mode == other.cull_mode
+            && front_face == other.front_face
+            && depth_test == other.depth_test
+            && depth_write == other.depth_write
+            && depth_compare == other.depth_compare
+            && blend == other.blend
+            && render_pass == other.render_pass
+            && subpass == other.subpass
+            && layout == other.layout;
+    }
+
+    uint64_t ComputePipelineDesc::hash() const {
+        // shares the lookup table with graphics descriptions, which is fine
+        // because lookups compare the kind as well
+        uint64_t hash = hash_combine(shader, reinterpret_cast<uint64_t>(layout));
+        return hash_combine(hash, VK_PIPELINE_BIND_POINT_COMPUTE);
+    }
+
+    bool ComputePipelineDesc::operator==(const ComputePipelineDesc& other) const {
+        return shader == other.shader && layout == other.layout;
+    }
+
+    PipelineRegistryParams::PipelineRegistryParams()
+    : compile_threads(0)
+    , cache_path(default_cache_path())
+    , load_cache(true)
+    {}
+
+    PipelineRegistry::PipelineRegistry(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        ShaderLibrary& shaders,
+        const PipelineRegistryParams& params
+    )
+        : m_device(device)
+        , m_shaders(shaders)
+        , m_params(params)
+        , m_jobs(std::numeric_limits<size_t>::max())
+        , m_created(clock::now())
+        , m_logger(create_logger("pipelines")) {
+        load_cache(physical_device);
+
+        uint32_t threads = m_params.compile_threads;
+        if (threads == 0) {
+            threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        }
+        m_workers.reserve(threads);
+        for (uint32_t i = 0; i < threads; ++i) {
+            m_workers.emplace_back([this]() { compile_worker(); });
+        }
+    }
+
+    PipelineRegistry::~PipelineRegistry() {
+        m_stopping = true;
+        m_jobs.close();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+
+        save_cache();
+
+        // finished compiles nobody picked up
+        for (const Result& result : m_results) {
+            vkDestroyPipeline(m_device, result.pipeline, nullptr);
+        }
+        for (const Retired& retired : m_retired) {
+            vkDestroyPipeline(m_device, retired.pipeline, nullptr);
+        }
+        for (const Record& record : m_records) {
+            vkDestroyPipeline(m_device, record.pipeline, nullptr);
+        }
+        for (const auto& [hash, layout] : m_layouts) {
+            vkDestroyPipelineLayout(m_device, layout, nullptr);
+        }
+        vkDestroyPipelineCache(m_device, m_cache, nullptr);
+    }
+
+    PipelineId PipelineRegistry::request(const GraphicsPipelineDesc& desc) {
+        const uint64_t hash = desc.hash();
+        for (const PipelineId id : m_by_hash[hash]) {
+            Record& record = m_records[id];
+            if (record.compute_shader == invalid_shader && record.desc == desc) {
+                // a new fallback is the only thing a repeated request can
+                // change; it has to be older than the pipeline, which keeps
+                // the fallback chain free of cycles
+                if (desc.fallback < id) {
+                    record.desc.fallback = desc.fallback;
+                }
+                return id;
+            }
+        }
+        return add_record(hash, desc, invalid_shader);
+    }
+
+    PipelineId PipelineRegistry::request(const ComputePipelineDesc& desc) {
+        const uint64_t hash = desc.hash();
+        for (const PipelineId id : m_by_hash[hash]) {
+            Record& record = m_records[id];
+            if (record.compute_shader == desc.shader && record.desc.layout == desc.layout) {
+                if (desc.fallback < id) {
+                    record.desc.fallback = desc.fallback;
+                }
+                return id;
+            }
+        }
+
+        GraphicsPipelineDesc stored;
+        stored.layout = desc.layout;
+        stored.fallback = desc.fallback;
+        return add_record(hash, stored, desc.shader);
+    }
+
+    PipelineId PipelineRegistry::add_record(uint64_t hash, const GraphicsPipelineDesc& desc, ShaderId compute_shader) {
+        const PipelineId id = static_cast<PipelineId>(m_records.size());
+        Record& record = m_records.emplace_back();
+        record.desc = desc;
+        record.compute_shader = compute_shader;
+        if (desc.layout != VK_NULL_HANDLE) {
+            record.layout = desc.layout;
+        } else if (compute_shader != invalid_shader) {
+            record.layout = layout_for({ compute_shader });
+        } else {
+            record.layout = layout_for({ desc.vertex_shader, desc.fragment_shader });
+        }
+        m_by_hash[hash].push_back(id);
+
+        queue_compile(id);
+        return id;
+    }
+
+    VkPipeline PipelineRegistry::get(PipelineId id) const {
+        // fallbacks are always older pipelines, so the chain ends
+        while (id != invalid_pipeline) {
+            const Record& record = m_records[id];
+            if (record.pipeline != VK_NULL_HANDLE) {
+                return record.pipeline;
+            }
+            id = record.desc.fallback;
+        }
+        return VK_NULL_HANDLE;
+    }
+
+    VkPipelineLayout PipelineRegistry::layout(PipelineId id) const {
+        while (id != invalid_pipeline) {
+            const Record& record = m_records[id];
+            if (record.pipeline != VK_NULL_HANDLE) {
+                return record.layout;
+            }
+            id = record.desc.fallback;
+        }
+        return VK_NULL_HANDLE;
+    }
+
+    bool PipelineRegistry::is_ready(PipelineId id) const {
+        return m_records[id].pipeline != VK_NULL_HANDLE && !m_records[id].pending;
+    }
+
+    void PipelineRegistry::update(uint64_t frame_number, uint64_t completed_frames) {
+        std::vector<Result> results;
+        {
+            std::lock_guard lock(m_results_mutex);
+            results.swap(m_results);
+        }
+
+        for (const Result& result : results) {
+            Record& record = m_records[result.id];
+            if (result.generation != record.generation) {
+                // superseded by a later recompile, never handed out
+                vkDestroyPipeline(m_device, result.pipeline, nullptr);
+                continue;
+            }
+            record.pending = false;
+            if (result.pipeline == VK_NULL_HANDLE) {
+                ++m_stats.failed;
+                continue;
+            }
+            if (record.pipeline != VK_NULL_HANDLE) {
+                // frames already recorded may still use the old one
+                m_retired.push_back({ record.pipeline, frame_number });
+            }
+            record.pipeline = result.pipeline;
+            ++m_stats.compiled;
+            m_stats.compile_ms += result.ms;
+            m_stats.max_compile_ms = std::max(m_stats.max_compile_ms, result.ms);
+        }
+
+        std::erase_if(m_retired, [&](const Retired& retired) {
+            if (retired.frame >= completed_frames) {
+                return false;
+            }
+            vkDestroyPipeline(m_device, retired.pipeline, nullptr);
+            return true;
+        });
+
+        if (!m_startup_reported && !m_records.empty() && !results.empty()) {
+            const bool pending = std::any_of(m_records.begin(), m_records.end(), [](const Record& record) {
+                return record.pending;
+            });
+            if (!pending) {
+                m_startup_reported = true;
+                m_stats.startup_ms = std::chrono::duration<double, std::milli>(clock::now() - m_created).count();
+                m_logger->info(
+                    "{} pipeline(s) ready after {:.2f} ms ({} start, {:.2f} ms compiling, slowest {:.2f} ms)",
+                    m_stats.compiled,
+                    m_stats.startup_ms,
+                    m_stats.cache_loaded ? "warm" : "cold",
+                    m_stats.compile_ms,
+                    m_stats.max_compile_ms
+                );
+            }
+        }
+    }
+
+    void PipelineRegistry::shaders_changed(std::span<const ShaderId> shaders) {
+        if (shaders.empty()) {
+            return;
+        }
+        for (PipelineId id = 0; id < m_records.size(); ++id) {
+            const Record& record = m_records[id];
+            const bool affected = std::any_of(shaders.begin(), shaders.end(), [&](ShaderId shader) {
+                return shader == record.desc.vertex_shader
+                    || shader == record.desc.fragment_shader
+                    || shader == record.compute_shader;
+            });
+            if (affected) {
+                queue_compile(id);
+            }
+        }
+    }
+
+    void PipelineRegistry::wait_idle() {
+        std::unique_lock lock(m_results_mutex);
+        m_results_cv.wait(lock, [this]() { return m_in_flight == 0; });
+    }
+
+    void PipelineRegistry::save_cache() {
+        size_t size = 0;
+        if (!check_vk(vkGetPipelineCacheData(m_device, m_cache, &size, nullptr)) || size == 0) {
+            return;
+        }
+        std::vector<std::byte> data(size);
+        if (!check_vk(vkGetPipelineCacheData(m_device, m_cache, &size, data.data()))) {
+            return;
+        }
+        data.resize(size);
+
+        CacheFileHeader header;
+        header.magic = cache_file_magic;
+        header.version = cache_file_version;
+        header.data_size = data.size();
+        header.data_hash = hash_bytes(data);
+
+        std::error_code error;
+        std::filesystem::create_directories(m_params.cache_path.parent_path(), error);
+        std::filesystem::path temporary = m_params.cache_path;
+        temporary += ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(data.data()), data.size());
+            if (!file) {
+                m_logger->warn("failed to write pipeline cache {}", temporary.string());
+                return;
+            }
+        }
+        std::filesystem::rename(temporary, m_params.cache_path, error);
+        if (error) {
+            m_logger->warn("failed to replace pipeline cache {}: {}", m_params.cache_path.string(), error.message());
+            return;
+        }
+        m_logger->info("saved {} bytes of pipeline cache to {}", data.size(), m_params.cache_path.string());
+    }
+
+    PipelineRegistryStats PipelineRegistry::stats() const {
+        PipelineRegistryStats stats = m_stats;
+        stats.pipelines = static_cast<uint32_t>(m_records.size());
+        stats.pending = static_cast<uint32_t>(std::count_if(m_records.begin(), m_records.end(), [](const Record& record) {
+            return record.pending;
+        }));
+        return stats;
+    }
+
+    void PipelineRegistry::queue_compile(PipelineId id) {
+        Record& record = m_records[id];
+        ++record.generation;
+        record.pending = true;
+
+        Job job;
+        job.id = id;
+        job.generation = record.generation;
+        job.desc = record.desc;
+        job.layout = record.layout;
+        if (record.desc.vertex_shader != invalid_shader) {
+            job.vertex = m_shaders.get(record.desc.vertex_shader).module;
+        }
+        if (record.desc.fragment_shader != invalid_shader) {
+            job.fragment = m_shaders.get(record.desc.fragment_shader).module;
+        }
+        if (record.compute_shader != invalid_shader) {
+            job.compute = m_shaders.get(record.compute_shader).module;
+        }
+
+        {
+            std::lock_guard lock(m_results_mutex);
+            ++m_in_flight;
+        }
+        m_jobs.push(std::move(job));
+    }
+
+    VkPipelineLayout PipelineRegistry::layout_for(std::initializer_list<ShaderId> shaders) {
+        // push constant blocks the stages share are merged into one range
+        std::vector<VkPushConstantRange> ranges;
+        for (const ShaderId shader : shaders) {
+            if (shader == invalid_shader) {
+                continue;
+            }
+            for (const VkPushConstantRange& range : m_shaders.get(shader).reflection().push_constants) {
+                auto it = std::find_if(ranges.begin(), ranges.end(), [&](const VkPushConstantRange& other) {
+                    return other.offset == range.offset && other.size == range.size;
+                });
+                if (it != ranges.end()) {
+                    it->stageFlags |= range.stageFlags;
+                } else {
+                    ranges.push_back(range);
+                }
+            }
+        }
+
+        const uint64_t hash = hash_bytes(ranges.data(), ranges.size() * sizeof(VkPushConstantRange));
+        if (auto it = m_layouts.find(hash); it != m_layouts.end()) {
+            return it->second;
+        }
+
+        VkPipelineLayoutCreateInfo layout_info = {};
+        layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layout_info.pNext = nullptr;
+        layout_info.flags = 0;
+        layout_info.setLayoutCount = 0;
+        layout_info.pSetLayouts = nullptr;
+        layout_info.pushConstantRangeCount = static_cast<uint32_t>(ranges.size());
+        layout_info.pPushConstantRanges = ranges.data();
+
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        check_vk(vkCreatePipelineLayout(m_device, &layout_info, nullptr, &layout));
+        m_layouts.emplace(hash, layout);
+        return layout;
+    }
+
+    void PipelineRegistry::compile_worker() {
+        while (auto job = m_jobs.pop()) {
+            const auto start = clock::now();
+            const VkPipeline pipeline = m_stopping ? VK_NULL_HANDLE : compile(*job);
+            const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+            {
+                std::lock_guard lock(m_results_mutex);
+                m_results.push_back({ job->id, job->generation, pipeline, ms });
+                --m_in_flight;
+            }
+            m_results_cv.notify_all();
+        }
+    }
+
+    VkPipeline PipelineRegistry::compile(const Job& job) const {
+        if (job.compute) {
+            return compile_compute(job);
+        }
+        const GraphicsPipelineDesc& desc = job.desc;
+
+        std::vector<VkPipelineShaderStageCreateInfo> stages;
+        for (const auto& module : { job.vertex, job.fragment }) {
+            if (!module) {
+                continue;
+            }
+            VkPipelineShaderStageCreateInfo stage_info = {};
+            stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+            stage_info.pNext = nullptr;
+            stage_info.stage = module->reflection.stage;
+            stage_info.module = module->module;
+            stage_info.pName = module->reflection.entry_point.c_str();
+            stages.push_back(stage_info);
+        }
+
+        VkPipelineVertexInputStateCreateInfo vertex_input_info = {};
+        vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertex_input_info.pNext = nullptr;
+        vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertex_input.bindings.size());
+        vertex_input_info.pVertexBindingDescriptions = desc.vertex_input.bindings.data();
+        vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertex_input.attributes.size());
+        vertex_input_info.pVertexAttributeDescriptions = desc.vertex_input.attributes.data();
+
+        VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+        input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        input_assembly.pNext = nullptr;
+        input_assembly.topology = desc.topology;
+        input_assembly.primitiveRestartEnable = VK_FALSE;
+
+        // viewport and scissor are dynamic, only the counts matter here
+        VkPipelineViewportStateCreateInfo viewport_state = {};
+        viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewport_state.pNext = nullptr;
+        viewport_state.viewportCount = 1;
+        viewport_state.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterizer = {};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.pNext = nullptr;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = desc.polygon_mode;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = desc.cull_mode;
+        rasterizer.frontFace = desc.front_face;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling = {};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.pNext = nullptr;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.minSampleShading = 1.0f;
+
+        VkPipelineDepthStencilStateCreateInfo depth_stencil = {};
+        depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depth_stencil.pNext = nullptr;
+        depth_stencil.depthTestEnable = desc.depth_test ? VK_TRUE : VK_FALSE;
+        depth_stencil.depthWriteEnable = desc.depth_write ? VK_TRUE : VK_FALSE;
+        depth_stencil.depthCompareOp = desc.depth_test ? desc.depth_compare : VK_COMPARE_OP_ALWAYS;
+        depth_stencil.depthBoundsTestEnable = VK_FALSE;
+        depth_stencil.stencilTestEnable = VK_FALSE;
+        depth_stencil.minDepthBounds = 0.0f;
+        depth_stencil.maxDepthBounds = 1.0f;
+
+        VkPipelineColorBlendAttachmentState blend_attachment = {};
+        blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT
+            | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        blend_attachment.blendEnable = desc.blend != BlendMode::opaque ? VK_TRUE : VK_FALSE;
+        blend_attachment.srcColorBlendFactor = desc.blend == BlendMode::alpha ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+        blend_attachment.dstColorBlendFactor = desc.blend == BlendMode::alpha ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+        blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+        blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        blend_attachment.dstAlphaBlendFactor = desc.blend == BlendMode::alpha ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+        blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+        VkPipelineColorBlendStateCreateInfo color_blending = {};
+        color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        color_blending.pNext = nullptr;
+        color_blending.logicOpEnable = VK_FALSE;
+        color_blending.logicOp = VK_LOGIC_OP_COPY;
+        color_blending.attachmentCount = 1;
+        color_blending.pAttachments = &blend_attachment;
+
+        const std::array<VkDynamicState, 2> dynamic_states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+        VkPipelineDynamicStateCreateInfo dynamic_state = {};
+        dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamic_state.pNext = nullptr;
+        dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+        dynamic_state.pDynamicStates = dynamic_states.data();
+
+        VkGraphicsPipelineCreateInfo pipeline_info = {};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipeline_info.pNext = nullptr;
+        pipeline_info.stageCount = static_cast<uint32_t>(stages.size());
+        pipeline_info.pStages = stages.data();
+        pipeline_info.pVertexInputState = &vertex_input_info;
+        pipeline_info.pInputAssemblyState = &input_assembly;
+        pipeline_info.pViewportState = &viewport_state;
+        pipeline_info.pRasterizationState = &rasterizer;
+        pipeline_info.pMultisampleState = &multisampling;
+        pipeline_info.pDepthStencilState = &depth_stencil;
+        pipeline_info.pColorBlendState = &color_blending;
+        pipeline_info.pDynamicState = &dynamic_state;
+        pipeline_info.layout = job.layout;
+        pipeline_info.renderPass = desc.render_pass;
+        pipeline_info.subpass = desc.subpass;
+        pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+        // the cache is internally synchronised, all workers share it
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        if (!check_vk(vkCreateGraphicsPipelines(m_device, m_cache, 1, &pipeline_info, nullptr, &pipeline))) {
+            m_logger->error("failed to compile pipeline {}", job.id);
+            return VK_NULL_HANDLE;
+        }
+        return pipeline;
+    }
+
+    VkPipeline PipelineRegistry::compile_compute(const Job& job) const {
+        VkPipelineShaderStageCreateInfo stage_info = {};
+        stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stage_info.pNext = nullptr;
+        stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        stage_info.module = job.compute->module;
+        stage_info.pName = job.compute->reflection.entry_point.c_str();
+
+        VkComputePipelineCreateInfo pipeline_info = {};
+        pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_info.pNext = nullptr;
+        pipeline_info.flags = 0;
+        pipeline_info.stage = stage_info;
+        pipeline_info.layout = job.layout;
+        pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+        pipeline_info.basePipelineIndex = -1;
+
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        if (!check_vk(vkCreateComputePipelines(m_device, m_cache, 1, &pipeline_info, nullptr, &pipeline))) {
+            m_logger->error("failed to compile compute pipeline {}", job.id);
+            return VK_NULL_HANDLE;
+        }
+        return pipeline;
+    }
+
+    void PipelineRegistry::load_cache(VkPhysicalDevice physical_device) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+        MappedFile file;
+        std::span<const std::byte> data;
+        if (m_params.load_cache) {
+            file = MappedFile(m_params.cache_path);
+        }
+        if (file.is_open() && file.size() >= sizeof(CacheFileHeader)) {
+            CacheFileHeader header;
+            std::memcpy(&header, file.data(), sizeof(header));
+            const auto blob = file.bytes().subspan(sizeof(header));
+            if (header.magic != cache_file_magic
+                || header.version != cache_file_version
+                || header.data_size != blob.size()
+                || header.data_hash != hash_bytes(blob)) {
+                m_logger->warn("pipeline cache {} is corrupted, starting cold", m_params.cache_path.string());
+            } else if (!matches_device(blob, properties)) {
+                m_logger->info("pipeline cache {} belongs to another device or driver, starting cold", m_params.cache_path.string());
+            } else {
+                data = blob;
+            }
+        }
+
+        VkPipelineCacheCreateInfo cache_info = {};
+        cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cache_info.pNext = nullptr;
+        cache_info.flags = 0;
+        cache_info.initialDataSize = data.size();
+        cache_info.pInitialData = data.data();
+        if (!check_vk(vkCreatePipelineCache(m_device, &cache_info, nullptr, &m_cache)) && !data.empty()) {
+            // a driver may still reject a blob that passed our checks
+            cache_info.initialDataSize = 0;
+            cache_info.pInitialData = nullptr;
+            data = {};
+            check_vk(vkCreatePipelineCache(m_device, &cache_info, nullptr, &m_cache));
+        }
+
+        m_stats.cache_loaded = !data.empty();
+        m_stats.cache_bytes_loaded = data.size();
+        if (m_stats.cache_loaded) {
+            m_logger->info("loaded {} bytes of pipeline cache from {}", data.size(), m_params.cache_path.string());
+        }
+    }
+}
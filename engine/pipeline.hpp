@@ -0,0 +1,223 @@
+#pragma once
+
+#include "bounded_queue.hpp"
+#include "logger.hpp"
+#include "mesh.hpp"
+#include "shader_library.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+namespace engine {
+
+    using PipelineId = uint32_t;
+    constexpr PipelineId invalid_pipeline = ~0u;
+
+    enum class BlendMode : uint32_t {
+        opaque,
+        alpha,
+        additive
+    };
+
+    // Everything that goes into vkCreateGraphicsPipelines. Viewport and scissor
+    // are dynamic, so the same pipeline survives a swapchain resize.
+    struct GraphicsPipelineDesc {
+        ShaderId vertex_shader = invalid_shader;
+        ShaderId fragment_shader = invalid_shader;
+        VertexInputDescription vertex_input;
+
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+        VkCullModeFlags cull_mode = VK_CULL_MODE_NONE;
+        VkFrontFace front_face = VK_FRONT_FACE_CLOCKWISE;
+
+        bool depth_test = false;
+        bool depth_write = false;
+        VkCompareOp depth_compare = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+        BlendMode blend = BlendMode::opaque;
+
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        uint32_t subpass = 0;
+        // VK_NULL_HANDLE builds one from the push constants the shaders reflect
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+
+        // used by get() while this pipeline is still compiling; has to be
+        // requested before this one
+        PipelineId fallback = invalid_pipeline;
+
+        uint64_t hash() const;
+        bool operator==(const GraphicsPipelineDesc& other) const;
+    };
+
+    struct ComputePipelineDesc {
+        ShaderId shader = invalid_shader;
+        // VK_NULL_HANDLE builds one from the push constants the shader reflects
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        PipelineId fallback = invalid_pipeline;
+
+        uint64_t hash() const;
+        bool operator==(const ComputePipelineDesc& other) const;
+    };
+
+    struct PipelineRegistryParams {
+        PipelineRegistryParams();
+
+        // 0 picks the hardware concurrency minus the render thread
+        uint32_t compile_threads;
+        // where the VkPipelineCache blob is kept between runs
+        std::filesystem::path cache_path;
+        // false ignores the stored blob, i.e. forces a cold start
+        bool load_cache;
+    };
+
+    struct PipelineRegistryStats {
+        uint32_t pipelines = 0;
+        uint32_t pending = 0;
+        uint32_t compiled = 0;
+        uint32_t failed = 0;
+        // compile time summed over the workers, and the slowest pipeline
+        double compile_ms = 0.0;
+        double max_compile_ms = 0.0;
+        // from construction until the first batch of requests was compiled
+        double startup_ms = 0.0;
+        // warm start: a valid cache blob for this device was loaded
+        bool cache_loaded = false;
+        size_t cache_bytes_loaded = 0;
+    };
+
+    // Compiles every distinct pipeline description once, on worker threads,
+    // through a VkPipelineCache that is persisted across runs. The render
+    // thread never waits for a compile: get() hands out the fallback (or
+    // nothing) until the pipeline is ready. Hot reloaded shaders trigger a
+    // recompile, and the old pipeline keeps being used until the new one is
+    // done.
+    class PipelineRegistry {
+    public:
+        PipelineRegistry(
+            VkPhysicalDevice physical_device,
+            VkDevice device,
+            ShaderLibrary& shaders,
+            const PipelineRegistryParams& params = PipelineRegistryParams()
+        );
+        ~PipelineRegistry();
+
+        PipelineRegistry(const PipelineRegistry&) = delete;
+        PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+        // Returns the id of an identical description if there is one,
+        // otherwise queues a compile. Render thread only.
+        PipelineId request(const GraphicsPipelineDesc& desc);
+        PipelineId request(const ComputePipelineDesc& desc);
+
+        // The compiled pipeline, the fallback's while it is pending, or
+        // VK_NULL_HANDLE if neither is ready (skip the draw).
+        VkPipeline get(PipelineId id) const;
+        VkPipelineLayout layout(PipelineId id) const;
+        bool is_ready(PipelineId id) const;
+
+        // Render thread, once per frame: publishes finished compiles and
+        // destroys replaced pipelines no frame can use anymore.
+        void update(uint64_t frame_number, uint64_t completed_frames);
+
+        // recompiles the pipelines built from these shaders
+        void shaders_changed(std::span<const ShaderId> shaders);
+
+        // blocks until nothing is compiling; for loading screens and tests
+        void wait_idle();
+
+        // writes the pipeline cache blob, also done on destruction
+        void save_cache();
+
+        PipelineRegistryStats stats() const;
+
+    private:
+        // Compute pipelines keep their layout and fallback in `desc` as well,
+        // everything else in it stays at its default.
+        struct Record {
+            GraphicsPipelineDesc desc;
+            ShaderId compute_shader = invalid_shader;
+            VkPipelineLayout layout = VK_NULL_HANDLE;
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            // bumped by every recompile, stale results are dropped
+            uint32_t generation = 0;
+            bool pending = false;
+        };
+
+        struct Job {
+            PipelineId id;
+            uint32_t generation;
+            GraphicsPipelineDesc desc;
+            VkPipelineLayout layout;
+            // keeps the modules alive even if a hot reload replaces them
+            std::shared_ptr<const ShaderModule> vertex;
+            std::shared_ptr<const ShaderModule> fragment;
+            std::shared_ptr<const ShaderModule> compute;
+        };
+
+        struct Result {
+            PipelineId id;
+            uint32_t generation;
+            VkPipeline pipeline;
+            double ms;
+        };
+
+        struct Retired {
+            VkPipeline pipeline;
+            uint64_t frame;
+        };
+
+        PipelineId add_record(uint64_t hash, const GraphicsPipelineDesc& desc, ShaderId compute_shader);
+        void queue_compile(PipelineId id);
+        VkPipelineLayout layout_for(std::initializer_list<ShaderId> shaders);
+        void compile_worker();
+        VkPipeline compile(const Job& job) const;
+        VkPipeline compile_compute(const Job& job) const;
+
+        void load_cache(VkPhysicalDevice physical_device);
+
+    private:
+        VkDevice m_device;
+        ShaderLibrary& m_shaders;
+        PipelineRegistryParams m_params;
+
+        VkPipelineCache m_cache = VK_NULL_HANDLE;
+
+        std::vector<Record> m_records;
+        std::unordered_map<uint64_t, std::vector<PipelineId>> m_by_hash;
+        // layouts built from reflected push constants, by range hash
+        std::unordered_map<uint64_t, VkPipelineLayout> m_layouts;
+
+        BoundedQueue<Job> m_jobs;
+        std::vector<std::thread> m_workers;
+        // set on destruction, queued jobs are dropped instead of compiled
+        std::atomic<bool> m_stopping = false;
+
+        mutable std::mutex m_results_mutex;
+        std::condition_variable m_results_cv;
+        std::vector<Result> m_results;
+        uint32_t m_in_flight = 0;
+
+        std::vector<Retired> m_retired;
+
+        std::chrono::steady_clock::time_point m_created;
+        PipelineRegistryStats m_stats;
+        bool m_startup_reported = false;
+
+        logger_t m_logger;
+    };
+}
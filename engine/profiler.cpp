@@ -0,0 +1,382 @@
+#include "profiler.hpp"
+#include "logger.hpp"
+#include "vk_util.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+
+namespace engine {
+
+    uint64_t profiler::now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+#if ENGINE_PROFILING
+    namespace {
+
+        struct TraceEvent {
+            const char* name;
+            uint64_t begin_ns;
+            uint64_t end_ns;
+        };
+
+        // One thread's ring. Only its thread writes; the mutex is there for
+        // the exporter and is uncontended otherwise.
+        struct Track {
+            std::mutex mutex;
+            uint32_t id = 0;
+            std::string name;
+            std::vector<TraceEvent> events;
+            uint64_t count = 0;
+
+            void push(const char* event_name, uint64_t begin_ns, uint64_t end_ns) {
+                std::lock_guard lock(mutex);
+                if (events.empty()) {
+                    events.resize(profiler::ring_size);
+                }
+                events[count % profiler::ring_size] = { event_name, begin_ns, end_ns };
+                ++count;
+            }
+        };
+
+        // tracks outlive their threads, so a trace still shows finished workers
+        struct TrackRegistry {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<Track>> tracks;
+
+            Track& add(std::string name) {
+                std::lock_guard lock(mutex);
+                auto& track = tracks.emplace_back(std::make_unique<Track>());
+                track->id = static_cast<uint32_t>(tracks.size());
+                track->name = name.empty() ? "thread " + std::to_string(track->id) : std::move(name);
+                return *track;
+            }
+        };
+
+        TrackRegistry& registry() {
+            static TrackRegistry registry;
+            return registry;
+        }
+
+        thread_local Track* t_track = nullptr;
+
+        Track& thread_track() {
+            if (t_track == nullptr) {
+                t_track = &registry().add({});
+            }
+            return *t_track;
+        }
+
+        Track& gpu_track() {
+            static Track& track = registry().add("gpu");
+            return track;
+        }
+
+        void write_json_string(std::FILE* file, const std::string& text) {
+            std::fputc('"', file);
+            for (const char c : text) {
+                if (c == '"' || c == '\\') {
+                    std::fputc('\\', file);
+                }
+                std::fputc(c, file);
+            }
+            std::fputc('"', file);
+        }
+    }
+
+    void profiler::set_thread_name(std::string name) {
+        if (t_track == nullptr) {
+            t_track = &registry().add(std::move(name));
+            return;
+        }
+        std::lock_guard lock(t_track->mutex);
+        t_track->name = std::move(name);
+    }
+
+    void profiler::record(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+        thread_track().push(name, begin_ns, end_ns);
+    }
+
+    void profiler::record_gpu(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+        gpu_track().push(name, begin_ns, end_ns);
+    }
+
+    bool profiler::write_chrome_trace(const std::filesystem::path& path) {
+        std::FILE* file = std::fopen(path.string().c_str(), "wb");
+        if (file == nullptr) {
+            get_default_logger()->error("failed to open {}", path.string());
+            return false;
+        }
+
+        TrackRegistry& tracks = registry();
+        std::lock_guard registry_lock(tracks.mutex);
+
+        std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+        bool first = true;
+        const auto separate = [&]() {
+            if (!first) {
+                std::fputs(",\n", file);
+            }
+            first = false;
+        };
+
+        size_t event_count = 0;
+        for (const auto& track : tracks.tracks) {
+            std::lock_guard lock(track->mutex);
+
+            separate();
+            std::fprintf(file, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", track->id);
+            write_json_string(file, track->name);
+            std::fputs("}}", file);
+
+            // oldest first; whatever the ring overwrote is gone
+            const uint64_t available = std::min<uint64_t>(track->count, profiler::ring_size);
+            for (uint64_t i = track->count - available; i < track->count; ++i) {
+                const TraceEvent& event = track->events[i % profiler::ring_size];
+                separate();
+                std::fprintf(file, "{\"ph\":\"X\",\"name\":");
+                write_json_string(file, event.name);
+                std::fprintf(
+                    file,
+                    ",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    track->id,
+                    event.begin_ns / 1000.0,
+                    (event.end_ns - event.begin_ns) / 1000.0
+                );
+            }
+            event_count += available;
+        }
+        std::fputs("\n]}\n", file);
+
+        const bool written = std::fclose(file) == 0;
+        if (written) {
+            get_default_logger()->info("wrote {} zone(s) on {} track(s) to {}", event_count, tracks.tracks.size(), path.string());
+        }
+        return written;
+    }
+#else
+    void profiler::set_thread_name(std::string) {}
+    void profiler::record(const char*, uint64_t, uint64_t) {}
+    void profiler::record_gpu(const char*, uint64_t, uint64_t) {}
+
+    bool profiler::write_chrome_trace(const std::filesystem::path&) {
+        get_default_logger()->warn("profiling is compiled out, configure with -DENGINE_ENABLE_PROFILER=ON");
+        return false;
+    }
+#endif
+
+    GpuProfilerParams::GpuProfilerParams()
+    : max_zones(64)
+    {}
+
+    GpuProfiler::GpuProfiler(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        VkQueue queue,
+        uint32_t queue_family,
+        uint32_t frame_slots,
+        const GpuProfilerParams& params
+    )
+        : m_device(device)
+        , m_params(params) {
+#if ENGINE_PROFILING
+        VkPhysicalDeviceProperties properties = {};
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+        uint32_t family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> families(family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+
+        const uint32_t valid_bits = queue_family < family_count ? families[queue_family].timestampValidBits : 0;
+        if (valid_bits == 0 || properties.limits.timestampPeriod <= 0.0f) {
+            get_default_logger()->warn("the graphics queue has no timestamps, GPU zones are disabled");
+            return;
+        }
+        m_enabled = true;
+        m_period_ns = properties.limits.timestampPeriod;
+        m_tick_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+        VkQueryPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_info.pNext = nullptr;
+        pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        pool_info.queryCount = m_params.max_zones * 2;
+
+        m_slots.resize(frame_slots);
+        for (Slot& slot : m_slots) {
+            check_vk(vkCreateQueryPool(m_device, &pool_info, nullptr, &slot.pool));
+            slot.zones.reserve(m_params.max_zones);
+        }
+        m_results.resize(pool_info.queryCount);
+
+        calibrate(queue, queue_family);
+#else
+        (void)physical_device;
+        (void)queue;
+        (void)queue_family;
+        (void)frame_slots;
+#endif
+    }
+
+    GpuProfiler::~GpuProfiler() {
+        for (Slot& slot : m_slots) {
+            vkDestroyQueryPool(m_device, slot.pool, nullptr);
+        }
+    }
+
+    void GpuProfiler::begin_frame(VkCommandBuffer cmd, uint32_t frame_slot) {
+        if (!m_enabled) {
+            return;
+        }
+
+        Slot& slot = m_slots[frame_slot];
+        m_last_frame_end_ns = 0;
+        collect(slot);
+
+        // queries have to be reset before they are written again
+        vkCmdResetQueryPool(cmd, slot.pool, 0, m_params.max_zones * 2);
+        slot.zones.clear();
+        slot.used_queries = 0;
+        m_current = &slot;
+    }
+
+    uint32_t GpuProfiler::begin_zone(VkCommandBuffer cmd, const char* name) {
+        if (m_current == nullptr || m_current->zones.size() == m_params.max_zones) {
+            return no_zone;
+        }
+
+        Zone& zone = m_current->zones.emplace_back();
+        zone.name = name;
+        zone.begin_query = m_current->used_queries++;
+        zone.end_query = no_zone;
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_current->pool, zone.begin_query);
+        return static_cast<uint32_t>(m_current->zones.size() - 1);
+    }
+
+    void GpuProfiler::end_zone(VkCommandBuffer cmd, uint32_t zone) {
+        if (m_current == nullptr || zone == no_zone) {
+            return;
+        }
+
+        Zone& ended = m_current->zones[zone];
+        ended.end_query = m_current->used_queries++;
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_current->pool, ended.end_query);
+    }
+
+    void GpuProfiler::calibrate(VkQueue queue, uint32_t queue_family) {
+        VkCommandPoolCreateInfo pool_info = {};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.pNext = nullptr;
+        pool_info.queueFamilyIndex = queue_family;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        VkCommandPool command_pool = VK_NULL_HANDLE;
+        check_vk(vkCreateCommandPool(m_device, &pool_info, nullptr, &command_pool));
+
+        VkCommandBufferAllocateInfo buffer_info = {};
+        buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        buffer_info.pNext = nullptr;
+        buffer_info.commandPool = command_pool;
+        buffer_info.commandBufferCount = 1;
+        buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        VkCommandBuffer cmd = VK_NULL_HANDLE;
+        check_vk(vkAllocateCommandBuffers(m_device, &buffer_info, &cmd));
+
+        VkFenceCreateInfo fence_info = {};
+        fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fence_info.pNext = nullptr;
+        fence_info.flags = 0;
+        VkFence fence = VK_NULL_HANDLE;
+        check_vk(vkCreateFence(m_device, &fence_info, nullptr, &fence));
+
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.pNext = nullptr;
+        begin_info.pInheritanceInfo = nullptr;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        check_vk(vkBeginCommandBuffer(cmd, &begin_info));
+        const VkQueryPool query_pool = m_slots.front().pool;
+        vkCmdResetQueryPool(cmd, query_pool, 0, 1);
+        vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
+        check_vk(vkEndCommandBuffer(cmd));
+
+        VkSubmitInfo submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.pNext = nullptr;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &cmd;
+
+        // the timestamp is taken somewhere between the submit and the fence
+        // wake up; the middle is off by at most half of that
+        const uint64_t submit_ns = profiler::now_ns();
+        check_vk(vkQueueSubmit(queue, 1, &submit, fence));
+        check_vk(vkWaitForFences(m_device, 1, &fence, true, 1000000000));
+        const uint64_t done_ns = profiler::now_ns();
+
+        uint64_t ticks = 0;
+        if (check_vk(vkGetQueryPoolResults(m_device, query_pool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks), VK_QUERY_RESULT_64_BIT))) {
+            m_calibration_ticks = ticks & m_tick_mask;
+            m_calibration_ns = submit_ns + (done_ns - submit_ns) / 2;
+        }
+
+        vkDestroyFence(m_device, fence, nullptr);
+        vkDestroyCommandPool(m_device, command_pool, nullptr);
+
+        get_default_logger()->info(
+            "gpu timestamps: {:.2f} ns per tick, calibrated within {:.3f} ms",
+            m_period_ns,
+            (done_ns - submit_ns) / 2e6
+        );
+    }
+
+    void GpuProfiler::collect(Slot& slot) {
+        if (slot.used_queries == 0) {
+            return;
+        }
+
+        // the slot's fence has signalled, so this does not wait; NOT_READY
+        // only happens if the frame was never submitted
+        const VkResult result = vkGetQueryPoolResults(
+            m_device,
+            slot.pool,
+            0,
+            slot.used_queries,
+            slot.used_queries * sizeof(uint64_t),
+            m_results.data(),
+            sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT
+        );
+        if (result != VK_SUCCESS) {
+            return;
+        }
+
+        uint64_t frame_begin = ~0ull;
+        uint64_t frame_end = 0;
+        for (const Zone& zone : slot.zones) {
+            if (zone.end_query == no_zone) {
+                continue;
+            }
+            const uint64_t begin = to_cpu_ns(m_results[zone.begin_query]);
+            const uint64_t end = std::max(begin, to_cpu_ns(m_results[zone.end_query]));
+            profiler::record_gpu(zone.name, begin, end);
+            frame_begin = std::min(frame_begin, begin);
+            frame_end = std::max(frame_end, end);
+        }
+        if (frame_end > 0) {
+            m_last_frame_ms = (frame_end - frame_begin) / 1e6;
+            m_last_frame_end_ns = frame_end;
+        }
+    }
+
+    uint64_t GpuProfiler::to_cpu_ns(uint64_t ticks) const {
+        // ticks only count up from the calibration, modulo the valid bits
+        const uint64_t elapsed = ((ticks & m_tick_mask) - m_calibration_ticks) & m_tick_mask;
+        return m_calibration_ns + static_cast<uint64_t>(elapsed * m_period_ns);
+    }
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Set by the ENGINE_ENABLE_PROFILER cmake option. Without it the zone macros
+// expand to nothing and GpuProfiler records no queries.
+#ifndef ENGINE_PROFILING
+#define ENGINE_PROFILING 0
+#endif
+
+#define ENGINE_PROFILE_CONCAT_INNER(a, b) a##b
+#define ENGINE_PROFILE_CONCAT(a, b) ENGINE_PROFILE_CONCAT_INNER(a, b)
+
+#if ENGINE_PROFILING
+// Times the enclosing scope on the calling thread. `name` must outlive the
+// profiler, string literals do.
+#define ENGINE_PROFILE_ZONE(name) ::engine::CpuZone ENGINE_PROFILE_CONCAT(engine_zone_, __LINE__)(name)
+// Times the commands recorded into `cmd` while the enclosing scope is open.
+#define ENGINE_PROFILE_GPU_ZONE(profiler, cmd, name) \
+    ::engine::GpuZone ENGINE_PROFILE_CONCAT(engine_gpu_zone_, __LINE__)(profiler, cmd, name)
+#define ENGINE_PROFILE_THREAD(name) ::engine::profiler::set_thread_name(name)
+#else
+#define ENGINE_PROFILE_ZONE(name) do {} while (false)
+#define ENGINE_PROFILE_GPU_ZONE(profiler, cmd, name) do {} while (false)
+#define ENGINE_PROFILE_THREAD(name) do {} while (false)
+#endif
+
+
+namespace engine {
+
+    namespace profiler {
+
+        // steady clock, the time base of every CPU and GPU zone
+        uint64_t now_ns();
+
+        // names the calling thread's track in the trace
+        void set_thread_name(std::string name);
+
+        // Appends a finished zone to the calling thread's ring. Every thread
+        // keeps its last `ring_size` zones; older ones are overwritten.
+        void record(const char* name, uint64_t begin_ns, uint64_t end_ns);
+        // same, on the track of GPU zones
+        void record_gpu(const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+        // Writes every zone still in the rings as Chrome trace event JSON,
+        // which chrome://tracing and ui.perfetto.dev open. False if profiling
+        // is compiled out or the file could not be written.
+        bool write_chrome_trace(const std::filesystem::path& path);
+
+        constexpr uint32_t ring_size = 1 << 16;
+    }
+
+    class CpuZone {
+    public:
+        explicit CpuZone(const char* name)
+            : m_name(name)
+            , m_begin(profiler::now_ns()) {}
+
+        ~CpuZone() {
+            profiler::record(m_name, m_begin, profiler::now_ns());
+        }
+
+        CpuZone(const CpuZone&) = delete;
+        CpuZone& operator=(const CpuZone&) = delete;
+
+    private:
+        const char* m_name;
+        uint64_t m_begin;
+    };
+
+    struct GpuProfilerParams {
+        GpuProfilerParams();
+
+        // zones per frame, each takes two timestamp queries
+        uint32_t max_zones;
+    };
+
+    // GPU zones from timestamp queries, one query pool per frame slot. A
+    // slot's results are read when the slot comes around again, after its
+    // fence, so reading them never waits for the GPU. Timestamps are mapped
+    // onto the CPU clock by one calibration submit at start up.
+    class GpuProfiler {
+    public:
+        GpuProfiler(
+            VkPhysicalDevice physical_device,
+            VkDevice device,
+            VkQueue queue,
+            uint32_t queue_family,
+            uint32_t frame_slots,
+            const GpuProfilerParams& params = GpuProfilerParams()
+        );
+        ~GpuProfiler();
+
+        GpuProfiler(const GpuProfiler&) = delete;
+        GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+        // Call at the start of the slot's command buffer, once its fence has
+        // signalled: publishes the slot's previous zones and resets its queries.
+        void begin_frame(VkCommandBuffer cmd, uint32_t frame_slot);
+
+        // index for end_zone, or no_zone if the frame ran out of queries
+        uint32_t begin_zone(VkCommandBuffer cmd, const char* name);
+        void end_zone(VkCommandBuffer cmd, uint32_t zone);
+
+        // first zone begin to last zone end of the latest published frame
+        double last_frame_ms() const { return m_last_frame_ms; }
+        // profiler::now_ns() time the last zone of the frame published by the
+        // latest begin_frame() ended, 0 if it had none
+        uint64_t last_frame_end_ns() const { return m_last_frame_end_ns; }
+        // false without timestamp support on the queue
+        bool enabled() const { return m_enabled; }
+
+        static constexpr uint32_t no_zone = ~0u;
+
+    private:
+        struct Zone {
+            const char* name;
+            uint32_t begin_query;
+            uint32_t end_query;
+        };
+
+        struct Slot {
+            VkQueryPool pool = VK_NULL_HANDLE;
+            std::vector<Zone> zones;
+            uint32_t used_queries = 0;
+        };
+
+        void calibrate(VkQueue queue, uint32_t queue_family);
+        void collect(Slot& slot);
+        uint64_t to_cpu_ns(uint64_t ticks) const;
+
+    private:
+        VkDevice m_device;
+        GpuProfilerParams m_params;
+        bool m_enabled = false;
+
+        double m_period_ns = 1.0;
+        uint64_t m_tick_mask = ~0ull;
+        // one GPU tick and CPU time taken at the same moment
+        uint64_t m_calibration_ticks = 0;
+        uint64_t m_calibration_ns = 0;
+
+        std::vector<Slot> m_slots;
+        Slot* m_current = nullptr;
+        std::vector<uint64_t> m_results;
+        double m_last_frame_ms = 0.0;
+        uint64_t m_last_frame_end_ns = 0;
+    };
+
+    class GpuZone {
+    public:
+        GpuZone(GpuProfiler& profiler, VkCommandBuffer cmd, const char* name)
+            : m_profiler(profiler)
+            , m_cmd(cmd)
+            , m_zone(profiler.begin_zone(cmd, name)) {}
+
+        ~GpuZone() {
+            m_profiler.end_zone(m_cmd, m_zone);
+        }
+
+        GpuZone(const GpuZone&) = delete;
+        GpuZone& operator=(const GpuZone&) = delete;
+
+    private:
+        GpuProfiler& m_profiler;
+        VkCommandBuffer m_cmd;
+        uint32_t m_zone;
+    };
+}
@@ -0,0 +1,59 @@
+#include "readback.hpp"
+#include "logger.hpp"
+
+#include <fstream>
+#include <vector>
+
+#include <spdlog/fmt/fmt.h>
+
+
+namespace engine {
+
+    bool write_ppm(const std::filesystem::path& path, const ReadbackImage& image) {
+        bool swap_red_blue;
+        switch (image.format) {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            swap_red_blue = false;
+            break;
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            swap_red_blue = true;
+            break;
+        default:
+            return false;
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        file << "P6\n" << image.width << ' ' << image.height << "\n255\n";
+
+        std::vector<char> row(image.width * 3);
+        for (uint32_t y = 0; y < image.height; ++y) {
+            const std::byte* src = image.data + y * image.row_pitch;
+            for (uint32_t x = 0; x < image.width; ++x) {
+                const std::byte* pixel = src + x * 4;
+                row[x * 3 + 0] = static_cast<char>(pixel[swap_red_blue ? 2 : 0]);
+                row[x * 3 + 1] = static_cast<char>(pixel[1]);
+                row[x * 3 + 2] = static_cast<char>(pixel[swap_red_blue ? 0 : 2]);
+            }
+            file.write(row.data(), row.size());
+        }
+
+        return file.good();
+    }
+
+    readback_callback_t make_ppm_writer(std::filesystem::path directory) {
+        std::filesystem::create_directories(directory);
+
+        return [directory = std::move(directory)](const ReadbackImage& image) {
+            auto path = directory / fmt::format("frame_{:06}.ppm", image.frame_number);
+            if (!write_ppm(path, image)) {
+                get_default_logger()->error("failed to write {}", path.string());
+            }
+        };
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+
+namespace engine {
+
+    // One finished headless frame. `data` points into a mapped staging buffer
+    // and is only valid for the duration of the callback.
+    struct ReadbackImage {
+        uint64_t frame_number;
+        uint32_t width;
+        uint32_t height;
+        VkFormat format;
+        size_t row_pitch;
+        const std::byte* data;
+    };
+
+    using readback_callback_t = std::function<void(const ReadbackImage&)>;
+
+    // writes the RGB channels of an 8 bit RGBA/BGRA image as binary PPM
+    bool write_ppm(const std::filesystem::path& path, const ReadbackImage& image);
+
+    // callback that stores every frame as <directory>/frame_<number>.ppm
+    readback_callback_t make_ppm_writer(std::filesystem::path directory);
+}
@@ -0,0 +1,1399 @@
+#include "render_graph.hpp"
+#include "hash.hpp"
+#include "vk_util.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+
+namespace engine {
+
+    namespace {
+
+        using clock = std::chrono::steady_clock;
+
+        constexpr uint32_t none = ~0u;
+
+        // plans and framebuffers unused for this many frames are released
+        constexpr uint64_t release_after_frames = 120;
+
+        constexpr VkAccessFlags write_access_mask =
+            VK_ACCESS_SHADER_WRITE_BIT
+            | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+            | VK_ACCESS_TRANSFER_WRITE_BIT
+            | VK_ACCESS_HOST_WRITE_BIT
+            | VK_ACCESS_MEMORY_WRITE_BIT;
+
+        struct AccessInfo {
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags stages = 0;
+            VkAccessFlags access = 0;
+            bool write = false;
+        };
+
+        bool is_attachment(ImageUsage usage) {
+            return usage == ImageUsage::color_attachment
+                || usage == ImageUsage::depth_attachment
+                || usage == ImageUsage::depth_read
+                || usage == ImageUsage::input_attachment;
+        }
+
+        bool has_stencil(VkFormat format) {
+            return format == VK_FORMAT_S8_UINT
+                || format == VK_FORMAT_D16_UNORM_S8_UINT
+                || format == VK_FORMAT_D24_UNORM_S8_UINT
+                || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+        }
+
+        VkImageAspectFlags aspect_for(VkFormat format) {
+            switch (format) {
+            case VK_FORMAT_D16_UNORM:
+            case VK_FORMAT_X8_D24_UNORM_PACK32:
+            case VK_FORMAT_D32_SFLOAT:
+                return VK_IMAGE_ASPECT_DEPTH_BIT;
+            case VK_FORMAT_S8_UINT:
+                return VK_IMAGE_ASPECT_STENCIL_BIT;
+            case VK_FORMAT_D16_UNORM_S8_UINT:
+            case VK_FORMAT_D24_UNORM_S8_UINT:
+            case VK_FORMAT_D32_SFLOAT_S8_UINT:
+                return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+            default:
+                return VK_IMAGE_ASPECT_COLOR_BIT;
+            }
+        }
+
+        VkImageUsageFlags image_usage_for(ImageUsage usage) {
+            switch (usage) {
+            case ImageUsage::color_attachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+            case ImageUsage::depth_attachment:
+            case ImageUsage::depth_read: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            case ImageUsage::input_attachment: return VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+            case ImageUsage::sampled: return VK_IMAGE_USAGE_SAMPLED_BIT;
+            case ImageUsage::storage_read:
+            case ImageUsage::storage_write: return VK_IMAGE_USAGE_STORAGE_BIT;
+            case ImageUsage::transfer_src: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            case ImageUsage::transfer_dst: return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            }
+            return 0;
+        }
+
+        AccessInfo image_access(ImageUsage usage, VkPipelineStageFlags stages) {
+            switch (usage) {
+            case ImageUsage::color_attachment:
+                // blending and LOAD_OP_LOAD read the attachment as well
+                return {
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    true
+                };
+            case ImageUsage::depth_attachment:
+                return {
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    true
+                };
+            case ImageUsage::depth_read:
+                return {
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+                    false
+                };
+            case ImageUsage::input_attachment:
+                return {
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+                    false
+                };
+            case ImageUsage::sampled:
+                return { VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, stages, VK_ACCESS_SHADER_READ_BIT, false };
+            case ImageUsage::storage_read:
+                return { VK_IMAGE_LAYOUT_GENERAL, stages, VK_ACCESS_SHADER_READ_BIT, false };
+            case ImageUsage::storage_write:
+                return { VK_IMAGE_LAYOUT_GENERAL, stages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true };
+            case ImageUsage::transfer_src:
+                return { VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, false };
+            case ImageUsage::transfer_dst:
+                return { VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, true };
+            }
+            return {};
+        }
+
+        AccessInfo buffer_access(BufferUsage usage, VkPipelineStageFlags stages, bool write) {
+            AccessInfo info;
+            info.write = write;
+            switch (usage) {
+            case BufferUsage::vertex:
+                info.stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+                info.access = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+                break;
+            case BufferUsage::index:
+                info.stages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+                info.access = VK_ACCESS_INDEX_READ_BIT;
+                break;
+            case BufferUsage::indirect:
+                info.stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+                info.access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+                break;
+            case BufferUsage::uniform:
+                info.stages = stages != 0 ? stages : VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+                info.access = VK_ACCESS_UNIFORM_READ_BIT;
+                break;
+            case BufferUsage::storage_read:
+                info.stages = stages != 0 ? stages : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+                info.access = VK_ACCESS_SHADER_READ_BIT;
+                break;
+            case BufferUsage::storage_write:
+                info.stages = stages != 0 ? stages : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+                info.access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+                break;
+            case BufferUsage::transfer_src:
+                info.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+                info.access = VK_ACCESS_TRANSFER_READ_BIT;
+                break;
+            case BufferUsage::transfer_dst:
+                info.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+                info.access = VK_ACCESS_TRANSFER_WRITE_BIT;
+                break;
+            }
+            return info;
+        }
+
+        // who uses an imported image after the graph, given the layout it is left in
+        AccessInfo final_access(VkImageLayout layout) {
+            switch (layout) {
+            case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+                // the present engine waits on the submit's semaphore
+                return { layout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, false };
+            case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+                return {
+                    layout,
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT,
+                    false
+                };
+            case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+                return { layout, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, false };
+            default:
+                return {
+                    layout,
+                    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                    VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+                    false
+                };
+            }
+        }
+
+        // What the barrier simulation knows about one resource.
+        struct ResourceState {
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            // the last write (or layout transition)
+            VkPipelineStageFlags write_stages = 0;
+            VkAccessFlags write_access = 0;
+            // reads since then, a write has to wait for them
+            VkPipelineStageFlags read_stages = 0;
+            // where the last write is visible already
+            VkPipelineStageFlags visible_stages = 0;
+            VkAccessFlags visible_access = 0;
+            bool has_contents = false;
+        };
+
+        struct Dependency {
+            VkPipelineStageFlags src_stages;
+            VkAccessFlags src_access;
+            VkPipelineStageFlags dst_stages;
+            VkAccessFlags dst_access;
+            VkImageLayout old_layout;
+            VkImageLayout new_layout;
+        };
+
+        // Moves `state` to `access` and returns the dependency that needs, if
+        // any: read after write, write after read or write, layout changes.
+        std::optional<Dependency> transition(ResourceState& state, const AccessInfo& access, bool image) {
+            const bool layout_change = image && state.layout != access.layout;
+
+            bool needed = layout_change;
+            if (access.write) {
+                needed = needed || state.write_stages != 0 || state.read_stages != 0;
+            } else if (state.write_stages != 0) {
+                needed = needed
+                    || (access.stages & ~state.visible_stages) != 0
+                    || (access.access & ~state.visible_access) != 0;
+            }
+
+            std::optional<Dependency> dependency;
+            if (needed) {
+                Dependency& d = dependency.emplace();
+                d.src_stages = state.write_stages;
+                if (access.write || layout_change) {
+                    d.src_stages |= state.read_stages;
+                }
+                d.src_access = state.write_access;
+                d.dst_stages = access.stages;
+                d.dst_access = access.access;
+                d.old_layout = state.layout;
+                d.new_layout = image ? access.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+            }
+
+            if (access.write) {
+                state.write_stages = access.stages;
+                state.write_access = access.access & write_access_mask;
+                state.read_stages = 0;
+                state.visible_stages = 0;
+                state.visible_access = 0;
+                state.has_contents = true;
+            } else if (layout_change) {
+                // the transition is a write that only these readers wait for
+                state.write_stages = access.stages;
+                state.read_stages = access.stages;
+                state.visible_stages = access.stages;
+                state.visible_access = access.access;
+            } else {
+                state.read_stages |= access.stages;
+                if (needed) {
+                    state.visible_stages |= access.stages;
+                    state.visible_access |= access.access;
+                }
+            }
+            if (image) {
+                state.layout = access.layout;
+            }
+            return dependency;
+        }
+
+        uint64_t render_pass_hash(const VkRenderPassCreateInfo& info) {
+            uint64_t hash = hash_bytes(info.pAttachments, info.attachmentCount * sizeof(VkAttachmentDescription));
+            for (uint32_t i = 0; i < info.subpassCount; ++i) {
+                const VkSubpassDescription& subpass = info.pSubpasses[i];
+                hash = hash_combine(hash, subpass.colorAttachmentCount);
+                hash = hash_bytes(subpass.pColorAttachments, subpass.colorAttachmentCount * sizeof(VkAttachmentReference), hash);
+                hash = hash_combine(hash, subpass.inputAttachmentCount);
+                hash = hash_bytes(subpass.pInputAttachments, subpass.inputAttachmentCount * sizeof(VkAttachmentReference), hash);
+                if (subpass.pDepthStencilAttachment != nullptr) {
+                    hash = hash_pod(*subpass.pDepthStencilAttachment, hash);
+                } else {
+                    hash = hash_combine(hash, none);
+                }
+                hash = hash_combine(hash, subpass.preserveAttachmentCount);
+                hash = hash_bytes(subpass.pPreserveAttachments, subpass.preserveAttachmentCount * sizeof(uint32_t), hash);
+            }
+            return hash_bytes(info.pDependencies, info.dependencyCount * sizeof(VkSubpassDependency), hash);
+        }
+    }
+
+    struct RenderGraph::BarrierBatch {
+        struct ImageBarrier {
+            uint32_t resource;
+            VkAccessFlags src_access;
+            VkAccessFlags dst_access;
+            VkImageLayout old_layout;
+            VkImageLayout new_layout;
+        };
+
+        struct BufferBarrier {
+            uint32_t resource;
+            VkAccessFlags src_access;
+            VkAccessFlags dst_access;
+        };
+
+        VkPipelineStageFlags src_stages = 0;
+        VkPipelineStageFlags dst_stages = 0;
+        std::vector<ImageBarrier> images;
+        std::vector<BufferBarrier> buffers;
+
+        bool empty() const { return images.empty() && buffers.empty(); }
+    };
+
+    struct RenderGraph::Plan {
+        // where the clear value of an attachment comes from
+        struct ClearSource {
+            uint32_t pass = none;
+            uint32_t access = none;
+        };
+
+        // One vkCmdPipelineBarrier followed by either a render pass with
+        // one subpass per pass, or a single pass outside of a render pass.
+        struct Step {
+            BarrierBatch barriers;
+            std::vector<uint32_t> passes;
+
+            VkRenderPass render_pass = VK_NULL_HANDLE;
+            VkExtent2D extent = {};
+            // image indices, in attachment order
+            std::vector<uint32_t> attachments;
+            std::vector<ClearSource> clears;
+        };
+
+        struct Transient {
+            VkImage image = VK_NULL_HANDLE;
+            VkImageView view = VK_NULL_HANDLE;
+        };
+
+        std::vector<Step> steps;
+        BarrierBatch final_barriers;
+
+        // by image index, empty for imported images
+        std::vector<Transient> transients;
+        std::vector<DeviceMemory> memory;
+
+        RenderGraphStats stats;
+        uint64_t last_used = 0;
+    };
+
+    // PassBuilder
+
+    void PassBuilder::write_color(RenderGraphImage image, std::optional<VkClearColorValue> clear) {
+        VkClearValue value = {};
+        if (clear.has_value()) {
+            value.color = clear.value();
+        }
+        add_image(image, ImageUsage::color_attachment, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, clear.has_value() ? &value : nullptr);
+    }
+
+    void PassBuilder::write_depth(RenderGraphImage image, std::optional<VkClearDepthStencilValue> clear) {
+        VkClearValue value = {};
+        if (clear.has_value()) {
+            value.depthStencil = clear.value();
+        }
+        add_image(image, ImageUsage::depth_attachment, 0, clear.has_value() ? &value : nullptr);
+    }
+
+    void PassBuilder::read_depth(RenderGraphImage image) {
+        add_image(image, ImageUsage::depth_read, 0, nullptr);
+    }
+
+    void PassBuilder::read_input(RenderGraphImage image) {
+        add_image(image, ImageUsage::input_attachment, 0, nullptr);
+    }
+
+    void PassBuilder::read_sampled(RenderGraphImage image, VkPipelineStageFlags stages) {
+        add_image(image, ImageUsage::sampled, stages, nullptr);
+    }
+
+    void PassBuilder::read_storage(RenderGraphImage image, VkPipelineStageFlags stages) {
+        add_image(image, ImageUsage::storage_read, stages, nullptr);
+    }
+
+    void PassBuilder::write_storage(RenderGraphImage image, VkPipelineStageFlags stages) {
+        add_image(image, ImageUsage::storage_write, stages, nullptr);
+    }
+
+    void PassBuilder::copy_from(RenderGraphImage image) {
+        add_image(image, ImageUsage::transfer_src, 0, nullptr);
+    }
+
+    void PassBuilder::copy_to(RenderGraphImage image) {
+        add_image(image, ImageUsage::transfer_dst, 0, nullptr);
+    }
+
+    void PassBuilder::read_buffer(RenderGraphBuffer buffer, BufferUsage usage, VkPipelineStageFlags stages) {
+        m_buffers.push_back({ buffer.index, usage, stages, false });
+    }
+
+    void PassBuilder::write_buffer(RenderGraphBuffer buffer, BufferUsage usage, VkPipelineStageFlags stages) {
+        m_buffers.push_back({ buffer.index, usage, stages, true });
+    }
+
+    void PassBuilder::side_effect() {
+        m_side_effect = true;
+    }
+
+    void PassBuilder::record_secondary() {
+        m_secondary = true;
+    }
+
+    void PassBuilder::add_image(RenderGraphImage image, ImageUsage usage, VkPipelineStageFlags stages, const VkClearValue* clear) {
+        ImageAccess& access = m_images.emplace_back();
+        access.resource = image.index;
+        access.usage = usage;
+        access.stages = stages;
+        access.clear = clear != nullptr;
+        access.clear_value = clear != nullptr ? *clear : VkClearValue{};
+    }
+
+    // RenderGraph
+
+    RenderGraph::RenderGraph(VkDevice device, Allocator& allocator)
+        : m_device(device)
+        , m_allocator(allocator)
+        , m_logger(create_logger("graph")) {}
+
+    RenderGraph::~RenderGraph() {
+        for (auto& [hash, plan] : m_plans) {
+            destroy_plan(*plan);
+        }
+        for (Retired& retired : m_retired) {
+            if (retired.plan) {
+                destroy_plan(*retired.plan);
+            }
+            vkDestroyFramebuffer(m_device, retired.framebuffer, nullptr);
+        }
+        for (const auto& [hash, cached] : m_framebuffers) {
+            vkDestroyFramebuffer(m_device, cached.framebuffer, nullptr);
+        }
+        for (const auto& [hash, render_pass] : m_render_passes) {
+            vkDestroyRenderPass(m_device, render_pass, nullptr);
+        }
+    }
+
+    void RenderGraph::begin_frame(uint64_t frame_number, uint64_t completed_frames) {
+        m_frame_number = frame_number;
+        m_completed_frames = completed_frames;
+
+        m_images.clear();
+        m_buffers.clear();
+        m_passes.clear();
+        m_current = nullptr;
+
+        for (auto it = m_plans.begin(); it != m_plans.end();) {
+            const uint64_t last_used = it->second->last_used;
+            if (last_used + release_after_frames < frame_number) {
+                m_retired.push_back({ std::move(it->second), VK_NULL_HANDLE, last_used });
+                it = m_plans.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto it = m_framebuffers.begin(); it != m_framebuffers.end();) {
+            if (it->second.last_used + release_after_frames < frame_number) {
+                m_retired.push_back({ nullptr, it->second.framebuffer, it->second.last_used });
+                it = m_framebuffers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        // the GPU is done with every frame below completed_frames
+        auto first_alive = std::partition(m_retired.begin(), m_retired.end(), [&](const Retired& retired) {
+            return retired.frame < completed_frames;
+        });
+        for (auto it = m_retired.begin(); it != first_alive; ++it) {
+            if (it->plan) {
+                destroy_plan(*it->plan);
+            }
+            vkDestroyFramebuffer(m_device, it->framebuffer, nullptr);
+        }
+        m_retired.erase(m_retired.begin(), first_alive);
+    }
+
+    RenderGraphImage RenderGraph::import_image(
+        const char* name,
+        VkImage image,
+        VkImageView view,
+        VkFormat format,
+        VkExtent2D extent,
+        VkImageLayout initial_layout,
+        VkImageLayout final_layout,
+        VkPipelineStageFlags initial_stages
+    ) {
+        ImageDecl& decl = m_images.emplace_back();
+        decl.name = name;
+        decl.imported = true;
+        decl.image = image;
+        decl.view = view;
+        decl.format = format;
+        decl.extent = extent;
+        decl.initial_layout = initial_layout;
+        decl.final_layout = final_layout;
+        decl.initial_stages = initial_stages;
+        return { static_cast<uint32_t>(m_images.size() - 1) };
+    }
+
+    RenderGraphBuffer RenderGraph::import_buffer(
+        const char* name,
+        VkBuffer buffer,
+        VkPipelineStageFlags final_stages,
+        VkAccessFlags final_access,
+        VkPipelineStageFlags initial_stages
+    ) {
+        BufferDecl& decl = m_buffers.emplace_back();
+        decl.name = name;
+        decl.buffer = buffer;
+        decl.final_stages = final_stages;
+        decl.final_access = final_access;
+        decl.initial_stages = initial_stages;
+        return { static_cast<uint32_t>(m_buffers.size() - 1) };
+    }
+
+    RenderGraphImage RenderGraph::create_image(const char* name, const TransientImageDesc& desc) {
+        ImageDecl& decl = m_images.emplace_back();
+        decl.name = name;
+        decl.format = desc.format;
+        decl.extent = desc.extent;
+        decl.samples = desc.samples;
+        return { static_cast<uint32_t>(m_images.size() - 1) };
+    }
+
+    void RenderGraph::add_pass(const char* name, PassType type, const setup_t& setup, execute_t execute) {
+        PassDecl& pass = m_passes.emplace_back();
+        pass.name = name;
+        pass.type = type;
+        pass.execute = std::move(execute);
+        setup(pass.builder);
+    }
+
+    void RenderGraph::execute(VkCommandBuffer cmd) {
+        const uint64_t hash = declaration_hash();
+        auto it = m_plans.find(hash);
+        if (it == m_plans.end()) {
+            const auto compile_start = clock::now();
+            std::unique_ptr<Plan> plan = compile();
+            if (!plan) {
+                // a broken declaration fails the same way every frame
+                ENGINE_LOG_LIMITED(m_logger, ERROR, "failed to compile the render graph, frame {} is not rendered", m_frame_number);
+                return;
+            }
+            plan->stats.last_compile_ms = std::chrono::duration<double, std::milli>(clock::now() - compile_start).count();
+            ++m_stats.compiles;
+
+            const RenderGraphStats& stats = plan->stats;
+            m_logger->info(
+                "compiled in {:.3f} ms: {} pass(es), {} culled, {} merged into subpasses, {} render pass(es), {} preserved attachment(s)",
+                stats.last_compile_ms,
+                stats.passes,
+                stats.culled_passes,
+                stats.merged_passes,
+                stats.render_passes,
+                stats.preserved_attachments
+            );
+            m_logger->info(
+                "  {} image and {} buffer barrier(s) in {} batch(es), {} transient image(s): {} KiB aliased into {} KiB",
+                stats.image_barriers,
+                stats.buffer_barriers,
+                stats.barrier_batches,
+                stats.transient_images,
+                stats.transient_bytes / 1024,
+                stats.aliased_bytes / 1024
+            );
+
+            it = m_plans.emplace(hash, std::move(plan)).first;
+        } else {
+            ++m_stats.cache_hits;
+        }
+
+        Plan& plan = *it->second;
+        plan.last_used = m_frame_number;
+        m_current = &plan;
+
+        std::vector<VkImageView> views;
+        std::vector<VkClearValue> clear_values;
+        for (const Plan::Step& step : plan.steps) {
+            record_barriers(cmd, step.barriers);
+
+            if (step.render_pass == VK_NULL_HANDLE) {
+                const PassDecl& pass = m_passes[step.passes.front()];
+                if (pass.execute) {
+                    pass.execute({ cmd, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, {}, *this });
+                }
+                continue;
+            }
+
+            views.clear();
+            clear_values.clear();
+            for (size_t i = 0; i < step.attachments.size(); ++i) {
+                views.push_back(view({ step.attachments[i] }));
+
+                const Plan::ClearSource& clear = step.clears[i];
+                clear_values.push_back(
+                    clear.pass != none ? m_passes[clear.pass].builder.m_images[clear.access].clear_value : VkClearValue{}
+                );
+            }
+
+            VkRenderPassBeginInfo begin_info = {};
+            begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            begin_info.pNext = nullptr;
+            begin_info.renderPass = step.render_pass;
+            begin_info.framebuffer = get_framebuffer(step.render_pass, views, step.extent);
+            begin_info.renderArea.offset = { 0, 0 };
+            begin_info.renderArea.extent = step.extent;
+            begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+            begin_info.pClearValues = clear_values.data();
+
+            for (uint32_t subpass = 0; subpass < step.passes.size(); ++subpass) {
+                const PassDecl& pass = m_passes[step.passes[subpass]];
+                // a subpass records either inline or only secondaries, never both
+                const VkSubpassContents contents = pass.builder.m_secondary
+                    ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                    : VK_SUBPASS_CONTENTS_INLINE;
+                if (subpass == 0) {
+                    vkCmdBeginRenderPass(cmd, &begin_info, contents);
+                } else {
+                    vkCmdNextSubpass(cmd, contents);
+                }
+                if (pass.execute) {
+                    pass.execute({ cmd, step.render_pass, subpass, begin_info.framebuffer, step.extent, *this });
+                }
+            }
+
+            vkCmdEndRenderPass(cmd);
+        }
+        record_barriers(cmd, plan.final_barriers);
+
+        const uint64_t compiles = m_stats.compiles;
+        const uint64_t cache_hits = m_stats.cache_hits;
+        m_stats = plan.stats;
+        m_stats.compiles = compiles;
+        m_stats.cache_hits = cache_hits;
+    }
+
+    VkImage RenderGraph::image(RenderGraphImage image) const {
+        const ImageDecl& decl = m_images[image.index];
+        if (decl.imported) {
+            return decl.image;
+        }
+        return m_current != nullptr ? m_current->transients[image.index].image : VK_NULL_HANDLE;
+    }
+
+    VkImageView RenderGraph::view(RenderGraphImage image) const {
+        const ImageDecl& decl = m_images[image.index];
+        if (decl.imported) {
+            return decl.view;
+        }
+        return m_current != nullptr ? m_current->transients[image.index].view : VK_NULL_HANDLE;
+    }
+
+    VkBuffer RenderGraph::buffer(RenderGraphBuffer buffer) const {
+        return m_buffers[buffer.index].buffer;
+    }
+
+    void RenderGraph::release_framebuffers() {
+        // frames up to the current one may still reference them
+        for (const auto& [hash, cached] : m_framebuffers) {
+            m_retired.push_back({ nullptr, cached.framebuffer, m_frame_number });
+        }
+        m_framebuffers.clear();
+    }
+
+    RenderGraphStats RenderGraph::stats() const {
+        return m_stats;
+    }
+
+    uint64_t RenderGraph::declaration_hash() const {
+        // structure only: handles and clear values may change every frame
+        uint64_t hash = hash_combine(m_images.size(), m_buffers.size());
+        for (const ImageDecl& decl : m_images) {
+            hash = hash_combine(hash, decl.imported);
+            hash = hash_combine(hash, decl.format);
+            hash = hash_combine(hash, (uint64_t(decl.extent.width) << 32) | decl.extent.height);
+            hash = hash_combine(hash, decl.samples);
+            hash = hash_combine(hash, decl.initial_layout);
+            hash = hash_combine(hash, decl.final_layout);
+            hash = hash_combine(hash, decl.initial_stages);
+        }
+        for (const BufferDecl& decl : m_buffers) {
+            hash = hash_combine(hash, decl.final_stages);
+            hash = hash_combine(hash, decl.final_access);
+            hash = hash_combine(hash, decl.initial_stages);
+        }
+        for (const PassDecl& pass : m_passes) {
+            const PassBuilder& builder = pass.builder;
+            hash = hash_combine(hash, static_cast<uint64_t>(pass.type));
+            hash = hash_combine(hash, builder.m_side_effect);
+            hash = hash_combine(hash, builder.m_images.size());
+            for (const auto& access : builder.m_images) {
+                hash = hash_combine(hash, access.resource);
+                hash = hash_combine(hash, static_cast<uint64_t>(access.usage));
+                hash = hash_combine(hash, access.stages);
+                hash = hash_combine(hash, access.clear);
+            }
+            hash = hash_combine(hash, builder.m_buffers.size());
+            for (const auto& access : builder.m_buffers) {
+                hash = hash_combine(hash, access.resource);
+                hash = hash_combine(hash, static_cast<uint64_t>(access.usage));
+                hash = hash_combine(hash, access.stages);
+                hash = hash_combine(hash, access.write);
+            }
+        }
+        return hash;
+    }
+
+    std::unique_ptr<RenderGraph::Plan> RenderGraph::compile() {
+        const uint32_t pass_count = static_cast<uint32_t>(m_passes.size());
+        const uint32_t image_count = static_cast<uint32_t>(m_images.size());
+        const uint32_t buffer_count = static_cast<uint32_t>(m_buffers.size());
+
+        auto plan = std::make_unique<Plan>();
+        RenderGraphStats& stats = plan->stats;
+        stats.passes = pass_count;
+
+        // Culling, back to front: a pass stays if it has side effects or
+        // writes something that is imported or read by a pass that stays.
+        // Every buffer is imported, so any buffer write keeps a pass.
+        std::vector<bool> kept(pass_count, false);
+        std::vector<bool> image_needed(image_count, false);
+        for (uint32_t p = pass_count; p-- > 0;) {
+            const PassBuilder& builder = m_passes[p].builder;
+
+            bool keep = builder.m_side_effect;
+            for (const auto& access : builder.m_images) {
+                const bool write = image_access(access.usage, access.stages).write;
+                keep = keep || (write && (m_images[access.resource].imported || image_needed[access.resource]));
+            }
+            for (const auto& access : builder.m_buffers) {
+                keep = keep || access.write;
+            }
+            if (!keep) {
+                ++stats.culled_passes;
+                continue;
+            }
+            kept[p] = true;
+
+            // a clear overwrites everything, anything else may keep
+            // (or read) the previous contents
+            for (const auto& access : builder.m_images) {
+                image_needed[access.resource] = !access.clear;
+            }
+        }
+
+        // Grouping: a graphics pass joins the render pass of the one before
+        // it as a new subpass if it only uses attachments of the same size,
+        // and only reads buffers the render pass does not write.
+        struct Group {
+            bool graphics = false;
+            VkExtent2D extent = {};
+            VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+            std::vector<bool> non_attachment_images;
+            std::vector<bool> written_buffers;
+        };
+        std::vector<Group> groups;
+
+        for (uint32_t p = 0; p < pass_count; ++p) {
+            if (!kept[p]) {
+                continue;
+            }
+            const PassDecl& pass = m_passes[p];
+            const PassBuilder& builder = pass.builder;
+
+            bool has_attachments = false;
+            bool attachments_only = !builder.m_images.empty();
+            for (const auto& access : builder.m_images) {
+                has_attachments = has_attachments || is_attachment(access.usage);
+                attachments_only = attachments_only && is_attachment(access.usage);
+            }
+
+            bool merge = pass.type == PassType::graphics && attachments_only && !groups.empty() && groups.back().graphics;
+            if (merge) {
+                const Group& group = groups.back();
+                for (const auto& access : builder.m_images) {
+                    const ImageDecl& decl = m_images[access.resource];
+                    merge = merge
+                        && decl.extent.width == group.extent.width
+                        && decl.extent.height == group.extent.height
+                        && decl.samples == group.samples
+                        && !group.non_attachment_images[access.resource];
+                }
+                for (const auto& access : builder.m_buffers) {
+                    merge = merge && !access.write && !group.written_buffers[access.resource];
+                }
+            }
+
+            if (merge) {
+                plan->steps.back().passes.push_back(p);
+                ++stats.merged_passes;
+            } else {
+                plan->steps.emplace_back().passes.push_back(p);
+
+                Group& group = groups.emplace_back();
+                // a graphics pass without attachments is recorded like a compute pass
+                group.graphics = pass.type == PassType::graphics && has_attachments;
+                group.non_attachment_images.resize(image_count, false);
+                group.written_buffers.resize(buffer_count, false);
+                for (const auto& access : builder.m_images) {
+                    if (is_attachment(access.usage)) {
+                        group.extent = m_images[access.resource].extent;
+                        group.samples = m_images[access.resource].samples;
+                    }
+                }
+            }
+
+            Group& group = groups.back();
+            for (const auto& access : builder.m_images) {
+                if (!is_attachment(access.usage)) {
+                    group.non_attachment_images[access.resource] = true;
+                }
+            }
+            for (const auto& access : builder.m_buffers) {
+                if (access.write) {
+                    group.written_buffers[access.resource] = true;
+                }
+            }
+        }
+
+        // lifetimes in steps, for aliasing and store ops
+        std::vector<uint32_t> first_step(image_count, none);
+        std::vector<uint32_t> last_step(image_count, none);
+        for (uint32_t s = 0; s < plan->steps.size(); ++s) {
+            for (const uint32_t p : plan->steps[s].passes) {
+                for (const auto& access : m_passes[p].builder.m_images) {
+                    first_step[access.resource] = std::min(first_step[access.resource], s);
+                    last_step[access.resource] = last_step[access.resource] == none ? s : std::max(last_step[access.resource], s);
+                }
+            }
+        }
+
+        std::vector<uint32_t> previous(image_count, none);
+        if (!create_transients(*plan, first_step, last_step, previous)) {
+            destroy_plan(*plan);
+            return nullptr;
+        }
+
+        // Barriers, by simulating every resource's state through the steps.
+        std::vector<ResourceState> image_states(image_count);
+        std::vector<ResourceState> buffer_states(buffer_count);
+        for (uint32_t i = 0; i < buffer_count; ++i) {
+            buffer_states[i].read_stages = m_buffers[i].initial_stages;
+        }
+        std::vector<bool> started(image_count, false);
+        std::vector<bool> had_barrier(image_count, false);
+        for (uint32_t i = 0; i < image_count; ++i) {
+            const ImageDecl& decl = m_images[i];
+            if (decl.imported) {
+                image_states[i].layout = decl.initial_layout;
+                image_states[i].read_stages = decl.initial_stages;
+                image_states[i].has_contents = decl.initial_layout != VK_IMAGE_LAYOUT_UNDEFINED;
+            }
+        }
+
+        // A transient's first barrier waits for the image that used its
+        // memory before. If that was last frame's user, its final state is
+        // only known at the end, so the barrier is patched afterwards.
+        struct Patch {
+            BarrierBatch* batch;
+            size_t barrier;
+            uint32_t previous;
+        };
+        std::vector<Patch> patches;
+
+        auto start_image = [&](uint32_t image) {
+            if (started[image] || m_images[image].imported) {
+                return;
+            }
+            started[image] = true;
+            const uint32_t before = previous[image];
+            if (before != none && first_step[before] < first_step[image]) {
+                image_states[image].read_stages |= image_states[before].write_stages | image_states[before].read_stages;
+                image_states[image].write_access |= image_states[before].write_access;
+            }
+        };
+
+        auto add_image_barrier = [&](BarrierBatch& batch, uint32_t image, const AccessInfo& info, bool discard) {
+            start_image(image);
+            const auto dependency = transition(image_states[image], info, true);
+            if (!dependency.has_value()) {
+                return;
+            }
+            batch.src_stages |= dependency->src_stages;
+            batch.dst_stages |= dependency->dst_stages;
+            batch.images.push_back({
+                image,
+                dependency->src_access,
+                dependency->dst_access,
+                discard ? VK_IMAGE_LAYOUT_UNDEFINED : dependency->old_layout,
+                dependency->new_layout
+            });
+            // the first barrier of a transient is the one out of UNDEFINED
+            const bool first = !m_images[image].imported && !had_barrier[image];
+            had_barrier[image] = true;
+            if (first && previous[image] != none && first_step[previous[image]] >= first_step[image]) {
+                patches.push_back({ &batch, batch.images.size() - 1, previous[image] });
+            }
+        };
+
+        auto add_buffer_barrier = [&](BarrierBatch& batch, uint32_t buffer, const AccessInfo& info) {
+            const auto dependency = transition(buffer_states[buffer], info, false);
+            if (!dependency.has_value()) {
+                return;
+            }
+            batch.src_stages |= dependency->src_stages;
+            batch.dst_stages |= dependency->dst_stages;
+            batch.buffers.push_back({ buffer, dependency->src_access, dependency->dst_access });
+        };
+
+        std::vector<VkAttachmentDescription> attachments;
+        std::vector<VkSubpassDescription> subpasses;
+        std::vector<VkSubpassDependency> dependencies;
+        std::vector<std::vector<VkAttachmentReference>> color_refs;
+        std::vector<std::vector<VkAttachmentReference>> input_refs;
+        std::vector<VkAttachmentReference> depth_refs;
+        std::vector<std::vector<uint32_t>> preserve_refs;
+        // attachment * subpass count + subpass
+        std::vector<bool> used_in_subpass;
+        std::vector<uint32_t> attachment_index(image_count, none);
+        std::vector<uint32_t> last_subpass(image_count, none);
+
+        for (uint32_t s = 0; s < plan->steps.size(); ++s) {
+            Plan::Step& step = plan->steps[s];
+
+            if (!groups[s].graphics) {
+                const PassBuilder& builder = m_passes[step.passes.front()].builder;
+                for (const auto& access : builder.m_images) {
+                    add_image_barrier(step.barriers, access.resource, image_access(access.usage, access.stages), false);
+                }
+                for (const auto& access : builder.m_buffers) {
+                    add_buffer_barrier(step.barriers, access.resource, buffer_access(access.usage, access.stages, access.write));
+                }
+                continue;
+            }
+
+            // everything that is not an attachment is synchronised before the
+            // render pass; merged passes only bring buffer reads
+            for (const uint32_t p : step.passes) {
+                const PassBuilder& builder = m_passes[p].builder;
+                for (const auto& access : builder.m_images) {
+                    if (!is_attachment(access.usage)) {
+                        add_image_barrier(step.barriers, access.resource, image_access(access.usage, access.stages), false);
+                    }
+                }
+                for (const auto& access : builder.m_buffers) {
+                    add_buffer_barrier(step.barriers, access.resource, buffer_access(access.usage, access.stages, access.write));
+                }
+            }
+
+            // Attachments enter the render pass in the layout of their first
+            // subpass, so the render pass only transitions between subpasses.
+            attachments.clear();
+            step.attachments.clear();
+            step.clears.clear();
+            for (uint32_t subpass = 0; subpass < step.passes.size(); ++subpass) {
+                const PassBuilder& builder = m_passes[step.passes[subpass]].builder;
+                for (uint32_t a = 0; a < builder.m_images.size(); ++a) {
+                    const auto& access = builder.m_images[a];
+                    const uint32_t image = access.resource;
+                    if (!is_attachment(access.usage) || attachment_index[image] != none) {
+                        continue;
+                    }
+                    attachment_index[image] = static_cast<uint32_t>(attachments.size());
+                    last_subpass[image] = subpass;
+
+                    start_image(image);
+                    VkAttachmentLoadOp load_op = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                    if (access.clear) {
+                        load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                    } else if (image_states[image].has_contents) {
+                        load_op = VK_ATTACHMENT_LOAD_OP_LOAD;
+                    }
+
+                    const AccessInfo info = image_access(access.usage, access.stages);
+                    add_image_barrier(step.barriers, image, info, load_op != VK_ATTACHMENT_LOAD_OP_LOAD);
+
+                    const ImageDecl& decl = m_images[image];
+                    VkAttachmentDescription& description = attachments.emplace_back();
+                    description = {};
+                    description.format = decl.format;
+                    description.samples = decl.samples;
+                    description.loadOp = load_op;
+                    description.stencilLoadOp = has_stencil(decl.format) ? load_op : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                    description.initialLayout = info.layout;
+
+                    step.attachments.push_back(image);
+                    Plan::ClearSource& clear = step.clears.emplace_back();
+                    if (access.clear) {
+                        clear.pass = step.passes[subpass];
+                        clear.access = a;
+                    }
+                    if (step.extent.width == 0) {
+                        step.extent = decl.extent;
+                    }
+                }
+            }
+
+            // An attachment a subpass does not reference is undefined after
+            // it unless preserved, so every subpass between its first and last
+            // use keeps it.
+            const uint32_t subpass_count = static_cast<uint32_t>(step.passes.size());
+            used_in_subpass.assign(step.attachments.size() * subpass_count, false);
+            for (uint32_t subpass = 0; subpass < subpass_count; ++subpass) {
+                for (const auto& access : m_passes[step.passes[subpass]].builder.m_images) {
+                    if (is_attachment(access.usage)) {
+                        used_in_subpass[attachment_index[access.resource] * subpass_count + subpass] = true;
+                    }
+                }
+            }
+            preserve_refs.assign(subpass_count, {});
+            for (uint32_t i = 0; i < step.attachments.size(); ++i) {
+                const auto used = [&](uint32_t subpass) { return used_in_subpass[i * subpass_count + subpass]; };
+                uint32_t first = none;
+                uint32_t last = 0;
+                for (uint32_t subpass = 0; subpass < subpass_count; ++subpass) {
+                    if (used(subpass)) {
+                        first = std::min(first, subpass);
+                        last = subpass;
+                    }
+                }
+                for (uint32_t subpass = first + 1; subpass < last; ++subpass) {
+                    if (!used(subpass)) {
+                        preserve_refs[subpass].push_back(i);
+                        ++stats.preserved_attachments;
+                    }
+                }
+            }
+
+            subpasses.assign(step.passes.size(), VkSubpassDescription{});
+            color_refs.assign(step.passes.size(), {});
+            input_refs.assign(step.passes.size(), {});
+            depth_refs.assign(step.passes.size(), VkAttachmentReference{ VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED });
+            dependencies.clear();
+
+            for (uint32_t subpass = 0; subpass < step.passes.size(); ++subpass) {
+                const PassBuilder& builder = m_passes[step.passes[subpass]].builder;
+                for (const auto& access : builder.m_images) {
+                    if (!is_attachment(access.usage)) {
+                        continue;
+                    }
+                    const uint32_t image = access.resource;
+                    const AccessInfo info = image_access(access.usage, access.stages);
+
+                    // first uses were synchronised by the barrier in front
+                    if (last_subpass[image] != subpass) {
+                        const auto dependency = transition(image_states[image], info, true);
+                        if (dependency.has_value()) {
+                            auto existing = std::find_if(dependencies.begin(), dependencies.end(), [&](const VkSubpassDependency& d) {
+                                return d.srcSubpass == last_subpass[image] && d.dstSubpass == subpass;
+                            });
+                            if (existing == dependencies.end()) {
+                                existing = dependencies.insert(dependencies.end(), VkSubpassDependency{});
+                                existing->srcSubpass = last_subpass[image];
+                                existing->dstSubpass = subpass;
+                                existing->dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+                            }
+                            existing->srcStageMask |= dependency->src_stages;
+                            existing->srcAccessMask |= dependency->src_access;
+                            existing->dstStageMask |= dependency->dst_stages;
+                            existing->dstAccessMask |= dependency->dst_access;
+                        }
+                        last_subpass[image] = subpass;
+                    }
+
+                    const VkAttachmentReference reference{ attachment_index[image], info.layout };
+                    switch (access.usage) {
+                    case ImageUsage::color_attachment:
+                        color_refs[subpass].push_back(reference);
+                        break;
+                    case ImageUsage::depth_attachment:
+                    case ImageUsage::depth_read:
+                        depth_refs[subpass] = reference;
+                        break;
+                    case ImageUsage::input_attachment:
+                        input_refs[subpass].push_back(reference);
+                        break;
+                    default:
+                        break;
+                    }
+                }
+
+                VkSubpassDescription& description = subpasses[subpass];
+                description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+                description.colorAttachmentCount = static_cast<uint32_t>(color_refs[subpass].size());
+                description.pColorAttachments = color_refs[subpass].data();
+                description.inputAttachmentCount = static_cast<uint32_t>(input_refs[subpass].size());
+                description.pInputAttachments = input_refs[subpass].data();
+                description.pDepthStencilAttachment = depth_refs[subpass].attachment != VK_ATTACHMENT_UNUSED
+                    ? &depth_refs[subpass]
+                    : nullptr;
+                description.preserveAttachmentCount = static_cast<uint32_t>(preserve_refs[subpass].size());
+                description.pPreserveAttachments = preserve_refs[subpass].data();
+            }
+
+            // contents only have to reach memory if someone looks at them later
+            for (size_t i = 0; i < step.attachments.size(); ++i) {
+                const uint32_t image = step.attachments[i];
+                const bool store = m_images[image].imported || last_step[image] > s;
+                const VkAttachmentStoreOp store_op = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+                attachments[i].storeOp = store_op;
+                attachments[i].stencilStoreOp = has_stencil(m_images[image].format) ? store_op : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                attachments[i].finalLayout = image_states[image].layout;
+
+                attachment_index[image] = none;
+                last_subpass[image] = none;
+            }
+
+            VkRenderPassCreateInfo render_pass_info = {};
+            render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+            render_pass_info.pNext = nullptr;
+            render_pass_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+            render_pass_info.pAttachments = attachments.data();
+            render_pass_info.subpassCount = static_cast<uint32_t>(subpasses.size());
+            render_pass_info.pSubpasses = subpasses.data();
+            render_pass_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+            render_pass_info.pDependencies = dependencies.data();
+            step.render_pass = get_render_pass(render_pass_info);
+            if (step.render_pass == VK_NULL_HANDLE) {
+                destroy_plan(*plan);
+                return nullptr;
+            }
+            ++stats.render_passes;
+        }
+
+        // hand imported resources over to whoever uses them after the graph
+        for (uint32_t i = 0; i < image_count; ++i) {
+            const ImageDecl& decl = m_images[i];
+            if (decl.imported && decl.final_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+                add_image_barrier(plan->final_barriers, i, final_access(decl.final_layout), false);
+            }
+        }
+        for (uint32_t i = 0; i < buffer_count; ++i) {
+            const BufferDecl& decl = m_buffers[i];
+            if (decl.final_stages != 0) {
+                add_buffer_barrier(plan->final_barriers, i, { VK_IMAGE_LAYOUT_UNDEFINED, decl.final_stages, decl.final_access, false });
+            }
+        }
+
+        for (const Patch& patch : patches) {
+            const ResourceState& state = image_states[patch.previous];
+            patch.batch->src_stages |= state.write_stages | state.read_stages;
+            patch.batch->images[patch.barrier].src_access |= state.write_access;
+        }
+
+        auto count_batch = [&](const BarrierBatch& batch) {
+            stats.image_barriers += static_cast<uint32_t>(batch.images.size());
+            stats.buffer_barriers += static_cast<uint32_t>(batch.buffers.size());
+            stats.barrier_batches += batch.empty() ? 0 : 1;
+        };
+        for (const Plan::Step& step : plan->steps) {
+            count_batch(step.barriers);
+        }
+        count_batch(plan->final_barriers);
+
+        return plan;
+    }
+
+    bool RenderGraph::create_transients(
+        Plan& plan,
+        const std::vector<uint32_t>& first_step,
+        const std::vector<uint32_t>& last_step,
+        std::vector<uint32_t>& previous
+    ) {
+        const uint32_t image_count = static_cast<uint32_t>(m_images.size());
+        plan.transients.resize(image_count);
+
+        std::vector<VkImageUsageFlags> usage(image_count, 0);
+        for (const Plan::Step& step : plan.steps) {
+            for (const uint32_t p : step.passes) {
+                for (const auto& access : m_passes[p].builder.m_images) {
+                    usage[access.resource] |= image_usage_for(access.usage);
+                }
+            }
+        }
+
+        struct Candidate {
+            uint32_t image;
+            VkMemoryRequirements requirements;
+        };
+        std::vector<Candidate> candidates;
+
+        for (uint32_t i = 0; i < image_count; ++i) {
+            const ImageDecl& decl = m_images[i];
+            // culled away entirely
+            if (decl.imported || first_step[i] == none) {
+                continue;
+            }
+
+            VkImageCreateInfo image_info = {};
+            image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            image_info.pNext = nullptr;
+            image_info.imageType = VK_IMAGE_TYPE_2D;
+            image_info.format = decl.format;
+            image_info.extent = { decl.extent.width, decl.extent.height, 1 };
+            image_info.mipLevels = 1;
+            image_info.arrayLayers = 1;
+            image_info.samples = decl.samples;
+            image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+            image_info.usage = usage[i];
+            image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            if (!check_vk(vkCreateImage(m_device, &image_info, nullptr, &plan.transients[i].image))) {
+                return false;
+            }
+
+            Candidate& candidate = candidates.emplace_back();
+            candidate.image = i;
+            vkGetImageMemoryRequirements(m_device, plan.transients[i].image, &candidate.requirements);
+
+            ++plan.stats.transient_images;
+            plan.stats.transient_bytes += candidate.requirements.size;
+        }
+
+        // Greedy placement, largest first: an image shares a slot with the
+        // images whose step ranges do not overlap its own.
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return a.requirements.size > b.requirements.size;
+        });
+
+        struct Slot {
+            VkMemoryRequirements requirements;
+            std::vector<uint32_t> images;
+        };
+        std::vector<Slot> slots;
+
+        for (const Candidate& candidate : candidates) {
+            const uint32_t image = candidate.image;
+            auto fits = [&](const Slot& slot) {
+                if ((slot.requirements.memoryTypeBits & candidate.requirements.memoryTypeBits) == 0) {
+                    return false;
+                }
+                return std::all_of(slot.images.begin(), slot.images.end(), [&](uint32_t other) {
+                    return last_step[other] < first_step[image] || last_step[image] < first_step[other];
+                });
+            };
+
+            auto slot = std::find_if(slots.begin(), slots.end(), fits);
+            if (slot == slots.end()) {
+                slots.push_back({ candidate.requirements, { image } });
+                continue;
+            }
+            slot->requirements.size = std::max(slot->requirements.size, candidate.requirements.size);
+            slot->requirements.alignment = std::max(slot->requirements.alignment, candidate.requirements.alignment);
+            slot->requirements.memoryTypeBits &= candidate.requirements.memoryTypeBits;
+            slot->images.push_back(image);
+        }
+
+        VkImageViewCreateInfo view_info = {};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.pNext = nullptr;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+
+        for (Slot& slot : slots) {
+            DeviceMemory memory = m_allocator.allocate_memory(slot.requirements, MemoryUsage::render_target);
+            if (!memory) {
+                ENGINE_LOG_LIMITED(m_logger, ERROR, "failed to allocate {} bytes for transient images", slot.requirements.size);
+                return false;
+            }
+
+            // in frame order; the first one follows the last one of the previous frame
+            std::sort(slot.images.begin(), slot.images.end(), [&](uint32_t a, uint32_t b) {
+                return first_step[a] < first_step[b];
+            });
+            for (size_t i = 0; i < slot.images.size(); ++i) {
+                const uint32_t image = slot.images[i];
+                previous[image] = slot.images[(i + slot.images.size() - 1) % slot.images.size()];
+
+                Plan::Transient& transient = plan.transients[image];
+                if (!memory.bind_image(transient.image)) {
+                    return false;
+                }
+
+                view_info.image = transient.image;
+                view_info.format = m_images[image].format;
+                view_info.subresourceRange.aspectMask = aspect_for(m_images[image].format);
+                if (!check_vk(vkCreateImageView(m_device, &view_info, nullptr, &transient.view))) {
+                    return false;
+                }
+            }
+
+            plan.stats.aliased_bytes += memory.size();
+            plan.memory.push_back(std::move(memory));
+        }
+
+        return true;
+    }
+
+    VkRenderPass RenderGraph::get_render_pass(const VkRenderPassCreateInfo& info) {
+        const uint64_t hash = render_pass_hash(info);
+        if (auto it = m_render_passes.find(hash); it != m_render_passes.end()) {
+            return it->second;
+        }
+
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        if (!check_vk(vkCreateRenderPass(m_device, &info, nullptr, &render_pass))) {
+            return VK_NULL_HANDLE;
+        }
+        m_render_passes.emplace(hash, render_pass);
+        return render_pass;
+    }
+
+    VkFramebuffer RenderGraph::get_framebuffer(VkRenderPass render_pass, const std::vector<VkImageView>& views, VkExtent2D extent) {
+        uint64_t hash = hash_combine(reinterpret_cast<uint64_t>(render_pass), (uint64_t(extent.width) << 32) | extent.height);
+        hash = hash_bytes(views.data(), views.size() * sizeof(VkImageView), hash);
+
+        if (auto it = m_framebuffers.find(hash); it != m_framebuffers.end()) {
+            it->second.last_used = m_frame_number;
+            return it->second.framebuffer;
+        }
+
+        VkFramebufferCreateInfo framebuffer_info = {};
+        framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_info.pNext = nullptr;
+        framebuffer_info.renderPass = render_pass;
+        framebuffer_info.attachmentCount = static_cast<uint32_t>(views.size());
+        framebuffer_info.pAttachments = views.data();
+        framebuffer_info.width = extent.width;
+        framebuffer_info.height = extent.height;
+        framebuffer_info.layers = 1;
+
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        check_vk(vkCreateFramebuffer(m_device, &framebuffer_info, nullptr, &framebuffer));
+        m_framebuffers.emplace(hash, CachedFramebuffer{ framebuffer, m_frame_number });
+        return framebuffer;
+    }
+
+    void RenderGraph::record_barriers(VkCommandBuffer cmd, const BarrierBatch& batch) const {
+        if (batch.empty()) {
+            return;
+        }
+
+        std::vector<VkImageMemoryBarrier> image_barriers;
+        image_barriers.reserve(batch.images.size());
+        for (const auto& barrier : batch.images) {
+            VkImageMemoryBarrier& image_barrier = image_barriers.emplace_back();
+            image_barrier = {};
+            image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            image_barrier.pNext = nullptr;
+            image_barrier.srcAccessMask = barrier.src_access;
+            image_barrier.dstAccessMask = barrier.dst_access;
+            image_barrier.oldLayout = barrier.old_layout;
+            image_barrier.newLayout = barrier.new_layout;
+            image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            image_barrier.image = image({ barrier.resource });
+            image_barrier.subresourceRange.aspectMask = aspect_for(m_images[barrier.resource].format);
+            image_barrier.subresourceRange.baseMipLevel = 0;
+            image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+            image_barrier.subresourceRange.baseArrayLayer = 0;
+            image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        }
+
+        std::vector<VkBufferMemoryBarrier> buffer_barriers;
+        buffer_barriers.reserve(batch.buffers.size());
+        for (const auto& barrier : batch.buffers) {
+            VkBufferMemoryBarrier& buffer_barrier = buffer_barriers.emplace_back();
+            buffer_barrier = {};
+            buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            buffer_barrier.pNext = nullptr;
+            buffer_barrier.srcAccessMask = barrier.src_access;
+            buffer_barrier.dstAccessMask = barrier.dst_access;
+            buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            buffer_barrier.buffer = buffer({ barrier.resource });
+            buffer_barrier.offset = 0;
+            buffer_barrier.size = VK_WHOLE_SIZE;
+        }
+
+        vkCmdPipelineBarrier(
+            cmd,
+            batch.src_stages != 0 ? batch.src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            batch.dst_stages != 0 ? batch.dst_stages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            0,
+            0, nullptr,
+            static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+            static_cast<uint32_t>(image_barriers.size()), image_barriers.data()
+        );
+    }
+
+    void RenderGraph::destroy_plan(Plan& plan) {
+        for (Plan::Transient& transient : plan.transients) {
+            vkDestroyImageView(m_device, transient.view, nullptr);
+            vkDestroyImage(m_device, transient.image, nullptr);
+            transient = Plan::Transient();
+        }
+        plan.memory.clear();
+    }
+}
@@ -0,0 +1,312 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace engine {
+
+    struct RenderGraphImage {
+        uint32_t index = ~0u;
+        bool valid() const { return index != ~0u; }
+    };
+
+    struct RenderGraphBuffer {
+        uint32_t index = ~0u;
+        bool valid() const { return index != ~0u; }
+    };
+
+    enum class PassType : uint32_t {
+        graphics,
+        compute,
+        transfer
+    };
+
+    // How a pass touches an image. Decides layout, stages and access masks.
+    enum class ImageUsage : uint32_t {
+        color_attachment,
+        depth_attachment,
+        depth_read,        // read-only depth attachment
+        input_attachment,
+        sampled,
+        storage_read,
+        storage_write,
+        transfer_src,
+        transfer_dst
+    };
+
+    enum class BufferUsage : uint32_t {
+        vertex,
+        index,
+        indirect,
+        uniform,
+        storage_read,
+        storage_write,
+        transfer_src,
+        transfer_dst
+    };
+
+    // Graph-owned image that only lives within a frame. Its memory is shared
+    // with other transients whose lifetimes do not overlap.
+    struct TransientImageDesc {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent = {};
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    };
+
+    class RenderGraph;
+
+    struct PassContext {
+        VkCommandBuffer cmd;
+        // graphics passes only
+        VkRenderPass render_pass;
+        uint32_t subpass;
+        // for the inheritance info of secondary command buffers
+        VkFramebuffer framebuffer;
+        VkExtent2D extent;
+        const RenderGraph& graph;
+    };
+
+    // Collects the accesses of one pass while it is being declared. A pass
+    // touches each image at most once.
+    class PassBuilder {
+    public:
+        // Attachments are bound in the order they are declared. Without a
+        // clear value the previous contents are loaded.
+        void write_color(RenderGraphImage image, std::optional<VkClearColorValue> clear = std::nullopt);
+        void write_depth(RenderGraphImage image, std::optional<VkClearDepthStencilValue> clear = std::nullopt);
+        void read_depth(RenderGraphImage image);
+        void read_input(RenderGraphImage image);
+
+        void read_sampled(RenderGraphImage image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+        void read_storage(RenderGraphImage image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        void write_storage(RenderGraphImage image, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        void copy_from(RenderGraphImage image);
+        void copy_to(RenderGraphImage image);
+
+        void read_buffer(RenderGraphBuffer buffer, BufferUsage usage, VkPipelineStageFlags stages = 0);
+        void write_buffer(RenderGraphBuffer buffer, BufferUsage usage, VkPipelineStageFlags stages = 0);
+
+        // keeps the pass even if nothing reads what it writes
+        void side_effect();
+
+        // The graphics pass only executes secondary command buffers, its
+        // subpass is begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+        void record_secondary();
+
+    private:
+        friend class RenderGraph;
+
+        struct ImageAccess {
+            uint32_t resource;
+            ImageUsage usage;
+            VkPipelineStageFlags stages;
+            bool clear;
+            VkClearValue clear_value;
+        };
+
+        struct BufferAccess {
+            uint32_t resource;
+            BufferUsage usage;
+            VkPipelineStageFlags stages;
+            bool write;
+        };
+
+        void add_image(RenderGraphImage image, ImageUsage usage, VkPipelineStageFlags stages, const VkClearValue* clear);
+
+        std::vector<ImageAccess> m_images;
+        std::vector<BufferAccess> m_buffers;
+        bool m_side_effect = false;
+        bool m_secondary = false;
+    };
+
+    struct RenderGraphStats {
+        uint32_t passes = 0;
+        uint32_t culled_passes = 0;
+        uint32_t render_passes = 0;
+        // graphics passes that became a subpass of the previous pass
+        uint32_t merged_passes = 0;
+        // subpasses keeping an attachment they skip for a later subpass
+        uint32_t preserved_attachments = 0;
+        uint32_t image_barriers = 0;
+        uint32_t buffer_barriers = 0;
+        uint32_t barrier_batches = 0;
+        uint32_t transient_images = 0;
+        // what the transients would need on their own / what they got
+        VkDeviceSize transient_bytes = 0;
+        VkDeviceSize aliased_bytes = 0;
+
+        uint64_t compiles = 0;
+        uint64_t cache_hits = 0;
+        double last_compile_ms = 0.0;
+    };
+
+    // Frame graph, declared from scratch every frame:
+    //
+    //     graph.begin_frame(frame, completed);
+    //     auto target = graph.import_image(...);
+    //     graph.add_pass("main", PassType::graphics,
+    //         [&](PassBuilder& pass) { pass.write_color(target, clear); },
+    //         [&](const PassContext& ctx) { ... });
+    //     graph.execute(cmd);
+    //
+    // Compiling culls passes nobody depends on, merges consecutive graphics
+    // passes that only talk through attachments into subpasses, derives the
+    // barriers and layout transitions (batched, one vkCmdPipelineBarrier per
+    // pass at most) and places transient images into shared memory. The
+    // result is cached by the structure of the declaration, so a graph that
+    // does not change between frames is only compiled once.
+    class RenderGraph {
+    public:
+        using setup_t = std::function<void(PassBuilder&)>;
+        using execute_t = std::function<void(const PassContext&)>;
+
+        RenderGraph(VkDevice device, Allocator& allocator);
+        ~RenderGraph();
+
+        RenderGraph(const RenderGraph&) = delete;
+        RenderGraph& operator=(const RenderGraph&) = delete;
+
+        // Starts a new declaration. Plans and framebuffers that went unused
+        // for a while are released once no frame in flight can use them.
+        void begin_frame(uint64_t frame_number, uint64_t completed_frames);
+
+        // An image the graph does not own. `initial_stages` are the stages
+        // that last used it before the graph (e.g. the acquire semaphore's
+        // wait stage); it is left in `final_layout`, or in whatever layout
+        // its last pass needed for VK_IMAGE_LAYOUT_UNDEFINED.
+        RenderGraphImage import_image(
+            const char* name,
+            VkImage image,
+            VkImageView view,
+            VkFormat format,
+            VkExtent2D extent,
+            VkImageLayout initial_layout,
+            VkImageLayout final_layout,
+            VkPipelineStageFlags initial_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT
+        );
+
+        // An external buffer; after the graph its writes are made available
+        // to `final_stages` / `final_access` (e.g. host reads). The first
+        // write waits for `initial_stages`, the stages earlier frames may
+        // still be reading it with.
+        RenderGraphBuffer import_buffer(
+            const char* name,
+            VkBuffer buffer,
+            VkPipelineStageFlags final_stages,
+            VkAccessFlags final_access,
+            VkPipelineStageFlags initial_stages = 0
+        );
+
+        RenderGraphImage create_image(const char* name, const TransientImageDesc& desc);
+
+        void add_pass(const char* name, PassType type, const setup_t& setup, execute_t execute);
+
+        // compiles the declaration (or reuses the plan) and records it
+        void execute(VkCommandBuffer cmd);
+
+        // valid inside a pass's execute callback
+        VkImage image(RenderGraphImage image) const;
+        VkImageView view(RenderGraphImage image) const;
+        VkBuffer buffer(RenderGraphBuffer buffer) const;
+
+        // Framebuffers keep image views alive; call before destroying views
+        // that were imported (e.g. on swapchain recreation).
+        void release_framebuffers();
+
+        RenderGraphStats stats() const;
+
+    private:
+        struct ImageDecl {
+            std::string name;
+            bool imported = false;
+            VkImage image = VK_NULL_HANDLE;
+            VkImageView view = VK_NULL_HANDLE;
+            VkFormat format = VK_FORMAT_UNDEFINED;
+            VkExtent2D extent = {};
+            VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+            VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags initial_stages = 0;
+        };
+
+        struct BufferDecl {
+            std::string name;
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkPipelineStageFlags final_stages = 0;
+            VkAccessFlags final_access = 0;
+            VkPipelineStageFlags initial_stages = 0;
+        };
+
+        struct PassDecl {
+            std::string name;
+            PassType type;
+            PassBuilder builder;
+            execute_t execute;
+        };
+
+        struct BarrierBatch;
+        struct Plan;
+
+        uint64_t declaration_hash() const;
+        std::unique_ptr<Plan> compile();
+        // places the used transients into memory; `previous` is the image
+        // that used the same memory before each one (possibly last frame)
+        bool create_transients(
+            Plan& plan,
+            const std::vector<uint32_t>& first_step,
+            const std::vector<uint32_t>& last_step,
+            std::vector<uint32_t>& previous
+        );
+        VkRenderPass get_render_pass(const VkRenderPassCreateInfo& info);
+        VkFramebuffer get_framebuffer(VkRenderPass render_pass, const std::vector<VkImageView>& views, VkExtent2D extent);
+        void record_barriers(VkCommandBuffer cmd, const BarrierBatch& batch) const;
+        void destroy_plan(Plan& plan);
+
+    private:
+        VkDevice m_device;
+        Allocator& m_allocator;
+
+        uint64_t m_frame_number = 0;
+        uint64_t m_completed_frames = 0;
+
+        std::vector<ImageDecl> m_images;
+        std::vector<BufferDecl> m_buffers;
+        std::vector<PassDecl> m_passes;
+
+        // compiled plans by declaration hash
+        std::unordered_map<uint64_t, std::unique_ptr<Plan>> m_plans;
+        const Plan* m_current = nullptr;
+
+        // render passes are shared between plans, so pipelines built for
+        // one stay valid when the graph changes shape
+        std::unordered_map<uint64_t, VkRenderPass> m_render_passes;
+
+        struct CachedFramebuffer {
+            VkFramebuffer framebuffer;
+            uint64_t last_used;
+        };
+        std::unordered_map<uint64_t, CachedFramebuffer> m_framebuffers;
+
+        struct Retired {
+            std::unique_ptr<Plan> plan;
+            VkFramebuffer framebuffer = VK_NULL_HANDLE;
+            uint64_t frame;
+        };
+        std::vector<Retired> m_retired;
+
+        RenderGraphStats m_stats;
+
+        logger_t m_logger;
+    };
+}
@@ -1,46 +1,101 @@
 #include "renderer.hpp"
 #include "vk_util.hpp"
 
+#include <SDL.h>
 #include <SDL_vulkan.h>
 
+#include <algorithm>
+#include <array>
 #include <optional>
-#include <fstream>
-#include <filesystem>
+#include <thread>
+
+
+#ifndef ENGINE_ASSET_PACK
+#define ENGINE_ASSET_PACK "assets.pack"
+#endif
 
 
 namespace engine {
 
-    Renderer::Renderer(window_t window)
+    RendererParams::RendererParams()
+    : frames_in_flight(2)
+    , stats_window(240)
+    , defragment_threshold(0.5)
+    , validation(true)
+    , headless(false)
+    , headless_width(1280)
+    , headless_height(720)
+    , present_mode(VK_PRESENT_MODE_FIFO_KHR)
+    , low_latency(false)
+    , recording_threads(0)
+    , draw_count(1)
+    , bindless(true)
+    , gpu_driven(true)
+    , upload_service(true)
+    , buffer_device_address(true)
+    , asset_pack(ENGINE_ASSET_PACK)
+    {}
+
+    const char* to_string(VkPresentModeKHR mode) {
+        switch (mode) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:    return "immediate";
+        case VK_PRESENT_MODE_MAILBOX_KHR:      return "mailbox";
+        case VK_PRESENT_MODE_FIFO_KHR:         return "fifo";
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo_relaxed";
+        default:                               return "unknown";
+        }
+    }
+
+    Renderer::Renderer(window_t window, const RendererParams& params)
         : m_window(std::move(window))
-        , m_logger(create_logger("render")) {}
+        , m_params(params)
+        , m_pacer(params.pacing)
+        , m_logger(create_logger("render")) {
+        m_params.frames_in_flight = std::clamp(m_params.frames_in_flight, 1u, 3u);
+        m_params.stats_window = std::max(m_params.stats_window, 1u);
+    }
 
     Renderer::~Renderer() {
-        vkDestroyCommandPool(
-            m_device, 
-            m_command_pool, 
-            nullptr
-        );
+        if (m_device != VK_NULL_HANDLE) {
+            // frames, upload batches and readbacks may all still be running;
+            // after this, retired objects can go whatever they are tagged with
+            check_vk(vkDeviceWaitIdle(m_device));
+        }
 
+        // framebuffers and transient images go before the views and memory they use
+        m_graph.reset();
+        // its pipelines and layouts belong to the registry and the cache
+        m_scene.reset();
+        // waits for its last batch on the transfer queue
+        m_uploads.reset();
+        m_uniforms.reset();
+        // its command pools are not part of the frame contexts
+        m_recorder.reset();
+        m_jobs.reset();
+        m_gpu_profiler.reset();
+
+        // the table's layout belongs to the cache
+        m_bindless.reset();
+        m_descriptors.reset();
+        m_descriptor_layouts.reset();
+
+        for (auto& frame : m_frames) {
+            destroy_offscreen_target(frame.offscreen);
+            vkDestroyCommandPool(m_device, frame.command_pool, nullptr);
+            vkDestroyFence(m_device, frame.render_fence, nullptr);
+            vkDestroySemaphore(m_device, frame.present_semaphore, nullptr);
+        }
+        for (VkSemaphore semaphore : m_render_semaphores) {
+            vkDestroySemaphore(m_device, semaphore, nullptr);
+        }
+
+        destroy_retired_swapchains(true);
         vkDestroySwapchainKHR(
             m_device,
             m_swapchain,
             nullptr
         );
 
-        vkDestroyRenderPass(
-            m_device,
-            m_render_pass,
-            nullptr
-        );
-
-        for (auto& framebuffer : m_framebuffers) {
-            vkDestroyFramebuffer(
-                m_device,
-                framebuffer,
-                nullptr
-            );
-        }
-
         for (auto& image_view : m_swapchain_image_views) {
             vkDestroyImageView(
                 m_device,
@@ -49,6 +104,19 @@ namespace engine {
             );
         }
 
+        m_pipelines.reset();
+        m_shaders.reset();
+
+        // every allocation has to be returned before VMA goes away
+        m_textures.reset();
+        m_frames.clear();
+        if (m_allocator) {
+            m_allocator->set_deletion_queue(nullptr);
+        }
+        // destroys what the objects above retired
+        m_deletions.reset();
+        m_allocator.reset();
+
         vkDestroyDevice(m_device, nullptr);
         vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
         vkb::destroy_debug_utils_messenger(m_instance, m_vk_debug_messenger);
@@ -56,6 +124,16 @@ namespace engine {
     }
     
     bool Renderer::init() {
+        // the pack, if it was built, with the loose files behind it; while
+        // shaders are hot reloaded the freshly compiled ones win
+        m_vfs = std::make_unique<Vfs>();
+        m_vfs->mount_directory("", ".");
+        m_vfs->mount_directory(m_params.shaders.vfs_dir, m_params.shaders.spirv_dir);
+        m_vfs->set_prefer_loose(m_params.shaders.hot_reload);
+        if (!m_params.asset_pack.empty() && !m_vfs->mount_pack(m_params.asset_pack)) {
+            m_logger->info("no asset pack at {}, loading loose files", m_params.asset_pack.string());
+        }
+
         // creating instance
         auto vkb_inst = create_vulk_instance();
         if (!vkb_inst.has_value()) {
@@ -65,20 +143,86 @@ namespace engine {
         m_instance = vkb_inst.value().instance;
         m_vk_debug_messenger = vkb_inst.value().debug_messenger;
         
-	    if(!SDL_Vulkan_CreateSurface(m_window.get(), m_instance, &m_surface)) {
+        if (!m_params.headless && !SDL_Vulkan_CreateSurface(m_window.get(), m_instance, &m_surface)) {
             m_logger->critical("Failed to create vulkan surface");
             return false;
         }
+        if (!m_params.headless) {
+            // later changes arrive through window_changed()
+            m_window_state = getWindowState(m_window.get());
+        }
 
         // creating device
         vkb::PhysicalDeviceSelector selector{ vkb_inst.value() };
-        vkb::PhysicalDevice vkb_physical_device = selector
-            .set_minimum_version(1, 1)
-            .set_surface(m_surface)
-            .select()
-            .value();
+        selector.set_minimum_version(1, 1);
+        selector.add_desired_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (m_params.bindless) {
+            selector.add_desired_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        }
+        if (m_params.gpu_driven) {
+            // without it culled instances stay in the draw list
+            selector.add_desired_extension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        }
+        if (m_params.upload_service) {
+            selector.add_desired_extension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        }
+        if (m_params.buffer_device_address) {
+            selector.add_desired_extension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
+        }
+        if (!m_params.headless) {
+            selector.set_surface(m_surface);
+        }
+        auto physical_device_ret = selector.select();
+        if (!physical_device_ret) {
+            m_logger->critical(
+                "Failed to select physical device. Error: {}",
+                physical_device_ret.error().message()
+            );
+            return false;
+        }
+        vkb::PhysicalDevice vkb_physical_device = physical_device_ret.value();
+
+        // the scene draws every instance with one indirect draw whose
+        // commands start at the instance's index
+        bool gpu_driven = false;
+        if (m_params.gpu_driven) {
+            VkPhysicalDeviceFeatures supported = {};
+            vkGetPhysicalDeviceFeatures(vkb_physical_device.physical_device, &supported);
+            gpu_driven = supported.multiDrawIndirect && supported.drawIndirectFirstInstance;
+            if (gpu_driven) {
+                vkb_physical_device.features.multiDrawIndirect = VK_TRUE;
+                vkb_physical_device.features.drawIndirectFirstInstance = VK_TRUE;
+            } else {
+                m_logger->warn("multi draw indirect is not supported, the gpu driven scene is disabled");
+            }
+        }
 
         vkb::DeviceBuilder device_builder{ vkb_physical_device };
+        // has to live until the device is built
+        auto indexing_features = m_params.bindless
+            ? bindless_features(vkb_physical_device.physical_device)
+            : std::nullopt;
+        if (indexing_features) {
+            device_builder.add_pNext(&indexing_features.value());
+        } else if (m_params.bindless) {
+            m_logger->warn("descriptor indexing is not supported, bindless descriptors are disabled");
+        }
+        auto timeline_features = m_params.upload_service
+            ? timeline_semaphore_features(vkb_physical_device.physical_device)
+            : std::nullopt;
+        if (timeline_features) {
+            device_builder.add_pNext(&timeline_features.value());
+        } else if (m_params.upload_service) {
+            m_logger->warn("timeline semaphores are not supported, the upload service is disabled");
+        }
+        auto address_features = m_params.buffer_device_address
+            ? buffer_device_address_features(vkb_physical_device.physical_device)
+            : std::nullopt;
+        if (address_features) {
+            device_builder.add_pNext(&address_features.value());
+        } else if (m_params.buffer_device_address) {
+            m_logger->warn("buffer device addresses are not supported, per-frame constants need descriptors");
+        }
 
         vkb::Device vkb_device = device_builder.build().value();
 
@@ -87,112 +231,875 @@ namespace engine {
 
         m_logger->info("vulkan instance created successfully");
 
-        // creating swapchain
+        m_allocator = std::make_unique<Allocator>(
+            m_instance,
+            m_physical_device,
+            m_device,
+            has_device_extension(m_physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME),
+            address_features.has_value()
+        );
+        m_deletions = std::make_unique<DeletionQueue>(m_device);
+        m_allocator->set_deletion_queue(m_deletions.get());
+
+        if (m_params.headless) {
+            m_swapchain_image_format = VK_FORMAT_R8G8B8A8_UNORM;
+            m_extent = { m_params.headless_width, m_params.headless_height };
+        } else if (!create_swapchain()) {
+            return false;
+        }
+
+        // creating que
+        m_graphics_que = vkb_device.get_queue(vkb::QueueType::graphics).value();
+        m_graphics_que_family = vkb_device.get_queue_index(
+            vkb::QueueType::graphics
+        ).value();
+        // vk-bootstrap creates a queue in every family: a transfer only family
+        // first, then one without graphics, otherwise uploads share the graphics queue
+        if (auto dedicated = vkb_device.get_dedicated_queue(vkb::QueueType::transfer)) {
+            m_transfer_que.queue = dedicated.value();
+            m_transfer_que.family = vkb_device.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+        } else if (auto separate = vkb_device.get_queue(vkb::QueueType::transfer)) {
+            m_transfer_que.queue = separate.value();
+            m_transfer_que.family = vkb_device.get_queue_index(vkb::QueueType::transfer).value();
+        } else {
+            m_transfer_que.queue = m_graphics_que;
+            m_transfer_que.family = m_graphics_que_family;
+        }
+
+        prepare_commands();
+        m_gpu_profiler = std::make_unique<GpuProfiler>(
+            m_physical_device,
+            m_device,
+            m_graphics_que,
+            m_graphics_que_family,
+            static_cast<uint32_t>(m_frames.size())
+        );
+        if (m_params.headless) {
+            prepare_offscreen_targets();
+        }
+
+        m_textures = std::make_unique<TextureStreamer>(
+            m_device,
+            *m_allocator,
+            *m_deletions,
+            *m_vfs,
+            static_cast<uint32_t>(m_frames.size())
+        );
+        m_graph = std::make_unique<RenderGraph>(m_device, *m_allocator);
+        prepare_descriptors(indexing_features.has_value());
+        prepare_pipelines();
+        prepare_scene(gpu_driven);
+        if (timeline_features) {
+            m_uploads = std::make_unique<UploadService>(
+                m_physical_device,
+                m_device,
+                *m_allocator,
+                m_transfer_que,
+                m_graphics_que_family,
+                m_params.uploads
+            );
+        }
+        m_uniforms = std::make_unique<UniformRing>(
+            m_physical_device,
+            m_device,
+            *m_allocator,
+            static_cast<uint32_t>(m_frames.size()),
+            address_features.has_value(),
+            m_params.uniforms
+        );
+        prepare_recording();
+
+        // created once, set_recording_threads() keeps what callers added;
+        // unit spheres around the triangle, which covers the middle of clip space
+        m_draw_list = std::make_unique<DrawList>(m_params.draw_list);
+        m_draw_list->reserve(m_params.draw_count);
+        for (uint32_t draw = 0; draw < m_params.draw_count; ++draw) {
+            m_draw_list->add(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), DrawPass::opaque, 0, 0);
+        }
+
+        return true;
+    }
+
+    bool Renderer::create_swapchain() {
+        const int window_width = m_window_state.width;
+        const int window_height = m_window_state.height;
+        if (window_width <= 0 || window_height <= 0) {
+            // minimised; tried again every frame until it has a size
+            m_swapchain_dirty = true;
+            return false;
+        }
+        m_present_mode = choose_present_mode(m_params.present_mode);
+
    	    vkb::SwapchainBuilder swapchain_builder{
             m_physical_device,
             m_device,
             m_surface 
         };
 
-        auto [window_width, window_height] = getWindowDimentions(m_window);
-
-        vkb::Swapchain vkb_swapchain = swapchain_builder
+        auto swapchain_ret = swapchain_builder
             .use_default_format_selection()
-            .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+            .set_desired_present_mode(m_present_mode)
             .set_desired_extent(window_width, window_height) 
-            .build()
-            .value();
+            // lets the driver reuse the old swapchain's resources; its images
+            // stay valid for the frames still using them
+            .set_old_swapchain(m_swapchain)
+            .build();
+        if (!swapchain_ret) {
+            m_logger->critical(
+                "Failed to create swapchain. Error: {}",
+                swapchain_ret.error().message()
+            );
+            return false;
+        }
+        vkb::Swapchain vkb_swapchain = swapchain_ret.value();
+
+        if (m_swapchain != VK_NULL_HANDLE) {
+            // the graph's framebuffers point at the old views
+            m_graph->release_framebuffers();
+            m_retired_swapchains.push_back({
+                m_swapchain,
+                std::move(m_swapchain_image_views),
+                std::move(m_render_semaphores),
+                m_frame_number
+            });
+        }
 
         m_swapchain = vkb_swapchain.swapchain;
         m_swapchain_images = vkb_swapchain.get_images().value();
         m_swapchain_image_views = vkb_swapchain.get_image_views().value();
 
+        VkSemaphoreCreateInfo semaphore_create_info = {};
+        semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphore_create_info.pNext = nullptr;
+        semaphore_create_info.flags = 0;
+
+        m_render_semaphores = std::vector<VkSemaphore>(m_swapchain_images.size(), VK_NULL_HANDLE);
+        for (VkSemaphore& semaphore : m_render_semaphores) {
+            check_vk(vkCreateSemaphore(m_device, &semaphore_create_info, nullptr, &semaphore));
+        }
+
         m_swapchain_image_format = vkb_swapchain.image_format;
+        m_extent = vkb_swapchain.extent;
+        m_swapchain_dirty = false;
+        update_refresh_interval();
 
-        // creating que
-        m_graphics_que = vkb_device.get_queue(vkb::QueueType::graphics).value();
-        m_graphics_que_family = vkb_device.get_queue_index(
-            vkb::QueueType::graphics
-        ).value();
+        m_logger->info(
+            "swapchain {}x{}, {} image(s), {}",
+            m_extent.width,
+            m_extent.height,
+            m_swapchain_images.size(),
+            to_string(m_present_mode)
+        );
+        return true;
+    }
 
-        prepare_commands();
-        prepare_pipelines();
+    VkPresentModeKHR Renderer::choose_present_mode(VkPresentModeKHR desired) const {
+        uint32_t count = 0;
+        vkGetPhysicalDeviceSurfacePresentModesKHR(m_physical_device, m_surface, &count, nullptr);
+        std::vector<VkPresentModeKHR> supported(count);
+        vkGetPhysicalDeviceSurfacePresentModesKHR(m_physical_device, m_surface, &count, supported.data());
+
+        // tearing modes fall back to tearing modes first, vsynced ones never tear
+        std::vector<VkPresentModeKHR> chain = { desired };
+        switch (desired) {
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            chain.push_back(VK_PRESENT_MODE_FIFO_RELAXED_KHR);
+            chain.push_back(VK_PRESENT_MODE_MAILBOX_KHR);
+            break;
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            chain.push_back(VK_PRESENT_MODE_IMMEDIATE_KHR);
+            break;
+        default:
+            break;
+        }
+        chain.push_back(VK_PRESENT_MODE_FIFO_KHR);
+
+        for (const VkPresentModeKHR mode : chain) {
+            if (std::find(supported.begin(), supported.end(), mode) != supported.end()) {
+                if (mode != desired) {
+                    m_logger->warn("{} is not supported, using {}", to_string(desired), to_string(mode));
+                }
+                return mode;
+            }
+        }
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    void Renderer::update_refresh_interval() {
+        // only a vsynced swapchain makes the CPU wait for vblanks
+        const bool vsync = m_present_mode == VK_PRESENT_MODE_FIFO_KHR || m_present_mode == VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+
+        uint64_t interval_ns = 0;
+        if (vsync && m_window_state.refresh_rate > 0) {
+            interval_ns = 1000000000ull / m_window_state.refresh_rate;
+        }
+        m_pacer.set_refresh_interval(interval_ns);
+    }
+
+    bool Renderer::acquire_image(FrameContext& frame) {
+        ENGINE_PROFILE_ZONE("acquire");
+        const auto acquire_start = clock::now();
+        const uint64_t begin_ns = profiler::now_ns();
+
+        VkResult result = vkAcquireNextImageKHR(m_device, m_swapchain, 1000000000, frame.present_semaphore, nullptr, &m_swapchain_image_index);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR && create_swapchain()) {
+            // a failed acquire leaves the semaphore unsignalled, so it can be used again
+            result = vkAcquireNextImageKHR(m_device, m_swapchain, 1000000000, frame.present_semaphore, nullptr, &m_swapchain_image_index);
+        }
+        m_times.acquire = clock::now() - acquire_start;
+
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            m_swapchain_dirty = true;
+            return false;
+        }
+        if (result == VK_SUBOPTIMAL_KHR) {
+            // still presentable, replaced after this frame
+            m_swapchain_dirty = true;
+        } else if (!check_vk(result)) {
+            return false;
+        }
+
+        m_pacer.on_acquire(begin_ns, profiler::now_ns());
+        return true;
+    }
+
+    void Renderer::destroy_retired_swapchains(bool all) {
+        auto first_alive = std::partition(m_retired_swapchains.begin(), m_retired_swapchains.end(), [&](const RetiredSwapchain& retired) {
+            return all || retired.frame <= m_completed_frames;
+        });
+        for (auto it = m_retired_swapchains.begin(); it != first_alive; ++it) {
+            for (VkImageView view : it->image_views) {
+                vkDestroyImageView(m_device, view, nullptr);
+            }
+            for (VkSemaphore semaphore : it->render_semaphores) {
+                vkDestroySemaphore(m_device, semaphore, nullptr);
+            }
+            vkDestroySwapchainKHR(m_device, it->swapchain, nullptr);
+        }
+        m_retired_swapchains.erase(m_retired_swapchains.begin(), first_alive);
+    }
+
+    void Renderer::set_present_mode(VkPresentModeKHR mode) {
+        m_params.present_mode = mode;
+        m_swapchain_dirty = !m_params.headless;
+        // the next stats window measures the new mode only
+        reset_frame_stats();
+    }
+
+    void Renderer::window_changed(const WindowState& state) {
+        m_window_state = state;
+        m_swapchain_dirty = !m_params.headless;
+    }
+
+    void Renderer::set_low_latency(bool enabled) {
+        m_params.low_latency = enabled;
+        reset_frame_stats();
+    }
+
+    bool Renderer::wait_for_frame() {
+        if (m_frame_started) {
+            return true;
+        }
+        if (m_swapchain_dirty && !create_swapchain()) {
+            return false;
+        }
+
+        m_times = FrameTimes();
+        m_times.start = clock::now();
+        FrameContext& frame = current_frame();
+        FrameContext& previous = m_frames[(m_frame_number + m_frames.size() - 1) % m_frames.size()];
+        // with one frame in flight the previous frame is the slot's own
+        const bool wait_previous = m_params.low_latency && previous.submitted && &previous != &frame;
+
+        {
+            ENGINE_PROFILE_ZONE("fence wait");
+            // only blocks if the GPU is still busy with the frame that used this
+            // slot frames_in_flight frames ago; in low latency mode nothing may
+            // be queued on the GPU when the next frame samples input
+            const VkFence fences[2] = { frame.render_fence, previous.render_fence };
+            check_vk(vkWaitForFences(m_device, wait_previous ? 2 : 1, fences, true, 1000000000));//1sec
+        }
+        m_times.wait_end = clock::now();
+        if (frame.submitted) {
+            m_completed_frames = std::max(m_completed_frames, frame.submitted_frame + 1);
+        }
+        if (m_params.low_latency && previous.submitted) {
+            m_completed_frames = std::max(m_completed_frames, previous.submitted_frame + 1);
+            // input to GPU and CPU both done; later than the GPU alone when
+            // the CPU is the bottleneck, which is what the delay has to fit
+            m_pacer.on_frame_work(profiler::now_ns() - previous.input_ns);
+        }
+        destroy_retired_swapchains(false);
+
+        if (!m_params.headless && !acquire_image(frame)) {
+            return false;
+        }
 
+        if (m_params.low_latency) {
+            if (const uint64_t delay = m_pacer.delay_ns(profiler::now_ns()); delay > 0) {
+                ENGINE_PROFILE_ZONE("pacing");
+                const auto pacing_start = clock::now();
+                std::this_thread::sleep_for(std::chrono::nanoseconds(delay));
+                m_times.pacing = clock::now() - pacing_start;
+            }
+        }
+
+        m_input_ns = profiler::now_ns();
+        m_times.ready = clock::now();
+        m_frame_started = true;
         return true;
     }
 
     void Renderer::render() {
-        check_vk(vkWaitForFences(m_device, 1, &m_render_fence, true, 1000000000));//1sec
-        check_vk(vkResetFences(m_device, 1, &m_render_fence));
+        ENGINE_PROFILE_ZONE("render");
+        if (!m_frame_started) {
+            // the caller sampled its input before this call
+            const uint64_t input_ns = profiler::now_ns();
+            if (!wait_for_frame()) {
+                return;
+            }
+            m_input_ns = input_ns;
+        }
+        m_frame_started = false;
+        m_times.render_start = clock::now();
 
-        uint32_t swapchain_image_index;
-        check_vk(vkAcquireNextImageKHR(m_device, m_swapchain, 1000000000, m_present_semaphore, nullptr, &swapchain_image_index));
+        FrameTimes& times = m_times;
+        FrameContext& frame = current_frame();
+        const uint32_t slot = static_cast<uint32_t>(m_frame_number % m_frames.size());
+
+        m_allocator->set_frame(m_frame_number);
+        // what the GPU finished with goes in one batch
+        m_deletions->begin_frame(m_frame_number, m_completed_frames);
+        // modules rebuilt by the shader watcher since the last frame, and
+        // the pipelines that have to be compiled again because of them
+        const auto changed_shaders = m_shaders->update();
+        m_pipelines->shaders_changed(changed_shaders);
+        m_pipelines->update(m_frame_number, m_completed_frames);
+        m_graph->begin_frame(m_frame_number, m_completed_frames);
+        m_recorder->begin_frame(slot);
+        m_descriptors->begin_frame(slot);
+        m_uniforms->begin_frame(slot);
+        if (m_bindless) {
+            m_bindless->begin_frame(m_completed_frames);
+        }
+
+        // the copy this slot submitted last time is finished by now
+        deliver_readback(frame);
+
+        RenderGraphImage target;
+        if (m_params.headless) {
+            // the only earlier use is last time's readback copy
+            target = m_graph->import_image(
+                "offscreen",
+                frame.offscreen.image.handle(),
+                frame.offscreen.image_view,
+                m_swapchain_image_format,
+                m_extent,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_PIPELINE_STAGE_TRANSFER_BIT
+            );
+        } else {
+            // the submit waits for the acquire at the color output stage
+            target = m_graph->import_image(
+                "swapchain",
+                m_swapchain_images[m_swapchain_image_index],
+                m_swapchain_image_views[m_swapchain_image_index],
+                m_swapchain_image_format,
+                m_extent,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+            );
+        }
+        check_vk(vkResetFences(m_device, 1, &frame.render_fence));
         
-        check_vk(vkResetCommandBuffer(m_command_buffer, 0));
+        // the slot is idle, so everything allocated from its pool can be recycled at once
+        check_vk(vkResetCommandPool(m_device, frame.command_pool, 0));
         
         // create command buffer
-        VkCommandBuffer cmd = m_command_buffer;
+        VkCommandBuffer cmd = frame.command_buffer;
        	VkCommandBufferBeginInfo begin_info = {};
        	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
        	begin_info.pNext = nullptr;
        	begin_info.pInheritanceInfo = nullptr;
        	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
        	check_vk(vkBeginCommandBuffer(cmd, &begin_info));
+        // publishes the GPU zones this slot recorded last time
+        m_gpu_profiler->begin_frame(cmd, slot);
+        // the slot's previous frame, from its input to the end of its GPU work
+        if (frame.submitted && m_gpu_profiler->last_frame_end_ns() > frame.input_ns) {
+            times.latency_ns = m_gpu_profiler->last_frame_end_ns() - frame.input_ns;
+        }
+        frame.input_ns = m_input_ns;
+
+        {
+            ENGINE_PROFILE_GPU_ZONE(*m_gpu_profiler, cmd, "uploads");
+            // moves a few allocations per frame while a defragmentation is running
+            m_allocator->defragment_step(cmd, m_frame_number, m_completed_frames);
+            // finished textures are copied as part of this frame's submit
+            m_textures->record_uploads(cmd, slot, m_frame_number);
+            if (m_uploads) {
+                // what was uploaded since the last frame goes out as one batch,
+                // ahead of this frame's submit
+                m_uploads->flush();
+                m_uploads->record_acquires(cmd);
+            }
+        }
 
-       	VkClearValue clearValue;
-       	float flash = abs(sin(m_frame_number / 120.f));
-       	clearValue.color = { { 1.0f, flash, 0.0f, 1.0f } };
-       
-       	//start the main renderpass.
-       	VkRenderPassBeginInfo rpInfo = {};
-       	rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-       	rpInfo.pNext = nullptr;
-       	rpInfo.renderPass = m_render_pass;
-       	rpInfo.renderArea.offset.x = 0;
-       	rpInfo.renderArea.offset.y = 0;
-       	//rpInfo.renderArea.extent = _windowExtent;
-       	rpInfo.framebuffer = m_framebuffers[swapchain_image_index];
-       	rpInfo.clearValueCount = 1;
-       	rpInfo.pClearValues = &clearValue;
-       	vkCmdBeginRenderPass(cmd, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-        vkCmdEndRenderPass(cmd);
+        if (m_scene) {
+            // uploads and culling go in front of the passes drawing into target
+            m_scene->begin_frame(m_frame_number, m_completed_frames);
+            m_scene->add_cull_passes(*m_graph, slot, m_extent, *m_descriptors, *m_uniforms);
+        }
+
+        const float flash = abs(sin(m_frame_number / 120.f));
+        const VkClearColorValue clear_color = { { 1.0f, flash, 0.0f, 1.0f } };
+        {
+            const auto draw_list_start = clock::now();
+            // no camera yet: the triangles are placed in clip space directly
+            m_draw_list->build(glm::mat4(1.0f), m_jobs.get());
+            times.draw_list = clock::now() - draw_list_start;
+        }
+        // a few draws are cheaper to record inline than to hand out to threads
+        const uint32_t draws = static_cast<uint32_t>(m_draw_list->commands().size());
+        const bool secondary = draws >= m_params.recording.min_batch;
+        m_graph->add_pass(
+            "main",
+            PassType::graphics,
+            [&](PassBuilder& pass) {
+                pass.write_color(target, clear_color);
+                if (secondary) {
+                    pass.record_secondary();
+                }
+            },
+            [this, secondary](const PassContext& context) {
+                ENGINE_PROFILE_GPU_ZONE(*m_gpu_profiler, context.cmd, "main");
+                draw_triangle(context, secondary);
+            }
+        );
+        if (m_scene) {
+            m_scene->add_draw_passes(*m_graph, target, *m_descriptors);
+        }
+        if (m_graph_callback) {
+            m_graph_callback(*m_graph, target);
+        }
+
+        if (m_params.headless) {
+            const RenderGraphBuffer readback = m_graph->import_buffer(
+                "readback",
+                frame.offscreen.readback_buffer.handle(),
+                VK_PIPELINE_STAGE_HOST_BIT,
+                VK_ACCESS_HOST_READ_BIT
+            );
+            m_graph->add_pass(
+                "readback",
+                PassType::transfer,
+                [&](PassBuilder& pass) {
+                    pass.copy_from(target);
+                    pass.write_buffer(readback, BufferUsage::transfer_dst);
+                },
+                [this, &frame](const PassContext& context) {
+                    ENGINE_PROFILE_GPU_ZONE(*m_gpu_profiler, context.cmd, "readback");
+                    record_readback(context.cmd, frame);
+                }
+            );
+        }
+
+        {
+            ENGINE_PROFILE_ZONE("record");
+            const auto record_start = clock::now();
+            m_graph->execute(cmd);
+            times.record = clock::now() - record_start;
+        }
+        // the recording threads have added their binds by now
+        const DrawListStats draw_stats = m_draw_list->stats();
+        times.draws = draw_stats.visible;
+        times.binds_saved = draw_stats.binds_saved;
         check_vk(vkEndCommandBuffer(cmd));
+        // the constants the passes wrote are read once the submit starts
+        m_uniforms->flush();
+
+        ENGINE_PROFILE_ZONE("submit");
+        const auto submit_start = clock::now();
+
+        // the acquire, and the upload batches only if the frame uses them
+        std::array<VkSemaphore, 2> wait_semaphores = {};
+        std::array<VkPipelineStageFlags, 2> wait_stages = {};
+        std::array<uint64_t, 2> wait_values = {};
+        uint32_t wait_count = 0;
+        if (!m_params.headless) {
+            wait_semaphores[wait_count] = frame.present_semaphore;
+            wait_stages[wait_count] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+            ++wait_count;
+        }
+        const UploadWait upload_wait = m_uploads ? m_uploads->frame_wait() : UploadWait();
+        if (upload_wait.value > 0) {
+            wait_semaphores[wait_count] = upload_wait.semaphore;
+            wait_stages[wait_count] = upload_wait.stages;
+            wait_values[wait_count] = upload_wait.value;
+            ++wait_count;
+        }
+
+        // values of binary semaphores are ignored
+        VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        timeline_info.pNext = nullptr;
+        timeline_info.waitSemaphoreValueCount = wait_count;
+        timeline_info.pWaitSemaphoreValues = wait_values.data();
+        timeline_info.signalSemaphoreValueCount = 0;
+        timeline_info.pSignalSemaphoreValues = nullptr;
 
         VkSubmitInfo submit = {};
         submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-       	submit.pNext = nullptr;
-       	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-       	submit.pWaitDstStageMask = &waitStage;
-       	submit.waitSemaphoreCount = 1;
-       	submit.pWaitSemaphores = &m_present_semaphore;
-       	submit.signalSemaphoreCount = 1;
-       	submit.pSignalSemaphores = &m_render_semaphore;
+       	submit.pNext = upload_wait.value > 0 ? &timeline_info : nullptr;
+        submit.waitSemaphoreCount = wait_count;
+        submit.pWaitSemaphores = wait_semaphores.data();
+       	submit.pWaitDstStageMask = wait_stages.data();
+        if (!m_params.headless) {
+            submit.signalSemaphoreCount = 1;
+            submit.pSignalSemaphores = &m_render_semaphores[m_swapchain_image_index];
+        }
        	submit.commandBufferCount = 1;
        	submit.pCommandBuffers = &cmd;
-        check_vk(vkQueueSubmit(m_graphics_que, 1, &submit, m_render_fence));
+        check_vk(vkQueueSubmit(m_graphics_que, 1, &submit, frame.render_fence));
+        frame.submitted_frame = m_frame_number;
+        frame.submitted = true;
 
-        VkPresentInfoKHR present_info = {};
-       	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-       	present_info.pNext = nullptr;
-       	present_info.pSwapchains = &m_swapchain;
-       	present_info.swapchainCount = 1;
-       	present_info.pWaitSemaphores = &m_render_semaphore;
-       	present_info.waitSemaphoreCount = 1;
-       	present_info.pImageIndices = &swapchain_image_index;
+        if (!m_params.headless) {
+            VkPresentInfoKHR present_info = {};
+            present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            present_info.pNext = nullptr;
+            present_info.pSwapchains = &m_swapchain;
+            present_info.swapchainCount = 1;
+            present_info.pWaitSemaphores = &m_render_semaphores[m_swapchain_image_index];
+            present_info.waitSemaphoreCount = 1;
+            present_info.pImageIndices = &m_swapchain_image_index;
 
-       	check_vk(vkQueuePresentKHR(m_graphics_que, &present_info));
+            const VkResult result = vkQueuePresentKHR(m_graphics_que, &present_info);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+                // recreated before the next acquire
+                m_swapchain_dirty = true;
+            } else {
+                check_vk(result);
+            }
+        }
 
+        times.end = clock::now();
+        times.submit = times.end - submit_start;
+        accumulate_stats(times);
         ++m_frame_number;
     }
 
+    void Renderer::set_readback_callback(readback_callback_t callback) {
+        m_readback_callback = std::move(callback);
+    }
+
+    void Renderer::set_graph_callback(graph_callback_t callback) {
+        m_graph_callback = std::move(callback);
+    }
+
+    uint32_t Renderer::add_draw_pipeline(const GraphicsPipelineDesc& desc) {
+        m_draw_pipelines.push_back(desc);
+        return static_cast<uint32_t>(m_draw_pipelines.size() - 1);
+    }
+
+    void Renderer::flush() {
+        // oldest slot first, so readbacks keep frame order
+        for (size_t i = 0; i < m_frames.size(); ++i) {
+            FrameContext& frame = m_frames[(m_frame_number + i) % m_frames.size()];
+            check_vk(vkWaitForFences(m_device, 1, &frame.render_fence, true, 1000000000));
+            deliver_readback(frame);
+        }
+    }
+
+    void Renderer::set_recording_threads(uint32_t threads) {
+        // the recorder's pools may still be in use by submitted frames
+        flush();
+        m_recorder.reset();
+        m_jobs.reset();
+        m_params.recording_threads = threads;
+        prepare_recording();
+    }
+
+    void Renderer::reset_frame_stats() {
+        m_pending_stats = FrameStats();
+        m_latency_samples = 0;
+        m_last_frame_start.reset();
+    }
+
+    FrameContext& Renderer::current_frame() {
+        return m_frames[m_frame_number % m_frames.size()];
+    }
+
+    void Renderer::draw_triangle(const PassContext& context, bool secondary) {
+        // a lookup once the graph's render pass is known, a compile the first
+        // time; null until compiled, so those objects are not drawn yet
+        std::vector<VkPipeline> pipelines(m_draw_pipelines.size(), VK_NULL_HANDLE);
+        for (size_t i = 0; i < m_draw_pipelines.size(); ++i) {
+            GraphicsPipelineDesc desc = m_draw_pipelines[i];
+            if (desc.vertex_shader == invalid_shader || desc.fragment_shader == invalid_shader) {
+                continue;
+            }
+            desc.render_pass = context.render_pass;
+            desc.subpass = context.subpass;
+            pipelines[i] = m_pipelines->get(m_pipelines->request(desc));
+        }
+        if (std::all_of(pipelines.begin(), pipelines.end(), [](VkPipeline pipeline) { return pipeline == VK_NULL_HANDLE; })) {
+            return;
+        }
+
+        VkViewport viewport = {};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>(context.extent.width);
+        viewport.height = static_cast<float>(context.extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        VkRect2D scissor = {};
+        scissor.offset = { 0, 0 };
+        scissor.extent = context.extent;
+
+        const std::span<const DrawCommand> commands = m_draw_list->commands();
+
+        // secondaries inherit no state, so every batch binds its own; within
+        // a batch the sorted commands repeat binds the filter drops
+        const auto record_draws = [&](VkCommandBuffer cmd, uint32_t begin, uint32_t end) {
+            BindFilter binds(cmd);
+            vkCmdSetViewport(cmd, 0, 1, &viewport);
+            vkCmdSetScissor(cmd, 0, 1, &scissor);
+            for (uint32_t i = begin; i < end; ++i) {
+                const uint32_t object = commands[i].object;
+                const uint32_t pipeline = m_draw_list->pipeline(object);
+                if (pipeline >= pipelines.size()) {
+                    ENGINE_LOG_LIMITED(m_logger, WARN, "draw list object {} uses unknown pipeline {}", object, pipeline);
+                    continue;
+                }
+                if (pipelines[pipeline] == VK_NULL_HANDLE) {
+                    continue;
+                }
+                binds.bind_pipeline(pipelines[pipeline]);
+                vkCmdDraw(cmd, 3, 1, 0, object);
+            }
+            m_draw_list->add_binds(binds.binds(), binds.saved());
+        };
+
+        const uint32_t count = static_cast<uint32_t>(commands.size());
+        if (!secondary) {
+            record_draws(context.cmd, 0, count);
+            return;
+        }
+
+        VkCommandBufferInheritanceInfo inheritance = {};
+        inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance.pNext = nullptr;
+        inheritance.renderPass = context.render_pass;
+        inheritance.subpass = context.subpass;
+        inheritance.framebuffer = context.framebuffer;
+        m_recorder->record(context.cmd, inheritance, count, record_draws);
+    }
+
+    void Renderer::record_readback(VkCommandBuffer cmd, FrameContext& frame) {
+        // the graph put the image into TRANSFER_SRC_OPTIMAL after the attachment
+        // writes, and makes the copy visible to the host once the fence signals
+        VkBufferImageCopy region = {};
+        region.bufferOffset = 0;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = { 0, 0, 0 };
+        region.imageExtent = { m_extent.width, m_extent.height, 1 };
+        vkCmdCopyImageToBuffer(
+            cmd,
+            frame.offscreen.image.handle(),
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            frame.offscreen.readback_buffer.handle(),
+            1,
+            &region
+        );
+
+        frame.offscreen.readback_pending = true;
+    }
+
+    void Renderer::deliver_readback(FrameContext& frame) {
+        OffscreenTarget& target = frame.offscreen;
+        if (!target.readback_pending) {
+            return;
+        }
+        target.readback_pending = false;
+
+        if (!m_readback_callback) {
+            return;
+        }
+
+        // readback memory is usually cached rather than coherent
+        target.readback_buffer.invalidate();
+
+        ReadbackImage image;
+        image.frame_number = frame.submitted_frame;
+        image.width = m_extent.width;
+        image.height = m_extent.height;
+        image.format = m_swapchain_image_format;
+        image.row_pitch = static_cast<size_t>(m_extent.width) * 4;
+        image.data = static_cast<const std::byte*>(target.readback_buffer.mapped());
+        m_readback_callback(image);
+    }
+
+    void Renderer::accumulate_stats(const FrameTimes& times) {
+        using ms = std::chrono::duration<double, std::milli>;
+
+        if (m_last_frame_start.has_value()) {
+            m_pending_stats.frame_ms += ms(times.start - m_last_frame_start.value()).count();
+            m_pending_stats.fence_wait_ms += ms(times.wait_end - times.start).count();
+            // without the pacing delay and whatever the caller did between
+            // wait_for_frame() and render()
+            m_pending_stats.cpu_ms += ms(times.end - times.wait_end - times.pacing - (times.render_start - times.ready)).count();
+            m_pending_stats.acquire_ms += ms(times.acquire).count();
+            m_pending_stats.pacing_ms += ms(times.pacing).count();
+            if (times.latency_ns > 0) {
+                m_pending_stats.latency_ms += times.latency_ns / 1e6;
+                ++m_latency_samples;
+            }
+            m_pending_stats.record_ms += ms(times.record).count();
+            m_pending_stats.submit_ms += ms(times.submit).count();
+            m_pending_stats.draw_list_ms += ms(times.draw_list).count();
+            m_pending_stats.draws += times.draws;
+            m_pending_stats.binds_saved += static_cast<double>(times.binds_saved);
+            // frames_in_flight frames old, the newest the GPU has finished
+            m_pending_stats.gpu_ms += m_gpu_profiler->last_frame_ms();
+            ++m_pending_stats.frame_count;
+        }
+        m_last_frame_start = times.start;
+
+        if (m_pending_stats.frame_count < m_params.stats_window) {
+            return;
+        }
+
+        const double count = static_cast<double>(m_pending_stats.frame_count);
+        m_frame_stats.frames_in_flight = m_params.frames_in_flight;
+        m_frame_stats.frame_count += m_pending_stats.frame_count;
+        m_frame_stats.frame_ms = m_pending_stats.frame_ms / count;
+        m_frame_stats.fence_wait_ms = m_pending_stats.fence_wait_ms / count;
+        m_frame_stats.cpu_ms = m_pending_stats.cpu_ms / count;
+        m_frame_stats.acquire_ms = m_pending_stats.acquire_ms / count;
+        m_frame_stats.record_ms = m_pending_stats.record_ms / count;
+        m_frame_stats.submit_ms = m_pending_stats.submit_ms / count;
+        m_frame_stats.draw_list_ms = m_pending_stats.draw_list_ms / count;
+        m_frame_stats.draws = m_pending_stats.draws / count;
+        m_frame_stats.binds_saved = m_pending_stats.binds_saved / count;
+        m_frame_stats.gpu_ms = m_pending_stats.gpu_ms / count;
+        m_frame_stats.pacing_ms = m_pending_stats.pacing_ms / count;
+        m_frame_stats.latency_ms = m_latency_samples > 0 ? m_pending_stats.latency_ms / m_latency_samples : 0.0;
+        m_frame_stats.present_mode = m_present_mode;
+        m_frame_stats.low_latency = m_params.low_latency;
+        m_pending_stats = FrameStats();
+        m_latency_samples = 0;
+
+        m_logger->info(
+            "{} frame(s) in flight: frame {:.3f} ms, cpu {:.3f} ms, fence wait {:.3f} ms, overlap {:.1f}%",
+            m_frame_stats.frames_in_flight,
+            m_frame_stats.frame_ms,
+            m_frame_stats.cpu_ms,
+            m_frame_stats.fence_wait_ms,
+            m_frame_stats.overlap() * 100.0
+        );
+        m_logger->info(
+            "  acquire {:.3f} ms, record {:.3f} ms, submit {:.3f} ms, gpu {:.3f} ms",
+            m_frame_stats.acquire_ms,
+            m_frame_stats.record_ms,
+            m_frame_stats.submit_ms,
+            m_frame_stats.gpu_ms
+        );
+        m_logger->info(
+            "  draw list {:.3f} ms: {:.0f} draw(s) after culling, {:.0f} redundant bind(s) skipped",
+            m_frame_stats.draw_list_ms,
+            m_frame_stats.draws,
+            m_frame_stats.binds_saved
+        );
+        if (!m_params.headless) {
+            m_logger->info(
+                "  {}{}: input to gpu done {:.3f} ms, pacing delay {:.3f} ms",
+                to_string(m_frame_stats.present_mode),
+                m_frame_stats.low_latency ? " low latency" : "",
+                m_frame_stats.latency_ms,
+                m_frame_stats.pacing_ms
+            );
+        }
+
+        log_memory_stats();
+        check_fragmentation();
+    }
+
+    void Renderer::check_fragmentation() {
+        if (m_params.defragment_threshold >= 1.0 || m_allocator->is_defragmenting()) {
+            return;
+        }
+        const PoolStats pool = m_allocator->stats().pools[size_t(MemoryUsage::static_geometry)];
+        if (pool.fragmentation() <= m_params.defragment_threshold) {
+            return;
+        }
+        // render() carries it out a few moves per frame
+        m_logger->info("static geometry pool is {:.1f}% fragmented", pool.fragmentation() * 100.0);
+        m_allocator->begin_defragmentation();
+    }
+
+    void Renderer::log_memory_stats() {
+        const AllocatorStats stats = m_allocator->stats();
+        m_logger->info(
+            "gpu memory: {} allocation(s), {} defragmentation move(s) ({} bytes)",
+            stats.total_allocations,
+            stats.defragmentation_moves,
+            stats.defragmentation_bytes_moved
+        );
+        for (size_t i = 0; i < stats.pools.size(); ++i) {
+            const PoolStats& pool = stats.pools[i];
+            if (pool.block_count == 0) {
+                continue;
+            }
+            m_logger->info(
+                "  {}: {} allocation(s) in {} block(s), {} / {} bytes used, fragmentation {:.1f}%",
+                to_string(MemoryUsage(i)),
+                pool.allocation_count,
+                pool.block_count,
+                pool.allocation_bytes,
+                pool.block_bytes,
+                pool.fragmentation() * 100.0
+            );
+        }
+
+        const UniformRingStats uniforms = m_uniforms->stats();
+        m_logger->info(
+            "  per-frame constants: {} / {} bytes last frame, high water {} bytes, {} failed allocation(s)",
+            uniforms.last_frame_bytes,
+            uniforms.bytes_per_frame,
+            uniforms.high_water,
+            uniforms.failed
+        );
+
+        const auto budgets = m_allocator->heap_budgets();
+        for (size_t i = 0; i < budgets.size(); ++i) {
+            m_logger->info(
+                "  heap {}{}: {} / {} MiB",
+                i,
+                (budgets[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "",
+                budgets[i].usage / (1024 * 1024),
+                budgets[i].budget / (1024 * 1024)
+            );
+        }
+    }
+
     std::optional<vkb::Instance> Renderer::create_vulk_instance() {
         vkb::InstanceBuilder builder;
         auto inst_ret = builder
             .set_app_name("Example Vulkan Application")
-            .request_validation_layers(true)
+            .request_validation_layers(m_params.validation)
             .require_api_version(1, 1, 0)
             .use_default_debug_messenger()
+            .set_headless(m_params.headless)
             .build();
 
         if (!inst_ret) {
@@ -208,129 +1115,182 @@ namespace engine {
     }
 
     void Renderer::prepare_commands() {
-        // creating command pool
-        VkCommandPoolCreateInfo pool_info;
+        // create one frame context per frame in flight
+        VkCommandPoolCreateInfo pool_info = {};
         pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
         pool_info.pNext = nullptr;
         pool_info.queueFamilyIndex = m_graphics_que_family;
-        pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        check_vk(vkCreateCommandPool(m_device, &pool_info, nullptr, &m_command_pool));
-        
-        // creating command buffer
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
        	VkCommandBufferAllocateInfo buffer_info = {};
         buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         buffer_info.pNext = nullptr;
-        buffer_info.commandPool = m_command_pool;
         buffer_info.commandBufferCount = 1;
         buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        check_vk(vkAllocateCommandBuffers(m_device, &buffer_info, &m_command_buffer));
-
-        // create renderpass
-        VkAttachmentDescription color_attachment = {};
-        color_attachment.format = m_swapchain_image_format;
-        color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-        color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        VkAttachmentReference color_attachment_ref = {};
-        color_attachment_ref.attachment = 0;
-        color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-        VkSubpassDescription subpass = {};
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &color_attachment_ref;
-
-        VkRenderPassCreateInfo render_pass_info = {};
-        render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        render_pass_info.attachmentCount = 1;
-        render_pass_info.pAttachments = &color_attachment;
-        render_pass_info.subpassCount = 1;
-        render_pass_info.pSubpasses = &subpass;
-        check_vk(vkCreateRenderPass(
-            m_device, 
-            &render_pass_info, 
-            nullptr, 
-            &m_render_pass
-        ));
-
-        auto [window_width, window_height] = getWindowDimentions(m_window);
-        // create framebuffers
-        VkFramebufferCreateInfo fb_info = {};
-        fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        fb_info.pNext = nullptr;
-        fb_info.renderPass = m_render_pass;
-        fb_info.attachmentCount = 1;
-        fb_info.width = window_width; 
-        fb_info.height = window_height;
-        fb_info.layers = 1;
-        const uint32_t swapchain_imagecount = m_swapchain_images.size();
-        m_framebuffers = std::vector<VkFramebuffer>(swapchain_imagecount);
-        for (int i = 0; i < swapchain_imagecount; ++i) {
-            fb_info.pAttachments = &m_swapchain_image_views[i];
-            check_vk(vkCreateFramebuffer(m_device, &fb_info, nullptr, &m_framebuffers[i]));
-        }
-
-        // create sync
+
         VkFenceCreateInfo fence_create_info = {};
         fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
         fence_create_info.pNext = nullptr;
         fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-        check_vk(vkCreateFence(m_device, &fence_create_info, nullptr, &m_render_fence));
 
         VkSemaphoreCreateInfo semaphore_create_info = {};
         semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
         semaphore_create_info.pNext = nullptr;
         semaphore_create_info.flags = 0;
-        check_vk(vkCreateSemaphore(m_device, &semaphore_create_info, nullptr, &m_present_semaphore));
-        check_vk(vkCreateSemaphore(m_device, &semaphore_create_info, nullptr, &m_render_semaphore));
 
-    }
+        m_frames = std::vector<FrameContext>(m_params.frames_in_flight);
+        for (auto& frame : m_frames) {
+            check_vk(vkCreateCommandPool(m_device, &pool_info, nullptr, &frame.command_pool));
 
-    void Renderer::prepare_pipelines() {
-        VkShaderModule triangleFragShader;
-        if (!load_shader_module("resources/shaders/frag.spv", &triangleFragShader)) {
-            m_logger->error("failed to load shader");
+            buffer_info.commandPool = frame.command_pool;
+            check_vk(vkAllocateCommandBuffers(m_device, &buffer_info, &frame.command_buffer));
+
+            check_vk(vkCreateFence(m_device, &fence_create_info, nullptr, &frame.render_fence));
+            check_vk(vkCreateSemaphore(m_device, &semaphore_create_info, nullptr, &frame.present_semaphore));
         }
 
-        VkShaderModule triangleVertShader;
-        if (!load_shader_module("resources/shaders/vert.spv", &triangleVertShader)) {
-            m_logger->error("failed to load shader");
+        m_logger->info("using {} frame(s) in flight", m_frames.size());
+    }
+
+    void Renderer::prepare_offscreen_targets() {
+        VkImageCreateInfo image_info = {};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.pNext = nullptr;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = m_swapchain_image_format;
+        image_info.extent = { m_extent.width, m_extent.height, 1 };
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkImageViewCreateInfo view_info = {};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.pNext = nullptr;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = m_swapchain_image_format;
+        view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+
+        const VkDeviceSize readback_size = static_cast<VkDeviceSize>(m_extent.width) * m_extent.height * 4;
+
+        for (auto& frame : m_frames) {
+            OffscreenTarget& target = frame.offscreen;
+
+            target.image = m_allocator->create_image(image_info, MemoryUsage::render_target);
+
+            view_info.image = target.image.handle();
+            check_vk(vkCreateImageView(m_device, &view_info, nullptr, &target.image_view));
+
+            target.readback_buffer = m_allocator->create_buffer(
+                readback_size,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                MemoryUsage::readback
+            );
+            if (target.readback_buffer.mapped() == nullptr) {
+                m_logger->critical("no host visible memory for readback buffers");
+                return;
+            }
         }
+
+        m_logger->info(
+            "rendering headless into {} offscreen target(s) of {}x{}",
+            m_frames.size(),
+            m_extent.width,
+            m_extent.height
+        );
+    }
+
+    void Renderer::destroy_offscreen_target(OffscreenTarget& target) {
+        vkDestroyImageView(m_device, target.image_view, nullptr);
+        target = OffscreenTarget();
     }
 
+    void Renderer::prepare_descriptors(bool bindless) {
+        m_descriptor_layouts = std::make_unique<DescriptorLayoutCache>(m_device);
+        m_descriptors = std::make_unique<DescriptorAllocator>(
+            m_device,
+            static_cast<uint32_t>(m_frames.size()),
+            m_params.descriptors
+        );
+        if (bindless) {
+            m_bindless = std::make_unique<BindlessTable>(
+                m_physical_device,
+                m_device,
+                *m_descriptor_layouts,
+                m_params.bindless_table
+            );
+        }
+    }
 
-    bool Renderer::load_shader_module(const char* filePath, VkShaderModule* outShaderModule) {
-        std::ifstream shader_file(filePath, std::ios::binary);
+    void Renderer::prepare_pipelines() {
+        m_shaders = std::make_unique<ShaderLibrary>(m_device, *m_vfs, m_params.shaders);
+        m_shaders->load_all();
 
-        if (!shader_file.is_open()) {
-            return false;
+        m_triangle_vert = m_shaders->find("triangle.vert");
+        m_triangle_frag = m_shaders->find("triangle.frag");
+        if (m_triangle_vert == invalid_shader || m_triangle_frag == invalid_shader) {
+            m_logger->error("failed to load the triangle shaders");
         }
-        auto filesize = std::filesystem::file_size(filePath);
-        std::vector<uint32_t> shader_code(filesize / sizeof(uint32_t));
 
-        m_logger->info("loading shader of size {}", filesize);
-        m_logger->info("code size is {}", shader_code.size());
-        shader_file.read(reinterpret_cast<char*>(shader_code.data()), filesize);
+        m_pipelines = std::make_unique<PipelineRegistry>(
+            m_physical_device,
+            m_device,
+            *m_shaders,
+            m_params.pipelines
+        );
+
+        // draw list pipeline 0, skipped while its shaders are missing
+        GraphicsPipelineDesc triangle;
+        triangle.vertex_shader = m_triangle_vert;
+        triangle.fragment_shader = m_triangle_frag;
+        m_draw_pipelines.push_back(triangle);
+    }
 
-        VkShaderModuleCreateInfo createInfo = {};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.pNext = nullptr;
+    void Renderer::prepare_scene(bool supported) {
+        if (!supported) {
+            return;
+        }
 
-        createInfo.codeSize = shader_code.size() * sizeof(uint32_t);
-        createInfo.pCode = shader_code.data();
+        // vkCmdDrawIndexedIndirectCount is core in 1.2 only
+        PFN_vkCmdDrawIndexedIndirectCountKHR draw_count = nullptr;
+        if (has_device_extension(m_physical_device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+            draw_count = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+                vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR")
+            );
+        }
 
-        //check that the creation goes well.
-        VkShaderModule shaderModule;
-        if (vkCreateShaderModule(m_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-            return false;
+        m_scene = std::make_unique<GpuScene>(
+            m_physical_device,
+            m_device,
+            *m_allocator,
+            *m_shaders,
+            *m_pipelines,
+            *m_descriptor_layouts,
+            static_cast<uint32_t>(m_frames.size()),
+            draw_count,
+            m_params.scene
+        );
+        if (!m_scene->valid()) {
+            m_scene.reset();
         }
-        *outShaderModule = shaderModule;
-        return true;
     }
-    
-}
 
+    void Renderer::prepare_recording() {
+        m_jobs = std::make_unique<JobSystem>(m_params.recording_threads);
+        m_recorder = std::make_unique<CommandRecorder>(
+            m_device,
+            m_graphics_que_family,
+            *m_jobs,
+            static_cast<uint32_t>(m_frames.size()),
+            m_params.recording
+        );
+        m_logger->info("recording {} draw(s) per frame on {} thread(s)", m_params.draw_count, m_jobs->thread_count());
+    }
+}
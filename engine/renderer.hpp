@@ -2,61 +2,330 @@
 
 #include "window.hpp"
 #include "logger.hpp"
+#include "frame.hpp"
+#include "readback.hpp"
+#include "allocator.hpp"
+#include "deletion_queue.hpp"
+#include "texture.hpp"
+#include "shader_library.hpp"
+#include "pipeline.hpp"
+#include "render_graph.hpp"
+#include "job_system.hpp"
+#include "command_recorder.hpp"
+#include "draw_list.hpp"
+#include "profiler.hpp"
+#include "descriptors.hpp"
+#include "frame_pacer.hpp"
+#include "gpu_scene.hpp"
+#include "upload_service.hpp"
+#include "uniform_ring.hpp"
+#include "vfs.hpp"
 
 #include <VkBootstrap.h>
 
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <memory>
 #include <optional>
+#include <vector>
 
 
 namespace engine {
-    
+
+    struct RendererParams {
+        RendererParams();
+
+        // how many frames the CPU may record ahead of the GPU (1 - 3)
+        uint32_t frames_in_flight;
+        // how many frames are averaged into one FrameStats report
+        uint32_t stats_window;
+        // fragmentation of the static geometry pool, checked every stats
+        // window, above which an incremental defragmentation is started;
+        // 1 or more turns it off
+        double defragment_threshold;
+
+        // the Khronos validation layer, when it is installed
+        bool validation;
+
+        // render into engine-owned images instead of a window swapchain
+        bool headless;
+        uint32_t headless_width;
+        uint32_t headless_height;
+
+        // Preferred presentation mode. Unsupported modes fall back to the
+        // nearest one with the same tearing behaviour, and then to FIFO,
+        // which every device supports.
+        VkPresentModeKHR present_mode;
+        // Waits for the previous frame before sampling input and, with FIFO,
+        // delays the frame start until just before the vblank its measured
+        // work time can still make.
+        bool low_latency;
+        FramePacerParams pacing;
+
+        // threads recording draws, the render thread included; 0 uses
+        // every hardware thread
+        uint32_t recording_threads;
+        // triangles drawn per frame, one draw call each. They go through
+        // the draw list's culling and sorting, and enough of them are
+        // recorded into secondary command buffers in parallel.
+        uint32_t draw_count;
+        // a BindlessTable when the device supports descriptor indexing
+        bool bindless;
+        // a GpuScene when the device supports multi draw indirect; it is
+        // culled and drawn on top of the triangles every frame
+        bool gpu_driven;
+        // an UploadService when the device has timeline semaphores, on a
+        // transfer queue family of its own where there is one
+        bool upload_service;
+        // VK_KHR_buffer_device_address, so per-frame constants can be read
+        // through pointers instead of descriptors
+        bool buffer_device_address;
+        // mounted in front of the loose files if it exists; written by the
+        // asset_pack tool, the build puts one next to the compiled shaders
+        std::filesystem::path asset_pack;
+
+        ShaderLibraryParams shaders;
+        PipelineRegistryParams pipelines;
+        CommandRecorderParams recording;
+        DrawListParams draw_list;
+        DescriptorAllocatorParams descriptors;
+        BindlessParams bindless_table;
+        GpuSceneParams scene;
+        UploadServiceParams uploads;
+        UniformRingParams uniforms;
+    };
+
+    const char* to_string(VkPresentModeKHR mode);
+
+    // declares passes of its own into the frame's graph; `target` is the
+    // swapchain image or the offscreen target
+    using graph_callback_t = std::function<void(RenderGraph& graph, RenderGraphImage target)>;
+
     class Renderer {
     public:
-        Renderer(window_t window);
+        // window may be empty when params.headless is set
+        Renderer(window_t window, const RendererParams& params = RendererParams());
         ~Renderer();
 
         bool init();
+
+        // Blocks until the next frame can be recorded: its frame slot, its
+        // swapchain image and the low latency delay. Sample input between
+        // this and render() to keep it fresh; render() calls it itself
+        // otherwise. False while there is nothing to render into, e.g. when
+        // the window is minimised; render() then does nothing.
+        bool wait_for_frame();
         void render();
 
+        // both take effect at the start of the next frame, by recreating the
+        // swapchain without waiting for the device. `state` is read with
+        // getWindowState() on the thread that created the window; the
+        // renderer makes no SDL video calls after init().
+        void set_present_mode(VkPresentModeKHR mode);
+        void window_changed(const WindowState& state);
+        // the mode the swapchain uses, after fallbacks
+        VkPresentModeKHR present_mode() const { return m_present_mode; }
+
+        void set_low_latency(bool enabled);
+        bool low_latency() const { return m_params.low_latency; }
+
+        // headless mode: called with every finished frame, in frame order.
+        // Frame N is handed out when its ring slot is reused, so the copy of
+        // frame N overlaps the rendering of the following frames.
+        void set_readback_callback(readback_callback_t callback);
+        // called every frame after the built-in passes and before the
+        // headless readback copy
+        void set_graph_callback(graph_callback_t callback);
+        // waits for all submitted frames and hands out the pending readbacks
+        void flush();
+
+        // waits for the GPU and recreates the job system with `threads`
+        // recording threads (0 = hardware concurrency)
+        void set_recording_threads(uint32_t threads);
+        uint32_t recording_threads() const { return m_jobs->thread_count(); }
+
+        bool is_headless() const { return m_params.headless; }
+        // of the swapchain or the offscreen targets
+        VkExtent2D extent() const { return m_extent; }
+
+        // shaders and textures are loaded through it
+        Vfs& vfs() { return *m_vfs; }
+        Allocator& allocator() { return *m_allocator; }
+        // for anything dropped while frames may still use it
+        DeletionQueue& deletions() { return *m_deletions; }
+        TextureStreamer& textures() { return *m_textures; }
+        ShaderLibrary& shaders() { return *m_shaders; }
+        PipelineRegistry& pipelines() { return *m_pipelines; }
+        RenderGraph& graph() { return *m_graph; }
+        DescriptorLayoutCache& descriptor_layouts() { return *m_descriptor_layouts; }
+        // per-frame sets of the render thread, reset with the frame slot
+        DescriptorAllocator& descriptors() { return *m_descriptors; }
+        // null without descriptor indexing or with params.bindless off
+        BindlessTable* bindless() { return m_bindless.get(); }
+        // null without multi draw indirect or with params.gpu_driven off
+        GpuScene* scene() { return m_scene.get(); }
+        // null without timeline semaphores or with params.upload_service off.
+        // Flushed by render(), which also waits for what the frame use()s.
+        UploadService* uploads() { return m_uploads.get(); }
+        // camera, object and material constants of the frame being recorded,
+        // rewound with the frame slot
+        UniformRing& uniforms() { return *m_uniforms; }
+        // the CPU path's objects, culled and sorted every frame
+        DrawList& draw_list() { return *m_draw_list; }
+        // Registers a pipeline for draw list objects and returns the id to
+        // pass to DrawList::add(); render pass and subpass are filled in by
+        // the graph. 0 is the triangle. Objects with an id nobody registered
+        // are skipped with a warning. After init(), render thread only.
+        uint32_t add_draw_pipeline(const GraphicsPipelineDesc& desc);
+
+        VkDevice device() const { return m_device; }
+        uint32_t graphics_queue_family() const { return m_graphics_que_family; }
+
+        // averages over the last completed stats window
+        const FrameStats& frame_stats() const { return m_frame_stats; }
+        // drops the partially collected window, e.g. after a warm up
+        void reset_frame_stats();
+
     private:
+        using clock = std::chrono::steady_clock;
+
+        // where one render() call spent its time
+        struct FrameTimes {
+            clock::time_point start;
+            clock::time_point wait_end;
+            // wait_for_frame() returned and render() was called
+            clock::time_point ready;
+            clock::time_point render_start;
+            clock::time_point end;
+            clock::duration acquire = {};
+            clock::duration pacing = {};
+            clock::duration draw_list = {};
+            clock::duration record = {};
+            clock::duration submit = {};
+            // of the frame the slot published, 0 without GPU timestamps
+            uint64_t latency_ns = 0;
+            // of the draw list, once the frame is recorded
+            uint32_t draws = 0;
+            uint64_t binds_saved = 0;
+        };
+
+        // kept until no frame in flight can use its images any more
+        struct RetiredSwapchain {
+            VkSwapchainKHR swapchain;
+            std::vector<VkImageView> image_views;
+            std::vector<VkSemaphore> render_semaphores;
+            // the first frame that used the new swapchain
+            uint64_t frame;
+        };
+
         window_t m_window;
+        RendererParams m_params;
 
-        VkInstance m_instance;
-        VkDebugUtilsMessengerEXT m_vk_debug_messenger;
-        VkPhysicalDevice m_physical_device; 
-	    VkDevice m_device;
-        VkSurfaceKHR m_surface;
-        VkSwapchainKHR m_swapchain; 
-	    VkFormat m_swapchain_image_format;
+        VkInstance m_instance = VK_NULL_HANDLE;
+        VkDebugUtilsMessengerEXT m_vk_debug_messenger = VK_NULL_HANDLE;
+        VkPhysicalDevice m_physical_device = VK_NULL_HANDLE;
+	    VkDevice m_device = VK_NULL_HANDLE;
+        VkSurfaceKHR m_surface = VK_NULL_HANDLE;
+        VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
+	    VkFormat m_swapchain_image_format = VK_FORMAT_UNDEFINED;
+        VkExtent2D m_extent = {};
 
         std::vector<VkImage> m_swapchain_images;
         std::vector<VkImageView> m_swapchain_image_views;
+        // one per image: the present waiting on it is not covered by any
+        // frame fence, so it is only signalled again once the image is
+        // acquired again
+        std::vector<VkSemaphore> m_render_semaphores;
+        VkPresentModeKHR m_present_mode = VK_PRESENT_MODE_FIFO_KHR;
+        // out of date, resized, or another present mode was asked for
+        bool m_swapchain_dirty = false;
+        // as of init() or the last window_changed()
+        WindowState m_window_state;
+        std::vector<RetiredSwapchain> m_retired_swapchains;
+
+        // outlives the loaders holding spans into it
+        std::unique_ptr<Vfs> m_vfs;
 
-        VkQueue m_graphics_que;
-        uint32_t m_graphics_que_family;
+        std::unique_ptr<Allocator> m_allocator;
+        // outlives everything that retires into it, except the allocator
+        std::unique_ptr<DeletionQueue> m_deletions;
 
-        // this should probably go somewhere else
-        VkCommandPool m_command_pool;
-        VkCommandBuffer m_command_buffer;
-        VkRenderPass m_render_pass;
-	    std::vector<VkFramebuffer> m_framebuffers;
+        VkQueue m_graphics_que = VK_NULL_HANDLE;
+        uint32_t m_graphics_que_family = 0;
+        // the graphics queue when there is no other one
+        UploadQueue m_transfer_que;
 
-        VkSemaphore m_present_semaphore;
-        VkSemaphore m_render_semaphore;
-        VkFence m_render_fence;
+        std::vector<FrameContext> m_frames;
+
+        std::unique_ptr<TextureStreamer> m_textures;
+        std::unique_ptr<ShaderLibrary> m_shaders;
+        ShaderId m_triangle_vert = invalid_shader;
+        ShaderId m_triangle_frag = invalid_shader;
+        std::unique_ptr<PipelineRegistry> m_pipelines;
+        // indexed by the draw list's pipeline ids
+        std::vector<GraphicsPipelineDesc> m_draw_pipelines;
+        std::unique_ptr<RenderGraph> m_graph;
+
+        std::unique_ptr<JobSystem> m_jobs;
+        // per-thread command pools for every frame slot, uses m_jobs
+        std::unique_ptr<CommandRecorder> m_recorder;
+        std::unique_ptr<DrawList> m_draw_list;
+        std::unique_ptr<GpuProfiler> m_gpu_profiler;
+
+        std::unique_ptr<DescriptorLayoutCache> m_descriptor_layouts;
+        std::unique_ptr<DescriptorAllocator> m_descriptors;
+        std::unique_ptr<BindlessTable> m_bindless;
+        std::unique_ptr<GpuScene> m_scene;
+        std::unique_ptr<UploadService> m_uploads;
+        std::unique_ptr<UniformRing> m_uniforms;
 
         uint64_t m_frame_number = 0;
+        // every frame below this number has finished on the GPU
+        uint64_t m_completed_frames = 0;
+
+        // set by wait_for_frame() until render() records the frame
+        bool m_frame_started = false;
+        uint32_t m_swapchain_image_index = 0;
+        uint64_t m_input_ns = 0;
+        FrameTimes m_times;
+        FramePacer m_pacer;
+
+        readback_callback_t m_readback_callback;
+        graph_callback_t m_graph_callback;
+
+        FrameStats m_frame_stats;
+        FrameStats m_pending_stats;
+        // frames in m_pending_stats that had a latency measurement
+        uint32_t m_latency_samples = 0;
+        std::optional<clock::time_point> m_last_frame_start;
 
         logger_t m_logger;
 
     private:
         std::optional<vkb::Instance> create_vulk_instance();
+        bool create_swapchain();
+        VkPresentModeKHR choose_present_mode(VkPresentModeKHR desired) const;
+        void update_refresh_interval();
+        bool acquire_image(FrameContext& frame);
+        void destroy_retired_swapchains(bool all);
         void prepare_commands();
+        void prepare_offscreen_targets();
+        void prepare_descriptors(bool bindless);
         void prepare_pipelines();
+        void prepare_scene(bool supported);
+        void prepare_recording();
 
-        bool load_shader_module(const char* filePath, VkShaderModule* outShaderModule);
+        FrameContext& current_frame();
+        void draw_triangle(const PassContext& context, bool secondary);
+        void record_readback(VkCommandBuffer cmd, FrameContext& frame);
+        void deliver_readback(FrameContext& frame);
+        void destroy_offscreen_target(OffscreenTarget& target);
 
+        void accumulate_stats(const FrameTimes& times);
+        void log_memory_stats();
+        // starts a defragmentation when params.defragment_threshold is passed
+        void check_fragmentation();
     };
 
 }
-
@@ -0,0 +1,420 @@
+#include "scene.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define ENGINE_SCENE_SSE2 1
+#endif
+
+
+namespace engine {
+
+    namespace {
+
+        // parent * local for two affine matrices; the implied fourth row is (0, 0, 0, 1)
+        void multiply_scalar(const Affine& a, const Affine& b, Affine& out) {
+            for (int r = 0; r < 3; ++r) {
+                for (int c = 0; c < 4; ++c) {
+                    out.rows[r][c] = a.rows[r][0] * b.rows[0][c]
+                        + a.rows[r][1] * b.rows[1][c]
+                        + a.rows[r][2] * b.rows[2][c]
+                        + (c == 3 ? a.rows[r][3] : 0.0f);
+                }
+            }
+        }
+
+#if defined(ENGINE_SCENE_SSE2)
+        // each output row is a combination of b's rows, plus a's translation
+        void multiply_sse2(const Affine& a, const Affine& b, Affine& out) {
+            const __m128 b0 = _mm_load_ps(b.rows[0]);
+            const __m128 b1 = _mm_load_ps(b.rows[1]);
+            const __m128 b2 = _mm_load_ps(b.rows[2]);
+            const __m128 w_mask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+            for (int r = 0; r < 3; ++r) {
+                const __m128 row = _mm_load_ps(a.rows[r]);
+                __m128 result = _mm_and_ps(row, w_mask);
+                result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), b0));
+                result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+                result = _mm_add_ps(result, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+                _mm_store_ps(out.rows[r], result);
+            }
+        }
+#endif
+
+        void multiply(const Affine& a, const Affine& b, Affine& out) {
+#if defined(ENGINE_SCENE_SSE2)
+            multiply_sse2(a, b, out);
+#else
+            multiply_scalar(a, b, out);
+#endif
+        }
+
+        // The sphere moves with the centre and grows with the longest basis
+        // vector, which is exact for rotations and scales without shear.
+        glm::vec4 transform_sphere(const Affine& m, const glm::vec4& sphere) {
+            glm::vec3 center;
+            float scale_sq = 0.0f;
+            for (int r = 0; r < 3; ++r) {
+                center[r] = m.rows[r][0] * sphere.x + m.rows[r][1] * sphere.y + m.rows[r][2] * sphere.z + m.rows[r][3];
+            }
+            for (int c = 0; c < 3; ++c) {
+                const float length_sq = m.rows[0][c] * m.rows[0][c] + m.rows[1][c] * m.rows[1][c] + m.rows[2][c] * m.rows[2][c];
+                scale_sq = std::max(scale_sq, length_sq);
+            }
+            return glm::vec4(center, sphere.w * std::sqrt(scale_sq));
+        }
+
+        template <typename T>
+        void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+            std::vector<T> sorted;
+            sorted.reserve(order.size());
+            for (uint32_t old_slot : order) {
+                sorted.push_back(values[old_slot]);
+            }
+            values = std::move(sorted);
+        }
+    }
+
+    Affine Affine::identity() {
+        Affine affine = {};
+        affine.rows[0][0] = 1.0f;
+        affine.rows[1][1] = 1.0f;
+        affine.rows[2][2] = 1.0f;
+        return affine;
+    }
+
+    Affine Affine::from_matrix(const glm::mat4& matrix) {
+        Affine affine;
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 4; ++c) {
+                // glm is column-major
+                affine.rows[r][c] = matrix[c][r];
+            }
+        }
+        return affine;
+    }
+
+    glm::mat4 Affine::matrix() const {
+        glm::mat4 matrix(1.0f);
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 4; ++c) {
+                matrix[c][r] = rows[r][c];
+            }
+        }
+        return matrix;
+    }
+
+    Affine Transform::affine() const {
+        const glm::mat3 basis = glm::mat3_cast(rotation);
+        Affine affine;
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 3; ++c) {
+                affine.rows[r][c] = basis[c][r] * scale[c];
+            }
+            affine.rows[r][3] = position[r];
+        }
+        return affine;
+    }
+
+    SceneParams::SceneParams()
+    : batch_size(2048)
+    {}
+
+    Scene::Scene(const SceneParams& params)
+        : m_params(params) {
+        m_params.batch_size = std::max(m_params.batch_size, 64u);
+    }
+
+    NodeId Scene::create_node(NodeId parent, const Transform& local) {
+        const uint32_t parent_slot = parent == invalid_node ? no_slot : slot(parent);
+        if (parent != invalid_node && parent_slot == no_slot) {
+            return invalid_node;
+        }
+
+        NodeId id;
+        if (!m_free_ids.empty()) {
+            id = m_free_ids.back();
+            m_free_ids.pop_back();
+        } else {
+            id = static_cast<NodeId>(m_slots.size());
+            m_slots.push_back(no_slot);
+        }
+
+        const uint32_t new_slot = static_cast<uint32_t>(m_ids.size());
+        m_slots[id] = new_slot;
+        m_parent.push_back(parent_slot);
+        // known once reorder() has run
+        m_depth.push_back(0);
+        m_local.push_back(local.affine());
+        m_world.push_back(Affine::identity());
+        m_local_bounds.push_back(glm::vec4(0.0f));
+        m_world_bounds.push_back(glm::vec4(0.0f));
+        m_mesh.push_back(no_mesh);
+        m_dirty.push_back(1);
+        m_changed.push_back(0);
+        m_alive.push_back(1);
+        m_ids.push_back(id);
+
+        m_structure_dirty = true;
+        ++m_node_count;
+        return id;
+    }
+
+    void Scene::destroy_node(NodeId node) {
+        const uint32_t s = slot(node);
+        if (s == no_slot) {
+            return;
+        }
+        m_alive[s] = 0;
+        m_structure_dirty = true;
+        --m_node_count;
+    }
+
+    bool Scene::set_parent(NodeId node, NodeId parent) {
+        const uint32_t s = slot(node);
+        const uint32_t parent_slot = parent == invalid_node ? no_slot : slot(parent);
+        if (s == no_slot || (parent != invalid_node && parent_slot == no_slot)) {
+            return false;
+        }
+        for (uint32_t ancestor = parent_slot; ancestor != no_slot; ancestor = m_parent[ancestor]) {
+            if (ancestor == s) {
+                return false;
+            }
+        }
+        m_parent[s] = parent_slot;
+        m_dirty[s] = 1;
+        m_structure_dirty = true;
+        return true;
+    }
+
+    bool Scene::contains(NodeId node) const {
+        return slot(node) != no_slot;
+    }
+
+    void Scene::set_local_transform(NodeId node, const Transform& local) {
+        set_local_transform(node, local.affine());
+    }
+
+    void Scene::set_local_transform(NodeId node, const Affine& local) {
+        const uint32_t s = slot(node);
+        if (s == no_slot) {
+            return;
+        }
+        m_local[s] = local;
+        mark_dirty(s);
+    }
+
+    void Scene::set_mesh(NodeId node, uint32_t mesh, const glm::vec4& bounds) {
+        const uint32_t s = slot(node);
+        if (s == no_slot) {
+            return;
+        }
+        m_mesh[s] = mesh;
+        m_local_bounds[s] = bounds;
+        mark_dirty(s);
+    }
+
+    NodeId Scene::parent(NodeId node) const {
+        const uint32_t s = slot(node);
+        if (s == no_slot || m_parent[s] == no_slot) {
+            return invalid_node;
+        }
+        return m_ids[m_parent[s]];
+    }
+
+    const Affine& Scene::local_transform(NodeId node) const {
+        return m_local[m_slots[node]];
+    }
+
+    const Affine& Scene::world_transform(NodeId node) const {
+        return m_world[m_slots[node]];
+    }
+
+    const glm::vec4& Scene::world_bounds(NodeId node) const {
+        return m_world_bounds[m_slots[node]];
+    }
+
+    uint32_t Scene::slot(NodeId node) const {
+        if (node >= m_slots.size() || m_slots[node] == no_slot || !m_alive[m_slots[node]]) {
+            return no_slot;
+        }
+        return m_slots[node];
+    }
+
+    void Scene::mark_dirty(uint32_t s) {
+        m_dirty[s] = 1;
+        // before the first reorder() the depths are not known yet; it
+        // collects the dirty levels itself
+        if (!m_structure_dirty) {
+            m_level_dirty[m_depth[s]] = 1;
+        }
+    }
+
+    void Scene::update(JobSystem* jobs) {
+        ENGINE_PROFILE_ZONE("scene update");
+        m_stats.reordered = m_structure_dirty;
+        if (m_structure_dirty) {
+            reorder();
+        }
+
+        m_stats.nodes = static_cast<uint32_t>(m_ids.size());
+        m_stats.levels = static_cast<uint32_t>(m_level_dirty.size());
+        m_stats.updated_levels = 0;
+        m_stats.updated_nodes = 0;
+
+        bool parents_changed = false;
+        for (uint32_t level = 0; level < m_level_dirty.size(); ++level) {
+            const uint32_t begin = m_level_begin[level];
+            const uint32_t end = m_level_begin[level + 1];
+            if (!m_level_dirty[level] && !parents_changed) {
+                // the next level may be dirty and reads these as its parents'
+                if (m_level_changed[level]) {
+                    std::fill(m_changed.begin() + begin, m_changed.begin() + end, uint8_t(0));
+                    m_level_changed[level] = 0;
+                }
+                continue;
+            }
+            m_level_dirty[level] = 0;
+
+            uint32_t updated = 0;
+            const uint32_t count = end - begin;
+            if (jobs == nullptr || jobs->thread_count() == 1 || count < m_params.batch_size * 2) {
+                updated = update_range(begin, end);
+            } else {
+                std::atomic<uint32_t> total = 0;
+                jobs->parallel_for(count, m_params.batch_size, [&](uint32_t first, uint32_t last, uint32_t) {
+                    total.fetch_add(update_range(begin + first, begin + last), std::memory_order_relaxed);
+                });
+                updated = total.load(std::memory_order_relaxed);
+            }
+
+            parents_changed = updated > 0;
+            m_level_changed[level] = parents_changed;
+            m_stats.updated_nodes += updated;
+            m_stats.updated_levels += updated > 0 ? 1 : 0;
+        }
+    }
+
+    uint32_t Scene::update_range(uint32_t begin, uint32_t end) {
+        uint32_t updated = 0;
+        for (uint32_t i = begin; i < end; ++i) {
+            const uint32_t parent = m_parent[i];
+            const bool changed = m_dirty[i] || (parent != no_slot && m_changed[parent]);
+            m_changed[i] = changed;
+            if (!changed) {
+                continue;
+            }
+            m_dirty[i] = 0;
+
+            if (parent == no_slot) {
+                m_world[i] = m_local[i];
+            } else {
+                multiply(m_world[parent], m_local[i], m_world[i]);
+            }
+            m_world_bounds[i] = transform_sphere(m_world[i], m_local_bounds[i]);
+            ++updated;
+        }
+        return updated;
+    }
+
+    void Scene::reorder() {
+        ENGINE_PROFILE_ZONE("scene reorder");
+        const uint32_t count = static_cast<uint32_t>(m_ids.size());
+
+        // depth of every slot, -1 while unknown and -2 for removed nodes and
+        // their descendants; slots are not in parent order after a reparent
+        std::vector<int32_t> depth(count, -1);
+        std::vector<uint32_t> chain;
+        for (uint32_t s = 0; s < count; ++s) {
+            uint32_t current = s;
+            while (depth[current] == -1) {
+                chain.push_back(current);
+                if (!m_alive[current] || m_parent[current] == no_slot) {
+                    break;
+                }
+                current = m_parent[current];
+            }
+            while (!chain.empty()) {
+                const uint32_t node = chain.back();
+                chain.pop_back();
+                if (!m_alive[node]) {
+                    depth[node] = -2;
+                } else if (m_parent[node] == no_slot) {
+                    depth[node] = 0;
+                } else {
+                    const int32_t parent_depth = depth[m_parent[node]];
+                    depth[node] = parent_depth < 0 ? -2 : parent_depth + 1;
+                }
+            }
+        }
+
+        int32_t max_depth = -1;
+        for (int32_t d : depth) {
+            max_depth = std::max(max_depth, d);
+        }
+        std::vector<std::vector<uint32_t>> levels(static_cast<size_t>(max_depth + 1));
+        for (uint32_t s = 0; s < count; ++s) {
+            if (depth[s] >= 0) {
+                levels[depth[s]].push_back(s);
+            } else {
+                m_slots[m_ids[s]] = no_slot;
+                m_free_ids.push_back(m_ids[s]);
+            }
+        }
+
+        // siblings end up next to each other, in the order of their parents
+        std::vector<uint32_t> new_slot(count, no_slot);
+        std::vector<uint32_t> order;
+        order.reserve(count);
+        m_level_begin.assign(1, 0);
+        for (std::vector<uint32_t>& level : levels) {
+            std::stable_sort(level.begin(), level.end(), [&](uint32_t a, uint32_t b) {
+                const uint32_t parent_a = m_parent[a] == no_slot ? 0 : new_slot[m_parent[a]];
+                const uint32_t parent_b = m_parent[b] == no_slot ? 0 : new_slot[m_parent[b]];
+                return parent_a < parent_b;
+            });
+            for (uint32_t s : level) {
+                new_slot[s] = static_cast<uint32_t>(order.size());
+                order.push_back(s);
+            }
+            m_level_begin.push_back(static_cast<uint32_t>(order.size()));
+        }
+
+        permute(m_parent, order);
+        for (uint32_t& parent : m_parent) {
+            if (parent != no_slot) {
+                parent = new_slot[parent];
+            }
+        }
+        permute(m_local, order);
+        permute(m_world, order);
+        permute(m_local_bounds, order);
+        permute(m_world_bounds, order);
+        permute(m_mesh, order);
+        permute(m_dirty, order);
+        permute(m_ids, order);
+        m_alive.assign(order.size(), 1);
+        m_changed.assign(order.size(), 0);
+        m_level_changed.assign(levels.size(), 0);
+
+        m_depth.resize(order.size());
+        m_level_dirty.assign(levels.size(), 0);
+        for (uint32_t level = 0; level < levels.size(); ++level) {
+            for (uint32_t s = m_level_begin[level]; s < m_level_begin[level + 1]; ++s) {
+                m_depth[s] = static_cast<uint16_t>(level);
+                m_slots[m_ids[s]] = s;
+                if (m_dirty[s]) {
+                    m_level_dirty[level] = 1;
+                }
+            }
+        }
+
+        m_node_count = static_cast<uint32_t>(order.size());
+        m_structure_dirty = false;
+    }
+}
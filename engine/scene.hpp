@@ -0,0 +1,144 @@
+#pragma once
+
+#include "job_system.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+namespace engine {
+
+    using NodeId = uint32_t;
+    constexpr NodeId invalid_node = ~0u;
+    constexpr uint32_t no_mesh = ~0u;
+
+    // The first three rows of an affine matrix, row-major, the layout
+    // GpuInstance::transform uses. 16 byte aligned, one SSE register a row.
+    struct alignas(16) Affine {
+        float rows[3][4];
+
+        static Affine identity();
+        static Affine from_matrix(const glm::mat4& matrix);
+        glm::mat4 matrix() const;
+    };
+    static_assert(sizeof(Affine) == 48);
+
+    struct Transform {
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        glm::vec3 scale = glm::vec3(1.0f);
+
+        Affine affine() const;
+    };
+
+    struct SceneParams {
+        SceneParams();
+
+        // nodes per job; levels smaller than two batches are updated inline
+        uint32_t batch_size;
+    };
+
+    struct SceneStats {
+        uint32_t nodes = 0;
+        uint32_t levels = 0;
+        // of the last update(): levels that had changed nodes in them, and
+        // the nodes whose world transform was recomputed
+        uint32_t updated_levels = 0;
+        uint32_t updated_nodes = 0;
+        // the hierarchy changed and the arrays were sorted again
+        bool reordered = false;
+    };
+
+    // Transform hierarchy and render data of every node in structure of
+    // arrays layout. Nodes are kept sorted by depth, each level contiguous
+    // and its nodes ordered by parent, so update() is one linear pass per
+    // level in which every parent is final before its children are read;
+    // a level's nodes are independent and are split over the job system.
+    //
+    // Changing a node marks it dirty; update() recomputes the dirty nodes
+    // and their subtrees only, and skips levels nothing changed in.
+    // Structural changes (new nodes, reparenting, removal) re-sort the
+    // arrays at the next update(). NodeIds stay valid across that; the
+    // spans below are in storage order and only valid until the next update().
+    class Scene {
+    public:
+        explicit Scene(const SceneParams& params = SceneParams());
+
+        NodeId create_node(NodeId parent = invalid_node, const Transform& local = Transform());
+        // the node's descendants are removed with it at the next update()
+        void destroy_node(NodeId node);
+        // false if that would make the node its own ancestor
+        bool set_parent(NodeId node, NodeId parent);
+        bool contains(NodeId node) const;
+        uint32_t node_count() const { return m_node_count; }
+
+        void set_local_transform(NodeId node, const Transform& local);
+        void set_local_transform(NodeId node, const Affine& local);
+        // `bounds` is a bounding sphere in the node's space: centre, radius
+        void set_mesh(NodeId node, uint32_t mesh, const glm::vec4& bounds);
+
+        NodeId parent(NodeId node) const;
+        const Affine& local_transform(NodeId node) const;
+        // as of the last update()
+        const Affine& world_transform(NodeId node) const;
+        const glm::vec4& world_bounds(NodeId node) const;
+
+        // Recomputes the world transforms and bounds of everything that
+        // changed since the last call. `jobs` may be null to run inline;
+        // the calling thread has to be the job system's submitting thread.
+        void update(JobSystem* jobs = nullptr);
+
+        std::span<const NodeId> nodes() const { return m_ids; }
+        std::span<const Affine> world_transforms() const { return m_world; }
+        std::span<const glm::vec4> world_bounds() const { return m_world_bounds; }
+        std::span<const uint32_t> meshes() const { return m_mesh; }
+
+        const SceneStats& stats() const { return m_stats; }
+
+    private:
+        static constexpr uint32_t no_slot = ~0u;
+
+        uint32_t slot(NodeId node) const;
+        void mark_dirty(uint32_t slot);
+        // drops removed nodes and sorts the rest by depth, then parent
+        void reorder();
+        // returns the number of updated nodes
+        uint32_t update_range(uint32_t begin, uint32_t end);
+
+    private:
+        SceneParams m_params;
+
+        // indexed by storage slot
+        std::vector<uint32_t> m_parent;
+        std::vector<uint16_t> m_depth;
+        std::vector<Affine> m_local;
+        std::vector<Affine> m_world;
+        std::vector<glm::vec4> m_local_bounds;
+        std::vector<glm::vec4> m_world_bounds;
+        std::vector<uint32_t> m_mesh;
+        // set by the setters, cleared by update()
+        std::vector<uint8_t> m_dirty;
+        // the world transform changed in the last update(), read by the children
+        std::vector<uint8_t> m_changed;
+        std::vector<uint8_t> m_alive;
+        std::vector<NodeId> m_ids;
+
+        // indexed by NodeId
+        std::vector<uint32_t> m_slots;
+        std::vector<NodeId> m_free_ids;
+
+        // level l occupies slots [m_level_begin[l], m_level_begin[l + 1])
+        std::vector<uint32_t> m_level_begin;
+        std::vector<uint8_t> m_level_dirty;
+        // some of the level's m_changed flags are set
+        std::vector<uint8_t> m_level_changed;
+        bool m_structure_dirty = false;
+        uint32_t m_node_count = 0;
+
+        SceneStats m_stats;
+    };
+}
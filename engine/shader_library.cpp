@@ -0,0 +1,466 @@
+#include "shader_library.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "vk_util.hpp"
+
+#include <spirv_reflect.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+
+#ifndef ENGINE_SHADER_DIR
+#define ENGINE_SHADER_DIR "shaders"
+#endif
+
+#ifndef ENGINE_SHADER_SOURCE_DIR
+#define ENGINE_SHADER_SOURCE_DIR "resources/shaders"
+#endif
+
+#ifndef ENGINE_GLSLC
+#define ENGINE_GLSLC "glslc"
+#endif
+
+
+namespace engine {
+
+    namespace {
+
+        constexpr uint32_t spirv_magic = 0x07230203;
+
+        using clock = std::chrono::steady_clock;
+
+        // Runs fn(0) .. fn(count - 1) on up to `threads` threads, the calling
+        // thread included.
+        template<typename Fn>
+        void parallel_for(size_t count, uint32_t threads, Fn&& fn) {
+            threads = static_cast<uint32_t>(std::min<size_t>(threads, count));
+            if (threads <= 1) {
+                for (size_t i = 0; i < count; ++i) {
+                    fn(i);
+                }
+                return;
+            }
+
+            std::atomic<size_t> next = 0;
+            auto worker = [&]() {
+                for (size_t i = next++; i < count; i = next++) {
+                    fn(i);
+                }
+            };
+
+            std::vector<std::thread> workers;
+            workers.reserve(threads - 1);
+            for (uint32_t i = 1; i < threads; ++i) {
+                workers.emplace_back(worker);
+            }
+            worker();
+            for (auto& thread : workers) {
+                thread.join();
+            }
+        }
+
+        bool is_spirv(std::span<const std::byte> code) {
+            if (code.size() < 20 || code.size() % sizeof(uint32_t) != 0) {
+                return false;
+            }
+            uint32_t magic;
+            std::memcpy(&magic, code.data(), sizeof(magic));
+            return magic == spirv_magic;
+        }
+
+        bool reflect(std::span<const std::byte> code, ShaderReflection& reflection) {
+            // NO_COPY: SPIRV-Reflect parses the mapping in place
+            SpvReflectShaderModule module;
+            if (spvReflectCreateShaderModule2(SPV_REFLECT_MODULE_FLAG_NO_COPY, code.size(), code.data(), &module) != SPV_REFLECT_RESULT_SUCCESS) {
+                return false;
+            }
+
+            reflection.stage = static_cast<VkShaderStageFlagBits>(module.shader_stage);
+            reflection.entry_point = module.entry_point_name != nullptr ? module.entry_point_name : "main";
+
+            uint32_t binding_count = 0;
+            spvReflectEnumerateDescriptorBindings(&module, &binding_count, nullptr);
+            std::vector<SpvReflectDescriptorBinding*> bindings(binding_count);
+            spvReflectEnumerateDescriptorBindings(&module, &binding_count, bindings.data());
+
+            reflection.bindings.reserve(binding_count);
+            for (const SpvReflectDescriptorBinding* binding : bindings) {
+                DescriptorBindingInfo info;
+                info.set = binding->set;
+                info.binding = binding->binding;
+                info.type = static_cast<VkDescriptorType>(binding->descriptor_type);
+                info.count = 1;
+                for (uint32_t i = 0; i < binding->array.dims_count; ++i) {
+                    info.count *= binding->array.dims[i];
+                }
+                info.stages = reflection.stage;
+                reflection.bindings.push_back(info);
+            }
+            std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](const auto& a, const auto& b) {
+                return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+            });
+
+            uint32_t block_count = 0;
+            spvReflectEnumeratePushConstantBlocks(&module, &block_count, nullptr);
+            std::vector<SpvReflectBlockVariable*> blocks(block_count);
+            spvReflectEnumeratePushConstantBlocks(&module, &block_count, blocks.data());
+
+            for (const SpvReflectBlockVariable* block : blocks) {
+                VkPushConstantRange range = {};
+                range.stageFlags = reflection.stage;
+                range.offset = block->offset;
+                range.size = block->size;
+                reflection.push_constants.push_back(range);
+            }
+
+            spvReflectDestroyShaderModule(&module);
+            return true;
+        }
+    }
+
+    ShaderModule::ShaderModule(VkDevice device, VkShaderModule module, uint64_t content_hash, size_t code_size)
+        : device(device)
+        , module(module)
+        , content_hash(content_hash)
+        , code_size(code_size) {}
+
+    ShaderModule::~ShaderModule() {
+        vkDestroyShaderModule(device, module, nullptr);
+    }
+
+    ShaderLibraryParams::ShaderLibraryParams()
+    : vfs_dir("shaders")
+    , spirv_dir(ENGINE_SHADER_DIR)
+    , source_dir(ENGINE_SHADER_SOURCE_DIR)
+    , compiler(ENGINE_GLSLC)
+#ifdef NDEBUG
+    , hot_reload(false)
+#else
+    , hot_reload(true)
+#endif
+    , poll_interval(250)
+    , load_threads(0)
+    {}
+
+    ShaderLibrary::ShaderLibrary(VkDevice device, const Vfs& vfs, const ShaderLibraryParams& params)
+        : m_device(device)
+        , m_vfs(vfs)
+        , m_params(params)
+        , m_logger(create_logger("shaders")) {
+        if (m_params.load_threads == 0) {
+            m_params.load_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        if (m_params.hot_reload) {
+            m_watcher = std::thread([this]() { watch_worker(); });
+        }
+    }
+
+    ShaderLibrary::~ShaderLibrary() {
+        {
+            std::lock_guard lock(m_watch_mutex);
+            m_stop = true;
+        }
+        m_watch_cv.notify_all();
+        if (m_watcher.joinable()) {
+            m_watcher.join();
+        }
+        // modules go with the last Shader / Reloaded holding them
+        m_reloaded.clear();
+        m_shaders.clear();
+    }
+
+    size_t ShaderLibrary::load_all() {
+        const auto start = clock::now();
+
+        std::vector<std::string> paths;
+        std::vector<PendingShader> pending;
+        constexpr std::string_view extension = ".spv";
+        for (std::string& path : m_vfs.list(m_params.vfs_dir, extension)) {
+            const size_t name_start = path.rfind('/') + 1;
+            std::string name = path.substr(name_start, path.size() - name_start - extension.size());
+            if (m_names.contains(name)) {
+                continue;
+            }
+            paths.push_back(std::move(path));
+            pending.emplace_back().name = std::move(name);
+        }
+
+        // open and hash everything first, so identical blobs can be found
+        // before any module is created
+        std::vector<std::optional<VfsFile>> files(paths.size());
+        parallel_for(paths.size(), m_params.load_threads, [&](size_t i) {
+            files[i] = m_vfs.open(paths[i]);
+            if (files[i]) {
+                pending[i].code_size = files[i]->size();
+                pending[i].content_hash = hash_bytes(files[i]->bytes());
+            }
+        });
+
+        // one module per distinct blob, reusing the ones already loaded
+        std::unordered_map<uint64_t, size_t> first_with_hash;
+        std::vector<size_t> unique;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            if (!files[i]) {
+                continue;
+            }
+            if (auto module = find_module(pending[i].content_hash, pending[i].code_size)) {
+                pending[i].module = std::move(module);
+                ++m_deduplicated;
+                continue;
+            }
+            const auto [it, inserted] = first_with_hash.emplace(pending[i].content_hash, i);
+            if (inserted) {
+                unique.push_back(i);
+            }
+        }
+
+        parallel_for(unique.size(), m_params.load_threads, [&](size_t u) {
+            const size_t i = unique[u];
+            pending[i].module = create_module(files[i]->bytes(), pending[i].content_hash);
+        });
+
+        // duplicates within the batch share the module of the first copy
+        for (size_t i = 0; i < pending.size(); ++i) {
+            const auto it = first_with_hash.find(pending[i].content_hash);
+            if (pending[i].module || !files[i] || it == first_with_hash.end() || it->second == i) {
+                continue;
+            }
+            if (pending[it->second].module) {
+                pending[i].module = pending[it->second].module;
+                ++m_deduplicated;
+            }
+        }
+
+        size_t added = 0;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            if (!pending[i].module) {
+                m_logger->error("failed to load shader {}", paths[i]);
+                continue;
+            }
+            m_bytes_mapped += pending[i].code_size;
+            add_shader(std::move(pending[i]));
+            ++added;
+        }
+
+        const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        m_load_ms += ms;
+        m_logger->info(
+            "loaded {} shader(s) into {} new module(s) in {:.2f} ms on {} thread(s)",
+            added,
+            unique.size(),
+            ms,
+            m_params.load_threads
+        );
+        return added;
+    }
+
+    ShaderId ShaderLibrary::load(std::string_view name) {
+        if (const ShaderId id = find(name); id != invalid_shader) {
+            return id;
+        }
+
+        const auto start = clock::now();
+        const std::string path = m_params.vfs_dir + "/" + std::string(name) + ".spv";
+        const auto file = m_vfs.open(path);
+        if (!file) {
+            m_logger->error("failed to open shader {}", path);
+            return invalid_shader;
+        }
+
+        PendingShader pending;
+        pending.name = std::string(name);
+        pending.code_size = file->size();
+        pending.content_hash = hash_bytes(file->bytes());
+        pending.module = find_module(pending.content_hash, pending.code_size);
+        if (pending.module) {
+            ++m_deduplicated;
+        } else {
+            pending.module = create_module(file->bytes(), pending.content_hash);
+        }
+        if (!pending.module) {
+            m_logger->error("failed to load shader {}", path);
+            return invalid_shader;
+        }
+
+        m_bytes_mapped += pending.code_size;
+        m_load_ms += std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        return add_shader(std::move(pending));
+    }
+
+    ShaderId ShaderLibrary::find(std::string_view name) const {
+        const auto it = m_names.find(std::string(name));
+        return it != m_names.end() ? it->second : invalid_shader;
+    }
+
+    std::vector<ShaderId> ShaderLibrary::update() {
+        std::vector<Reloaded> reloaded;
+        {
+            std::lock_guard lock(m_watch_mutex);
+            reloaded.swap(m_reloaded);
+        }
+
+        // Pipelines do not reference their modules once created, so the old
+        // module can go right away; nothing has to wait for the GPU.
+        std::vector<ShaderId> changed;
+        for (auto& entry : reloaded) {
+            Shader& shader = m_shaders[entry.id];
+            shader.module = std::move(entry.module);
+            ++shader.version;
+            ++m_reloads;
+            changed.push_back(entry.id);
+            m_logger->info("reloaded {} (version {})", shader.name, shader.version);
+        }
+        return changed;
+    }
+
+    ShaderLibraryStats ShaderLibrary::stats() const {
+        ShaderLibraryStats stats;
+        stats.shaders = static_cast<uint32_t>(m_shaders.size());
+        {
+            std::lock_guard lock(m_modules_mutex);
+            stats.modules = static_cast<uint32_t>(std::count_if(m_modules.begin(), m_modules.end(), [](const auto& entry) {
+                return !entry.second.expired();
+            }));
+        }
+        stats.deduplicated = m_deduplicated;
+        stats.bytes_mapped = m_bytes_mapped;
+        stats.load_ms = m_load_ms;
+        stats.reloads = m_reloads;
+        stats.failed_reloads = m_failed_reloads;
+        return stats;
+    }
+
+    std::shared_ptr<const ShaderModule> ShaderLibrary::create_module(std::span<const std::byte> code, uint64_t content_hash) {
+        if (!is_spirv(code)) {
+            return nullptr;
+        }
+
+        // mappings and pack blobs are page aligned, so the words can be passed as they are
+        VkShaderModuleCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        create_info.pNext = nullptr;
+        create_info.codeSize = code.size();
+        create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+        VkShaderModule handle;
+        if (!check_vk(vkCreateShaderModule(m_device, &create_info, nullptr, &handle))) {
+            return nullptr;
+        }
+
+        auto module = std::make_shared<ShaderModule>(m_device, handle, content_hash, code.size());
+        if (!reflect(code, module->reflection)) {
+            return nullptr;
+        }
+
+        std::lock_guard lock(m_modules_mutex);
+        m_modules[content_hash] = module;
+        return module;
+    }
+
+    std::shared_ptr<const ShaderModule> ShaderLibrary::find_module(uint64_t content_hash, size_t code_size) const {
+        std::lock_guard lock(m_modules_mutex);
+        const auto it = m_modules.find(content_hash);
+        if (it == m_modules.end()) {
+            return nullptr;
+        }
+        auto module = it->second.lock();
+        return module && module->code_size == code_size ? module : nullptr;
+    }
+
+    ShaderId ShaderLibrary::add_shader(PendingShader pending) {
+        const ShaderId id = static_cast<ShaderId>(m_shaders.size());
+
+        if (m_params.hot_reload) {
+            std::error_code error;
+            WatchedSource source;
+            source.id = id;
+            source.name = pending.name;
+            source.source = m_params.source_dir / pending.name;
+            source.last_write = std::filesystem::last_write_time(source.source, error);
+            source.content_hash = pending.content_hash;
+            if (!error) {
+                std::lock_guard lock(m_watch_mutex);
+                m_new_sources.push_back(std::move(source));
+            }
+        }
+
+        m_names.emplace(pending.name, id);
+        Shader& shader = m_shaders.emplace_back();
+        shader.name = std::move(pending.name);
+        shader.module = std::move(pending.module);
+        return id;
+    }
+
+    void ShaderLibrary::watch_worker() {
+        std::vector<WatchedSource> sources;
+
+        std::unique_lock lock(m_watch_mutex);
+        while (!m_stop) {
+            m_watch_cv.wait_for(lock, m_params.poll_interval, [this]() { return m_stop; });
+            if (m_stop) {
+                break;
+            }
+            std::move(m_new_sources.begin(), m_new_sources.end(), std::back_inserter(sources));
+            m_new_sources.clear();
+            lock.unlock();
+
+            // only the sources that changed are compiled again
+            for (auto& source : sources) {
+                std::error_code error;
+                const auto last_write = std::filesystem::last_write_time(source.source, error);
+                if (error || last_write == source.last_write) {
+                    continue;
+                }
+                source.last_write = last_write;
+                rebuild(source);
+            }
+
+            lock.lock();
+        }
+    }
+
+    void ShaderLibrary::rebuild(WatchedSource& source) {
+        const std::filesystem::path output = m_params.spirv_dir / (source.name + ".spv");
+        std::filesystem::path temporary = output;
+        temporary += ".tmp";
+
+        const std::string command = "\"" + m_params.compiler + "\" -o \"" + temporary.string() + "\" \"" + source.source.string() + "\"";
+        if (std::system(command.c_str()) != 0) {
+            m_logger->error("failed to compile {}, keeping the previous module", source.name);
+            ++m_failed_reloads;
+            return;
+        }
+
+        // the next start should never see a half written module
+        std::error_code error;
+        std::filesystem::rename(temporary, output, error);
+        if (error) {
+            m_logger->error("failed to replace {}: {}", output.string(), error.message());
+            ++m_failed_reloads;
+            return;
+        }
+
+        const MappedFile file(output);
+        const uint64_t content_hash = hash_bytes(file.bytes());
+        if (content_hash == source.content_hash) {
+            // e.g. a comment or whitespace edit
+            return;
+        }
+
+        auto module = find_module(content_hash, file.size());
+        if (!module) {
+            module = create_module(file.bytes(), content_hash);
+        }
+        if (!module) {
+            m_logger->error("compiled {} is not a valid module", source.name);
+            ++m_failed_reloads;
+            return;
+        }
+        source.content_hash = content_hash;
+
+        std::lock_guard lock(m_watch_mutex);
+        m_reloaded.push_back({ source.id, std::move(module) });
+    }
+}
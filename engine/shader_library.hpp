@@ -0,0 +1,188 @@
+#pragma once
+
+#include "logger.hpp"
+#include "vfs.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+namespace engine {
+
+    using ShaderId = uint32_t;
+    constexpr ShaderId invalid_shader = ~0u;
+
+    struct DescriptorBindingInfo {
+        uint32_t set;
+        uint32_t binding;
+        VkDescriptorType type;
+        uint32_t count;
+        VkShaderStageFlags stages;
+    };
+
+    // What a pipeline layout needs to know about a module.
+    struct ShaderReflection {
+        VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+        std::string entry_point;
+        std::vector<DescriptorBindingInfo> bindings;
+        std::vector<VkPushConstantRange> push_constants;
+    };
+
+    // One VkShaderModule per distinct SPIR-V blob. Shared by every shader with
+    // the same content and destroyed with its last reference, so an in-flight
+    // pipeline build may keep a module alive across a hot reload.
+    struct ShaderModule {
+        ShaderModule(VkDevice device, VkShaderModule module, uint64_t content_hash, size_t code_size);
+        ~ShaderModule();
+
+        ShaderModule(const ShaderModule&) = delete;
+        ShaderModule& operator=(const ShaderModule&) = delete;
+
+        VkDevice device;
+        VkShaderModule module;
+        uint64_t content_hash;
+        size_t code_size;
+        ShaderReflection reflection;
+    };
+
+    struct Shader {
+        // file name of the source, e.g. "triangle.vert"
+        std::string name;
+        std::shared_ptr<const ShaderModule> module;
+        // bumped by every hot reload
+        uint32_t version = 0;
+
+        VkShaderModule handle() const { return module->module; }
+        const ShaderReflection& reflection() const { return module->reflection; }
+    };
+
+    struct ShaderLibraryParams {
+        ShaderLibraryParams();
+
+        // compiled modules are loaded as <vfs_dir>/<source name>.spv through
+        // the Vfs; hot reload writes them to spirv_dir
+        std::string vfs_dir;
+        std::filesystem::path spirv_dir;
+        // .vert / .frag / .comp sources watched for hot reload
+        std::filesystem::path source_dir;
+        // glslc, used to rebuild changed sources
+        std::string compiler;
+        bool hot_reload;
+        std::chrono::milliseconds poll_interval;
+        // 0 picks the hardware concurrency
+        uint32_t load_threads;
+    };
+
+    struct ShaderLibraryStats {
+        uint32_t shaders = 0;
+        uint32_t modules = 0;
+        // shaders that reused the module of an identical blob
+        uint32_t deduplicated = 0;
+        uint64_t bytes_mapped = 0;
+        double load_ms = 0.0;
+        uint32_t reloads = 0;
+        uint32_t failed_reloads = 0;
+    };
+
+    // Owns every shader module of the renderer. SPIR-V comes from the Vfs and
+    // is handed to the driver straight from the mapping, identical blobs share a
+    // module, and reflection runs once per module. With hot reload on, a
+    // background thread polls the sources, recompiles the ones that changed
+    // and builds their new modules, which update() swaps in between frames.
+    class ShaderLibrary {
+    public:
+        ShaderLibrary(VkDevice device, const Vfs& vfs, const ShaderLibraryParams& params = ShaderLibraryParams());
+        ~ShaderLibrary();
+
+        ShaderLibrary(const ShaderLibrary&) = delete;
+        ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+        // Loads every module in vfs_dir that is not loaded yet, spread over
+        // load_threads. Returns the number of new shaders.
+        size_t load_all();
+
+        // Loads one shader by source name, or returns the loaded one.
+        // invalid_shader if the module is missing or broken.
+        ShaderId load(std::string_view name);
+
+        // invalid_shader unless loaded
+        ShaderId find(std::string_view name) const;
+        const Shader& get(ShaderId id) const { return m_shaders[id]; }
+
+        // Render thread, once per frame: swaps in the modules rebuilt since the
+        // last call and returns the ids of the shaders that changed.
+        std::vector<ShaderId> update();
+
+        ShaderLibraryStats stats() const;
+
+    private:
+        struct PendingShader {
+            std::string name;
+            uint64_t content_hash = 0;
+            size_t code_size = 0;
+            std::shared_ptr<const ShaderModule> module;
+        };
+
+        struct WatchedSource {
+            ShaderId id;
+            std::string name;
+            std::filesystem::path source;
+            std::filesystem::file_time_type last_write;
+            uint64_t content_hash;
+        };
+
+        struct Reloaded {
+            ShaderId id;
+            std::shared_ptr<const ShaderModule> module;
+        };
+
+        // nullptr if the blob is not valid SPIR-V
+        std::shared_ptr<const ShaderModule> create_module(std::span<const std::byte> code, uint64_t content_hash);
+        std::shared_ptr<const ShaderModule> find_module(uint64_t content_hash, size_t code_size) const;
+        ShaderId add_shader(PendingShader pending);
+
+        void watch_worker();
+        void rebuild(WatchedSource& source);
+
+    private:
+        VkDevice m_device;
+        const Vfs& m_vfs;
+        ShaderLibraryParams m_params;
+
+        std::vector<Shader> m_shaders;
+        std::unordered_map<std::string, ShaderId> m_names;
+
+        // content hash -> module, weak so that retired modules go away
+        mutable std::mutex m_modules_mutex;
+        std::unordered_map<uint64_t, std::weak_ptr<const ShaderModule>> m_modules;
+
+        std::thread m_watcher;
+        std::mutex m_watch_mutex;
+        std::condition_variable m_watch_cv;
+        bool m_stop = false;
+        // added by the render thread, picked up by the watcher
+        std::vector<WatchedSource> m_new_sources;
+        std::vector<Reloaded> m_reloaded;
+
+        uint32_t m_deduplicated = 0;
+        uint64_t m_bytes_mapped = 0;
+        double m_load_ms = 0.0;
+        uint32_t m_reloads = 0;
+        std::atomic<uint32_t> m_failed_reloads = 0;
+
+        logger_t m_logger;
+    };
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+
+namespace engine {
+
+    // Triple buffer handing whole snapshots from one producer thread to one
+    // consumer thread without locks. The producer fills its own slot and
+    // publishes it with one exchange against the shared middle slot; the
+    // consumer swaps the middle slot with its own when something new was
+    // published. Neither side ever waits for the other, the consumer always
+    // gets the newest complete snapshot, and the slot it reads is never
+    // written until it takes the next one.
+    template<typename T>
+    class SnapshotBuffer {
+    public:
+        SnapshotBuffer() = default;
+
+        SnapshotBuffer(const SnapshotBuffer&) = delete;
+        SnapshotBuffer& operator=(const SnapshotBuffer&) = delete;
+
+        // Producer: the slot to fill next. It holds an older snapshot, so
+        // every field has to be written; containers keep their capacity.
+        T& write_slot() { return m_slots[m_write].value; }
+
+        // Producer: makes the write slot the newest snapshot.
+        void publish() {
+            const uint8_t previous = m_middle.exchange(m_write | fresh_bit, std::memory_order_acq_rel);
+            m_write = previous & index_mask;
+        }
+
+        // Consumer: the newest published snapshot, nullptr until the first
+        // publish(). Stays valid and unchanged until the next call.
+        const T* latest() {
+            if (m_middle.load(std::memory_order_relaxed) & fresh_bit) {
+                const uint8_t previous = m_middle.exchange(m_read, std::memory_order_acq_rel);
+                m_read = previous & index_mask;
+                m_has_read = true;
+            }
+            return m_has_read ? &m_slots[m_read].value : nullptr;
+        }
+
+    private:
+        static constexpr uint8_t index_mask = 3;
+        // the middle slot was published and not taken yet
+        static constexpr uint8_t fresh_bit = 4;
+
+        // the two sides touch different slots, keep them off each other's lines
+        struct alignas(64) Slot {
+            T value = T();
+        };
+
+        std::array<Slot, 3> m_slots;
+        alignas(64) std::atomic<uint8_t> m_middle = 2;
+        // owned by the producer
+        alignas(64) uint8_t m_write = 0;
+        // owned by the consumer
+        alignas(64) uint8_t m_read = 1;
+        bool m_has_read = false;
+    };
+}
@@ -0,0 +1,379 @@
+#include "texture.hpp"
+#include "vk_util.hpp"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace engine {
+
+    namespace {
+        constexpr VkDeviceSize staging_alignment = 16;
+
+        VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    TextureStreamerParams::TextureStreamerParams()
+    : decode_threads(std::max(1u, std::thread::hardware_concurrency() / 2))
+    , mip_threads(std::max(1u, std::thread::hardware_concurrency() / 2))
+    , decoded_queue_capacity(8)
+    , mipped_queue_capacity(8)
+    , staging_bytes_per_frame(32 * 1024 * 1024)
+    , filter(MipFilter::box)
+    , srgb(true)
+    {}
+
+    TextureStreamer::TextureStreamer(
+        VkDevice device,
+        Allocator& allocator,
+        DeletionQueue& deletions,
+        const Vfs& vfs,
+        uint32_t frames_in_flight,
+        const TextureStreamerParams& params
+    )
+        : m_device(device)
+        , m_allocator(allocator)
+        , m_deletions(deletions)
+        , m_vfs(vfs)
+        , m_params(params)
+        // requests are only paths, so they need no bound
+        , m_requests(SIZE_MAX)
+        , m_decoded(std::max<size_t>(params.decoded_queue_capacity, 1))
+        , m_mipped(std::max<size_t>(params.mipped_queue_capacity, 1))
+        , m_logger(create_logger("texture")) {
+        // the buffers themselves are made by the first load()
+        m_staging.resize(frames_in_flight);
+
+        for (uint32_t i = 0; i < std::max(1u, m_params.decode_threads); ++i) {
+            m_workers.emplace_back([this] { decode_worker(); });
+        }
+        for (uint32_t i = 0; i < std::max(1u, m_params.mip_threads); ++i) {
+            m_workers.emplace_back([this] { mip_worker(); });
+        }
+    }
+
+    TextureStreamer::~TextureStreamer() {
+        // every stage stops after the item it is working on
+        m_requests.close();
+        m_decoded.close();
+        m_mipped.close();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+    TextureId TextureStreamer::load(const std::filesystem::path& path) {
+        if (!m_staging.empty() && !m_staging.front().buffer) {
+            for (auto& staging : m_staging) {
+                staging.buffer = m_allocator.create_buffer(
+                    m_params.staging_bytes_per_frame,
+                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    MemoryUsage::staging
+                );
+            }
+        }
+
+        const auto id = static_cast<TextureId>(m_textures.size());
+        m_textures.emplace_back();
+        ++m_requested;
+        m_requests.push({ id, path });
+        return id;
+    }
+
+    void TextureStreamer::unload(TextureId id) {
+        if (id >= m_textures.size() || m_textures[id].unloaded) {
+            return;
+        }
+        // image and view go through the deletion queue
+        m_textures[id] = Texture();
+        m_textures[id].unloaded = true;
+    }
+
+    const Texture* TextureStreamer::get(TextureId id) const {
+        if (id >= m_textures.size() || !m_textures[id].ready) {
+            return nullptr;
+        }
+        return &m_textures[id];
+    }
+
+    bool TextureStreamer::idle() const {
+        return m_uploaded + m_failed + m_discarded == m_requested;
+    }
+
+    TextureStreamerStats TextureStreamer::stats() const {
+        TextureStreamerStats stats;
+        stats.requested = m_requested;
+        stats.decoded = m_decoded_count;
+        stats.mipped = m_mipped_count;
+        stats.uploaded = m_uploaded;
+        stats.failed = m_failed;
+        stats.discarded = m_discarded;
+        stats.uploaded_bytes = m_uploaded_bytes;
+        stats.last_frame_uploads = m_last_frame_uploads;
+        stats.last_frame_bytes = m_last_frame_bytes;
+        stats.decoded_queue_depth = m_decoded.size();
+        stats.mipped_queue_depth = m_mipped.size();
+        return stats;
+    }
+
+    void TextureStreamer::decode_worker() {
+        while (auto request = m_requests.pop()) {
+            // decoded straight from the pack's mapping
+            const auto file = m_vfs.open(request->path.generic_string());
+            if (!file) {
+                m_logger->error("failed to open {}", request->path.string());
+                ++m_failed;
+                continue;
+            }
+
+            int width = 0;
+            int height = 0;
+            int channels = 0;
+            stbi_uc* pixels = stbi_load_from_memory(
+                reinterpret_cast<const stbi_uc*>(file->data()),
+                static_cast<int>(file->size()),
+                &width,
+                &height,
+                &channels,
+                STBI_rgb_alpha
+            );
+            if (pixels == nullptr) {
+                m_logger->error("failed to decode {}: {}", request->path.string(), stbi_failure_reason());
+                ++m_failed;
+                continue;
+            }
+
+            TextureData data;
+            data.id = request->id;
+            data.name = request->path.filename().string();
+            data.width = static_cast<uint32_t>(width);
+            data.height = static_cast<uint32_t>(height);
+
+            // reserve the whole chain up front so mip generation does not
+            // reallocate; thin images keep a full row or column per level, so
+            // base + base / 3 is not enough for them
+            const size_t base_size = size_t(width) * height * 4;
+            data.pixels.reserve(mip_chain_size(data.width, data.height));
+            data.pixels.resize(base_size);
+            std::memcpy(data.pixels.data(), pixels, base_size);
+            stbi_image_free(pixels);
+
+            ++m_decoded_count;
+            // blocks while the mip stage is behind
+            if (!m_decoded.push(std::move(data))) {
+                break;
+            }
+        }
+    }
+
+    void TextureStreamer::mip_worker() {
+        while (auto data = m_decoded.pop()) {
+            data->mips = generate_mips(data->pixels, data->width, data->height, m_params.filter);
+
+            ++m_mipped_count;
+            // blocks while uploads are behind
+            if (!m_mipped.push(std::move(data.value()))) {
+                break;
+            }
+        }
+    }
+
+    bool TextureStreamer::stage(
+        TextureData& data,
+        FrameStaging& staging,
+        VkDeviceSize& used,
+        std::vector<StagedUpload>& staged
+    ) {
+        const VkDeviceSize size = data.pixels.size();
+        const VkDeviceSize offset = align_up(used, staging_alignment);
+
+        const Buffer* target = nullptr;
+        if (offset + size <= staging.buffer.size()) {
+            target = &staging.buffer;
+            used = offset + size;
+        } else if (size > staging.buffer.size() && staged.empty()) {
+            // would never fit, so it gets a frame on its own
+            staging.oversized.push_back(
+                m_allocator.create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::staging)
+            );
+            target = &staging.oversized.back();
+            used = staging.buffer.size();
+        } else {
+            return false;
+        }
+
+        const VkDeviceSize target_offset = target == &staging.buffer ? offset : 0;
+        std::memcpy(static_cast<std::byte*>(target->mapped()) + target_offset, data.pixels.data(), size);
+        // oversized buffers live in a vector that may still grow, so keep the handle
+        staged.push_back({ std::move(data), target->handle(), target_offset });
+        return true;
+    }
+
+    void TextureStreamer::record_uploads(VkCommandBuffer cmd, uint32_t frame_slot, uint64_t frame_number) {
+        FrameStaging& staging = m_staging[frame_slot];
+        // the slot's previous copies are finished
+        staging.oversized.clear();
+        if (!staging.buffer) {
+            // nothing was ever loaded
+            m_last_frame_uploads = 0;
+            m_last_frame_bytes = 0;
+            return;
+        }
+
+        std::vector<StagedUpload> staged;
+        VkDeviceSize used = 0;
+        while (true) {
+            std::optional<TextureData> data = std::move(m_deferred);
+            m_deferred.reset();
+            if (!data.has_value()) {
+                data = m_mipped.try_pop();
+            }
+            if (!data.has_value()) {
+                break;
+            }
+            if (m_textures[data->id].unloaded) {
+                ++m_discarded;
+                continue;
+            }
+            if (!stage(data.value(), staging, used, staged)) {
+                m_deferred = std::move(data);
+                break;
+            }
+        }
+
+        m_last_frame_uploads = static_cast<uint32_t>(staged.size());
+        m_last_frame_bytes = used;
+        if (staged.empty()) {
+            return;
+        }
+
+        staging.buffer.flush(0, used);
+        for (auto& buffer : staging.oversized) {
+            buffer.flush();
+        }
+
+        // one barrier for all new images, then the copies, then one barrier
+        // that hands every image to the shaders
+        std::vector<VkImageMemoryBarrier> to_transfer;
+        std::vector<VkImageMemoryBarrier> to_shader;
+        to_transfer.reserve(staged.size());
+        to_shader.reserve(staged.size());
+
+        const VkFormat format = m_params.srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+
+        for (auto& upload : staged) {
+            Texture& texture = m_textures[upload.data.id];
+            const auto mip_count = static_cast<uint32_t>(upload.data.mips.size());
+
+            VkImageCreateInfo image_info = {};
+            image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            image_info.pNext = nullptr;
+            image_info.imageType = VK_IMAGE_TYPE_2D;
+            image_info.format = format;
+            image_info.extent = { upload.data.width, upload.data.height, 1 };
+            image_info.mipLevels = mip_count;
+            image_info.arrayLayers = 1;
+            image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+            image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+            image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            texture.image = m_allocator.create_image(image_info, MemoryUsage::texture);
+
+            VkImageViewCreateInfo view_info = {};
+            view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_info.pNext = nullptr;
+            view_info.image = texture.image.handle();
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = format;
+            view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            view_info.subresourceRange.baseMipLevel = 0;
+            view_info.subresourceRange.levelCount = mip_count;
+            view_info.subresourceRange.baseArrayLayer = 0;
+            view_info.subresourceRange.layerCount = 1;
+            VkImageView view = VK_NULL_HANDLE;
+            check_vk(vkCreateImageView(m_device, &view_info, nullptr, &view));
+            texture.view = UniqueHandle<VkImageView>(m_deletions, view);
+
+            VkImageMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.pNext = nullptr;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = texture.image.handle();
+            barrier.subresourceRange = view_info.subresourceRange;
+
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            to_transfer.push_back(barrier);
+
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            to_shader.push_back(barrier);
+        }
+
+        vkCmdPipelineBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(to_transfer.size()), to_transfer.data()
+        );
+
+        std::vector<VkBufferImageCopy> regions;
+        for (auto& upload : staged) {
+            regions.clear();
+            for (uint32_t level = 0; level < upload.data.mips.size(); ++level) {
+                const MipLevel& mip = upload.data.mips[level];
+
+                VkBufferImageCopy region = {};
+                region.bufferOffset = upload.offset + mip.offset;
+                region.bufferRowLength = 0;
+                region.bufferImageHeight = 0;
+                region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                region.imageSubresource.mipLevel = level;
+                region.imageSubresource.baseArrayLayer = 0;
+                region.imageSubresource.layerCount = 1;
+                region.imageOffset = { 0, 0, 0 };
+                region.imageExtent = { mip.width, mip.height, 1 };
+                regions.push_back(region);
+            }
+
+            Texture& texture = m_textures[upload.data.id];
+            vkCmdCopyBufferToImage(
+                cmd,
+                upload.staging,
+                texture.image.handle(),
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                static_cast<uint32_t>(regions.size()),
+                regions.data()
+            );
+
+            // commands recorded after this point in the same frame see the texture
+            texture.ready = true;
+            texture.ready_frame = frame_number;
+            ++m_uploaded;
+            m_uploaded_bytes += upload.data.pixels.size();
+        }
+
+        vkCmdPipelineBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(to_shader.size()), to_shader.data()
+        );
+    }
+}
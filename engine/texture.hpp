@@ -0,0 +1,174 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "bounded_queue.hpp"
+#include "deletion_queue.hpp"
+#include "logger.hpp"
+#include "mipmap.hpp"
+#include "vfs.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace engine {
+
+    using TextureId = uint32_t;
+
+    // Decoded RGBA8 image with its whole mip chain in one allocation.
+    struct TextureData {
+        TextureId id;
+        std::string name;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<MipLevel> mips;
+        std::vector<std::byte> pixels;
+    };
+
+    struct Texture {
+        Image image;
+        UniqueHandle<VkImageView> view;
+        // first frame whose commands may sample the texture
+        uint64_t ready_frame = 0;
+        bool ready = false;
+        // dropped by unload(), a load still in the pipeline is discarded
+        bool unloaded = false;
+    };
+
+    struct TextureStreamerParams {
+        TextureStreamerParams();
+
+        uint32_t decode_threads;
+        uint32_t mip_threads;
+        // decoded / mipped images waiting for the next stage. These bound the
+        // memory of a load that outpaces the uploads.
+        size_t decoded_queue_capacity;
+        size_t mipped_queue_capacity;
+        // staging memory per frame in flight, i.e. the upload budget per
+        // frame; allocated by the first load()
+        VkDeviceSize staging_bytes_per_frame;
+        MipFilter filter;
+        bool srgb;
+    };
+
+    struct TextureStreamerStats {
+        uint64_t requested = 0;
+        uint64_t decoded = 0;
+        uint64_t mipped = 0;
+        uint64_t uploaded = 0;
+        uint64_t failed = 0;
+        // unloaded before their upload
+        uint64_t discarded = 0;
+        uint64_t uploaded_bytes = 0;
+        // textures and bytes copied by the last record_uploads call
+        uint32_t last_frame_uploads = 0;
+        VkDeviceSize last_frame_bytes = 0;
+        size_t decoded_queue_depth = 0;
+        size_t mipped_queue_depth = 0;
+    };
+
+    // Three stage texture pipeline: stb_image decode and mip generation run on
+    // their own worker threads and talk through bounded queues; the upload
+    // stage runs on the render thread and copies as many finished textures as
+    // fit into the frame's staging budget, all recorded into the frame's own
+    // command buffer, so a texture heavy load adds no extra submits.
+    class TextureStreamer {
+    public:
+        TextureStreamer(
+            VkDevice device,
+            Allocator& allocator,
+            DeletionQueue& deletions,
+            const Vfs& vfs,
+            uint32_t frames_in_flight,
+            const TextureStreamerParams& params = TextureStreamerParams()
+        );
+        ~TextureStreamer();
+
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+        // Queues an asset for loading, by Vfs name or file path. The id is
+        // valid right away, the texture becomes ready a few frames later.
+        // Render thread only.
+        TextureId load(const std::filesystem::path& path);
+
+        // Upload stage. `frame_slot` must be idle (its fence waited on), the
+        // staging memory it used last time is reused. Has to be called
+        // outside a render pass.
+        void record_uploads(VkCommandBuffer cmd, uint32_t frame_slot, uint64_t frame_number);
+
+        // Frees the texture once the frames sampling it have finished; the id
+        // stays invalid. Render thread only.
+        void unload(TextureId id);
+
+        // nullptr until the texture is uploaded, and after unload()
+        const Texture* get(TextureId id) const;
+
+        // true when every requested texture has been uploaded or failed
+        bool idle() const;
+
+        TextureStreamerStats stats() const;
+
+    private:
+        struct LoadRequest {
+            TextureId id;
+            std::filesystem::path path;
+        };
+
+        struct FrameStaging {
+            Buffer buffer;
+            // textures bigger than the whole budget get a buffer of their own
+            std::vector<Buffer> oversized;
+        };
+
+        struct StagedUpload {
+            TextureData data;
+            VkBuffer staging;
+            VkDeviceSize offset;
+        };
+
+        void decode_worker();
+        void mip_worker();
+        // copies the pixels into staging memory, false if the frame's budget is used up
+        bool stage(TextureData& data, FrameStaging& staging, VkDeviceSize& used, std::vector<StagedUpload>& staged);
+
+    private:
+        VkDevice m_device;
+        Allocator& m_allocator;
+        DeletionQueue& m_deletions;
+        const Vfs& m_vfs;
+        TextureStreamerParams m_params;
+
+        BoundedQueue<LoadRequest> m_requests;
+        BoundedQueue<TextureData> m_decoded;
+        BoundedQueue<TextureData> m_mipped;
+        std::vector<std::thread> m_workers;
+
+        std::vector<FrameStaging> m_staging;
+        // popped from m_mipped but did not fit into the last frame's budget
+        std::optional<TextureData> m_deferred;
+
+        // a deque so the pointers get() hands out survive later loads
+        std::deque<Texture> m_textures;
+
+        std::atomic<uint64_t> m_requested = 0;
+        std::atomic<uint64_t> m_decoded_count = 0;
+        std::atomic<uint64_t> m_mipped_count = 0;
+        std::atomic<uint64_t> m_failed = 0;
+        uint64_t m_uploaded = 0;
+        uint64_t m_discarded = 0;
+        uint64_t m_uploaded_bytes = 0;
+        uint32_t m_last_frame_uploads = 0;
+        VkDeviceSize m_last_frame_bytes = 0;
+
+        logger_t m_logger;
+    };
+}
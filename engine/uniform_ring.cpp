@@ -0,0 +1,156 @@
+#include "uniform_ring.hpp"
+#include "vk_util.hpp"
+
+#include <algorithm>
+
+
+namespace engine {
+
+    namespace {
+        VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    UniformRingParams::UniformRingParams()
+    : bytes_per_frame(4 * 1024 * 1024)
+    {}
+
+    UniformRing::UniformRing(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        Allocator& allocator,
+        uint32_t frame_slots,
+        bool device_address,
+        const UniformRingParams& params
+    )
+        : m_device(device)
+        , m_params(params)
+        , m_logger(create_logger("uniforms")) {
+        VkPhysicalDeviceProperties properties = {};
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        // storage buffers are bound at offsets from the ring as well
+        m_alignment = std::max({
+            m_alignment,
+            properties.limits.minUniformBufferOffsetAlignment,
+            properties.limits.minStorageBufferOffsetAlignment,
+        });
+        m_params.bytes_per_frame = align_up(std::max(m_params.bytes_per_frame, m_alignment), m_alignment);
+
+        VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        if (device_address) {
+            usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR;
+        }
+        m_buffer = allocator.create_buffer(
+            m_params.bytes_per_frame * std::max(frame_slots, 1u),
+            usage,
+            MemoryUsage::dynamic_per_frame
+        );
+        if (!m_buffer.mapped()) {
+            m_logger->error("the uniform ring is not host visible, allocations will fail");
+            return;
+        }
+
+        if (device_address) {
+            auto get_address = reinterpret_cast<PFN_vkGetBufferDeviceAddressKHR>(
+                vkGetDeviceProcAddr(m_device, "vkGetBufferDeviceAddressKHR")
+            );
+            VkBufferDeviceAddressInfoKHR address_info = {};
+            address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR;
+            address_info.pNext = nullptr;
+            address_info.buffer = m_buffer.handle();
+            m_address = get_address ? get_address(m_device, &address_info) : 0;
+        }
+
+        m_logger->info(
+            "{} KiB of per-frame constants per slot, {} byte alignment{}",
+            m_params.bytes_per_frame / 1024,
+            m_alignment,
+            m_address != 0 ? ", with device addresses" : ""
+        );
+    }
+
+    void UniformRing::begin_frame(uint32_t frame_slot) {
+        const VkDeviceSize used = std::min(m_offset.load(std::memory_order_relaxed), m_params.bytes_per_frame);
+        if (m_started) {
+            m_last_frame_bytes = used;
+            m_high_water = std::max(m_high_water, used);
+        }
+        m_started = true;
+
+        // nothing to wait for: the slot's fence says its last frame is done
+        m_base = m_params.bytes_per_frame * frame_slot;
+        m_offset.store(0, std::memory_order_relaxed);
+        m_allocations.store(0, std::memory_order_relaxed);
+    }
+
+    UniformAllocation UniformRing::allocate(VkDeviceSize size) {
+        if (!m_buffer.mapped()) {
+            ++m_failed;
+            return {};
+        }
+
+        // rounding the size keeps every later offset aligned as well
+        const VkDeviceSize aligned = align_up(std::max<VkDeviceSize>(size, 1), m_alignment);
+        VkDeviceSize offset = m_offset.load(std::memory_order_relaxed);
+        do {
+            if (offset + aligned > m_params.bytes_per_frame) {
+                ENGINE_LOG_LIMITED(m_logger, WARN, "uniform ring full, {} byte allocation failed", size);
+                ++m_failed;
+                return {};
+            }
+        } while (!m_offset.compare_exchange_weak(offset, offset + aligned, std::memory_order_relaxed));
+        ++m_allocations;
+
+        UniformAllocation allocation;
+        allocation.buffer = m_buffer.handle();
+        allocation.offset = m_base + offset;
+        allocation.size = size;
+        allocation.data = static_cast<std::byte*>(m_buffer.mapped()) + allocation.offset;
+        allocation.address = m_address != 0 ? m_address + allocation.offset : 0;
+        return allocation;
+    }
+
+    void UniformRing::flush() {
+        const VkDeviceSize used = std::min(m_offset.load(std::memory_order_relaxed), m_params.bytes_per_frame);
+        if (used > 0) {
+            m_buffer.flush(m_base, used);
+        }
+    }
+
+    UniformRingStats UniformRing::stats() const {
+        UniformRingStats stats;
+        stats.bytes_per_frame = m_params.bytes_per_frame;
+        stats.bytes = std::min(m_offset.load(std::memory_order_relaxed), m_params.bytes_per_frame);
+        stats.last_frame_bytes = m_last_frame_bytes;
+        stats.high_water = std::max(m_high_water, stats.bytes);
+        stats.allocations = m_allocations.load(std::memory_order_relaxed);
+        stats.failed = m_failed.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    std::optional<VkPhysicalDeviceBufferDeviceAddressFeaturesKHR> buffer_device_address_features(VkPhysicalDevice physical_device) {
+        if (!has_device_extension(physical_device, VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME)) {
+            return std::nullopt;
+        }
+
+        VkPhysicalDeviceBufferDeviceAddressFeaturesKHR supported = {};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+        supported.pNext = nullptr;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &supported;
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        if (!supported.bufferDeviceAddress) {
+            return std::nullopt;
+        }
+
+        VkPhysicalDeviceBufferDeviceAddressFeaturesKHR enabled = {};
+        enabled.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES_KHR;
+        enabled.pNext = nullptr;
+        enabled.bufferDeviceAddress = VK_TRUE;
+        return enabled;
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+
+namespace engine {
+
+    struct UniformRingParams {
+        UniformRingParams();
+
+        // per frame slot; what does not fit fails until the slot comes around again
+        VkDeviceSize bytes_per_frame;
+    };
+
+    // A piece of the current frame's slot. `offset` is a multiple of
+    // minUniformBufferOffsetAlignment, so it can be passed as a dynamic
+    // offset with a descriptor of `size` bytes, or read through `address`.
+    struct UniformAllocation {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* data = nullptr;
+        // 0 without buffer device addresses
+        VkDeviceAddress address = 0;
+
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    struct UniformRingStats {
+        VkDeviceSize bytes_per_frame = 0;
+        // handed out since the current slot began, alignment padding included
+        VkDeviceSize bytes = 0;
+        // of the last finished frame, and the most any frame has used
+        VkDeviceSize last_frame_bytes = 0;
+        VkDeviceSize high_water = 0;
+        uint32_t allocations = 0;
+        // allocations that did not fit, since the start
+        uint64_t failed = 0;
+    };
+
+    // Linear allocator for camera, object and material constants over one
+    // persistently mapped buffer, split into a region per frame slot.
+    // allocate() only bumps an offset and may be called from any recording
+    // thread; begin_frame() rewinds the slot's region without synchronisation,
+    // since its fence has signalled by then and the GPU is done with it.
+    class UniformRing {
+    public:
+        UniformRing(
+            VkPhysicalDevice physical_device,
+            VkDevice device,
+            Allocator& allocator,
+            uint32_t frame_slots,
+            bool device_address,
+            const UniformRingParams& params = UniformRingParams()
+        );
+
+        UniformRing(const UniformRing&) = delete;
+        UniformRing& operator=(const UniformRing&) = delete;
+
+        // call once the slot's fence has signalled
+        void begin_frame(uint32_t frame_slot);
+
+        // an empty allocation when the slot is full
+        UniformAllocation allocate(VkDeviceSize size);
+
+        template<typename T>
+        UniformAllocation push(const T& value) {
+            UniformAllocation allocation = allocate(sizeof(T));
+            if (allocation) {
+                std::memcpy(allocation.data, &value, sizeof(T));
+            }
+            return allocation;
+        }
+
+        // makes the slot's writes visible to the GPU on non-coherent memory;
+        // call before submitting the frame
+        void flush();
+
+        // the whole ring, for descriptors that take dynamic offsets
+        VkBuffer buffer() const { return m_buffer.handle(); }
+        VkDeviceSize alignment() const { return m_alignment; }
+
+        UniformRingStats stats() const;
+
+    private:
+        VkDevice m_device;
+        UniformRingParams m_params;
+
+        Buffer m_buffer;
+        VkDeviceSize m_alignment = 16;
+        VkDeviceAddress m_address = 0;
+
+        // start of the current slot's region, and the bytes used in it
+        VkDeviceSize m_base = 0;
+        std::atomic<VkDeviceSize> m_offset = 0;
+        std::atomic<uint32_t> m_allocations = 0;
+        std::atomic<uint64_t> m_failed = 0;
+        bool m_started = false;
+
+        VkDeviceSize m_last_frame_bytes = 0;
+        VkDeviceSize m_high_water = 0;
+
+        logger_t m_logger;
+    };
+
+    // VK_KHR_buffer_device_address's feature struct with the feature turned
+    // on for the device builder's pNext chain, or nullopt without support
+    std::optional<VkPhysicalDeviceBufferDeviceAddressFeaturesKHR> buffer_device_address_features(VkPhysicalDevice physical_device);
+}
@@ -0,0 +1,493 @@
+#include "upload_service.hpp"
+#include "vk_util.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace engine {
+
+    namespace {
+        VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+
+        VkImageSubresourceRange level_range(const VkImageSubresourceLayers& layers) {
+            VkImageSubresourceRange range = {};
+            range.aspectMask = layers.aspectMask;
+            range.baseMipLevel = layers.mipLevel;
+            range.levelCount = 1;
+            range.baseArrayLayer = layers.baseArrayLayer;
+            range.layerCount = layers.layerCount;
+            return range;
+        }
+    }
+
+    UploadServiceParams::UploadServiceParams()
+    : staging_bytes(64 * 1024 * 1024)
+    {}
+
+    UploadService::UploadService(
+        VkPhysicalDevice physical_device,
+        VkDevice device,
+        Allocator& allocator,
+        UploadQueue transfer_queue,
+        uint32_t graphics_family,
+        const UploadServiceParams& params
+    )
+        : m_device(device)
+        , m_allocator(allocator)
+        , m_transfer(transfer_queue)
+        , m_graphics_family(graphics_family)
+        , m_params(params)
+        , m_logger(create_logger("upload")) {
+        VkPhysicalDeviceProperties properties = {};
+        vkGetPhysicalDeviceProperties(physical_device, &properties);
+        // a multiple of every texel block size, so image copies can start anywhere
+        m_alignment = std::max<VkDeviceSize>(m_alignment, properties.limits.optimalBufferCopyOffsetAlignment);
+
+        m_get_counter = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+            vkGetDeviceProcAddr(m_device, "vkGetSemaphoreCounterValueKHR")
+        );
+        m_wait_semaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+            vkGetDeviceProcAddr(m_device, "vkWaitSemaphoresKHR")
+        );
+
+        VkSemaphoreTypeCreateInfoKHR type_info = {};
+        type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+        type_info.pNext = nullptr;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        type_info.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphore_info = {};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphore_info.pNext = &type_info;
+        semaphore_info.flags = 0;
+        check_vk(vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_timeline));
+
+        m_params.staging_bytes = align_up(std::max<VkDeviceSize>(m_params.staging_bytes, m_alignment), m_alignment);
+        m_ring = m_allocator.create_buffer(
+            m_params.staging_bytes,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            MemoryUsage::staging
+        );
+
+        m_frame_wait.semaphore = m_timeline;
+        m_stats.dedicated_queue = owned_by_transfer();
+        m_logger->info(
+            "uploads go through {} MiB of staging on {}",
+            m_params.staging_bytes / (1024 * 1024),
+            owned_by_transfer() ? "a transfer queue family of their own" : "the graphics queue family"
+        );
+    }
+
+    UploadService::~UploadService() {
+        // copies that were never flushed are dropped
+        const uint64_t last = m_next_value - 1;
+        if (last > 0 && m_wait_semaphores) {
+            VkSemaphoreWaitInfoKHR wait_info = {};
+            wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+            wait_info.pNext = nullptr;
+            wait_info.flags = 0;
+            wait_info.semaphoreCount = 1;
+            wait_info.pSemaphores = &m_timeline;
+            wait_info.pValues = &last;
+            check_vk(m_wait_semaphores(m_device, &wait_info, 1000000000));
+        }
+
+        for (auto& batch : m_batches) {
+            vkDestroyCommandPool(m_device, batch.pool, nullptr);
+        }
+        for (auto& batch : m_free_batches) {
+            vkDestroyCommandPool(m_device, batch.pool, nullptr);
+        }
+        vkDestroySemaphore(m_device, m_timeline, nullptr);
+    }
+
+    UploadTicket UploadService::upload(
+        VkBuffer buffer,
+        VkDeviceSize offset,
+        std::span<const std::byte> data,
+        VkPipelineStageFlags stages,
+        VkAccessFlags access
+    ) {
+        if (data.empty()) {
+            return no_upload;
+        }
+        const auto position = allocate(data.size());
+        if (!position) {
+            return no_upload;
+        }
+
+        Copy copy;
+        copy.buffer = buffer;
+        copy.buffer_region.srcOffset = *position % m_ring.size();
+        copy.buffer_region.dstOffset = offset;
+        copy.buffer_region.size = data.size();
+        copy.stages = stages;
+        copy.access = access;
+        return queue(copy, *position, data);
+    }
+
+    UploadTicket UploadService::upload(
+        VkImage image,
+        VkImageAspectFlags aspect,
+        uint32_t mip_level,
+        uint32_t array_layer,
+        VkExtent3D extent,
+        std::span<const std::byte> data,
+        VkImageLayout layout,
+        VkPipelineStageFlags stages,
+        VkAccessFlags access
+    ) {
+        if (data.empty()) {
+            return no_upload;
+        }
+        const auto position = allocate(data.size());
+        if (!position) {
+            return no_upload;
+        }
+
+        Copy copy;
+        copy.image = image;
+        copy.image_region.bufferOffset = *position % m_ring.size();
+        // tightly packed
+        copy.image_region.bufferRowLength = 0;
+        copy.image_region.bufferImageHeight = 0;
+        copy.image_region.imageSubresource.aspectMask = aspect;
+        copy.image_region.imageSubresource.mipLevel = mip_level;
+        copy.image_region.imageSubresource.baseArrayLayer = array_layer;
+        copy.image_region.imageSubresource.layerCount = 1;
+        copy.image_region.imageOffset = { 0, 0, 0 };
+        copy.image_region.imageExtent = extent;
+        copy.layout = layout;
+        copy.stages = stages;
+        copy.access = access;
+        return queue(copy, *position, data);
+    }
+
+    UploadTicket UploadService::queue(Copy copy, uint64_t position, std::span<const std::byte> data) {
+        if (copy.stages == 0) {
+            copy.stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        }
+        const VkDeviceSize offset = position % m_ring.size();
+        std::memcpy(static_cast<std::byte*>(m_ring.mapped()) + offset, data.data(), data.size());
+        m_ring.flush(offset, data.size());
+
+        m_queued.push_back(copy);
+        // the batch the next flush() submits
+        const UploadTicket ticket = m_next_value;
+        m_pending.push_back({ copy, ticket });
+
+        ++m_stats.uploads;
+        m_stats.bytes += data.size();
+        return ticket;
+    }
+
+    std::optional<uint64_t> UploadService::allocate(VkDeviceSize size) {
+        const uint64_t capacity = m_ring.size();
+        if (size > capacity) {
+            m_logger->error("an upload of {} bytes does not fit into {} bytes of staging", size, capacity);
+            ++m_stats.rejected;
+            return std::nullopt;
+        }
+
+        uint64_t start = align_up(m_ring_head, m_alignment);
+        // a copy never wraps around the end of the ring
+        if (start % capacity + size > capacity) {
+            start = (start / capacity + 1) * capacity;
+        }
+        if (start + size - m_ring_tail > capacity) {
+            retire_batches();
+            if (start + size - m_ring_tail > capacity) {
+                ++m_stats.rejected;
+                return std::nullopt;
+            }
+        }
+
+        m_ring_head = start + size;
+        return start;
+    }
+
+    void UploadService::flush() {
+        retire_batches();
+        if (m_queued.empty()) {
+            return;
+        }
+
+        Batch batch;
+        if (!m_free_batches.empty()) {
+            batch = m_free_batches.back();
+            m_free_batches.pop_back();
+        } else {
+            VkCommandPoolCreateInfo pool_info = {};
+            pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            pool_info.pNext = nullptr;
+            pool_info.queueFamilyIndex = m_transfer.family;
+            pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            check_vk(vkCreateCommandPool(m_device, &pool_info, nullptr, &batch.pool));
+
+            VkCommandBufferAllocateInfo buffer_info = {};
+            buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            buffer_info.pNext = nullptr;
+            buffer_info.commandPool = batch.pool;
+            buffer_info.commandBufferCount = 1;
+            buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            check_vk(vkAllocateCommandBuffers(m_device, &buffer_info, &batch.cmd));
+        }
+        batch.value = m_next_value++;
+        batch.ring_end = m_ring_head;
+
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.pNext = nullptr;
+        begin_info.pInheritanceInfo = nullptr;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        check_vk(vkBeginCommandBuffer(batch.cmd, &begin_info));
+        record_batch(batch.cmd);
+        check_vk(vkEndCommandBuffer(batch.cmd));
+        m_queued.clear();
+
+        VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+        timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        timeline_info.pNext = nullptr;
+        timeline_info.waitSemaphoreValueCount = 0;
+        timeline_info.signalSemaphoreValueCount = 1;
+        timeline_info.pSignalSemaphoreValues = &batch.value;
+
+        VkSubmitInfo submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit.pNext = &timeline_info;
+        submit.commandBufferCount = 1;
+        submit.pCommandBuffers = &batch.cmd;
+        submit.signalSemaphoreCount = 1;
+        submit.pSignalSemaphores = &m_timeline;
+        check_vk(vkQueueSubmit(m_transfer.queue, 1, &submit, VK_NULL_HANDLE));
+
+        m_batches.push_back(batch);
+        ++m_stats.batches;
+    }
+
+    void UploadService::record_batch(VkCommandBuffer cmd) const {
+        std::vector<VkImageMemoryBarrier> image_barriers;
+        std::vector<VkBufferMemoryBarrier> buffer_barriers;
+
+        // the levels are overwritten whole, so their old contents can go
+        for (const auto& copy : m_queued) {
+            if (copy.image == VK_NULL_HANDLE) {
+                continue;
+            }
+            VkImageMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.pNext = nullptr;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = copy.image;
+            barrier.subresourceRange = level_range(copy.image_region.imageSubresource);
+            image_barriers.push_back(barrier);
+        }
+        if (!image_barriers.empty()) {
+            vkCmdPipelineBarrier(
+                cmd,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0,
+                0, nullptr,
+                0, nullptr,
+                static_cast<uint32_t>(image_barriers.size()), image_barriers.data()
+            );
+        }
+
+        for (const auto& copy : m_queued) {
+            if (copy.image != VK_NULL_HANDLE) {
+                vkCmdCopyBufferToImage(
+                    cmd,
+                    m_ring.handle(),
+                    copy.image,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    1,
+                    &copy.image_region
+                );
+            } else {
+                vkCmdCopyBuffer(cmd, m_ring.handle(), copy.buffer, 1, &copy.buffer_region);
+            }
+        }
+
+        // With a queue family of its own this is the release half of the
+        // ownership transfer; the frame using it records the acquire half.
+        // Otherwise images only move to their final layout, and the frame's
+        // semaphore wait makes the writes visible.
+        const bool release = owned_by_transfer();
+        image_barriers.clear();
+        for (const auto& copy : m_queued) {
+            if (copy.image != VK_NULL_HANDLE) {
+                VkImageMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.pNext = nullptr;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.newLayout = copy.layout;
+                barrier.srcQueueFamilyIndex = release ? m_transfer.family : VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = release ? m_graphics_family : VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = copy.image;
+                barrier.subresourceRange = level_range(copy.image_region.imageSubresource);
+                image_barriers.push_back(barrier);
+            } else if (release) {
+                VkBufferMemoryBarrier barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                barrier.pNext = nullptr;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = 0;
+                barrier.srcQueueFamilyIndex = m_transfer.family;
+                barrier.dstQueueFamilyIndex = m_graphics_family;
+                barrier.buffer = copy.buffer;
+                barrier.offset = copy.buffer_region.dstOffset;
+                barrier.size = copy.buffer_region.size;
+                buffer_barriers.push_back(barrier);
+            }
+        }
+        if (!image_barriers.empty() || !buffer_barriers.empty()) {
+            // the dst scope of a release is ignored; bottom of pipe exists on every queue
+            vkCmdPipelineBarrier(
+                cmd,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0,
+                0, nullptr,
+                static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+                static_cast<uint32_t>(image_barriers.size()), image_barriers.data()
+            );
+        }
+    }
+
+    void UploadService::retire_batches() {
+        if (m_batches.empty()) {
+            return;
+        }
+        const uint64_t completed = completed_value();
+        // batches finish in submission order on one queue
+        while (!m_batches.empty() && m_batches.front().value <= completed) {
+            Batch& batch = m_batches.front();
+            m_ring_tail = batch.ring_end;
+            check_vk(vkResetCommandPool(m_device, batch.pool, 0));
+            m_free_batches.push_back(batch);
+            m_batches.pop_front();
+        }
+    }
+
+    uint64_t UploadService::completed_value() const {
+        uint64_t value = 0;
+        check_vk(m_get_counter(m_device, m_timeline, &value));
+        return value;
+    }
+
+    bool UploadService::is_complete(UploadTicket ticket) const {
+        return ticket == no_upload || (ticket < m_next_value && ticket <= completed_value());
+    }
+
+    void UploadService::use(UploadTicket ticket) {
+        m_frame_ticket = std::max(m_frame_ticket, ticket);
+    }
+
+    void UploadService::record_acquires(VkCommandBuffer cmd) {
+        std::vector<VkImageMemoryBarrier> image_barriers;
+        std::vector<VkBufferMemoryBarrier> buffer_barriers;
+        VkPipelineStageFlags stages = 0;
+
+        // tickets grow along the queue
+        while (!m_pending.empty() && m_pending.front().ticket <= m_frame_ticket) {
+            const Pending& pending = m_pending.front();
+            const Copy& copy = pending.copy;
+            m_frame_wait.value = std::max(m_frame_wait.value, pending.ticket);
+            stages |= copy.stages;
+
+            if (owned_by_transfer()) {
+                // the same transfer as the release, with the frame's first use as its dst scope
+                if (copy.image != VK_NULL_HANDLE) {
+                    VkImageMemoryBarrier barrier = {};
+                    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                    barrier.pNext = nullptr;
+                    barrier.srcAccessMask = 0;
+                    barrier.dstAccessMask = copy.access;
+                    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                    barrier.newLayout = copy.layout;
+                    barrier.srcQueueFamilyIndex = m_transfer.family;
+                    barrier.dstQueueFamilyIndex = m_graphics_family;
+                    barrier.image = copy.image;
+                    barrier.subresourceRange = level_range(copy.image_region.imageSubresource);
+                    image_barriers.push_back(barrier);
+                } else {
+                    VkBufferMemoryBarrier barrier = {};
+                    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+                    barrier.pNext = nullptr;
+                    barrier.srcAccessMask = 0;
+                    barrier.dstAccessMask = copy.access;
+                    barrier.srcQueueFamilyIndex = m_transfer.family;
+                    barrier.dstQueueFamilyIndex = m_graphics_family;
+                    barrier.buffer = copy.buffer;
+                    barrier.offset = copy.buffer_region.dstOffset;
+                    barrier.size = copy.buffer_region.size;
+                    buffer_barriers.push_back(barrier);
+                }
+            }
+            m_pending.pop_front();
+        }
+        m_frame_wait.stages |= stages;
+        m_frame_ticket = 0;
+
+        if (!image_barriers.empty() || !buffer_barriers.empty()) {
+            vkCmdPipelineBarrier(
+                cmd,
+                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                stages,
+                0,
+                0, nullptr,
+                static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+                static_cast<uint32_t>(image_barriers.size()), image_barriers.data()
+            );
+        }
+    }
+
+    UploadWait UploadService::frame_wait() {
+        UploadWait wait = m_frame_wait;
+        m_frame_wait.value = 0;
+        m_frame_wait.stages = 0;
+        return wait;
+    }
+
+    UploadServiceStats UploadService::stats() const {
+        UploadServiceStats stats = m_stats;
+        stats.staging_used = m_ring_head - m_ring_tail;
+        return stats;
+    }
+
+    std::optional<VkPhysicalDeviceTimelineSemaphoreFeaturesKHR> timeline_semaphore_features(VkPhysicalDevice physical_device) {
+        if (!has_device_extension(physical_device, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+            return std::nullopt;
+        }
+
+        VkPhysicalDeviceTimelineSemaphoreFeaturesKHR supported = {};
+        supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+        supported.pNext = nullptr;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &supported;
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+        if (!supported.timelineSemaphore) {
+            return std::nullopt;
+        }
+
+        VkPhysicalDeviceTimelineSemaphoreFeaturesKHR enabled = {};
+        enabled.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+        enabled.pNext = nullptr;
+        enabled.timelineSemaphore = VK_TRUE;
+        return enabled;
+    }
+}
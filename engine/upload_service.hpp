@@ -0,0 +1,201 @@
+#pragma once
+
+#include "allocator.hpp"
+#include "logger.hpp"
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <vector>
+
+
+namespace engine {
+
+    // Timeline value of the batch an upload went out with; the upload has
+    // finished on the GPU once the service's semaphore reaches it. 0 is no
+    // upload.
+    using UploadTicket = uint64_t;
+    constexpr UploadTicket no_upload = 0;
+
+    struct UploadServiceParams {
+        UploadServiceParams();
+
+        // size of the persistently mapped staging ring; bounds how much
+        // is in flight on the transfer queue
+        VkDeviceSize staging_bytes;
+    };
+
+    struct UploadServiceStats {
+        uint64_t uploads = 0;
+        uint64_t bytes = 0;
+        uint64_t batches = 0;
+        // uploads that found the staging ring full and have to be retried
+        uint64_t rejected = 0;
+        VkDeviceSize staging_used = 0;
+        bool dedicated_queue = false;
+    };
+
+    // the queue uploads are submitted to, see Renderer::init
+    struct UploadQueue {
+        VkQueue queue = VK_NULL_HANDLE;
+        uint32_t family = 0;
+    };
+
+    // What the frame's submit has to wait for before its first use of an
+    // upload; value 0 means nothing.
+    struct UploadWait {
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t value = 0;
+        VkPipelineStageFlags stages = 0;
+    };
+
+    // Copies data into device local buffers and images on a transfer queue
+    // of its own, so streaming does not queue up behind the frame's work.
+    //
+    // upload() copies the bytes into a persistently mapped staging ring
+    // right away and queues the GPU copy; flush() records everything queued
+    // into one command buffer and submits it, signalling a timeline
+    // semaphore. Nothing on the CPU ever waits for the GPU: when the ring
+    // is full upload() says so and the caller tries again next frame.
+    //
+    // A frame declares the uploads it reads with use(); record_acquires()
+    // then records the queue family acquire barriers (when the transfer
+    // queue is of another family) and frame_wait() says which semaphore
+    // value the frame's submit waits for. Frames using nothing new wait for
+    // nothing. Every upload is meant to be used by a frame eventually; until
+    // then it keeps a small entry. All calls from the render thread.
+    class UploadService {
+    public:
+        UploadService(
+            VkPhysicalDevice physical_device,
+            VkDevice device,
+            Allocator& allocator,
+            UploadQueue transfer_queue,
+            uint32_t graphics_family,
+            const UploadServiceParams& params = UploadServiceParams()
+        );
+        ~UploadService();
+
+        UploadService(const UploadService&) = delete;
+        UploadService& operator=(const UploadService&) = delete;
+
+        // Queues a copy of `data` into `buffer` at `offset`. `stages` and
+        // `access` are how frames first read it. no_upload if the staging ring
+        // has no room right now; try again after a frame.
+        UploadTicket upload(
+            VkBuffer buffer,
+            VkDeviceSize offset,
+            std::span<const std::byte> data,
+            VkPipelineStageFlags stages,
+            VkAccessFlags access
+        );
+
+        // Queues a copy of one whole mip level, which every transfer queue
+        // can copy whatever its image granularity. The image is in `layout`
+        // once the ticket's frame waited for it; earlier contents of the
+        // level are discarded.
+        UploadTicket upload(
+            VkImage image,
+            VkImageAspectFlags aspect,
+            uint32_t mip_level,
+            uint32_t array_layer,
+            VkExtent3D extent,
+            std::span<const std::byte> data,
+            VkImageLayout layout,
+            VkPipelineStageFlags stages,
+            VkAccessFlags access
+        );
+
+        // Submits the queued copies as one batch; no-op when nothing is queued.
+        void flush();
+
+        bool is_complete(UploadTicket ticket) const;
+        // the newest ticket handed out
+        UploadTicket last_ticket() const { return m_next_value > 1 ? m_next_value - 1 : no_upload; }
+
+        // The next frame reads the uploads of `ticket` and every earlier one;
+        // called before Renderer::render() records it.
+        void use(UploadTicket ticket);
+        // Records the acquire barriers of what use() asked for, into the
+        // frame's command buffer before its first pass. Call flush() first.
+        void record_acquires(VkCommandBuffer cmd);
+        // What the frame's submit waits for; resets for the next frame.
+        UploadWait frame_wait();
+
+        UploadServiceStats stats() const;
+
+    private:
+        struct Copy {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkBufferCopy buffer_region = {};
+            VkImage image = VK_NULL_HANDLE;
+            VkBufferImageCopy image_region = {};
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags stages = 0;
+            VkAccessFlags access = 0;
+        };
+
+        // an upload no frame has used yet; with a transfer queue of its own
+        // the graphics queue still has to acquire it
+        struct Pending {
+            Copy copy;
+            UploadTicket ticket;
+        };
+
+        struct Batch {
+            VkCommandPool pool = VK_NULL_HANDLE;
+            VkCommandBuffer cmd = VK_NULL_HANDLE;
+            uint64_t value = 0;
+            // staging ring position after its copies
+            uint64_t ring_end = 0;
+        };
+
+        // a position in the ring, or nullopt if it is full
+        std::optional<uint64_t> allocate(VkDeviceSize size);
+        UploadTicket queue(Copy copy, uint64_t position, std::span<const std::byte> data);
+        void retire_batches();
+        uint64_t completed_value() const;
+        bool owned_by_transfer() const { return m_transfer.family != m_graphics_family; }
+
+        void record_batch(VkCommandBuffer cmd) const;
+
+    private:
+        VkDevice m_device;
+        Allocator& m_allocator;
+        UploadQueue m_transfer;
+        uint32_t m_graphics_family;
+        UploadServiceParams m_params;
+        VkDeviceSize m_alignment = 16;
+
+        PFN_vkGetSemaphoreCounterValueKHR m_get_counter = nullptr;
+        PFN_vkWaitSemaphoresKHR m_wait_semaphores = nullptr;
+        VkSemaphore m_timeline = VK_NULL_HANDLE;
+        // the value the next batch signals
+        uint64_t m_next_value = 1;
+
+        Buffer m_ring;
+        // monotonic positions; the ring offset is position % size
+        uint64_t m_ring_head = 0;
+        uint64_t m_ring_tail = 0;
+
+        std::vector<Copy> m_queued;
+        std::vector<Batch> m_free_batches;
+        std::deque<Batch> m_batches;
+        std::deque<Pending> m_pending;
+
+        uint64_t m_frame_ticket = 0;
+        UploadWait m_frame_wait;
+
+        UploadServiceStats m_stats;
+
+        logger_t m_logger;
+    };
+
+    // VK_KHR_timeline_semaphore's feature struct with the feature turned on
+    // for the device builder's pNext chain, or nullopt without support
+    std::optional<VkPhysicalDeviceTimelineSemaphoreFeaturesKHR> timeline_semaphore_features(VkPhysicalDevice physical_device);
+}
@@ -0,0 +1,155 @@
+#include "vfs.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+
+namespace engine {
+
+    namespace {
+        // the part of `name` below the mount's prefix, or nullopt if the
+        // mount does not cover it
+        std::optional<std::string_view> below(std::string_view name, std::string_view prefix) {
+            if (prefix.empty()) {
+                return name;
+            }
+            if (name.size() > prefix.size() && name.starts_with(prefix) && name[prefix.size()] == '/') {
+                return name.substr(prefix.size() + 1);
+            }
+            if (name == prefix) {
+                return std::string_view();
+            }
+            return std::nullopt;
+        }
+    }
+
+    Vfs::Vfs()
+        : m_logger(create_logger("vfs")) {}
+
+    bool Vfs::mount_pack(const std::filesystem::path& path) {
+        const auto start = std::chrono::steady_clock::now();
+        AssetPack pack(path);
+        if (!pack.is_open()) {
+            return false;
+        }
+        m_mount_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        m_logger->info("mounted {} with {} asset(s)", path.string(), pack.entries().size());
+        m_packs.push_back(std::move(pack));
+        return true;
+    }
+
+    void Vfs::mount_directory(std::string prefix, std::filesystem::path directory) {
+        while (!prefix.empty() && prefix.back() == '/') {
+            prefix.pop_back();
+        }
+        m_directories.push_back({ std::move(prefix), std::move(directory) });
+    }
+
+    std::optional<VfsFile> Vfs::open(std::string_view name) const {
+        auto file = m_prefer_loose ? open_loose(name) : open_packed(name);
+        if (!file) {
+            file = m_prefer_loose ? open_packed(name) : open_loose(name);
+        }
+        if (!file) {
+            ++m_missing;
+        }
+        return file;
+    }
+
+    std::optional<VfsFile> Vfs::open_packed(std::string_view name) const {
+        // later packs patch earlier ones
+        for (auto pack = m_packs.rbegin(); pack != m_packs.rend(); ++pack) {
+            const PackEntry* entry = pack->find(name);
+            if (entry == nullptr) {
+                continue;
+            }
+
+            VfsFile file;
+            file.m_from_pack = true;
+            if (entry->compression == PackCompression::none) {
+                file.m_bytes = pack->stored(*entry);
+                ++m_pack_opens;
+                return file;
+            }
+
+            file.m_decompressed.resize(entry->size);
+            if (!decompress(entry->compression, pack->stored(*entry), file.m_decompressed)) {
+                m_logger->error("failed to decompress {} from {}", name, pack->path().string());
+                return std::nullopt;
+            }
+            file.m_bytes = file.m_decompressed;
+            ++m_decompressed_opens;
+            m_decompressed_bytes += entry->size;
+            return file;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<VfsFile> Vfs::open_loose(std::string_view name) const {
+        for (auto directory = m_directories.rbegin(); directory != m_directories.rend(); ++directory) {
+            const auto relative = below(name, directory->prefix);
+            if (!relative) {
+                continue;
+            }
+
+            VfsFile file;
+            file.m_loose = MappedFile(directory->path / *relative);
+            if (!file.m_loose.is_open()) {
+                continue;
+            }
+            file.m_bytes = file.m_loose.bytes();
+            ++m_loose_opens;
+            return file;
+        }
+        return std::nullopt;
+    }
+
+    std::vector<std::string> Vfs::list(std::string_view directory, std::string_view extension) const {
+        std::vector<std::string> names;
+        const std::string prefix = directory.empty() ? std::string() : std::string(directory) + "/";
+
+        for (const AssetPack& pack : m_packs) {
+            for (const PackEntry& entry : pack.entries()) {
+                const std::string_view name = pack.name(entry);
+                if (name.starts_with(prefix)
+                    && name.ends_with(extension)
+                    && name.find('/', prefix.size()) == std::string_view::npos) {
+                    names.emplace_back(name);
+                }
+            }
+        }
+
+        for (const Directory& mount : m_directories) {
+            const auto relative = below(directory, mount.prefix);
+            if (!relative) {
+                continue;
+            }
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator(mount.path / *relative, error)) {
+                const std::string file_name = entry.path().filename().string();
+                if (entry.is_regular_file() && std::string_view(file_name).ends_with(extension)) {
+                    names.push_back(prefix + file_name);
+                }
+            }
+        }
+
+        std::sort(names.begin(), names.end());
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        return names;
+    }
+
+    VfsStats Vfs::stats() const {
+        VfsStats stats;
+        stats.packs = static_cast<uint32_t>(m_packs.size());
+        for (const AssetPack& pack : m_packs) {
+            stats.pack_entries += static_cast<uint32_t>(pack.entries().size());
+        }
+        stats.mount_ms = m_mount_ms;
+        stats.pack_opens = m_pack_opens;
+        stats.decompressed_opens = m_decompressed_opens;
+        stats.loose_opens = m_loose_opens;
+        stats.missing = m_missing;
+        stats.decompressed_bytes = m_decompressed_bytes;
+        return stats;
+    }
+}
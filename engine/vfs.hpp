@@ -0,0 +1,103 @@
+#pragma once
+
+#include "asset_pack.hpp"
+#include "logger.hpp"
+#include "mapped_file.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace engine {
+
+    // The contents of one asset: a span into a pack's mapping, the
+    // decompressed copy of a compressed blob, or a mapped loose file.
+    class VfsFile {
+    public:
+        std::span<const std::byte> bytes() const { return m_bytes; }
+        const std::byte* data() const { return m_bytes.data(); }
+        size_t size() const { return m_bytes.size(); }
+
+        // false for a loose file
+        bool from_pack() const { return m_from_pack; }
+
+    private:
+        friend class Vfs;
+
+        std::span<const std::byte> m_bytes;
+        bool m_from_pack = false;
+        std::vector<std::byte> m_decompressed;
+        MappedFile m_loose;
+    };
+
+    struct VfsStats {
+        uint32_t packs = 0;
+        uint32_t pack_entries = 0;
+        double mount_ms = 0.0;
+        // opened without a copy, decompressed, read from loose files, not found
+        uint64_t pack_opens = 0;
+        uint64_t decompressed_opens = 0;
+        uint64_t loose_opens = 0;
+        uint64_t missing = 0;
+        uint64_t decompressed_bytes = 0;
+    };
+
+    // Asset names are relative paths with forward slashes, e.g.
+    // "shaders/triangle.vert.spv". open() looks them up in the mounted packs,
+    // newest first, and then under the mounted directories, so a tree without
+    // packs keeps working from loose files. With prefer_loose set the
+    // directories go first instead, for edits during development.
+    // Mounting is not thread safe; open() and list() are.
+    class Vfs {
+    public:
+        Vfs();
+
+        Vfs(const Vfs&) = delete;
+        Vfs& operator=(const Vfs&) = delete;
+
+        // false if the file is missing or not a pack
+        bool mount_pack(const std::filesystem::path& path);
+        // names starting with `prefix` + '/' are read from `directory`; an
+        // empty prefix takes every name, and plain file paths as well
+        void mount_directory(std::string prefix, std::filesystem::path directory);
+        void set_prefer_loose(bool prefer) { m_prefer_loose = prefer; }
+
+        std::optional<VfsFile> open(std::string_view name) const;
+
+        // names directly inside `directory` ending in `extension`, from
+        // every pack and mounted directory, without duplicates
+        std::vector<std::string> list(std::string_view directory, std::string_view extension = {}) const;
+
+        VfsStats stats() const;
+
+    private:
+        struct Directory {
+            std::string prefix;
+            std::filesystem::path path;
+        };
+
+        std::optional<VfsFile> open_packed(std::string_view name) const;
+        std::optional<VfsFile> open_loose(std::string_view name) const;
+
+    private:
+        std::vector<AssetPack> m_packs;
+        std::vector<Directory> m_directories;
+        bool m_prefer_loose = false;
+        double m_mount_ms = 0.0;
+
+        mutable std::atomic<uint64_t> m_pack_opens = 0;
+        mutable std::atomic<uint64_t> m_decompressed_opens = 0;
+        mutable std::atomic<uint64_t> m_loose_opens = 0;
+        mutable std::atomic<uint64_t> m_missing = 0;
+        mutable std::atomic<uint64_t> m_decompressed_bytes = 0;
+
+        logger_t m_logger;
+    };
+}
@@ -0,0 +1,39 @@
+#include "vk_util.hpp"
+#include "hash.hpp"
+
+#include <mutex>
+#include <unordered_map>
+
+
+namespace engine {
+
+    void report_vk_error(int result, const std::source_location& location) {
+        static const logger_t logger = create_logger("vulkan");
+        // check_vk is one function for every call site, so the usual static
+        // in ENGINE_LOG_LIMITED would throttle all of them together
+        static std::mutex mutex;
+        static std::unordered_map<uint64_t, LogRateLimit> limits;
+
+        const uint64_t site = hash_combine(hash_string(location.file_name()), location.line());
+        std::optional<uint32_t> suppressed;
+        {
+            std::lock_guard lock(mutex);
+            suppressed = limits[site].allow();
+        }
+        if (!suppressed.has_value()) {
+            return;
+        }
+
+        ENGINE_LOG_ERROR(
+            logger,
+            "Vulkan error {} in function {} ({}:{})",
+            result,
+            location.function_name(),
+            location.file_name(),
+            location.line()
+        );
+        if (*suppressed > 0) {
+            ENGINE_LOG_ERROR(logger, "  ({} similar error(s) suppressed)", *suppressed);
+        }
+    }
+}
@@ -1,28 +1,42 @@
 #pragma once
 
 #include <source_location>
+#include <cstring>
+#include <vector>
+
+#include <vulkan/vulkan.h>
 
 #include "logger.hpp"
 
 
 namespace engine {
 
-    bool check_vk(
+    // logs through a cached logger, once per second per call site
+    void report_vk_error(int result, const std::source_location& location);
+
+    inline bool check_vk(
         int result,
         std::source_location location = std::source_location::current()
     ) {
-        if (result == 0) {
+        if (result == 0) [[likely]] {
             return true;
         }
 
-        auto logger = get_default_logger();
-        logger->error(
-            "Vulkan error in function {} ({}:{})", 
-            location.function_name(), 
-            location.file_name(), 
-            location.line()
-        );
+        report_vk_error(result, location);
+        return false;
+    }
+
+    inline bool has_device_extension(VkPhysicalDevice physical_device, const char* name) {
+        uint32_t count = 0;
+        vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, nullptr);
+        std::vector<VkExtensionProperties> extensions(count);
+        vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &count, extensions.data());
 
+        for (const auto& extension : extensions) {
+            if (std::strcmp(extension.extensionName, name) == 0) {
+                return true;
+            }
+        }
         return false;
     }
 }
@@ -0,0 +1,3 @@
+// the one translation unit that compiles VulkanMemoryAllocator
+#define VMA_IMPLEMENTATION
+#include <vk_mem_alloc.h>
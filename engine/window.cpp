@@ -53,4 +53,15 @@ namespace engine {
 
         return { width, height };
     }
+
+    WindowState getWindowState(SDL_Window* window) {
+        WindowState state;
+        SDL_GetWindowSize(window, &state.width, &state.height);
+
+        SDL_DisplayMode mode = {};
+        if (SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0) {
+            state.refresh_rate = mode.refresh_rate;
+        }
+        return state;
+    }
 }
@@ -26,5 +26,17 @@ namespace engine {
 
     // width, height
     std::pair<int, int> getWindowDimentions(const window_t&);
+
+    // What the swapchain and the frame pacing need from SDL. SDL's video
+    // functions belong on the thread that created the window, so this is
+    // read there and handed to the renderer.
+    struct WindowState {
+        int width = 0;
+        int height = 0;
+        // of the window's display, 0 when SDL does not know it
+        int refresh_rate = 0;
+    };
+
+    WindowState getWindowState(SDL_Window*);
 }
 
@@ -1,4 +1,7 @@
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
 #include <spdlog/spdlog.h>
 #include <SDL_vulkan.h>
 #include <SDL.h>
@@ -6,29 +9,268 @@
 #include "engine/window.hpp"
 #include "engine/renderer.hpp"
 #include "engine/logger.hpp"
+#include "engine/profiler.hpp"
+#include "engine/main_loop.hpp"
+#include "engine/scene.hpp"
+#include "engine/snapshot_buffer.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 using namespace engine;
 
-int main() {
+namespace {
+
+    VkPresentModeKHR parse_present_mode(const char* name) {
+        if (std::strcmp(name, "mailbox") == 0) {
+            return VK_PRESENT_MODE_MAILBOX_KHR;
+        }
+        if (std::strcmp(name, "immediate") == 0) {
+            return VK_PRESENT_MODE_IMMEDIATE_KHR;
+        }
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    void handle_key(Renderer& renderer, SDL_Keycode key) {
+        switch (key) {
+        case SDLK_1:
+            renderer.set_present_mode(VK_PRESENT_MODE_FIFO_KHR);
+            break;
+        case SDLK_2:
+            renderer.set_present_mode(VK_PRESENT_MODE_MAILBOX_KHR);
+            break;
+        case SDLK_3:
+            renderer.set_present_mode(VK_PRESENT_MODE_IMMEDIATE_KHR);
+            break;
+        case SDLK_l:
+            renderer.set_low_latency(!renderer.low_latency());
+            break;
+        default:
+            break;
+        }
+    }
+
+    // what the simulation hands to the render thread after every step
+    struct FrameSnapshot {
+        uint64_t step = 0;
+        glm::mat4 view = glm::mat4(1.0f);
+        std::vector<GpuInstance> instances;
+    };
+
+    // A grid of cubes turning around the origin. Only the simulation
+    // thread touches it.
+    class Simulation {
+    public:
+        explicit Simulation(uint32_t instance_count) {
+            m_root = m_scene.create_node();
+            const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instance_count))));
+            for (uint32_t i = 0; i < instance_count; ++i) {
+                Transform local;
+                local.position = glm::vec3(
+                    (static_cast<float>(i % side) - side * 0.5f) * 2.0f,
+                    0.0f,
+                    (static_cast<float>(i / side) - side * 0.5f) * 2.0f
+                );
+                const NodeId node = m_scene.create_node(m_root, local);
+                m_scene.set_mesh(node, 0, glm::vec4(0.0f, 0.0f, 0.0f, 0.87f));
+            }
+            m_distance = side * 1.5f + 5.0f;
+        }
+
+        void step(const SimulationStep& step, FrameSnapshot& snapshot) {
+            for (const SDL_Event& event : step.events) {
+                if (event.type == SDL_KEYDOWN && event.key.repeat == 0 && event.key.keysym.sym == SDLK_p) {
+                    m_paused = !m_paused;
+                }
+            }
+            if (!m_paused) {
+                m_angle += static_cast<float>(step.dt) * 0.5f;
+            }
+
+            Transform root;
+            root.rotation = glm::angleAxis(m_angle, glm::vec3(0.0f, 1.0f, 0.0f));
+            m_scene.set_local_transform(m_root, root);
+            m_scene.update();
+
+            snapshot.step = step.index;
+            snapshot.view = glm::lookAt(
+                glm::vec3(0.0f, m_distance * 0.5f, m_distance),
+                glm::vec3(0.0f),
+                glm::vec3(0.0f, 1.0f, 0.0f)
+            );
+            snapshot.instances.clear();
+            const auto transforms = m_scene.world_transforms();
+            const auto meshes = m_scene.meshes();
+            for (size_t i = 0; i < transforms.size(); ++i) {
+                if (meshes[i] == no_mesh) {
+                    continue;
+                }
+                GpuInstance instance = {};
+                std::memcpy(instance.transform, transforms[i].rows, sizeof(instance.transform));
+                instance.mesh = meshes[i];
+                snapshot.instances.push_back(instance);
+            }
+        }
+
+        float distance() const { return m_distance; }
+
+    private:
+        Scene m_scene;
+        NodeId m_root = invalid_node;
+        float m_angle = 0.0f;
+        float m_distance = 5.0f;
+        bool m_paused = false;
+    };
+
+    glm::mat4 projection(VkExtent2D extent, float far_plane) {
+        glm::mat4 projection = glm::perspective(
+            glm::radians(70.0f),
+            static_cast<float>(extent.width) / std::max(extent.height, 1u),
+            0.1f,
+            far_plane
+        );
+        // Vulkan's clip space y points down
+        projection[1][1] *= -1.0f;
+        return projection;
+    }
+}
+
+int main(int argc, char** argv) {
+    engine::LoggingParams logging_params;
+    engine::RendererParams renderer_params;
+    uint64_t headless_frames = 0;
+    const char* output_dir = nullptr;
+    const char* trace_path = nullptr;
+    uint32_t instance_count = 0;
+    engine::MainLoopParams loop_params;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            renderer_params.frames_in_flight = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            renderer_params.headless = true;
+            headless_frames = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_dir = argv[++i];
+        } else if (std::strcmp(argv[i], "--draws") == 0 && i + 1 < argc) {
+            renderer_params.draw_count = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc) {
+            renderer_params.recording_threads = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            // chrome://tracing / ui.perfetto.dev JSON of the last frames
+            trace_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--sync-log") == 0) {
+            // console writes on the calling thread, easier to follow in a debugger
+            logging_params.async = false;
+        } else if (std::strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+            // fifo, mailbox or immediate; 1 / 2 / 3 switch at run time
+            renderer_params.present_mode = parse_present_mode(argv[++i]);
+        } else if (std::strcmp(argv[i], "--low-latency") == 0) {
+            // L toggles it at run time
+            renderer_params.low_latency = true;
+        } else if (std::strcmp(argv[i], "--cold-start") == 0) {
+            // ignore the stored pipeline cache
+            renderer_params.pipelines.load_cache = false;
+        } else if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            // cubes animated by the simulation thread, drawn by the gpu driven scene
+            instance_count = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--sim-hz") == 0 && i + 1 < argc) {
+            loop_params.step = std::chrono::microseconds(1000000 / std::max(1, std::atoi(argv[++i])));
+        }
+    }
+
+    init_logging(logging_params);
+    ENGINE_PROFILE_THREAD("main");
     auto logger = get_default_logger();
     logger->info("starting tutorial...");
 
+    if (renderer_params.headless) {
+        auto renderer = Renderer(window_t(nullptr, destroySdlWindow), renderer_params);
+        if (!renderer.init()) {
+            return 1;
+        }
+        if (output_dir != nullptr) {
+            renderer.set_readback_callback(make_ppm_writer(output_dir));
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < headless_frames; ++i) {
+            renderer.render();
+        }
+        renderer.flush();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        logger->info(
+            "rendered {} headless frames in {:.3f} s ({:.1f} fps)",
+            headless_frames,
+            elapsed.count(),
+            headless_frames / elapsed.count()
+        );
+        if (trace_path != nullptr) {
+            profiler::write_chrome_trace(trace_path);
+        }
+        return 0;
+    }
+
     engine::WindowParams params;
-    params.flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN);
-
-	auto renderer = Renderer(engine::createWindow(params));
-    renderer.init();
-    
-    SDL_Event event;
-	bool should_quit = false;
-
-	while (!should_quit) {
-		while (SDL_PollEvent(&event) != 0) {
-			if (event.type == SDL_QUIT) {
-                should_quit = true;
+    params.flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+
+    auto renderer = Renderer(engine::createWindow(params), renderer_params);
+    if (!renderer.init()) {
+        return 1;
+    }
+
+    GpuScene* scene = renderer.scene();
+    if (scene != nullptr && instance_count > 0) {
+        scene->add_mesh(make_cube());
+    }
+
+    Simulation simulation(scene != nullptr ? instance_count : 0);
+    SnapshotBuffer<FrameSnapshot> snapshots;
+    uint64_t drawn_step = ~0ull;
+
+    MainLoop loop(loop_params);
+    loop.run(
+        [&](const SimulationStep& step) {
+            simulation.step(step, snapshots.write_slot());
+            snapshots.publish();
+        },
+        [&]() {
+            if (!renderer.wait_for_frame()) {
+                return false;
             }
-		}
-        renderer.render();
-	}
+            // the newest state, taken as late as the frame pacing allows
+            const FrameSnapshot* snapshot = snapshots.latest();
+            if (scene != nullptr && snapshot != nullptr) {
+                if (snapshot->step != drawn_step) {
+                    scene->set_instances(snapshot->instances);
+                    drawn_step = snapshot->step;
+                }
+                scene->set_view_projection(projection(renderer.extent(), simulation.distance() * 4.0f) * snapshot->view);
+            }
+            renderer.render();
+            return true;
+        },
+        [&](const SDL_Event& event) {
+            if (event.type == SDL_QUIT) {
+                loop.stop();
+            } else if (event.type == SDL_WINDOWEVENT
+                && (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED || event.window.event == SDL_WINDOWEVENT_DISPLAY_CHANGED)) {
+                // read here, SDL's video calls belong on this thread
+                const WindowState state = getWindowState(SDL_GetWindowFromID(event.window.windowID));
+                loop.post_render([&renderer, state]() { renderer.window_changed(state); });
+            } else if (event.type == SDL_KEYDOWN && event.key.repeat == 0) {
+                const SDL_Keycode key = event.key.keysym.sym;
+                loop.post_render([&renderer, key]() { handle_key(renderer, key); });
+            }
+        }
+    );
+    renderer.flush();
+
+    if (trace_path != nullptr) {
+        profiler::write_chrome_trace(trace_path);
+    }
     logger->info("closing application");    
 }
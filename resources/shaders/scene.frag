@@ -0,0 +1,13 @@
+#version 450
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inColor;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	const vec3 light = normalize(vec3(0.4f, 1.0f, 0.3f));
+	const float diffuse = max(dot(normalize(inNormal), light), 0.0f);
+	outFragColor = vec4(inColor * (0.25f + 0.75f * diffuse), 1.0f);
+}
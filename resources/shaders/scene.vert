@@ -0,0 +1,43 @@
+#version 450
+
+// matches engine::Vertex
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec4 vNormal;
+layout (location = 2) in vec2 vUV;
+
+// matches engine::GpuInstance
+struct Instance {
+	vec4 rows[3];
+	uint mesh;
+	uint padding[3];
+};
+
+// matches GpuScene's view block, see cull.comp
+layout (set = 0, binding = 0) uniform View {
+	mat4 view_proj;
+	mat4 occlusion_view_proj;
+	vec4 planes[6];
+	vec2 pyramid_size;
+	uint instance_count;
+	uint flags;
+} view;
+
+layout (set = 0, binding = 1) readonly buffer Instances { Instance instances[]; };
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+
+void main()
+{
+	// the culling pass put the instance index into firstInstance
+	const Instance instance = instances[gl_InstanceIndex];
+	const vec4 position = vec4(vPosition, 1.0f);
+	const vec4 normal = vec4(vNormal.xyz, 0.0f);
+
+	const vec3 world = vec3(dot(instance.rows[0], position), dot(instance.rows[1], position), dot(instance.rows[2], position));
+	gl_Position = view.view_proj * vec4(world, 1.0f);
+	outNormal = vec3(dot(instance.rows[0], normal), dot(instance.rows[1], normal), dot(instance.rows[2], normal));
+
+	const uint hash = uint(gl_InstanceIndex) * 2654435761u;
+	outColor = vec3((hash >> 8) & 255u, (hash >> 16) & 255u, (hash >> 24) & 255u) / 255.0f;
+}
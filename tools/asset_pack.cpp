@@ -0,0 +1,104 @@
+// Packs directories into one asset pack for engine::Vfs. Every file below a
+// directory is stored as <prefix>/<path relative to the directory>; --lz4
+// compresses the files of the directories that follow it, --store stops that.
+//
+//   asset_pack -o assets.pack [--lz4 | --store] <prefix>=<directory>...
+
+#include "engine/asset_pack.hpp"
+#include "engine/logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+using namespace engine;
+
+namespace {
+
+    struct Input {
+        std::string prefix;
+        std::filesystem::path directory;
+        PackCompression compression;
+    };
+}
+
+int main(int argc, char** argv) {
+    auto logger = get_default_logger();
+
+    std::filesystem::path output;
+    PackCompression compression = PackCompression::none;
+    std::vector<Input> inputs;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (std::strcmp(argv[i], "--lz4") == 0) {
+            compression = PackCompression::lz4;
+        } else if (std::strcmp(argv[i], "--store") == 0) {
+            compression = PackCompression::none;
+        } else if (const char* separator = std::strchr(argv[i], '=')) {
+            std::string prefix(argv[i], separator - argv[i]);
+            while (!prefix.empty() && prefix.back() == '/') {
+                prefix.pop_back();
+            }
+            inputs.push_back({ std::move(prefix), separator + 1, compression });
+        } else {
+            logger->error("unknown argument {}", argv[i]);
+            return 1;
+        }
+    }
+
+    if (output.empty() || inputs.empty()) {
+        logger->error("usage: asset_pack -o assets.pack [--lz4 | --store] <prefix>=<directory>...");
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    AssetPackWriter writer;
+    uint32_t failed = 0;
+    for (const Input& input : inputs) {
+        // sorted, so the same inputs give the same pack
+        std::vector<std::filesystem::path> files;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(input.directory, error)) {
+            if (entry.is_regular_file()) {
+                files.push_back(entry.path());
+            }
+        }
+        if (error) {
+            logger->error("failed to list {}: {}", input.directory.string(), error.message());
+            return 1;
+        }
+        std::sort(files.begin(), files.end());
+
+        for (const auto& file : files) {
+            const std::string relative = std::filesystem::relative(file, input.directory).generic_string();
+            std::string name = input.prefix.empty() ? relative : input.prefix + "/" + relative;
+            if (!writer.add_file(std::move(name), file, input.compression)) {
+                logger->error("failed to read {}", file.string());
+                ++failed;
+            }
+        }
+    }
+
+    if (!writer.write(output)) {
+        logger->error("failed to write {}", output.string());
+        return 1;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const AssetPackWriterStats& stats = writer.stats();
+    logger->info(
+        "{}: {} asset(s), {} deduplicated, {} compressed, {:.1f} -> {:.1f} KiB in {:.2f} s",
+        output.string(),
+        stats.entries,
+        stats.deduplicated,
+        stats.compressed,
+        stats.input_bytes / 1024.0,
+        stats.file_bytes / 1024.0,
+        seconds
+    );
+    return failed > 0 ? 1 : 0;
+}
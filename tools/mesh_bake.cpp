@@ -0,0 +1,176 @@
+// Bakes OBJ files into .mesh files with LOD chains and meshlets, on N
+// threads, and reports throughput and the triangle reduction per LOD.
+//
+//   mesh_bake [--threads N] [--lods L] [-o outdir] <file.obj | directory>...
+
+#include "engine/mesh.hpp"
+#include "engine/mesh_bake.hpp"
+#include "engine/logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace engine;
+
+namespace {
+
+    void collect(const std::filesystem::path& path, std::vector<std::filesystem::path>& files) {
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".obj") {
+                    files.push_back(entry.path());
+                }
+            }
+        } else {
+            files.push_back(path);
+        }
+    }
+
+    struct LodTotals {
+        uint32_t meshes = 0;
+        // summed per mesh, so every mesh weighs the same
+        double triangle_ratio = 0.0;
+        uint64_t triangles = 0;
+        uint64_t meshlets = 0;
+        uint64_t meshlet_triangles = 0;
+        double error = 0.0;
+    };
+
+    struct BakeTotals {
+        uint32_t failed_files = 0;
+        MeshImportStats import;
+        std::vector<LodTotals> lods;
+
+        void add(const BakedMesh& mesh) {
+            if (lods.size() < mesh.lods.size()) {
+                lods.resize(mesh.lods.size());
+            }
+            const double base = std::max(1u, mesh.triangle_count(0));
+            for (uint32_t i = 0; i < mesh.lods.size(); ++i) {
+                const MeshLod& lod = mesh.lods[i];
+                LodTotals& totals = lods[i];
+                ++totals.meshes;
+                totals.triangle_ratio += mesh.triangle_count(i) / base;
+                totals.triangles += mesh.triangle_count(i);
+                totals.meshlets += lod.meshlet_count;
+                totals.error += lod.error;
+                for (uint32_t m = 0; m < lod.meshlet_count; ++m) {
+                    totals.meshlet_triangles += mesh.meshlets[lod.meshlet_offset + m].triangle_count;
+                }
+            }
+        }
+    };
+}
+
+int main(int argc, char** argv) {
+    auto logger = get_default_logger();
+
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+    MeshBakeParams params;
+    std::filesystem::path output_dir;
+    std::vector<std::filesystem::path> files;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--lods") == 0 && i + 1 < argc) {
+            params.max_lods = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_dir = argv[++i];
+        } else {
+            collect(argv[i], files);
+        }
+    }
+
+    if (files.empty()) {
+        logger->error("usage: mesh_bake [--threads N] [--lods L] [-o outdir] <file.obj | directory>...");
+        return 1;
+    }
+    if (!output_dir.empty()) {
+        std::filesystem::create_directories(output_dir);
+    }
+
+    logger->info("baking {} file(s) on {} thread(s)", files.size(), threads);
+
+    BakeTotals totals;
+    std::mutex totals_mutex;
+    std::atomic<size_t> next = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    // whole files per worker; a bake is long enough that pulling them one
+    // at a time balances well
+    auto worker = [&] {
+        for (size_t i = next++; i < files.size(); i = next++) {
+            const auto& path = files[i];
+            MeshImportStats import_stats;
+            auto mesh = import_obj(path, &import_stats);
+            if (!mesh) {
+                std::lock_guard lock(totals_mutex);
+                ++totals.failed_files;
+                continue;
+            }
+
+            BakedMesh baked = bake_mesh(std::move(*mesh), params);
+            auto output = (output_dir.empty() ? path.parent_path() : output_dir) / path.stem();
+            output += ".mesh";
+            const bool saved = save_baked_mesh(output, baked);
+
+            std::lock_guard lock(totals_mutex);
+            if (!saved) {
+                logger->warn("failed to write {}", output.string());
+                ++totals.failed_files;
+                continue;
+            }
+            totals.import.files += import_stats.files;
+            totals.import.source_bytes += import_stats.source_bytes;
+            totals.import.source_vertices += import_stats.source_vertices;
+            totals.add(baked);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < std::min<size_t>(threads, files.size()); ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : workers) {
+        thread.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const uint64_t input_triangles = totals.lods.empty() ? 0 : totals.lods[0].triangles;
+    logger->info(
+        "{} mesh(es) in {:.2f} s: {:.1f} files/s, {:.2f} Mtri/s, {:.1f} MB/s",
+        totals.import.files,
+        seconds,
+        totals.import.files / seconds,
+        input_triangles / seconds / 1e6,
+        totals.import.source_bytes / seconds / (1024.0 * 1024.0)
+    );
+
+    logger->info("lod  meshes   triangles   of lod 0   meshlets   tris/meshlet   avg error");
+    for (size_t i = 0; i < totals.lods.size(); ++i) {
+        const LodTotals& lod = totals.lods[i];
+        logger->info(
+            "{:3} {:7} {:11} {:9.1f}% {:10} {:14.1f} {:11.5f}",
+            i,
+            lod.meshes,
+            lod.triangles,
+            100.0 * lod.triangle_ratio / lod.meshes,
+            lod.meshlets,
+            lod.meshlets > 0 ? double(lod.meshlet_triangles) / lod.meshlets : 0.0,
+            lod.error / lod.meshes
+        );
+    }
+
+    if (totals.failed_files > 0) {
+        logger->warn("{} file(s) failed to bake", totals.failed_files);
+    }
+    return totals.failed_files > 0 ? 1 : 0;
+}